@@ -0,0 +1,1019 @@
+/*!
+ * \file bench.c
+ * \brief Programme de mesure des performances des noyaux de matrix.c,
+ * sur les dimensions exactes du modèle construit par init_gan et sur un
+ * balayage de tailles. Les résultats sont écrits en JSON (un objet par
+ * ligne) et peuvent être comparés à une exécution de référence.
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include "config.h"
+#include "gan.h"
+#include "matrix.h"
+#include "conv.h"
+#include "sparse.h"
+#include "fastmath.h"
+#include "gemm.h"
+
+// Fichier de configuration par défaut
+#define BENCH_CONFIG "gan.cfg"
+// Nombre de mesures par défaut
+#define BENCH_TRIALS 11
+// Nombre d'appels de préchauffage par défaut
+#define BENCH_WARMUP 3
+// Durée min. d'une mesure en secondes
+#define BENCH_MIN_TIME 1e-3
+// Taille max. par défaut du balayage
+#define BENCH_SWEEP_MAX 256
+// Taille max. d'une ligne du fichier de référence
+#define BENCH_MAX_LINE 1024
+// Nombre max. de mesures de référence
+#define BENCH_MAX_BASELINE 4096
+// Nombre de canaux des couches convolutives mesurées si CONV_G / CONV_D valent 0
+#define BENCH_CONV_CH 8
+// Nombre de densités mesurées pour le noyau creux
+#define BENCH_SPARSE_NB 6
+// Nombre de points de la vérification des erreurs de FAST_MATH
+#define BENCH_MATH_POINTS (1 << 20)
+// Intervalle des arguments de tanh et de la sigmoïde pour la vérification
+#define BENCH_MATH_RANGE 40.0
+
+typedef struct bench_case bench_case_t;
+/* Structure représentant un cas de mesure (noyau + dimensions) */
+struct bench_case {
+  const char* kernel; // nom du noyau
+  const char* variant; // variante (transposée, ...)
+  const char* source; // origine des dimensions ("gan" ou "sweep")
+  char shape[64]; // dimensions
+  void (*run)(bench_case_t*); // appel du noyau
+  matrix_t* src; // matrice destination
+  matrix_t* a; // premier opérande
+  matrix_t* b; // second opérande
+  matrix_t* c; // troisième opérande
+  conv_t* conv; // couche convolutive
+  sparse_t* sp; // matrice creuse
+  double flops; // opérations flottantes par appel
+  double bytes; // octets lus et écrits par appel
+};
+
+typedef struct bench_ref bench_ref_t;
+/* Structure représentant une mesure de référence */
+struct bench_ref {
+  char key[192]; // noyau, variante et dimensions
+  double median; // temps médian en microsecondes
+};
+
+typedef struct bench_opt bench_opt_t;
+/* Structure représentant les options du programme */
+struct bench_opt {
+  int trials; // nombre de mesures
+  int warmup; // nombre d'appels de préchauffage
+  int sweep_max; // taille max. du balayage
+  double peak_gflops; // performance crête (GFLOP/s)
+  double peak_gbs; // bande passante crête (Go/s)
+  const char* config; // fichier de configuration
+  FILE* out; // fichier de sortie
+  bench_ref_t* refs; // mesures de référence
+  int nb_refs; // nombre de mesures de référence
+};
+
+/**
+ * Temps actuel en secondes.
+ * \return temps en secondes
+ */
+static double bench_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Remplir une matrice de valeurs aléatoires dans ]-1, 1[.
+ *
+ * \param a matrice
+ * \return la matrice a
+ */
+static matrix_t* bench_fill(matrix_t* a)
+{
+  int i;
+  for (i = 0; i < a->rows * a->cols; i++)
+    a->data[i] = 2.0 * ((double)rand() / RAND_MAX) - 1.0 + 1e-3;
+  return a;
+}
+
+/**
+ * Remplir une matrice de probabilités dans ]0, 1[ (pour les pertes).
+ *
+ * \param a matrice
+ * \return la matrice a
+ */
+static matrix_t* bench_fill_prob(matrix_t* a)
+{
+  int i;
+  for (i = 0; i < a->rows * a->cols; i++)
+    a->data[i] = 0.01 + 0.98 * ((double)rand() / RAND_MAX);
+  return a;
+}
+
+/* Appels des noyaux mesurés */
+static void run_zinit(bench_case_t* bc) { mat_free(mat_zinit(bc->a->rows, bc->a->cols)); }
+static void run_sum(bench_case_t* bc) { mat_sum_(bc->src, bc->a, bc->b); }
+static void run_sub(bench_case_t* bc) { mat_sub_(bc->src, bc->a, bc->b); }
+static void run_mul(bench_case_t* bc) { mat_mul_(bc->src, bc->a, bc->b); }
+static void run_lrelu(bench_case_t* bc) { mat_lrelu_(bc->src, bc->a, 1e-2); }
+static void run_tanh(bench_case_t* bc) { mat_tanh_(bc->src, bc->a); }
+static void run_sigmoid_(bench_case_t* bc) { mat_sigmoid_(bc->src, bc->a); }
+static void run_sigmoid(bench_case_t* bc) { mat_free(mat_sigmoid(bc->a)); }
+static void run_dsigmoid(bench_case_t* bc) { mat_free(mat_dsigmoid(bc->a)); }
+static void run_dlrelu(bench_case_t* bc) { mat_free(mat_dlrelu(bc->a, 1e-2)); }
+static void run_dtanh(bench_case_t* bc) { mat_free(mat_dtanh(bc->a)); }
+static void run_dot_left(bench_case_t* bc) { mat_dot_(bc->src, bc->a, bc->b, LEFT_TRANSPOSE); }
+static void run_dot_right(bench_case_t* bc) { mat_dot_(bc->src, bc->a, bc->b, RIGHT_TRANSPOSE); }
+static void run_dot(bench_case_t* bc) { mat_free(mat_dot(bc->a, bc->b)); }
+static void run_sum_z_act(bench_case_t* bc) { mat_sum_z_act(bc->src, bc->a, bc->b, bc->c); }
+static void run_sum_axis0(bench_case_t* bc) { mat_sum_axis0_(bc->src, bc->a); }
+static void run_mul_scalar(bench_case_t* bc) { mat_mul_scalar(bc->src, 1.0); }
+static void run_copy(bench_case_t* bc) { mat_copy_(bc->src, bc->a, 0); }
+static void run_ce(bench_case_t* bc) { mat_ce_(bc->src, bc->a, bc->b); }
+static void run_log(bench_case_t* bc) { mat_log_(bc->src, bc->a); }
+static void run_mean(bench_case_t* bc) { volatile double v = mat_mean(bc->a); (void)v; }
+static void run_sum_val(bench_case_t* bc) { volatile double v = mat_sum_val(bc->a); (void)v; }
+static void run_conv_forward(bench_case_t* bc) { conv_forward(bc->conv, bc->src, bc->a, bc->b, bc->c); }
+static void run_conv_input(bench_case_t* bc) { conv_backward_input(bc->conv, bc->src, bc->a, bc->b); }
+static void run_conv_weight(bench_case_t* bc) { conv_backward_weight(bc->conv, bc->src, bc->a, bc->b); }
+static void run_sparse_forward(bench_case_t* bc) { sparse_sum_z_act(bc->src, bc->sp, 0, bc->b, bc->c); }
+static void run_sparse_weight(bench_case_t* bc) { sparse_dot_left(bc->src, bc->sp, 0, bc->b); }
+static void run_gemm_forward(bench_case_t* bc) { gemm_sum_z_act(bc->src, bc->a, bc->b, bc->c); }
+static void run_gemm_left(bench_case_t* bc) { gemm_dot_left(bc->src, bc->a, bc->b); }
+static void run_gemm_right(bench_case_t* bc) { gemm_dot_right(bc->src, bc->a, bc->b); }
+
+/**
+ * Comparer deux doubles (tri).
+ */
+static int cmp_double(const void* a, const void* b)
+{
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Estimer la performance crête en GFLOP/s avec des multiplications-additions
+ * indépendantes (estimation grossière, à remplacer par --peak-gflops).
+ *
+ * \return performance crête en GFLOP/s
+ */
+static double measure_peak_gflops(void)
+{
+  const int n = 16, iters = 20000000;
+  double acc[16], x = 0.999999, y = 1e-7, sum = 0.0;
+  int i, k;
+
+  for (k = 0; k < n; k++)
+    acc[k] = k;
+
+  double t0 = bench_now();
+  for (i = 0; i < iters; i++)
+    for (k = 0; k < n; k++)
+      acc[k] = acc[k] * x + y;
+  double t1 = bench_now();
+
+  for (k = 0; k < n; k++)
+    sum += acc[k];
+  volatile double sink = sum;
+  (void)sink;
+  return 2.0 * n * iters / (t1 - t0) * 1e-9;
+}
+
+/**
+ * Estimer la bande passante mémoire crête en Go/s avec une copie.
+ *
+ * \return bande passante en Go/s
+ */
+static double measure_peak_gbs(void)
+{
+  const size_t n = 4 << 20;
+  int t;
+  double best = 0.0;
+  double* a = (double*)malloc(n * sizeof(*a));
+  double* b = (double*)malloc(n * sizeof(*b));
+  assert(a && b);
+  memset(a, 1, n * sizeof(*a));
+  memset(b, 0, n * sizeof(*b));
+
+  for (t = 0; t < 5; t++) {
+    double t0 = bench_now();
+    memcpy(b, a, n * sizeof(*a));
+    double t1 = bench_now();
+    double gbs = 2.0 * n * sizeof(*a) / (t1 - t0) * 1e-9;
+    if (gbs > best)
+      best = gbs;
+  }
+
+  free(a);
+  free(b);
+  return best;
+}
+
+/**
+ * Charger un fichier de référence produit par une exécution précédente.
+ *
+ * \param opt options
+ * \param file fichier JSON (un objet par ligne)
+ */
+static void load_baseline(bench_opt_t* opt, const char* file)
+{
+  char line[BENCH_MAX_LINE], kernel[64], variant[64], shape[64];
+  FILE* fp = fopen(file, "r");
+  if (!fp) {
+    fprintf(stderr, "Error: could not open baseline file %s. \n", file);
+    exit(1);
+  }
+
+  opt->refs = (bench_ref_t*)malloc(BENCH_MAX_BASELINE * sizeof(*opt->refs));
+  assert(opt->refs);
+
+  while (fgets(line, sizeof(line), fp) && opt->nb_refs < BENCH_MAX_BASELINE) {
+    char* med = strstr(line, "\"median_us\":");
+    if (sscanf(line, "{\"kernel\":\"%63[^\"]\",\"variant\":\"%63[^\"]\",\"shape\":\"%63[^\"]\"", kernel, variant, shape) != 3 || !med)
+      continue;
+
+    bench_ref_t* ref = &opt->refs[opt->nb_refs++];
+    snprintf(ref->key, sizeof(ref->key), "%s/%s/%s", kernel, variant, shape);
+    ref->median = atof(med + strlen("\"median_us\":"));
+  }
+  fclose(fp);
+}
+
+/**
+ * Mesurer un cas et écrire le résultat : temps médian et minimal par appel,
+ * opérations et octets par appel, débit, et pourcentage de la limite du
+ * modèle roofline min(crête, intensité * bande passante).
+ *
+ * \param bc cas de mesure
+ * \param opt options
+ */
+static void bench_run(bench_case_t* bc, bench_opt_t* opt)
+{
+  int i, t, reps = 1;
+  double t0, elapsed, key_median = 0.0;
+  char key[192];
+  double* times = (double*)malloc(opt->trials * sizeof(*times));
+  assert(times);
+
+  for (i = 0; i < opt->warmup; i++)
+    bc->run(bc);
+
+  // Calibrer le nombre d'appels par mesure
+  for (;;) {
+    t0 = bench_now();
+    for (i = 0; i < reps; i++)
+      bc->run(bc);
+    elapsed = bench_now() - t0;
+    if (elapsed >= BENCH_MIN_TIME || reps >= (1 << 20))
+      break;
+    reps *= 2;
+  }
+
+  for (t = 0; t < opt->trials; t++) {
+    t0 = bench_now();
+    for (i = 0; i < reps; i++)
+      bc->run(bc);
+    times[t] = (bench_now() - t0) / reps;
+  }
+  qsort(times, opt->trials, sizeof(*times), cmp_double);
+
+  double median = times[opt->trials / 2];
+  double min = times[0];
+  double gflops = bc->flops / median * 1e-9;
+  double gbs = bc->bytes / median * 1e-9;
+  double intensity = bc->bytes > 0 ? bc->flops / bc->bytes : 0.0;
+  double roof = intensity * opt->peak_gbs < opt->peak_gflops ? intensity * opt->peak_gbs : opt->peak_gflops;
+  double pct = bc->flops > 0 ? 100.0 * gflops / roof : 100.0 * gbs / opt->peak_gbs;
+
+  fprintf(opt->out, "{\"kernel\":\"%s\",\"variant\":\"%s\",\"shape\":\"%s\",\"source\":\"%s\","
+    "\"median_us\":%.3f,\"min_us\":%.3f,\"flops\":%.0f,\"bytes\":%.0f,"
+    "\"gflop_s\":%.3f,\"gb_s\":%.3f,\"intensity\":%.3f,\"pct_peak\":%.2f",
+    bc->kernel, bc->variant, bc->shape, bc->source, median * 1e6, min * 1e6, bc->flops, bc->bytes,
+    gflops, gbs, intensity, pct);
+
+  snprintf(key, sizeof(key), "%s/%s/%s", bc->kernel, bc->variant, bc->shape);
+  for (i = 0; i < opt->nb_refs; i++)
+    if (!strcmp(opt->refs[i].key, key))
+      key_median = opt->refs[i].median;
+  if (key_median > 0)
+    fprintf(opt->out, ",\"baseline_us\":%.3f,\"speedup\":%.3f", key_median, key_median / (median * 1e6));
+
+  fprintf(opt->out, "}\n");
+  fflush(opt->out);
+  free(times);
+}
+
+/**
+ * Mesurer une variante d'un noyau élément par élément sur une matrice
+ * 'rows' x 'cols'.
+ *
+ * \param opt options
+ * \param source origine des dimensions
+ * \param kernel nom du noyau
+ * \param variant nom de la variante
+ * \param run appel du noyau
+ * \param rows nombre de lignes
+ * \param cols nombre de colonnes
+ * \param flops opérations par élément
+ * \param nb_in nombre de matrices lues
+ * \param nb_out nombre de matrices écrites
+ */
+static void bench_elementwise_variant(bench_opt_t* opt, const char* source, const char* kernel, const char* variant,
+  void (*run)(bench_case_t*), int rows, int cols, double flops, int nb_in, int nb_out)
+{
+  bench_case_t bc;
+  double n = (double)rows * cols;
+
+  bc.kernel = kernel;
+  bc.variant = variant;
+  bc.source = source;
+  bc.run = run;
+  bc.src = mat_zinit(rows, cols);
+  bc.a = bench_fill_prob(mat_zinit(rows, cols));
+  bc.b = bench_fill_prob(mat_zinit(rows, cols));
+  bc.c = NULL;
+  bc.flops = flops * n;
+  bc.bytes = (nb_in + nb_out) * n * sizeof(double);
+  snprintf(bc.shape, sizeof(bc.shape), "%dx%d", rows, cols);
+
+  bench_run(&bc, opt);
+  mat_free(bc.src);
+  mat_free(bc.a);
+  mat_free(bc.b);
+}
+
+/**
+ * Mesurer un noyau élément par élément sur une matrice 'rows' x 'cols'.
+ *
+ * \param opt options
+ * \param source origine des dimensions
+ * \param kernel nom du noyau
+ * \param run appel du noyau
+ * \param rows nombre de lignes
+ * \param cols nombre de colonnes
+ * \param flops opérations par élément
+ * \param nb_in nombre de matrices lues
+ * \param nb_out nombre de matrices écrites
+ */
+static void bench_elementwise(bench_opt_t* opt, const char* source, const char* kernel,
+  void (*run)(bench_case_t*), int rows, int cols, double flops, int nb_in, int nb_out)
+{
+  bench_elementwise_variant(opt, source, kernel, "-", run, rows, cols, flops, nb_in, nb_out);
+}
+
+/**
+ * Mesurer les produits matriciels pour src (m x n) = a (m x k) . b (k x n),
+ * dans les trois formes utilisées par gan.c.
+ *
+ * \param opt options
+ * \param source origine des dimensions
+ * \param m nombre de lignes
+ * \param k dimension commune
+ * \param n nombre de colonnes
+ */
+static void bench_gemm(bench_opt_t* opt, const char* source, int m, int k, int n)
+{
+  bench_case_t bc;
+  bc.source = source;
+  bc.variant = "-";
+  bc.c = NULL;
+  bc.flops = 2.0 * m * k * n;
+  bc.bytes = ((double)m * k + (double)k * n + (double)m * n) * sizeof(double);
+  snprintf(bc.shape, sizeof(bc.shape), "%dx%dx%d", m, k, n);
+
+  // mat_dot : a (m x k) . b (k x n)
+  bc.kernel = "mat_dot";
+  bc.run = run_dot;
+  bc.src = NULL;
+  bc.a = bench_fill(mat_zinit(m, k));
+  bc.b = bench_fill(mat_zinit(k, n));
+  bench_run(&bc, opt);
+  mat_free(bc.a);
+  mat_free(bc.b);
+
+  // mat_dot_ LEFT_TRANSPOSE : a^T (k x m)^T . b (k x n)
+  bc.kernel = "mat_dot_";
+  bc.variant = "LEFT_TRANSPOSE";
+  bc.run = run_dot_left;
+  bc.src = mat_zinit(m, n);
+  bc.a = bench_fill(mat_zinit(k, m));
+  bc.b = bench_fill(mat_zinit(k, n));
+  bench_run(&bc, opt);
+  mat_free(bc.a);
+  mat_free(bc.b);
+
+  // mat_dot_ RIGHT_TRANSPOSE : a (m x k) . b^T (n x k)^T
+  bc.variant = "RIGHT_TRANSPOSE";
+  bc.run = run_dot_right;
+  bc.a = bench_fill(mat_zinit(m, k));
+  bc.b = bench_fill(mat_zinit(n, k));
+  bench_run(&bc, opt);
+  mat_free(bc.a);
+  mat_free(bc.b);
+  mat_free(bc.src);
+}
+
+/**
+ * Mesurer tous les noyaux élément par élément sur une matrice 'rows' x 'cols'.
+ *
+ * \param opt options
+ * \param source origine des dimensions
+ * \param rows nombre de lignes
+ * \param cols nombre de colonnes
+ */
+static void bench_elementwise_all(bench_opt_t* opt, const char* source, int rows, int cols)
+{
+  bench_elementwise(opt, source, "mat_zinit+mat_free", run_zinit, rows, cols, 0, 0, 1);
+  bench_elementwise(opt, source, "mat_sum_", run_sum, rows, cols, 1, 2, 1);
+  bench_elementwise(opt, source, "mat_sub_", run_sub, rows, cols, 1, 2, 1);
+  bench_elementwise(opt, source, "mat_mul_", run_mul, rows, cols, 1, 2, 1);
+  bench_elementwise(opt, source, "mat_mul_scalar", run_mul_scalar, rows, cols, 1, 1, 1);
+  bench_elementwise(opt, source, "mat_lrelu_", run_lrelu, rows, cols, 2, 1, 1);
+  bench_elementwise(opt, source, "mat_tanh_", run_tanh, rows, cols, 1, 1, 1);
+  bench_elementwise(opt, source, "mat_sigmoid_", run_sigmoid_, rows, cols, 3, 1, 1);
+  bench_elementwise(opt, source, "mat_sigmoid", run_sigmoid, rows, cols, 3, 1, 1);
+  bench_elementwise(opt, source, "mat_dsigmoid", run_dsigmoid, rows, cols, 2, 1, 1);
+  bench_elementwise(opt, source, "mat_dlrelu", run_dlrelu, rows, cols, 1, 1, 1);
+  bench_elementwise(opt, source, "mat_dtanh", run_dtanh, rows, cols, 3, 1, 1);
+  bench_elementwise(opt, source, "mat_copy_", run_copy, rows, cols, 0, 1, 1);
+  bench_elementwise(opt, source, "mat_ce_", run_ce, rows, cols, 4, 2, 1);
+  bench_elementwise(opt, source, "mat_log_", run_log, rows, cols, 2, 1, 1);
+  bench_elementwise(opt, source, "mat_mean", run_mean, rows, cols, 1, 1, 0);
+  bench_elementwise(opt, source, "mat_sum_val", run_sum_val, rows, cols, 1, 1, 0);
+}
+
+/**
+ * Mesurer les noyaux sur les dimensions d'une couche dense : propagation
+ * avant (mat_sum_z_act), produits de la propagation arrière (aussi avec
+ * les poids pré-emballés, variante "packed"), réduction
+ * des biais et activations.
+ *
+ * \param opt options
+ * \param batch taille du lot
+ * \param in taille de l'entrée de la couche
+ * \param out taille de la sortie de la couche
+ */
+static void bench_layer(bench_opt_t* opt, int batch, int in, int out)
+{
+  bench_case_t bc;
+
+  // Propagation avant : z = act . w + b
+  bc.kernel = "mat_sum_z_act";
+  bc.variant = "-";
+  bc.source = "gan";
+  bc.run = run_sum_z_act;
+  bc.src = mat_zinit(batch, out);
+  bc.a = bench_fill(mat_zinit(batch, in));
+  bc.b = bench_fill(mat_zinit(in, out));
+  bc.c = bench_fill(mat_zinit(1, out));
+  bc.flops = 2.0 * batch * in * out + (double)batch * out;
+  bc.bytes = ((double)batch * in + (double)in * out + out + (double)batch * out) * sizeof(double);
+  snprintf(bc.shape, sizeof(bc.shape), "%dx%dx%d", batch, in, out);
+  bench_run(&bc, opt);
+
+  // Mêmes produits avec les poids pré-emballés (emballage fait à la
+  // première mesure, puis réutilisé comme entre deux mises à jour)
+  mat_pack_init(bc.b);
+  bc.variant = "packed";
+  bench_run(&bc, opt);
+  mat_free(bc.a);
+
+  matrix_t* z = bc.src;
+  matrix_t* da = mat_zinit(batch, in);
+  bc.kernel = "mat_dot_";
+  bc.variant = "RIGHT_TRANSPOSE packed";
+  bc.run = run_dot_right;
+  bc.a = bench_fill(mat_zinit(batch, out));
+  bc.src = da;
+  bc.flops = 2.0 * batch * in * out;
+  bc.bytes = ((double)batch * out + (double)in * out + (double)batch * in) * sizeof(double);
+  snprintf(bc.shape, sizeof(bc.shape), "%dx%dx%d", batch, out, in);
+  bench_run(&bc, opt);
+  mat_free(bc.a);
+  mat_free(bc.b);
+  mat_free(bc.c);
+  mat_free(da);
+  bc.src = z;
+  bc.variant = "-";
+
+  // Réduction des biais : db = somme des lignes de dz
+  bc.kernel = "mat_sum_axis0_";
+  bc.run = run_sum_axis0;
+  bc.a = bc.src;
+  bc.src = mat_zinit(1, out);
+  bc.flops = (double)batch * out;
+  bc.bytes = ((double)batch * out + out) * sizeof(double);
+  snprintf(bc.shape, sizeof(bc.shape), "%dx%d", batch, out);
+  bench_run(&bc, opt);
+  mat_free(bc.a);
+  mat_free(bc.src);
+
+  // Gradient des poids (LEFT) et propagation du gradient (RIGHT)
+  bench_gemm(opt, "gan", in, batch, out);
+  bench_gemm(opt, "gan", batch, out, in);
+
+  // Activations et mises à jour
+  bench_elementwise_all(opt, "gan", batch, out);
+  bench_elementwise(opt, "gan", "mat_sub_", run_sub, in, out, 1, 2, 1);
+  bench_elementwise(opt, "gan", "mat_mul_scalar", run_mul_scalar, in, out, 1, 1, 1);
+  bench_elementwise(opt, "gan", "mat_sum_", run_sum, in, out, 1, 2, 1);
+}
+
+/**
+ * Mesurer les produits matriciels d'une couche dense (gemm.c) avec chaque
+ * implémentation compilée (variante = nom de l'implémentation), et avec
+ * les noyaux spécialisés de kernels_gen.c s'ils existent pour ces dimensions
+ * (variante "kgen"), poids pré-emballés comme pendant l'apprentissage.
+ *
+ * \param opt options
+ * \param batch taille du lot
+ * \param in taille de l'entrée de la couche
+ * \param out taille de la sortie de la couche
+ */
+static void bench_gemm_backends(bench_opt_t* opt, int batch, int in, int out)
+{
+  int i, spec;
+  bench_case_t bc;
+  int backend = gemm_get_backend();
+  int spec_on = gemm_get_spec();
+  matrix_t* act = bench_fill(mat_zinit(batch, in));
+  matrix_t* w = bench_fill(mat_zinit(in, out));
+  matrix_t* bias = bench_fill(mat_zinit(1, out));
+  matrix_t* z = mat_zinit(batch, out);
+  matrix_t* dz = bench_fill(mat_zinit(batch, out));
+  matrix_t* dw = mat_zinit(in, out);
+  matrix_t* da = mat_zinit(batch, in);
+  mat_pack_init(w);
+
+  bc.source = "gan";
+  for (i = 0; i < GEMM_NB_BACKENDS * 2; i++) {
+    spec = i % 2;
+    if (!gemm_available(i / 2))
+      continue;
+    gemm_set_backend(i / 2);
+    gemm_set_spec(spec);
+    if (spec && !gemm_is_specialized(batch, in, out))
+      continue;
+    bc.variant = spec ? "kgen" : gemm_backend_name(i / 2);
+
+    // Propagation avant : z = act . w + b
+    bc.kernel = "gemm_sum_z_act";
+    bc.run = run_gemm_forward;
+    bc.src = z;
+    bc.a = act;
+    bc.b = w;
+    bc.c = bias;
+    bc.flops = 2.0 * batch * in * out + (double)batch * out;
+    bc.bytes = ((double)batch * in + (double)in * out + out + (double)batch * out) * sizeof(double);
+    snprintf(bc.shape, sizeof(bc.shape), "%dx%dx%d", batch, in, out);
+    bench_run(&bc, opt);
+
+    // Gradient des poids : dw = act^T . dz
+    bc.kernel = "gemm_dot_left";
+    bc.run = run_gemm_left;
+    bc.src = dw;
+    bc.b = dz;
+    bc.flops = 2.0 * batch * in * out;
+    bc.bytes = ((double)batch * in + (double)batch * out + (double)in * out) * sizeof(double);
+    snprintf(bc.shape, sizeof(bc.shape), "%dx%dx%d", in, batch, out);
+    bench_run(&bc, opt);
+
+    // Gradient de l'entrée : da = dz . w^T
+    bc.kernel = "gemm_dot_right";
+    bc.run = run_gemm_right;
+    bc.src = da;
+    bc.a = dz;
+    bc.b = w;
+    snprintf(bc.shape, sizeof(bc.shape), "%dx%dx%d", batch, out, in);
+    bench_run(&bc, opt);
+  }
+  gemm_set_backend(backend);
+  gemm_set_spec(spec_on);
+
+  mat_free(act);
+  mat_free(w);
+  mat_free(bias);
+  mat_free(z);
+  mat_free(dz);
+  mat_free(dw);
+  mat_free(da);
+}
+
+/**
+ * Mesurer une couche convolutive (propagation avant, gradient de l'entrée
+ * et des poids) avec les deux noyaux, et la couche dense 'in' x 'out'
+ * qu'elle remplace dans le modèle (variante "dense").
+ *
+ * \param opt options
+ * \param source origine des dimensions
+ * \param batch taille du lot
+ * \param c canaux d'entrée
+ * \param h hauteur de l'entrée
+ * \param w largeur de l'entrée
+ * \param oc canaux de sortie
+ * \param transposed convolution transposée
+ * \param in taille de l'entrée de la couche dense (0 : pas de mesure)
+ * \param out taille de la sortie de la couche dense
+ */
+static void bench_conv(bench_opt_t* opt, const char* source, int batch, int c, int h, int w, int oc,
+  int transposed, int in, int out)
+{
+  int algo;
+  bench_case_t bc;
+  bc.source = source;
+  bc.c = NULL;
+
+  for (algo = CONV_IM2COL; algo <= CONV_DIRECT; algo++) {
+    conv_t* cv = conv_init(c, h, w, oc, CONV_KERNEL, CONV_STRIDE, CONV_PAD, transposed, algo);
+    double flops = 2.0 * batch * cv->c * cv->k * cv->k * cv->oc * cv->oh * cv->ow;
+    double bytes = ((double)batch * (conv_in_size(cv) + conv_out_size(cv)) + cv->c * cv->k * cv->k * cv->oc) * sizeof(double);
+    matrix_t* x = bench_fill(mat_zinit(batch, conv_in_size(cv)));
+    matrix_t* z = bench_fill(mat_zinit(batch, conv_out_size(cv)));
+    matrix_t* wt = bench_fill(conv_init_weights(cv));
+    matrix_t* b = bench_fill(conv_init_bias(cv));
+
+    bc.conv = cv;
+    bc.variant = conv_algo_name(algo);
+    bc.flops = flops;
+    bc.bytes = bytes;
+    snprintf(bc.shape, sizeof(bc.shape), "%dx%dx%dx%d%s%dk%ds%d", batch, c, h, w, transposed ? "T" : "-",
+      oc, cv->k, cv->stride);
+
+    bc.kernel = "conv_forward";
+    bc.run = run_conv_forward;
+    bc.src = z;
+    bc.a = x;
+    bc.b = wt;
+    bc.c = b;
+    bench_run(&bc, opt);
+
+    bc.kernel = "conv_backward_input";
+    bc.run = run_conv_input;
+    bc.src = x;
+    bc.a = z;
+    bench_run(&bc, opt);
+
+    bc.kernel = "conv_backward_weight";
+    bc.run = run_conv_weight;
+    bc.src = wt;
+    bc.a = x;
+    bc.b = z;
+    bench_run(&bc, opt);
+
+    mat_free(x);
+    mat_free(z);
+    mat_free(wt);
+    mat_free(b);
+    free(cv);
+  }
+
+  if (in == 0)
+    return;
+
+  // Couche dense remplacée : z = act . w + b, dx = dz . w^T, dw = act^T . dz
+  matrix_t* x = bench_fill(mat_zinit(batch, in));
+  matrix_t* z = bench_fill(mat_zinit(batch, out));
+  matrix_t* wt = bench_fill(mat_zinit(in, out));
+  matrix_t* b = bench_fill(mat_zinit(1, out));
+
+  bc.variant = "dense";
+  bc.flops = 2.0 * batch * in * out;
+  bc.bytes = ((double)batch * (in + out) + (double)in * out) * sizeof(double);
+
+  bc.kernel = "conv_forward";
+  bc.run = run_sum_z_act;
+  bc.src = z;
+  bc.a = x;
+  bc.b = wt;
+  bc.c = b;
+  bench_run(&bc, opt);
+
+  bc.kernel = "conv_backward_input";
+  bc.run = run_dot_right;
+  bc.src = x;
+  bc.a = z;
+  bench_run(&bc, opt);
+
+  bc.kernel = "conv_backward_weight";
+  bc.run = run_dot_left;
+  bc.src = wt;
+  bc.a = x;
+  bc.b = z;
+  bench_run(&bc, opt);
+
+  mat_free(x);
+  mat_free(z);
+  mat_free(wt);
+  mat_free(b);
+}
+
+/**
+ * Mesurer la première couche du discriminator sur des images creuses
+ * (propagation avant et gradient des poids) pour plusieurs densités de
+ * pixels hors fond, et les noyaux denses équivalents (variante "dense").
+ * Le seuil SPARSE_MAX_DENSITY se lit sur le croisement des deux.
+ *
+ * \param opt options
+ * \param batch taille du lot
+ * \param in taille de l'entrée de la couche
+ * \param out taille de la sortie de la couche
+ */
+static void bench_sparse(bench_opt_t* opt, int batch, int in, int out)
+{
+  const double density[BENCH_SPARSE_NB] = {0.05, 0.1, 0.2, 0.35, 0.5, 0.75};
+  char variant[32];
+  int d, n;
+  bench_case_t bc;
+
+  matrix_t* x = mat_zinit(batch, in);
+  matrix_t* z = bench_fill(mat_zinit(batch, out));
+  matrix_t* wt = bench_fill(mat_zinit(in, out));
+  matrix_t* b = bench_fill(mat_zinit(1, out));
+  bc.source = "gan";
+  bc.variant = variant;
+  snprintf(bc.shape, sizeof(bc.shape), "%dx%dx%d", batch, in, out);
+
+  for (d = 0; d < BENCH_SPARSE_NB; d++) {
+    for (n = 0; n < batch * in; n++)
+      x->data[n] = rand() < density[d] * RAND_MAX ? (double)rand() / RAND_MAX : MNIST_BACKGROUND;
+    bc.sp = sparse_init(x, MNIST_BACKGROUND);
+    snprintf(variant, sizeof(variant), "d=%.2f", sparse_density(bc.sp, 0, batch));
+    bc.flops = 2.0 * bc.sp->nnz * out;
+    bc.bytes = ((double)bc.sp->nnz * (sizeof(double) + sizeof(int)) +
+      ((double)in * out + 2.0 * batch * out) * sizeof(double));
+
+    bc.kernel = "sparse_sum_z_act";
+    bc.run = run_sparse_forward;
+    bc.src = z;
+    bc.b = wt;
+    bc.c = b;
+    bench_run(&bc, opt);
+
+    bc.kernel = "sparse_dot_left";
+    bc.run = run_sparse_weight;
+    bc.src = wt;
+    bc.b = z;
+    bench_run(&bc, opt);
+    sparse_free(bc.sp);
+  }
+
+  // Noyaux denses remplacés : z = x . w + b et dw = x^T . dz
+  bench_fill(x);
+  snprintf(variant, sizeof(variant), "dense");
+  bc.flops = 2.0 * batch * in * out;
+  bc.bytes = ((double)batch * (in + out) + (double)in * out) * sizeof(double);
+
+  bc.kernel = "sparse_sum_z_act";
+  bc.run = run_sum_z_act;
+  bc.src = z;
+  bc.a = x;
+  bc.b = wt;
+  bc.c = b;
+  bench_run(&bc, opt);
+
+  bc.kernel = "sparse_dot_left";
+  bc.run = run_dot_left;
+  bc.src = wt;
+  bc.a = x;
+  bc.b = z;
+  bench_run(&bc, opt);
+
+  mat_free(x);
+  mat_free(z);
+  mat_free(wt);
+  mat_free(b);
+}
+
+/**
+ * Erreur absolue max. d'une fonction de fastmath.c au niveau courant par
+ * rapport à libm, sur 'n' arguments.
+ *
+ * \param fn fonction sur un tableau
+ * \param ref fonction de référence (libm)
+ * \param x arguments
+ * \param y résultats
+ * \param n nombre d'arguments
+ * \return erreur absolue max.
+ */
+static double bench_math_error(void (*fn)(double*, const double*, int), double (*ref)(double),
+  const double* x, double* y, int n)
+{
+  int i;
+  double err = 0.0;
+
+  fn(y, x, n);
+  for (i = 0; i < n; i++)
+    if (!(fabs(y[i] - ref(x[i])) <= err))
+      err = isnan(y[i]) || isinf(y[i]) ? INFINITY : fabs(y[i] - ref(x[i]));
+  return err;
+}
+
+/* Fonctions de référence (libm) */
+static double ref_dtanh(double x) { return 1.0 - pow(tanh(x), 2); }
+static double ref_sigmoid(double x) { return 1 / (1 + exp(-x)); }
+
+/**
+ * Vérifier et mesurer chaque niveau de FAST_MATH : erreur absolue max. de
+ * tanh, de sa dérivée et de la sigmoïde sur [-BENCH_MATH_RANGE / 2,
+ * BENCH_MATH_RANGE / 2] (plus les extrêmes), et de log sur ]0, 2]
+ * (probabilités des pertes), comparée à la borne du niveau ; puis débit des
+ * noyaux de matrix.c concernés sur la sortie du generator (variante = niveau).
+ * Arrêt avec une erreur si une borne est dépassée.
+ *
+ * \param opt options
+ * \param rows nombre de lignes
+ * \param cols nombre de colonnes
+ */
+static void bench_math(bench_opt_t* opt, int rows, int cols)
+{
+  int i, t, fail = 0, tier = fm_get_tier();
+  double* x = (double*)malloc(BENCH_MATH_POINTS * sizeof(*x));
+  assert(x);
+  double* p = (double*)malloc(BENCH_MATH_POINTS * sizeof(*p));
+  assert(p);
+  double* y = (double*)malloc(BENCH_MATH_POINTS * sizeof(*y));
+  assert(y);
+
+  for (i = 0; i < BENCH_MATH_POINTS; i++) {
+    x[i] = BENCH_MATH_RANGE * ((double)i / (BENCH_MATH_POINTS - 1) - 0.5);
+    // Probabilités de 1e-300 à 2, denses près de 0 et de 1
+    p[i] = i % 2 ? pow(10.0, -300.0 * (double)i / BENCH_MATH_POINTS) : 2.0 * (double)(i + 1) / BENCH_MATH_POINTS;
+  }
+  x[0] = -1000.0;
+  x[1] = 1000.0;
+  x[2] = 0.0;
+  x[3] = -1e-300;
+
+  for (t = 0; t < FM_NB_TIERS; t++) {
+    fm_set_tier(t);
+    const char* name[4] = {"fm_tanh", "fm_dtanh", "fm_sigmoid", "fm_log"};
+    double err[4];
+    err[0] = bench_math_error(fm_tanh, tanh, x, y, BENCH_MATH_POINTS);
+    err[1] = bench_math_error(fm_dtanh, ref_dtanh, x, y, BENCH_MATH_POINTS);
+    err[2] = bench_math_error(fm_sigmoid, ref_sigmoid, x, y, BENCH_MATH_POINTS);
+    err[3] = bench_math_error(fm_log, log, p, y, BENCH_MATH_POINTS);
+
+    for (i = 0; i < 4; i++) {
+      int ok = err[i] <= fm_tier_bound(t);
+      fprintf(opt->out, "{\"kernel\":\"%s\",\"variant\":\"%s\",\"points\":%d,\"max_abs_err\":%.3e,"
+        "\"bound\":%.0e,\"ok\":%s}\n", name[i], fm_tier_name(t), BENCH_MATH_POINTS, err[i],
+        fm_tier_bound(t), ok ? "true" : "false");
+      fail |= !ok;
+    }
+
+    bench_elementwise_variant(opt, "gan", "mat_tanh_", fm_tier_name(t), run_tanh, rows, cols, 1, 1, 1);
+    bench_elementwise_variant(opt, "gan", "mat_dtanh", fm_tier_name(t), run_dtanh, rows, cols, 3, 1, 1);
+    bench_elementwise_variant(opt, "gan", "mat_sigmoid_", fm_tier_name(t), run_sigmoid_, rows, cols, 3, 1, 1);
+    bench_elementwise_variant(opt, "gan", "mat_log_", fm_tier_name(t), run_log, rows, cols, 2, 1, 1);
+  }
+
+  fm_set_tier(tier);
+  free(x);
+  free(p);
+  free(y);
+  if (fail) {
+    fprintf(stderr, "Error: fast math error above the bound of its tier. \n");
+    exit(1);
+  }
+}
+
+/**
+ * Mesurer tous les noyaux de matrix.c (sauf mat_print et mat_print_param)
+ * sur les dimensions de chaque couche du modèle, puis sur un balayage de
+ * matrices carrées.
+ *
+ * \param opt options
+ */
+static void bench_kernels(bench_opt_t* opt)
+{
+  int i, n;
+  config_t* cfg = init_config(opt->config);
+  gan_t* gan = init_gan(cfg);
+
+  for (i = 0; i < gan->nb_layers - 1; i++) {
+    if (!gan->g->conv[i]) {
+      bench_layer(opt, cfg->batch_sz, gan->layers_sz_g[i], gan->layers_sz_g[i + 1]);
+      bench_gemm_backends(opt, cfg->batch_sz, gan->layers_sz_g[i], gan->layers_sz_g[i + 1]);
+    }
+    if (!gan->d->conv[i]) {
+      bench_layer(opt, cfg->batch_sz, gan->layers_sz_d[i], gan->layers_sz_d[i + 1]);
+      bench_gemm_backends(opt, cfg->batch_sz, gan->layers_sz_d[i], gan->layers_sz_d[i + 1]);
+    }
+  }
+
+  // Couches convolutives du DCGAN, comparées aux couches denses du modèle
+  int ch_d = cfg->conv_d ? cfg->conv_d : BENCH_CONV_CH;
+  int ch_g = cfg->conv_g ? cfg->conv_g : BENCH_CONV_CH;
+  bench_conv(opt, "gan", cfg->batch_sz, cfg->img_ch, cfg->img_h, cfg->img_w, ch_d, 0,
+    cfg->conv_d ? 0 : cfg->img_sz, cfg->hd_layer_sz_d);
+  bench_conv(opt, "gan", cfg->batch_sz, ch_g, cfg->img_h / CONV_STRIDE, cfg->img_w / CONV_STRIDE, cfg->img_ch, 1,
+    cfg->conv_g ? 0 : cfg->hd_layer_sz_g, cfg->img_sz);
+
+  // Première couche du discriminator sur les images réelles creuses
+  bench_sparse(opt, cfg->batch_sz, cfg->img_sz, cfg->hd_layer_sz_d);
+
+  // Niveaux de FAST_MATH sur la sortie du generator
+  bench_math(opt, cfg->batch_sz, cfg->img_sz);
+
+  for (n = 16; n <= opt->sweep_max; n *= 2) {
+    bench_gemm(opt, "sweep", n, n, n);
+    bench_elementwise_all(opt, "sweep", n, n);
+  }
+
+  // Couches plus profondes (plus de canaux d'entrée)
+  for (n = 4; n <= 64; n *= 2)
+    bench_conv(opt, "sweep", cfg->batch_sz, n, cfg->img_h / CONV_STRIDE, cfg->img_w / CONV_STRIDE, 2 * n, 0, 0, 0);
+}
+
+/**
+ * Cas d'usage du programme.
+ */
+static void usage(char* exec)
+{
+  fprintf(stderr, "Usage: %s [-c config] [-t trials] [-w warmup] [-s sweep_max] [-b baseline.json]"
+    " [-o output.json] [-f peak_gflops] [-m peak_gbs]\n", exec);
+  exit(1);
+}
+
+int main(int argc, char* argv[])
+{
+  int i;
+  bench_opt_t opt;
+
+  opt.trials = BENCH_TRIALS;
+  opt.warmup = BENCH_WARMUP;
+  opt.sweep_max = BENCH_SWEEP_MAX;
+  opt.peak_gflops = 0.0;
+  opt.peak_gbs = 0.0;
+  opt.config = BENCH_CONFIG;
+  opt.out = stdout;
+  opt.refs = NULL;
+  opt.nb_refs = 0;
+
+  for (i = 1; i < argc; i++) {
+    if (i + 1 >= argc || argv[i][0] != '-')
+      usage(argv[0]);
+
+    switch (argv[i][1]) {
+    case 'c':
+      opt.config = argv[++i];
+      break;
+    case 't':
+      opt.trials = atoi(argv[++i]);
+      break;
+    case 'w':
+      opt.warmup = atoi(argv[++i]);
+      break;
+    case 's':
+      opt.sweep_max = atoi(argv[++i]);
+      break;
+    case 'b':
+      load_baseline(&opt, argv[++i]);
+      break;
+    case 'o':
+      if ((opt.out = fopen(argv[++i], "w")) == NULL) {
+        fprintf(stderr, "Error: could not open file %s. \n", argv[i]);
+        exit(1);
+      }
+      break;
+    case 'f':
+      opt.peak_gflops = atof(argv[++i]);
+      break;
+    case 'm':
+      opt.peak_gbs = atof(argv[++i]);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+
+  if (opt.trials < 1)
+    opt.trials = 1;
+
+  srand(1);
+  if (opt.peak_gflops <= 0)
+    opt.peak_gflops = measure_peak_gflops();
+  if (opt.peak_gbs <= 0)
+    opt.peak_gbs = measure_peak_gbs();
+
+  fprintf(opt.out, "{\"peak_gflop_s\":%.3f,\"peak_gb_s\":%.3f,\"trials\":%d,\"warmup\":%d}\n",
+    opt.peak_gflops, opt.peak_gbs, opt.trials, opt.warmup);
+
+  bench_kernels(&opt);
+
+  if (opt.out != stdout)
+    fclose(opt.out);
+  free(opt.refs);
+  return 0;
+}
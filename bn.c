@@ -0,0 +1,271 @@
+/*!
+ * \file bn.c
+ * \brief Fichier comprenant la normalisation par lot (batch normalization)
+ * des couches cachées : propagation avant fusionnée (statistiques du lot,
+ * normalisation et activation LRELU), propagation arrière fusionnée, et
+ * repliement des statistiques cumulées dans les poids de la couche pour
+ * l'inférence.
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "bn.h"
+#include "mem.h"
+#include "prof.h"
+
+/**
+ * Vérifier les dimensions des matrices passées à la normalisation.
+ *
+ * \param cond condition à vérifier
+ */
+static void bn_check(int cond)
+{
+  if (!cond) {
+    fprintf(stderr, "Error: bad matrix structures while batchnorm. \n");
+    exit(1);
+  }
+}
+
+/**
+ * Initialiser la normalisation d'une couche de 'channels' canaux de
+ * 'area' positions, pour des lots de 'rows' lignes.
+ *
+ * \param rows taille du lot
+ * \param channels nombre de canaux
+ * \param area nombre de positions par canal (1 pour une couche dense)
+ * \param shared normalisation dont les paramètres sont partagés (NULL pour de nouveaux paramètres)
+ * \return structure bn
+ */
+bn_t* bn_init(int rows, int channels, int area, bn_t* shared)
+{
+  int ch;
+  bn_t* bn = (bn_t*)malloc(sizeof(*bn));
+  assert(bn);
+
+  bn->channels = channels;
+  bn->area = area;
+  if (shared) {
+    bn->gamma = shared->gamma;
+    bn->beta = shared->beta;
+    bn->mean = shared->mean;
+    bn->var = shared->var;
+  }
+  else {
+    bn->gamma = mat_zinit(1, channels);
+    bn->beta = mat_zinit(1, channels);
+    bn->mean = mat_zinit(1, channels);
+    bn->var = mat_zinit(1, channels);
+    for (ch = 0; ch < channels; ch++) {
+      bn->gamma->data[ch] = 1.0;
+      bn->var->data[ch] = 1.0;
+    }
+  }
+
+  bn->xhat = mat_zinit(rows, channels * area);
+  bn->inv_std = mat_zinit(1, channels);
+  bn->dgamma = mat_zinit(1, channels);
+  bn->dbeta = mat_zinit(1, channels);
+  return bn;
+}
+
+/**
+ * Libérer une normalisation.
+ *
+ * \param bn structure bn
+ * \param owner libérer aussi les paramètres partagés (0 pour une réplique)
+ */
+void bn_free(bn_t* bn, int owner)
+{
+  if (owner) {
+    mat_free(bn->gamma);
+    mat_free(bn->beta);
+    mat_free(bn->mean);
+    mat_free(bn->var);
+  }
+  mat_free(bn->xhat);
+  mat_free(bn->inv_std);
+  mat_free(bn->dgamma);
+  mat_free(bn->dbeta);
+  free(bn);
+}
+
+/**
+ * Propagation avant fusionnée : statistiques du lot (une lecture de 'z'),
+ * puis normalisation, échelle, décalage et activation LRELU en un seul
+ * parcours. La pré-activation normalisée y = gamma * xhat + beta remplace
+ * 'z' (utilisée par la dérivée de l'activation). En apprentissage, les
+ * statistiques du lot mettent à jour les statistiques cumulées ; en
+ * inférence, ces dernières sont utilisées à la place.
+ *
+ * \param bn structure bn
+ * \param z pré-activation de la couche (remplacée par y)
+ * \param a activation
+ * \param alpha pente de LRELU pour les valeurs négatives
+ * \param train statistiques du lot (1) ou cumulées (0)
+ * \return nombre d'opérations flottantes
+ */
+double bn_forward(bn_t* bn, matrix_t* z, matrix_t* a, double alpha, int train)
+{
+  int n, ch, q, area = bn->area;
+  double cnt = (double)z->rows * area;
+  bn_check(z->cols == bn->channels * area && a->rows == z->rows && a->cols == z->cols &&
+    bn->xhat->rows == z->rows);
+
+  PROF_KBEGIN(PROF_K_BN);
+  for (ch = 0; ch < bn->channels; ch++) {
+    double mean, var, inv, g = bn->gamma->data[ch], be = bn->beta->data[ch];
+
+    if (train) {
+      double sum = 0.0, sq = 0.0;
+      for (n = 0; n < z->rows; n++) {
+        double* zr = z->data + n * z->cols + ch * area;
+        for (q = 0; q < area; q++) {
+          sum += zr[q];
+          sq += zr[q] * zr[q];
+        }
+      }
+      mean = sum / cnt;
+      var = sq / cnt - mean * mean;
+      if (var < 0.0)
+        var = 0.0;
+
+      bn->mean->data[ch] = (1.0 - BN_MOMENTUM) * bn->mean->data[ch] + BN_MOMENTUM * mean;
+      bn->var->data[ch] = (1.0 - BN_MOMENTUM) * bn->var->data[ch] +
+        BN_MOMENTUM * (cnt > 1.0 ? var * cnt / (cnt - 1.0) : var);
+    }
+    else {
+      mean = bn->mean->data[ch];
+      var = bn->var->data[ch];
+    }
+
+    inv = 1.0 / sqrt(var + BN_EPS);
+    bn->inv_std->data[ch] = inv;
+
+    for (n = 0; n < z->rows; n++) {
+      int off = n * z->cols + ch * area;
+      double *zr = z->data + off, *ar = a->data + off, *xr = bn->xhat->data + off;
+      for (q = 0; q < area; q++) {
+        double xh = (zr[q] - mean) * inv;
+        double y = g * xh + be;
+        xr[q] = xh;
+        zr[q] = y;
+        ar[q] = y < 0 ? y * alpha : y;
+      }
+    }
+  }
+  PROF_KEND(PROF_K_BN, (train ? 8.0 : 5.0) * z->rows * z->cols);
+  return (train ? 8.0 : 5.0) * z->rows * z->cols;
+}
+
+/**
+ * Propagation arrière fusionnée : dérivée de l'activation LRELU, gradients
+ * de l'échelle et du décalage (un parcours), puis gradient par rapport à la
+ * pré-activation avant normalisation (un second parcours), stocké dans 'dz'.
+ *
+ * \param bn structure bn
+ * \param dz gradient de la pré-activation (avant normalisation)
+ * \param da gradient de l'activation
+ * \param z pré-activation normalisée y (propagation avant)
+ * \param alpha pente de LRELU pour les valeurs négatives
+ * \return nombre d'opérations flottantes
+ */
+double bn_backward(bn_t* bn, matrix_t* dz, matrix_t* da, matrix_t* z, double alpha)
+{
+  int n, ch, q, area = bn->area;
+  double cnt = (double)z->rows * area;
+  bn_check(dz->rows == z->rows && dz->cols == z->cols && da->rows == z->rows && da->cols == z->cols &&
+    z->cols == bn->channels * area);
+
+  PROF_KBEGIN(PROF_K_BN_BACKWARD);
+  for (ch = 0; ch < bn->channels; ch++) {
+    double sum_dy = 0.0, sum_dyx = 0.0, k;
+
+    for (n = 0; n < z->rows; n++) {
+      int off = n * z->cols + ch * area;
+      double *dzr = dz->data + off, *dar = da->data + off, *zr = z->data + off, *xr = bn->xhat->data + off;
+      for (q = 0; q < area; q++) {
+        double dy = zr[q] < 0 ? dar[q] * alpha : dar[q];
+        dzr[q] = dy;
+        sum_dy += dy;
+        sum_dyx += dy * xr[q];
+      }
+    }
+    bn->dbeta->data[ch] = sum_dy;
+    bn->dgamma->data[ch] = sum_dyx;
+
+    k = bn->gamma->data[ch] * bn->inv_std->data[ch] / cnt;
+    for (n = 0; n < z->rows; n++) {
+      int off = n * z->cols + ch * area;
+      double *dzr = dz->data + off, *xr = bn->xhat->data + off;
+      for (q = 0; q < area; q++)
+        dzr[q] = k * (cnt * dzr[q] - sum_dy - xr[q] * sum_dyx);
+    }
+  }
+  PROF_KEND(PROF_K_BN_BACKWARD, 10.0 * z->rows * z->cols);
+  return 10.0 * z->rows * z->cols;
+}
+
+/**
+ * SGD pour mettre à jour l'échelle et le décalage.
+ *
+ * \param bn structure bn
+ * \param lr coefficient d'apprentissage
+ * \return nombre d'opérations flottantes
+ */
+double bn_update(bn_t* bn, double lr)
+{
+  int ch;
+  for (ch = 0; ch < bn->channels; ch++) {
+    bn->gamma->data[ch] -= lr * bn->dgamma->data[ch];
+    bn->beta->data[ch] -= lr * bn->dbeta->data[ch];
+  }
+  return 4.0 * bn->channels;
+}
+
+/**
+ * Multiplier chaque colonne de 'w' par l'échelle s = gamma / sqrt(var + eps)
+ * de son canal (colonnes regroupées par canal).
+ *
+ * \param bn structure bn
+ * \param w poids de la couche
+ */
+void bn_scale(bn_t* bn, matrix_t* w)
+{
+  int r, c, group;
+  bn_check(w->cols % bn->channels == 0);
+
+  group = w->cols / bn->channels;
+  for (c = 0; c < w->cols; c++) {
+    double s = bn->gamma->data[c / group] / sqrt(bn->var->data[c / group] + BN_EPS);
+    for (r = 0; r < w->rows; r++)
+      w->data[r * w->cols + c] *= s;
+  }
+}
+
+/**
+ * Replier les statistiques cumulées, l'échelle et le décalage dans les
+ * poids et biais de la couche précédant la normalisation :
+ * w' = w * s et b' = (b - mean) * s + beta, avec s = gamma / sqrt(var + eps)
+ * par canal. La couche produit alors directement y en inférence, sans
+ * noyau supplémentaire. Les colonnes des poids (couche dense ou
+ * convolutive) sont regroupées par canal.
+ *
+ * \param bn structure bn
+ * \param w poids de la couche
+ * \param b biais de la couche
+ */
+void bn_fold(bn_t* bn, matrix_t* w, matrix_t* b)
+{
+  int c, ch, group;
+  bn_check(w->cols == b->cols && w->cols % bn->channels == 0);
+
+  bn_scale(bn, w);
+  group = w->cols / bn->channels;
+  for (c = 0; c < b->cols; c++) {
+    ch = c / group;
+    double s = bn->gamma->data[ch] / sqrt(bn->var->data[ch] + BN_EPS);
+    b->data[c] = (b->data[c] - bn->mean->data[ch]) * s + bn->beta->data[ch];
+  }
+}
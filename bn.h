@@ -0,0 +1,43 @@
+/*!
+ * \file bn.h
+ * \brief Fichier header de bn.c
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#ifndef _BN_H_
+#define _BN_H_
+
+#include "matrix.h"
+
+// Coefficient de mise à jour des statistiques cumulées
+#define BN_MOMENTUM 0.1
+// Constante de stabilité numérique (variance)
+#define BN_EPS 1e-5
+
+typedef struct bn bn_t;
+/* Structure représentant la normalisation par lot de la pré-activation
+ * d'une couche : une moyenne et une variance par canal, calculées sur le lot
+ * et sur les 'area' positions du canal (1 pour une couche dense).
+ * Les paramètres et les statistiques cumulées sont partagés entre les
+ * répliques du GAN, les matrices du lot sont propres à chaque réplique. */
+struct bn {
+  int channels; // nombre de canaux
+  int area; // nombre de positions par canal
+  matrix_t* gamma; // échelle
+  matrix_t* beta; // décalage
+  matrix_t* mean; // moyenne cumulée (inférence)
+  matrix_t* var; // variance cumulée (inférence)
+  matrix_t* xhat; // pré-activation normalisée du lot
+  matrix_t* inv_std; // inverse de l'écart-type du lot, par canal
+  matrix_t* dgamma; // gradient de l'échelle
+  matrix_t* dbeta; // gradient du décalage
+};
+
+bn_t* bn_init(int, int, int, bn_t*);
+void bn_free(bn_t*, int);
+double bn_forward(bn_t*, matrix_t*, matrix_t*, double, int);
+double bn_backward(bn_t*, matrix_t*, matrix_t*, matrix_t*, double);
+double bn_update(bn_t*, double);
+void bn_scale(bn_t*, matrix_t*);
+void bn_fold(bn_t*, matrix_t*, matrix_t*);
+
+#endif
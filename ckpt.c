@@ -0,0 +1,228 @@
+/*!
+ * \file ckpt.c
+ * \brief Fichier comprenant le recalcul des activations (gradient
+ * checkpointing) : politique des couches gardées, zones partagées par les
+ * couches recalculées et bilan de la mémoire libérée par rapport aux
+ * opérations ajoutées. Le recalcul lui-même (couches du GAN) est fait
+ * par gan.c.
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "ckpt.h"
+#include "mem.h"
+
+/**
+ * Position d'une couche recalculée dans son segment.
+ *
+ * \param ck structure ckpt
+ * \param path chemin de la propagation avant
+ * \param i indice de la couche
+ * \return position (zones partagées)
+ */
+static int ckpt_pos(ckpt_t* ck, int path, int i)
+{
+  return i - ckpt_first(ck, path, i);
+}
+
+/**
+ * Initialiser le recalcul des activations : une couche gardée toutes les
+ * 'seg' couches (et la couche de sortie, lue par les pertes) du generator
+ * et du discriminator sur les données réelles, les autres partagent une
+ * zone par position dans le segment, de la taille de la plus grande couche
+ * à cette position.
+ *
+ * \param seg nombre de couches par segment (au moins 2)
+ * \param nb nombre de couches à poids
+ * \param rows taille du lot
+ * \param layers_sz_g nombre de neurones dans chaque couche (generator)
+ * \param layers_sz_d nombre de neurones dans chaque couche (discriminator)
+ * \param keep_g couches du generator toujours gardées (NULL : aucune)
+ * \return structure ckpt
+ */
+ckpt_t* ckpt_init(int seg, int nb, int rows, unsigned int* layers_sz_g, unsigned int* layers_sz_d,
+  const char* keep_g)
+{
+  int p, i, k, a;
+  ckpt_t* ck = (ckpt_t*)calloc(1, sizeof(*ck));
+  assert(ck);
+
+  ck->seg = seg;
+  ck->nb = nb;
+  ck->nb_slots = seg - 1;
+  ck->view = (matrix_t**)calloc(CKPT_NB_PATHS * nb * 2, sizeof(*ck->view));
+  assert(ck->view);
+  ck->slot = (double**)calloc(ck->nb_slots * 2, sizeof(*ck->slot));
+  assert(ck->slot);
+  ck->owner = (int*)malloc(ck->nb_slots * sizeof(*ck->owner));
+  assert(ck->owner);
+  size_t* slot_sz = (size_t*)calloc(ck->nb_slots, sizeof(*slot_sz));
+  assert(slot_sz);
+
+  for (p = 0; p < CKPT_NB_PATHS; p++) {
+    unsigned int* sz = p == CKPT_G ? layers_sz_g : layers_sz_d;
+    ck->keep[p] = (char*)malloc(nb * sizeof(*ck->keep[p]));
+    assert(ck->keep[p]);
+    // Le chemin des données générées est lu par la propagation en arrière
+    // du generator après la mise à jour du discriminator : un recalcul
+    // utiliserait les nouveaux poids, il est donc toujours gardé
+    for (i = 0; i < nb; i++)
+      ck->keep[p][i] = p == CKPT_D_FAKE || (i + 1) % seg == 0 || i == nb - 1 || (p == CKPT_G && keep_g && keep_g[i]);
+
+    for (i = 0; i < nb; i++) {
+      size_t n = (size_t)rows * sz[i + 1];
+      ck->total += 2 * n * sizeof(double);
+      if (ck->keep[p][i])
+        continue;
+      ck->freed += 2 * n * sizeof(double);
+      k = ckpt_pos(ck, p, i);
+      if (n > slot_sz[k])
+        slot_sz[k] = n;
+    }
+  }
+
+  for (k = 0; k < ck->nb_slots; k++) {
+    ck->owner[k] = -1;
+    if (!slot_sz[k])
+      continue;
+    ck->slot[2 * k] = (double*)MEM_CALLOC(slot_sz[k], sizeof(double));
+    ck->slot[2 * k + 1] = (double*)MEM_CALLOC(slot_sz[k], sizeof(double));
+    assert(ck->slot[2 * k] && ck->slot[2 * k + 1]);
+    ck->shared += 2 * slot_sz[k] * sizeof(double);
+  }
+  free(slot_sz);
+
+  // Matrices des couches recalculées : mat_zinit n'est pas utilisé, les
+  // valeurs appartiennent aux zones partagées
+  for (p = 0; p < CKPT_NB_PATHS; p++)
+    for (i = 0; i < nb; i++) {
+      if (ck->keep[p][i])
+        continue;
+      for (a = 0; a < 2; a++) {
+        matrix_t* m = (matrix_t*)MEM_MALLOC(sizeof(*m));
+        assert(m);
+        m->rows = rows;
+        m->cols = (p == CKPT_G ? layers_sz_g : layers_sz_d)[i + 1];
+        m->data = ck->slot[2 * ckpt_pos(ck, p, i) + a];
+        m->version = 0;
+        m->pack = NULL;
+        ck->view[(p * nb + i) * 2 + a] = m;
+      }
+    }
+
+  return ck;
+}
+
+/**
+ * Matrice d'une couche recalculée, sur la zone partagée de sa position.
+ *
+ * \param ck structure ckpt (NULL : pas de recalcul)
+ * \param path chemin de la propagation avant
+ * \param i indice de la couche
+ * \param act pré-activation (0) ou activation (1)
+ * \return matrice (NULL si la couche est gardée : à allouer par l'appelant)
+ */
+matrix_t* ckpt_view(ckpt_t* ck, int path, int i, int act)
+{
+  return ckpt_kept(ck, path, i) ? NULL : ck->view[(path * ck->nb + i) * 2 + act];
+}
+
+/**
+ * Savoir si une couche garde ses valeurs.
+ *
+ * \param ck structure ckpt (NULL : pas de recalcul)
+ * \param path chemin de la propagation avant
+ * \param i indice de la couche
+ * \return 1 si la couche est gardée, 0 si elle est recalculée
+ */
+int ckpt_kept(ckpt_t* ck, int path, int i)
+{
+  return !ck || ck->keep[path][i];
+}
+
+/**
+ * Première couche du segment d'une couche (après la couche gardée
+ * précédente).
+ *
+ * \param ck structure ckpt
+ * \param path chemin de la propagation avant
+ * \param i indice de la couche
+ * \return indice de la première couche du segment
+ */
+int ckpt_first(ckpt_t* ck, int path, int i)
+{
+  while (i > 0 && !ck->keep[path][i - 1])
+    i--;
+  return i;
+}
+
+/**
+ * Savoir si les valeurs d'une couche sont disponibles (couche gardée, ou
+ * zone partagée toujours occupée par la couche).
+ *
+ * \param ck structure ckpt (NULL : pas de recalcul)
+ * \param path chemin de la propagation avant
+ * \param i indice de la couche
+ * \return 1 si les valeurs sont disponibles, 0 s'il faut les recalculer
+ */
+int ckpt_resident(ckpt_t* ck, int path, int i)
+{
+  return ckpt_kept(ck, path, i) || ck->owner[ckpt_pos(ck, path, i)] == path * ck->nb + i;
+}
+
+/**
+ * Noter que la propagation avant vient d'écrire les valeurs d'une couche.
+ *
+ * \param ck structure ckpt (NULL : pas de recalcul)
+ * \param path chemin de la propagation avant
+ * \param i indice de la couche
+ */
+void ckpt_mark(ckpt_t* ck, int path, int i)
+{
+  if (!ckpt_kept(ck, path, i))
+    ck->owner[ckpt_pos(ck, path, i)] = path * ck->nb + i;
+}
+
+/**
+ * Afficher le bilan du recalcul : mémoire des activations avec et sans
+ * recalcul, couches et opérations flottantes recalculées par itération
+ * (et leur part des propagations avant).
+ *
+ * \param ck structure ckpt
+ */
+void ckpt_print(ckpt_t* ck)
+{
+  long steps = ck->steps ? ck->steps : 1;
+  printf("[ckpt] segment: %d, activations: %.1f -> %.1f KiB, recomputed layers/step: %.2f, "
+    "MFLOP/step: %.3f (%.1f%% of forward) \n", ck->seg, ck->total / 1024.0,
+    (ck->total - ck->freed + ck->shared) / 1024.0, (double)ck->layers / steps, ck->flops / steps * 1e-6,
+    ck->fwd_flops > 0.0 ? 100.0 * ck->flops / ck->fwd_flops : 0.0);
+}
+
+/**
+ * Libérer le recalcul des activations, avec les matrices des couches
+ * recalculées et les zones partagées.
+ *
+ * \param ck structure ckpt (NULL : rien à libérer)
+ */
+void ckpt_free(ckpt_t* ck)
+{
+  int p, k;
+  if (!ck)
+    return;
+
+  for (k = 0; k < CKPT_NB_PATHS * ck->nb * 2; k++)
+    if (ck->view[k])
+      MEM_FREE(ck->view[k]);
+  for (k = 0; k < ck->nb_slots * 2; k++)
+    if (ck->slot[k])
+      MEM_FREE(ck->slot[k]);
+  for (p = 0; p < CKPT_NB_PATHS; p++)
+    free(ck->keep[p]);
+
+  free(ck->view);
+  free(ck->slot);
+  free(ck->owner);
+  free(ck);
+}
@@ -0,0 +1,54 @@
+/*!
+ * \file ckpt.h
+ * \brief Fichier header de ckpt.c
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#ifndef _CKPT_H_
+#define _CKPT_H_
+
+#include <stddef.h>
+#include "matrix.h"
+
+/* Enumération pour les chemins de la propagation avant */
+enum CKPT_PATH_E {
+  CKPT_G = 0, // generator
+  CKPT_D_REAL, // discriminator, données réelles
+  CKPT_D_FAKE, // discriminator, données générées
+  CKPT_NB_PATHS
+};
+
+typedef struct ckpt ckpt_t;
+/* Structure représentant le recalcul des activations (gradient checkpointing) :
+ * seule une couche sur 'seg' garde sa pré-activation et son activation, les
+ * couches entre deux couches gardées (un segment) écrivent dans des zones
+ * partagées par tous les segments et tous les chemins, et sont recalculées
+ * à partir de la couche gardée précédente quand la propagation en arrière
+ * les lit alors qu'un autre segment ou un autre chemin occupe leurs zones. */
+struct ckpt {
+  int seg; // nombre de couches par segment
+  int nb; // nombre de couches à poids
+  char* keep[CKPT_NB_PATHS]; // couche gardée (1) ou recalculée (0), par chemin
+  matrix_t** view; // matrices des couches recalculées sur les zones partagées (2 par couche et par chemin)
+  int nb_slots; // nombre de positions recalculées dans un segment
+  double** slot; // zones partagées : pré-activation et activation, par position
+  int* owner; // couche (chemin * nb + indice) qui occupe chaque position (-1 : aucune)
+  matrix_t* in[CKPT_NB_PATHS]; // entrée de la dernière propagation avant, par chemin
+  size_t total; // octets des activations sans recalcul
+  size_t freed; // octets des activations recalculées
+  size_t shared; // octets des zones partagées
+  long steps; // nombre d'itérations
+  long layers; // nombre de couches recalculées
+  double fwd_flops; // opérations flottantes des propagations avant
+  double flops; // opérations flottantes du recalcul
+};
+
+ckpt_t* ckpt_init(int, int, int, unsigned int*, unsigned int*, const char*);
+matrix_t* ckpt_view(ckpt_t*, int, int, int);
+int ckpt_kept(ckpt_t*, int, int);
+int ckpt_first(ckpt_t*, int, int);
+int ckpt_resident(ckpt_t*, int, int);
+void ckpt_mark(ckpt_t*, int, int);
+void ckpt_print(ckpt_t*);
+void ckpt_free(ckpt_t*);
+
+#endif
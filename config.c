@@ -9,7 +9,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <unistd.h>
 #include "config.h"
+#include "mem.h"
 
 // Taille du batch pour l'entraînement
 #define BATCH_SZ 64
@@ -27,6 +29,12 @@
 #define HASH_CHOSEN_LABEL 210680089861
 // Hashcode pour la taille de l'image
 #define HASH_IMG_SZ 6952339998606
+// Hashcode pour la largeur de l'image
+#define HASH_IMG_W 210676969656
+// Hashcode pour la hauteur de l'image
+#define HASH_IMG_H 210676969641
+// Hashcode pour le nombre de canaux de l'image
+#define HASH_IMG_CH 6952339998060
 // Hashcode pour le nombre de données d'apprentissage
 #define HASH_NUM_TRAIN 210690187203
 // Hashcode pour le nombre de couches pour le GAN
@@ -47,6 +55,60 @@
 #define HASH_VERBOSE 229443707952891
 // Hashcode pour la barre de progression
 #define HASH_PBAR 6384389962
+// Hashcode pour le nombre de threads
+#define HASH_NB_THREADS 229441242515216
+// Hashcode pour l'apprentissage asynchrone (Hogwild)
+#define HASH_HOGWILD 229426006458035
+// Hashcode pour l'apprentissage en pipeline
+#define HASH_PIPELINE 7571391742828059
+// Hashcode pour le nombre max. de lots d'avance du generator
+#define HASH_STALENESS 249860596435850615
+// Hashcode pour l'exécution en graphe de tâches
+#define HASH_SCHED 210688469708
+// Hashcode pour le fichier de mesures par phase
+#define HASH_PROF_FILE 249856309849399707
+// Hashcode pour le nombre d'images de la grille
+#define HASH_SNAP_NB 229440166127238
+// Hashcode pour le fichier de la chronologie
+#define HASH_TRACE_FILE 8245443269447209587
+// Hashcode pour la première itération de la chronologie
+#define HASH_TRACE_FROM 8245443269447219495
+// Hashcode pour le nombre d'itérations de la chronologie
+#define HASH_TRACE_LEN 249861917255982450
+// Hashcode pour le fichier des images d'apprentissage
+#define HASH_DATA_IMG 7570870142249243
+// Hashcode pour le fichier des labels d'apprentissage
+#define HASH_DATA_LBL 7570870142252152
+// Hashcode pour les canaux de la couche transposée du generator
+#define HASH_CONV_G 6952107800225
+// Hashcode pour les canaux de la couche convolutive du discriminator
+#define HASH_CONV_D 6952107800222
+// Hashcode pour le noyau de convolution
+#define HASH_CONV_ALGO 249837898016555389
+// Hashcode pour la normalisation par lot du generator
+#define HASH_BN_G 6383900891
+// Hashcode pour le GAN conditionnel
+#define HASH_COND 6383937353
+// Hashcode pour le noyau creux de la première couche du discriminator
+#define HASH_SPARSE 6952734680499
+// Hashcode pour le niveau de précision des fonctions transcendantes
+#define HASH_FAST_MATH 249841526963697180
+// Hashcode pour l'implémentation des produits matriciels
+#define HASH_GEMM 6384070187
+// Hashcode pour les noyaux spécialisés générés par kgen
+#define HASH_KGEN 6384215850
+// Hashcode pour le cache de réglage des noyaux
+#define HASH_TUNE_FILE 249862062008598240
+// Hashcode pour le segment de mémoire partagée du suivi
+#define HASH_MONITOR 229432471608301
+// Hashcode pour la lecture en flux des données
+#define HASH_STREAM 6952740020369
+// Hashcode pour le nombre d'images par lecture en flux
+#define HASH_STREAM_CHUNK 14123413271928976905UL
+// Hashcode pour le nombre de blocs en lecture anticipée
+#define HASH_STREAM_DEPTH 14123413271930049765UL
+// Hashcode pour le recalcul des activations
+#define HASH_CHECKPOINT 8244640380817312941
 
 /**
  * Fonction de hashing permettant d'obtenir 
@@ -67,35 +129,68 @@ static unsigned long hash(const char* str)
 }
 
 /**
- * Initialiser la structure de configuration à partir
- * du fichier passé en paramètre.
+ * Copier la valeur d'un paramètre de type chaîne de caractère,
+ * sans les espaces et le retour à la ligne de fin.
+ * 
+ * \param tok valeur du paramètre
+ * \return copie de la valeur
+ */
+static char* parse_string(const char* tok)
+{
+  size_t len = strlen(tok);
+  while (len > 0 && (tok[len - 1] == '\n' || tok[len - 1] == '\r' || tok[len - 1] == ' '))
+    len--;
+
+  char* str = (char*)malloc(len + 1);
+  assert(str);
+  memcpy(str, tok, len);
+  str[len] = '\0';
+  return str;
+}
+
+/**
+ * Lire la structure de configuration à partir du fichier passé en
+ * paramètre, sans quitter le programme en cas d'erreur (utilisable par
+ * plusieurs threads).
  * 
  * \param config_file fichier de configuration
- * \return structure config
+ * \param err message d'erreur
+ * \param err_len taille du message d'erreur
+ * \return structure config (NULL en cas d'erreur)
  */
-config_t* init_config(const char* config_file)
+config_t* read_config(const char* config_file, char* err, size_t err_len)
 {
   const int MAX = 1024;
+  err[0] = '\0';
   FILE* fp = fopen(config_file, "r");
   if (!fp) {
-    fprintf(stderr, "Can't open file %s\n", config_file);
-    exit(1);
+    snprintf(err, err_len, "Can't open file %s", config_file);
+    return NULL;
   }
 
-  char *buf = (char *)malloc(MAX * sizeof(*buf)), *tok, *end;
+  char *buf = (char *)malloc(MAX * sizeof(*buf)), *tok, *end, *save;
   assert(buf);
 
-  config_t* cfg = (config_t*)malloc(sizeof *cfg);
+  config_t* cfg = (config_t*)calloc(1, sizeof *cfg);
   assert(cfg);
+  cfg->nb_threads = 1;
+  cfg->staleness = 1;
+  cfg->snap_nb = SNAPSHOT_IMAGES;
+  cfg->kgen = 1;
+  cfg->stream_chunk = STREAM_CHUNK;
+  cfg->stream_depth = STREAM_DEPTH;
+  cfg->data_img = parse_string(MNIST_TRAIN_IMAGE);
+  cfg->data_lbl = parse_string(MNIST_TRAIN_LABEL);
 
   while (!feof(fp)) {
-    fgets(buf, MAX, fp);
+    if (!fgets(buf, MAX, fp) && !ferror(fp))
+      break;
     if (ferror(fp)) {
-      fprintf(stderr, "Error while reading file %s\n", config_file);
-      exit(1);
+      snprintf(err, err_len, "Error while reading file %s", config_file);
+      break;
     }
 
-    tok = strtok(buf, "=");
+    tok = strtok_r(buf, "=", &save);
     while (tok != NULL) {
       if (tok != NULL && 
         tok[0] > ASCII_AT && 
@@ -103,71 +198,295 @@ config_t* init_config(const char* config_file)
       ) {
         switch (hash(tok)) {
         case HASH_BATCH_SZ:
-          tok = strtok(NULL, "=");
+          tok = strtok_r(NULL, "=", &save);
           cfg->batch_sz = atoi(tok);
           break;
         case HASH_NUM_TRAIN:
-          tok = strtok(NULL, "=");
+          tok = strtok_r(NULL, "=", &save);
           cfg->num_train = atoi(tok);
           break;
         case HASH_CHOSEN_LABEL:
-          tok = strtok(NULL, "=");
+          tok = strtok_r(NULL, "=", &save);
           cfg->chosen_label = strtod(tok, &end);
           break;
         case HASH_IMG_SZ:
-          tok = strtok(NULL, "=");
+          tok = strtok_r(NULL, "=", &save);
           cfg->img_sz = atoi(tok);
           break;
+        case HASH_IMG_W:
+          tok = strtok_r(NULL, "=", &save);
+          cfg->img_w = atoi(tok);
+          break;
+        case HASH_IMG_H:
+          tok = strtok_r(NULL, "=", &save);
+          cfg->img_h = atoi(tok);
+          break;
+        case HASH_IMG_CH:
+          tok = strtok_r(NULL, "=", &save);
+          cfg->img_ch = atoi(tok);
+          break;
         case HASH_NB_LAYERS:
-          tok = strtok(NULL, "=");
+          tok = strtok_r(NULL, "=", &save);
           cfg->nb_layers = atoi(tok);
           break;
         case HASH_IN_LAYER_SZ_G:
-          tok = strtok(NULL, "=");
+          tok = strtok_r(NULL, "=", &save);
           cfg->in_layer_sz_g = atoi(tok);
           break;
         case HASH_HD_LAYER_SZ_G:
-          tok = strtok(NULL, "=");
+          tok = strtok_r(NULL, "=", &save);
           cfg->hd_layer_sz_g = atoi(tok);
           break;
         case HASH_HD_LAYER_SZ_D:
-          tok = strtok(NULL, "=");
+          tok = strtok_r(NULL, "=", &save);
           cfg->hd_layer_sz_d = atoi(tok);
           break;
         case HASH_LEARNING_RATE:
-          tok = strtok(NULL, "=");
+          tok = strtok_r(NULL, "=", &save);
           cfg->learning_rate = strtod(tok, &end);
           break;
         case HASH_DECAY_RATE:
-          tok = strtok(NULL, "=");
+          tok = strtok_r(NULL, "=", &save);
           cfg->decay_rate = strtod(tok, &end);
           break;
         case HASH_EPOCHS:
-          tok = strtok(NULL, "=");
+          tok = strtok_r(NULL, "=", &save);
           cfg->epochs = atoi(tok);
           break;
         case HASH_VERBOSE:
-          tok = strtok(NULL, "=");
+          tok = strtok_r(NULL, "=", &save);
           cfg->verbose = atoi(tok);
           break;
         case HASH_PBAR:
-          tok = strtok(NULL, "=");
+          tok = strtok_r(NULL, "=", &save);
           cfg->progressbar = atoi(tok);
           break;
+        case HASH_NB_THREADS:
+          tok = strtok_r(NULL, "=", &save);
+          cfg->nb_threads = atoi(tok);
+          break;
+        case HASH_HOGWILD:
+          tok = strtok_r(NULL, "=", &save);
+          cfg->hogwild = atoi(tok);
+          break;
+        case HASH_PIPELINE:
+          tok = strtok_r(NULL, "=", &save);
+          cfg->pipeline = atoi(tok);
+          break;
+        case HASH_STALENESS:
+          tok = strtok_r(NULL, "=", &save);
+          // Nombre de lots d'avance : un nombre négatif donnerait 0 lot en vol
+          if (atoi(tok) < 0)
+            snprintf(err, err_len, "Error: STALENESS must be positive or zero.");
+          cfg->staleness = atoi(tok);
+          break;
+        case HASH_SCHED:
+          tok = strtok_r(NULL, "=", &save);
+          cfg->sched = atoi(tok);
+          break;
+        case HASH_PROF_FILE:
+          tok = strtok_r(NULL, "=", &save);
+          cfg->prof_file = parse_string(tok);
+          break;
+        case HASH_SNAP_NB:
+          tok = strtok_r(NULL, "=", &save);
+          cfg->snap_nb = atoi(tok);
+          break;
+        case HASH_TRACE_FILE:
+          tok = strtok_r(NULL, "=", &save);
+          cfg->trace_file = parse_string(tok);
+          break;
+        case HASH_TRACE_FROM:
+          tok = strtok_r(NULL, "=", &save);
+          cfg->trace_from = atoi(tok);
+          break;
+        case HASH_TRACE_LEN:
+          tok = strtok_r(NULL, "=", &save);
+          cfg->trace_len = atoi(tok);
+          break;
+        case HASH_DATA_IMG:
+          tok = strtok_r(NULL, "=", &save);
+          free(cfg->data_img);
+          cfg->data_img = parse_string(tok);
+          break;
+        case HASH_DATA_LBL:
+          tok = strtok_r(NULL, "=", &save);
+          free(cfg->data_lbl);
+          cfg->data_lbl = parse_string(tok);
+          break;
+        case HASH_STREAM:
+          tok = strtok_r(NULL, "=", &save);
+          cfg->stream = atoi(tok);
+          break;
+        case HASH_STREAM_CHUNK:
+          tok = strtok_r(NULL, "=", &save);
+          cfg->stream_chunk = atoi(tok);
+          break;
+        case HASH_STREAM_DEPTH:
+          tok = strtok_r(NULL, "=", &save);
+          cfg->stream_depth = atoi(tok);
+          break;
+        case HASH_CHECKPOINT:
+          tok = strtok_r(NULL, "=", &save);
+          cfg->checkpoint = atoi(tok);
+          break;
+        case HASH_CONV_G:
+          tok = strtok_r(NULL, "=", &save);
+          cfg->conv_g = atoi(tok);
+          break;
+        case HASH_CONV_D:
+          tok = strtok_r(NULL, "=", &save);
+          cfg->conv_d = atoi(tok);
+          break;
+        case HASH_CONV_ALGO:
+          tok = strtok_r(NULL, "=", &save);
+          cfg->conv_algo = atoi(tok);
+          break;
+        case HASH_BN_G:
+          tok = strtok_r(NULL, "=", &save);
+          cfg->bn_g = atoi(tok);
+          break;
+        case HASH_COND:
+          tok = strtok_r(NULL, "=", &save);
+          cfg->cond = atoi(tok);
+          break;
+        case HASH_SPARSE:
+          tok = strtok_r(NULL, "=", &save);
+          cfg->sparse = atoi(tok);
+          break;
+        case HASH_FAST_MATH:
+          tok = strtok_r(NULL, "=", &save);
+          cfg->fast_math = atoi(tok);
+          break;
+        case HASH_GEMM:
+          tok = strtok_r(NULL, "=", &save);
+          cfg->gemm = atoi(tok);
+          break;
+        case HASH_KGEN:
+          tok = strtok_r(NULL, "=", &save);
+          cfg->kgen = atoi(tok);
+          break;
+        case HASH_TUNE_FILE:
+          tok = strtok_r(NULL, "=", &save);
+          cfg->tune_file = parse_string(tok);
+          break;
+        case HASH_MONITOR:
+          tok = strtok_r(NULL, "=", &save);
+          cfg->monitor = parse_string(tok);
+          break;
         default:
-          fprintf(stderr, "Error: %s is not a valid parameter.\n", tok);
-          exit(0);
+          snprintf(err, err_len, "Error: %s is not a valid parameter.", tok);
+          break;
         }
       }
-      tok = strtok(NULL, "=");
+      tok = err[0] ? NULL : strtok_r(NULL, "=", &save);
     }
+    if (err[0])
+      break;
+  }
+
+  // Taille de l'image donnée par ses dimensions
+  if (!err[0] && cfg->img_w && cfg->img_h && cfg->img_ch) {
+    if (cfg->img_sz && cfg->img_sz != cfg->img_w * cfg->img_h * cfg->img_ch)
+      snprintf(err, err_len, "Error: IMG_SZ must be IMG_W x IMG_H x IMG_CH.");
+    cfg->img_sz = cfg->img_w * cfg->img_h * cfg->img_ch;
+  }
+
+  fclose(fp);
+  free(buf);
+  if (err[0]) {
+    free_config(cfg);
+    return NULL;
+  }
+  return cfg;
+}
+
+/**
+ * Initialiser la structure de configuration à partir
+ * du fichier passé en paramètre.
+ * 
+ * \param config_file fichier de configuration
+ * \return structure config
+ */
+config_t* init_config(const char* config_file)
+{
+  char err[CONFIG_MAX_ERR];
+  config_t* cfg = read_config(config_file, err, sizeof(err));
+  if (!cfg) {
+    fprintf(stderr, "%s\n", err);
+    exit(1);
   }
   return cfg;
 }
 
+/**
+ * Fixer les dimensions des images de la configuration d'après celles des
+ * données : une dimension nulle dans la configuration est prise dans les
+ * données, une dimension donnée des deux côtés doit être la même.
+ *
+ * \param cfg structure config
+ * \param width largeur des images des données (0 : inconnue)
+ * \param height hauteur des images des données (0 : inconnue)
+ * \param channels canaux des images des données (0 : inconnu)
+ * \param size taille d'une image des données
+ * \param file fichier des images
+ */
+static void set_image_config(config_t* cfg, int width, int height, int channels, long size, const char* file)
+{
+  int d, data[3] = {width, height, channels};
+  unsigned int* dims[3] = {&cfg->img_w, &cfg->img_h, &cfg->img_ch};
+
+  for (d = 0; d < 3; d++) {
+    if (!*dims[d])
+      *dims[d] = data[d];
+    else if (data[d] && (int)*dims[d] != data[d]) {
+      fprintf(stderr, "Error: the images of %s are %d x %d x %d, not IMG_W x IMG_H x IMG_CH. \n", file, width, height,
+        channels);
+      exit(1);
+    }
+  }
+
+  if (!cfg->img_w || !cfg->img_h || !cfg->img_ch) {
+    fprintf(stderr, "Error: IMG_W, IMG_H and IMG_CH must be given for the images of %s. \n", file);
+    exit(1);
+  }
+  if ((long)cfg->img_w * cfg->img_h * cfg->img_ch != size || (cfg->img_sz && cfg->img_sz != size)) {
+    fprintf(stderr, "Error: the images of %s have %ld values, not IMG_W x IMG_H x IMG_CH (IMG_SZ). \n", file, size);
+    exit(1);
+  }
+  cfg->img_sz = size;
+}
+
+/**
+ * Fixer les dimensions des images sans charger les données (réglage,
+ * benchmarks, kgen) : celles de l'en-tête de DATA_IMG si le fichier est
+ * lisible, celles d'une image MNIST sinon.
+ *
+ * \param cfg structure config
+ */
+void load_image_config(config_t* cfg)
+{
+  int width = MNIST_WIDTH, height = MNIST_HEIGHT, channels = 1;
+  long size = MNIST_SIZE;
+  idx_header_t hdr;
+
+  if (cfg->img_w && cfg->img_h && cfg->img_ch)
+    return;
+
+  if (access(cfg->data_img, R_OK) == 0) {
+    read_idx_header(cfg->data_img, &hdr);
+    read_idx_image(&hdr, &width, &height, &channels);
+    size = hdr.item;
+  }
+  set_image_config(cfg, width, height, channels, size, cfg->data_img);
+}
+
 /**
  * Charger les données MNIST pour la structure de configuration,
- * et récupérer les données d'apprentissage.
+ * et récupérer les données d'apprentissage : les images du label
+ * demandé, ou toutes les images en mode conditionnel (les labels
+ * servent alors de condition au GAN). Les dimensions des images sont
+ * fixées d'après celles des données.
  * 
  * \param cfg structure config
  * \param mnist structure mnist
@@ -175,20 +494,37 @@ config_t* init_config(const char* config_file)
 void load_mnist_config(config_t* cfg, mnist_t* mnist)
 {
   int i, s, j = 0, size = 0;
-  for (i = 0; i < cfg->num_train; i++)
-    if (mnist->train_label[i] == cfg->chosen_label)
+  set_image_config(cfg, mnist->width, mnist->height, mnist->channels, mnist->img_sz, cfg->data_img);
+  mnist->width = cfg->img_w;
+  mnist->height = cfg->img_h;
+  mnist->channels = cfg->img_ch;
+
+  if (cfg->num_train > mnist->num_train)
+    cfg->num_train = mnist->num_train;
+
+  for (i = 0; i < cfg->num_train; i++) {
+    if (cfg->cond && mnist->train_label[i] >= MNIST_NUM_CLASSES) {
+      fprintf(stderr, "Error: invalid label %u for the conditional GAN. \n", mnist->train_label[i]);
+      exit(1);
+    }
+    if (cfg->cond || mnist->train_label[i] == cfg->chosen_label)
       size++;
+  }
 
   int num_batches = size / cfg->batch_sz;
   size = num_batches * cfg->batch_sz;
+  if (num_batches == 0) {
+    fprintf(stderr, "Error: not enough images with label %u for one batch. \n", cfg->chosen_label);
+    exit(1);
+  }
 
   matrix_t* x_train = mat_zinit(size, cfg->img_sz);
-  unsigned int* y_train = (unsigned int*)malloc(size * sizeof(*y_train));
+  unsigned int* y_train = (unsigned int*)MEM_MALLOC(size * sizeof(*y_train));
   assert(y_train);
 
   for (i = 0; i < cfg->num_train; i++) {
-    // Récupérer seulement le label demandé
-    if (mnist->train_label[i] == cfg->chosen_label) {
+    // Récupérer seulement le label demandé (tous en mode conditionnel)
+    if (cfg->cond || mnist->train_label[i] == cfg->chosen_label) {
       for (s = 0; s < cfg->img_sz; s++)
         x_train->data[j * cfg->img_sz + s] = mnist->train_image[i][s];
 
@@ -206,4 +542,71 @@ void load_mnist_config(config_t* cfg, mnist_t* mnist)
   cfg->y_train = y_train;
   cfg->train_sz = size;
   cfg->num_batches = num_batches;
-}
\ No newline at end of file
+
+  // Images creuses (pixels différents du fond), si elles le sont assez
+  cfg->x_sparse = NULL;
+  if (cfg->sparse) {
+    cfg->x_sparse = sparse_init(x_train, MNIST_BACKGROUND);
+    if (sparse_density(cfg->x_sparse, 0, size) > SPARSE_MAX_DENSITY) {
+      sparse_free(cfg->x_sparse);
+      cfg->x_sparse = NULL;
+    }
+  }
+}
+
+/**
+ * Ouvrir la lecture en flux des données d'apprentissage (STREAM=1) : seul
+ * un lot est gardé en mémoire (x_train, y_train), rempli par select_batch
+ * à partir des blocs lus en avance par stream.c. Les lots sont les mêmes
+ * que ceux de load_mnist_config.
+ *
+ * \param cfg structure config
+ * \param image_file fichier IDX des images
+ * \param label_file fichier IDX des labels
+ */
+void load_stream_config(config_t* cfg, char* image_file, char* label_file)
+{
+  if (cfg->hogwild || cfg->pipeline) {
+    fprintf(stderr, "Error: STREAM is not supported with HOGWILD or PIPELINE. \n");
+    exit(1);
+  }
+
+  cfg->x_stream = stream_open(image_file, label_file, cfg->num_train, cfg->batch_sz, cfg->cond, cfg->chosen_label,
+    cfg->stream_chunk, cfg->stream_depth);
+  int width, height, channels;
+  read_idx_image(&cfg->x_stream->img_hdr, &width, &height, &channels);
+  set_image_config(cfg, width, height, channels, stream_item(cfg->x_stream), image_file);
+
+  cfg->x_train = mat_zinit(cfg->batch_sz, cfg->img_sz);
+  cfg->y_train = (unsigned int*)MEM_MALLOC(cfg->batch_sz * sizeof(*cfg->y_train));
+  assert(cfg->y_train);
+  cfg->train_sz = cfg->x_stream->nb_batches * cfg->batch_sz;
+  cfg->num_batches = cfg->x_stream->nb_batches;
+  cfg->x_sparse = NULL;
+}
+
+/**
+ * Libérer la structure de configuration et les données d'apprentissage
+ * récupérées par load_mnist_config ou load_stream_config.
+ *
+ * \param cfg structure config
+ */
+void free_config(config_t* cfg)
+{
+  if (cfg->x_train)
+    mat_free(cfg->x_train);
+  if (cfg->y_train)
+    MEM_FREE(cfg->y_train);
+  if (cfg->x_sparse)
+    sparse_free(cfg->x_sparse);
+  if (cfg->x_stream)
+    stream_close(cfg->x_stream);
+
+  free(cfg->prof_file);
+  free(cfg->trace_file);
+  free(cfg->data_img);
+  free(cfg->data_lbl);
+  free(cfg->tune_file);
+  free(cfg->monitor);
+  free(cfg);
+}
@@ -8,6 +8,11 @@
 
 #include "mnist.h"
 #include "matrix.h"
+#include "sparse.h"
+#include "stream.h"
+
+// Taille max. du message d'erreur de read_config
+#define CONFIG_MAX_ERR 256
 
 typedef struct config config_t;
 /* Structure représentant la configuration pour le GAN */
@@ -18,7 +23,10 @@ struct config {
   unsigned int chosen_label; // choix du label
   unsigned int num_train; // nombre de données d'apprentissage
   unsigned int num_batches; // nombre de données pour le lot
-  unsigned int img_sz; // taille de l'image
+  unsigned int img_sz; // taille de l'image (img_w x img_h x img_ch)
+  unsigned int img_w; // largeur de l'image (0 : en-tête des données)
+  unsigned int img_h; // hauteur de l'image (0 : en-tête des données)
+  unsigned int img_ch; // nombre de canaux de l'image (0 : en-tête des données)
   unsigned int train_sz; // taille du nombre de données
   unsigned int nb_layers; // nombre de couches
   unsigned int in_layer_sz_g; // taille de la couche d'entrée (generator)
@@ -27,11 +35,44 @@ struct config {
   unsigned int epochs; // nombre d'itérations
   double learning_rate; // coefficient d'apprentissage
   double decay_rate; // ratio de décroissance
+  unsigned int nb_threads; // nombre de threads pour l'apprentissage
+  char hogwild; // apprentissage asynchrone sans verrou (Hogwild)
+  char pipeline; // apprentissage en pipeline generator / discriminator
+  unsigned int staleness; // nombre max. de lots d'avance du generator (pipeline)
+  char sched; // itérations exécutées comme graphe de tâches (vol de tâches)
+  char* prof_file; // fichier CSV pour les mesures par phase (make PROFILE=1)
+  unsigned int snap_nb; // nombre d'images dans la grille des images générées
+  char* trace_file; // fichier JSON pour la chronologie (make TRACE=1)
+  unsigned int trace_from; // première itération de la chronologie
+  unsigned int trace_len; // nombre d'itérations de la chronologie
+  char* data_img; // fichier IDX des images d'apprentissage
+  char* data_lbl; // fichier IDX des labels d'apprentissage
+  unsigned int conv_g; // canaux de la couche transposée du generator (0 : dense)
+  unsigned int conv_d; // canaux de la couche convolutive du discriminator (0 : dense)
+  int conv_algo; // noyau de convolution (0 : auto, 1 : im2col, 2 : direct)
+  unsigned int bn_g; // normalisation par lot des couches cachées du generator
+  unsigned int cond; // GAN conditionnel : tous les chiffres, label en entrée
+  unsigned int sparse; // noyau creux pour la première couche du discriminator (images réelles)
+  int fast_math; // précision de tanh, sigmoïde et log (0 : libm, 1 : ~1e-7, 2 : ~1e-4)
+  int gemm; // produits matriciels des couches denses (0 : matrix.c, 1 : CBLAS, make CBLAS=1)
+  int kgen; // noyaux spécialisés de kernels_gen.c pour les dimensions des couches denses
+  char* tune_file; // cache de réglage des noyaux écrit par ./gan tune (vide : aucun)
+  char* monitor; // segment de mémoire partagée pour gan-monitor (vide : aucun)
+  char stream; // lecture en flux des données (un lot en mémoire, lecture anticipée)
+  unsigned int stream_chunk; // nombre d'images par lecture en flux
+  unsigned int stream_depth; // nombre de blocs en lecture anticipée
+  unsigned int checkpoint; // une couche gardée toutes les 'checkpoint' couches, les autres recalculées (0 : toutes gardées)
   unsigned int* y_train; // labels
   matrix_t* x_train; // données d'apprentissage
+  sparse_t* x_sparse; // données d'apprentissage creuses (NULL : noyau dense)
+  stream_t* x_stream; // lecture en flux du lot courant (NULL : données en mémoire)
 };
 
+config_t* read_config(const char*, char*, size_t);
 config_t* init_config(const char*);
 void load_mnist_config(config_t*, mnist_t*);
+void load_stream_config(config_t*, char*, char*);
+void load_image_config(config_t*);
+void free_config(config_t*);
 
 #endif
\ No newline at end of file
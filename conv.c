@@ -0,0 +1,667 @@
+/*!
+ * \file conv.c
+ * \brief Fichier comprenant les couches convolutives et convolutives
+ * transposées (DCGAN) : propagation avant, gradient de l'entrée, des poids
+ * et des biais. Deux noyaux sont disponibles, im2col suivi d'un produit
+ * matriciel par blocs, et un noyau direct (canaux de sortie par blocs de
+ * CONV_DIRECT_OC) pour les couches avec peu de canaux de sortie ; le choix
+ * se fait selon les dimensions de la couche.
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "conv.h"
+#include "mem.h"
+#include "prof.h"
+
+/**
+ * Initialiser une couche convolutive, de l'entrée (in_c, in_h, in_w)
+ * vers 'out_c' canaux.
+ *
+ * \param in_c nombre de canaux d'entrée
+ * \param in_h hauteur de l'entrée
+ * \param in_w largeur de l'entrée
+ * \param out_c nombre de canaux de sortie
+ * \param k taille du noyau
+ * \param stride pas
+ * \param pad marge
+ * \param transposed convolution transposée
+ * \param algo noyau (CONV_AUTO : choix selon les dimensions)
+ * \return structure conv
+ */
+conv_t* conv_init(int in_c, int in_h, int in_w, int out_c, int k, int stride, int pad, int transposed, int algo)
+{
+  conv_t* cv = (conv_t*)malloc(sizeof(*cv));
+  assert(cv);
+
+  cv->transposed = transposed;
+  cv->k = k;
+  cv->stride = stride;
+  cv->pad = pad;
+
+  if (transposed) {
+    // Convolution inverse : de la sortie de la couche vers son entrée
+    cv->oc = in_c;
+    cv->oh = in_h;
+    cv->ow = in_w;
+    cv->c = out_c;
+    cv->h = (in_h - 1) * stride - 2 * pad + k;
+    cv->w = (in_w - 1) * stride - 2 * pad + k;
+  }
+  else {
+    cv->c = in_c;
+    cv->h = in_h;
+    cv->w = in_w;
+    cv->oc = out_c;
+    cv->oh = (in_h + 2 * pad - k) / stride + 1;
+    cv->ow = (in_w + 2 * pad - k) / stride + 1;
+  }
+
+  if (cv->h <= 0 || cv->w <= 0 || cv->oh <= 0 || cv->ow <= 0) {
+    fprintf(stderr, "Error: invalid convolution dimensions. \n");
+    exit(1);
+  }
+
+  // Avec peu de canaux de sortie, le produit matriciel de im2col est trop
+  // étroit pour compenser la copie des colonnes (cf. gan_bench)
+  if (algo == CONV_AUTO)
+    algo = cv->oc <= CONV_DIRECT_MAX_OC ? CONV_DIRECT : CONV_IM2COL;
+  cv->algo = algo;
+
+  return cv;
+}
+
+/**
+ * Taille de l'entrée de la couche (une ligne de matrice).
+ *
+ * \param cv structure conv
+ * \return taille de l'entrée
+ */
+int conv_in_size(conv_t* cv)
+{
+  return cv->transposed ? cv->oc * cv->oh * cv->ow : cv->c * cv->h * cv->w;
+}
+
+/**
+ * Taille de la sortie de la couche (une ligne de matrice).
+ *
+ * \param cv structure conv
+ * \return taille de la sortie
+ */
+int conv_out_size(conv_t* cv)
+{
+  return cv->transposed ? cv->c * cv->h * cv->w : cv->oc * cv->oh * cv->ow;
+}
+
+/**
+ * Nombre de canaux de sortie de la couche (taille des biais).
+ *
+ * \param cv structure conv
+ * \return nombre de canaux
+ */
+int conv_out_channels(conv_t* cv)
+{
+  return cv->transposed ? cv->c : cv->oc;
+}
+
+/**
+ * Nombre de canaux d'entrée de la couche.
+ *
+ * \param cv structure conv
+ * \return nombre de canaux
+ */
+int conv_in_channels(conv_t* cv)
+{
+  return cv->transposed ? cv->oc : cv->c;
+}
+
+/**
+ * Nombre moyen d'entrées contribuant à une sortie (initialisation des poids).
+ *
+ * \param cv structure conv
+ * \return nombre d'entrées
+ */
+int conv_fan_in(conv_t* cv)
+{
+  int fan_in = cv->transposed ? cv->oc * cv->k * cv->k / (cv->stride * cv->stride) : cv->c * cv->k * cv->k;
+  return fan_in > 0 ? fan_in : 1;
+}
+
+/**
+ * Allouer la matrice des poids, (c * k * k) x oc.
+ *
+ * \param cv structure conv
+ * \return matrice des poids
+ */
+matrix_t* conv_init_weights(conv_t* cv)
+{
+  return mat_zinit(cv->c * cv->k * cv->k, cv->oc);
+}
+
+/**
+ * Allouer la matrice des biais, un par canal de sortie de la couche.
+ *
+ * \param cv structure conv
+ * \return matrice des biais
+ */
+matrix_t* conv_init_bias(conv_t* cv)
+{
+  return mat_zinit(1, conv_out_channels(cv));
+}
+
+/**
+ * Nom du noyau de convolution.
+ *
+ * \param algo noyau
+ * \return nom
+ */
+const char* conv_algo_name(int algo)
+{
+  switch (algo) {
+  case CONV_IM2COL:
+    return "im2col";
+  case CONV_DIRECT:
+    return "direct";
+  default:
+    return "auto";
+  }
+}
+
+/**
+ * Réorganiser une image (c, h, w) en colonnes : col est une matrice
+ * (c * k * k) x (oh * ow), une colonne par position de sortie.
+ *
+ * \param cv structure conv
+ * \param x image
+ * \param col colonnes
+ */
+static void im2col(conv_t* cv, const double* x, double* col)
+{
+  int ci, ki, kj, oy, ox, iy, ix;
+  int p = cv->oh * cv->ow;
+
+  for (ci = 0; ci < cv->c; ci++)
+    for (ki = 0; ki < cv->k; ki++)
+      for (kj = 0; kj < cv->k; kj++) {
+        double* row = col + ((ci * cv->k + ki) * cv->k + kj) * p;
+        for (oy = 0; oy < cv->oh; oy++) {
+          iy = oy * cv->stride - cv->pad + ki;
+          for (ox = 0; ox < cv->ow; ox++) {
+            ix = ox * cv->stride - cv->pad + kj;
+            row[oy * cv->ow + ox] = (iy >= 0 && iy < cv->h && ix >= 0 && ix < cv->w) ?
+              x[(ci * cv->h + iy) * cv->w + ix] : 0.0;
+          }
+        }
+      }
+}
+
+/**
+ * Opération inverse de im2col : accumuler les colonnes dans l'image.
+ *
+ * \param cv structure conv
+ * \param col colonnes
+ * \param x image (écrasée)
+ */
+static void col2im(conv_t* cv, const double* col, double* x)
+{
+  int ci, ki, kj, oy, ox, iy, ix;
+  int p = cv->oh * cv->ow;
+
+  memset(x, 0, cv->c * cv->h * cv->w * sizeof(*x));
+  for (ci = 0; ci < cv->c; ci++)
+    for (ki = 0; ki < cv->k; ki++)
+      for (kj = 0; kj < cv->k; kj++) {
+        const double* row = col + ((ci * cv->k + ki) * cv->k + kj) * p;
+        for (oy = 0; oy < cv->oh; oy++) {
+          iy = oy * cv->stride - cv->pad + ki;
+          if (iy < 0 || iy >= cv->h)
+            continue;
+          for (ox = 0; ox < cv->ow; ox++) {
+            ix = ox * cv->stride - cv->pad + kj;
+            if (ix >= 0 && ix < cv->w)
+              x[(ci * cv->h + iy) * cv->w + ix] += row[oy * cv->ow + ox];
+          }
+        }
+      }
+}
+
+/**
+ * Produit matriciel par blocs c (m x n) = a^T . b, avec a (l x m) et b (l x n).
+ *
+ * \param m nombre de lignes de c
+ * \param n nombre de colonnes de c
+ * \param l dimension commune
+ * \param a matrice a
+ * \param b matrice b
+ * \param c matrice résultat (écrasée)
+ */
+static void gemm_tn(int m, int n, int l, const double* a, const double* b, double* c)
+{
+  int i, j, p, j0, p0, jn, pn;
+
+  memset(c, 0, (size_t)m * n * sizeof(*c));
+  for (j0 = 0; j0 < n; j0 += CONV_BLOCK) {
+    jn = j0 + CONV_BLOCK < n ? j0 + CONV_BLOCK : n;
+    for (p0 = 0; p0 < l; p0 += CONV_BLOCK) {
+      pn = p0 + CONV_BLOCK < l ? p0 + CONV_BLOCK : l;
+      for (i = 0; i < m; i++)
+        for (p = p0; p < pn; p++) {
+          double av = a[p * m + i];
+          for (j = j0; j < jn; j++)
+            c[i * n + j] += av * b[p * n + j];
+        }
+    }
+  }
+}
+
+/**
+ * Produit matriciel par blocs c (m x n) = a . b, avec a (m x l) et b (l x n).
+ *
+ * \param m nombre de lignes de c
+ * \param n nombre de colonnes de c
+ * \param l dimension commune
+ * \param a matrice a
+ * \param b matrice b
+ * \param c matrice résultat (écrasée)
+ */
+static void gemm_nn(int m, int n, int l, const double* a, const double* b, double* c)
+{
+  int i, j, p, j0, jn;
+
+  memset(c, 0, (size_t)m * n * sizeof(*c));
+  for (j0 = 0; j0 < n; j0 += CONV_BLOCK) {
+    jn = j0 + CONV_BLOCK < n ? j0 + CONV_BLOCK : n;
+    for (i = 0; i < m; i++)
+      for (p = 0; p < l; p++) {
+        double av = a[i * l + p];
+        for (j = j0; j < jn; j++)
+          c[i * n + j] += av * b[p * n + j];
+      }
+  }
+}
+
+/**
+ * Produit matriciel par blocs c (m x n) += a . b^T, avec a (m x l) et b (n x l).
+ *
+ * \param m nombre de lignes de c
+ * \param n nombre de colonnes de c
+ * \param l dimension commune
+ * \param a matrice a
+ * \param b matrice b
+ * \param c matrice résultat (accumulée)
+ */
+static void gemm_nt(int m, int n, int l, const double* a, const double* b, double* c)
+{
+  int i, j, p, p0, pn;
+
+  for (p0 = 0; p0 < l; p0 += CONV_BLOCK) {
+    pn = p0 + CONV_BLOCK < l ? p0 + CONV_BLOCK : l;
+    for (i = 0; i < m; i++)
+      for (j = 0; j < n; j++) {
+        double tmp = 0.0;
+        for (p = p0; p < pn; p++)
+          tmp += a[i * l + p] * b[j * l + p];
+        c[i * n + j] += tmp;
+      }
+  }
+}
+
+/**
+ * Positions de sortie valides (ox_min <= ox < ox_max) pour une position
+ * 'kj' du noyau : l'entrée ox * stride - pad + kj est dans l'image.
+ *
+ * \param size taille de l'entrée
+ * \param osize taille de la sortie
+ * \param stride pas
+ * \param off décalage (kj - pad)
+ * \param lo première position valide
+ * \param hi position suivant la dernière position valide
+ */
+static void conv_range(int size, int osize, int stride, int off, int* lo, int* hi)
+{
+  *lo = off < 0 ? (-off + stride - 1) / stride : 0;
+  *hi = size - off > 0 ? (size - off + stride - 1) / stride : 0;
+  if (*hi > osize)
+    *hi = osize;
+}
+
+/**
+ * Convolution directe y = conv(x), sans colonnes intermédiaires : pour
+ * chaque position du noyau, les lignes de sortie sont mises à jour par
+ * blocs de CONV_DIRECT_OC canaux (une lecture de x pour plusieurs sorties).
+ *
+ * \param cv structure conv
+ * \param x image d'entrée (c, h, w)
+ * \param wt poids (c * k * k) x oc
+ * \param y image de sortie (oc, oh, ow)
+ */
+static void direct_apply(conv_t* cv, const double* x, const double* wt, double* y)
+{
+  int o0, j, nb, oy, ox, ci, ki, kj, iy, lo, hi;
+  int p = cv->oh * cv->ow;
+  double wv[CONV_DIRECT_OC];
+
+  memset(y, 0, cv->oc * p * sizeof(*y));
+  for (o0 = 0; o0 < cv->oc; o0 += CONV_DIRECT_OC) {
+    nb = cv->oc - o0 < CONV_DIRECT_OC ? cv->oc - o0 : CONV_DIRECT_OC;
+    for (ci = 0; ci < cv->c; ci++)
+      for (ki = 0; ki < cv->k; ki++)
+        for (kj = 0; kj < cv->k; kj++) {
+          const double* wr = wt + ((ci * cv->k + ki) * cv->k + kj) * cv->oc + o0;
+          for (j = 0; j < nb; j++)
+            wv[j] = wr[j];
+          conv_range(cv->w, cv->ow, cv->stride, kj - cv->pad, &lo, &hi);
+
+          for (oy = 0; oy < cv->oh; oy++) {
+            iy = oy * cv->stride - cv->pad + ki;
+            if (iy < 0 || iy >= cv->h)
+              continue;
+            const double* xr = x + (ci * cv->h + iy) * cv->w + kj - cv->pad;
+            double* yr = y + o0 * p + oy * cv->ow;
+            for (ox = lo; ox < hi; ox++) {
+              double xv = xr[ox * cv->stride];
+              for (j = 0; j < nb; j++)
+                yr[j * p + ox] += wv[j] * xv;
+            }
+          }
+        }
+  }
+}
+
+/**
+ * Adjoint direct de la convolution : x = conv^T(y).
+ *
+ * \param cv structure conv
+ * \param y image de sortie (oc, oh, ow)
+ * \param wt poids (c * k * k) x oc
+ * \param x image d'entrée (c, h, w), écrasée
+ */
+static void direct_adjoint(conv_t* cv, const double* y, const double* wt, double* x)
+{
+  int m, oy, ox, ci, ki, kj, iy, lo, hi;
+  int p = cv->oh * cv->ow;
+
+  memset(x, 0, cv->c * cv->h * cv->w * sizeof(*x));
+  for (ci = 0; ci < cv->c; ci++)
+    for (ki = 0; ki < cv->k; ki++)
+      for (kj = 0; kj < cv->k; kj++) {
+        const double* wr = wt + ((ci * cv->k + ki) * cv->k + kj) * cv->oc;
+        conv_range(cv->w, cv->ow, cv->stride, kj - cv->pad, &lo, &hi);
+
+        for (oy = 0; oy < cv->oh; oy++) {
+          iy = oy * cv->stride - cv->pad + ki;
+          if (iy < 0 || iy >= cv->h)
+            continue;
+          double* xr = x + (ci * cv->h + iy) * cv->w + kj - cv->pad;
+          for (m = 0; m < cv->oc; m++) {
+            double wv = wr[m];
+            const double* yr = y + m * p + oy * cv->ow;
+            for (ox = lo; ox < hi; ox++)
+              xr[ox * cv->stride] += wv * yr[ox];
+          }
+        }
+      }
+}
+
+/**
+ * Gradient direct des poids : dw += x (*) y.
+ *
+ * \param cv structure conv
+ * \param x image d'entrée (c, h, w)
+ * \param y gradient de la sortie (oc, oh, ow)
+ * \param dw gradient des poids (c * k * k) x oc, accumulé
+ */
+static void direct_weight(conv_t* cv, const double* x, const double* y, double* dw)
+{
+  int m, oy, ox, ci, ki, kj, iy, lo, hi;
+  int p = cv->oh * cv->ow;
+
+  for (ci = 0; ci < cv->c; ci++)
+    for (ki = 0; ki < cv->k; ki++)
+      for (kj = 0; kj < cv->k; kj++) {
+        double* dr = dw + ((ci * cv->k + ki) * cv->k + kj) * cv->oc;
+        conv_range(cv->w, cv->ow, cv->stride, kj - cv->pad, &lo, &hi);
+
+        for (m = 0; m < cv->oc; m++) {
+          double tmp = 0.0;
+          for (oy = 0; oy < cv->oh; oy++) {
+            iy = oy * cv->stride - cv->pad + ki;
+            if (iy < 0 || iy >= cv->h)
+              continue;
+            const double* xr = x + (ci * cv->h + iy) * cv->w + kj - cv->pad;
+            const double* yr = y + m * p + oy * cv->ow;
+            for (ox = lo; ox < hi; ox++)
+              tmp += xr[ox * cv->stride] * yr[ox];
+          }
+          dr[m] += tmp;
+        }
+      }
+}
+
+/**
+ * Convolution d'une image, y = conv(x), avec le noyau de la couche.
+ *
+ * \param cv structure conv
+ * \param x image d'entrée (c, h, w)
+ * \param wt poids
+ * \param y image de sortie (oc, oh, ow)
+ * \param col colonnes (im2col)
+ */
+static void conv_apply(conv_t* cv, const double* x, const double* wt, double* y, double* col)
+{
+  if (cv->algo == CONV_DIRECT) {
+    direct_apply(cv, x, wt, y);
+    return;
+  }
+  im2col(cv, x, col);
+  gemm_tn(cv->oc, cv->oh * cv->ow, cv->c * cv->k * cv->k, wt, col, y);
+}
+
+/**
+ * Adjoint de la convolution d'une image, x = conv^T(y).
+ *
+ * \param cv structure conv
+ * \param y image de sortie (oc, oh, ow)
+ * \param wt poids
+ * \param x image d'entrée (c, h, w)
+ * \param col colonnes (im2col)
+ */
+static void conv_adjoint(conv_t* cv, const double* y, const double* wt, double* x, double* col)
+{
+  if (cv->algo == CONV_DIRECT) {
+    direct_adjoint(cv, y, wt, x);
+    return;
+  }
+  gemm_nn(cv->c * cv->k * cv->k, cv->oh * cv->ow, cv->oc, wt, y, col);
+  col2im(cv, col, x);
+}
+
+/**
+ * Gradient des poids pour une image, dw += x (*) y.
+ *
+ * \param cv structure conv
+ * \param x image d'entrée (c, h, w)
+ * \param y gradient de la sortie (oc, oh, ow)
+ * \param dw gradient des poids
+ * \param col colonnes (im2col)
+ */
+static void conv_weight(conv_t* cv, const double* x, const double* y, double* dw, double* col)
+{
+  if (cv->algo == CONV_DIRECT) {
+    direct_weight(cv, x, y, dw);
+    return;
+  }
+  im2col(cv, x, col);
+  gemm_nt(cv->c * cv->k * cv->k, cv->oc, cv->oh * cv->ow, col, y, dw);
+}
+
+/**
+ * Allouer les colonnes de im2col (une image à la fois).
+ *
+ * \param cv structure conv
+ * \return colonnes, ou NULL pour le noyau direct
+ */
+static double* conv_col(conv_t* cv)
+{
+  if (cv->algo == CONV_DIRECT)
+    return NULL;
+
+  double* col = (double*)MEM_MALLOC((size_t)cv->c * cv->k * cv->k * cv->oh * cv->ow * sizeof(*col));
+  assert(col);
+  return col;
+}
+
+/**
+ * Vérifier les dimensions des matrices d'une couche.
+ *
+ * \param cond condition
+ */
+static void conv_check(int cond)
+{
+  if (!cond) {
+    fprintf(stderr, "Error: bad matrix structures while conv. \n");
+    exit(1);
+  }
+}
+
+/**
+ * Nombre d'opérations flottantes d'une convolution sur un lot.
+ *
+ * \param cv structure conv
+ * \param batch taille du lot
+ * \return nombre d'opérations flottantes
+ */
+static double conv_flops(conv_t* cv, int batch)
+{
+  return 2.0 * batch * cv->c * cv->k * cv->k * cv->oc * cv->oh * cv->ow;
+}
+
+/**
+ * Propagation avant de la couche, z = conv(act) + b, une image par ligne.
+ *
+ * \param cv structure conv
+ * \param z pré-activation (batch x taille de sortie)
+ * \param act activation de la couche précédente (batch x taille d'entrée)
+ * \param w poids
+ * \param b biais
+ * \return nombre d'opérations flottantes
+ */
+double conv_forward(conv_t* cv, matrix_t* z, matrix_t* act, matrix_t* w, matrix_t* b)
+{
+  int n, ch, q, chans = conv_out_channels(cv), area = conv_out_size(cv) / chans;
+  conv_check(act->cols == conv_in_size(cv) && z->cols == conv_out_size(cv) && z->rows == act->rows);
+
+  PROF_KBEGIN(PROF_K_CONV);
+  double* col = conv_col(cv);
+  for (n = 0; n < act->rows; n++) {
+    double* x = act->data + n * act->cols;
+    double* y = z->data + n * z->cols;
+    if (cv->transposed)
+      conv_adjoint(cv, x, w->data, y, col);
+    else
+      conv_apply(cv, x, w->data, y, col);
+
+    for (ch = 0; ch < chans; ch++)
+      for (q = 0; q < area; q++)
+        y[ch * area + q] += b->data[ch];
+  }
+  MEM_FREE(col);
+
+  double flops = conv_flops(cv, act->rows) + (double)z->rows * z->cols;
+  PROF_KEND(PROF_K_CONV, flops);
+  return flops;
+}
+
+/**
+ * Gradient par rapport à l'entrée de la couche (équivalent de
+ * dx = dz . w^T pour une couche dense).
+ *
+ * \param cv structure conv
+ * \param dx gradient de l'entrée (batch x taille d'entrée)
+ * \param dz gradient de la pré-activation (batch x taille de sortie)
+ * \param w poids
+ * \return nombre d'opérations flottantes
+ */
+double conv_backward_input(conv_t* cv, matrix_t* dx, matrix_t* dz, matrix_t* w)
+{
+  int n;
+  conv_check(dx->cols == conv_in_size(cv) && dz->cols == conv_out_size(cv) && dz->rows == dx->rows);
+
+  PROF_KBEGIN(PROF_K_CONV_INPUT);
+  double* col = conv_col(cv);
+  for (n = 0; n < dz->rows; n++) {
+    double* x = dx->data + n * dx->cols;
+    double* y = dz->data + n * dz->cols;
+    if (cv->transposed)
+      conv_apply(cv, y, w->data, x, col);
+    else
+      conv_adjoint(cv, y, w->data, x, col);
+  }
+  MEM_FREE(col);
+
+  double flops = conv_flops(cv, dz->rows);
+  PROF_KEND(PROF_K_CONV_INPUT, flops);
+  return flops;
+}
+
+/**
+ * Gradient des poids de la couche (équivalent de dw = act^T . dz pour
+ * une couche dense), sommé sur le lot.
+ *
+ * \param cv structure conv
+ * \param dw gradient des poids (écrasé)
+ * \param act activation de la couche précédente
+ * \param dz gradient de la pré-activation
+ * \return nombre d'opérations flottantes
+ */
+double conv_backward_weight(conv_t* cv, matrix_t* dw, matrix_t* act, matrix_t* dz)
+{
+  int n;
+  conv_check(act->cols == conv_in_size(cv) && dz->cols == conv_out_size(cv) &&
+    dw->rows == cv->c * cv->k * cv->k && dw->cols == cv->oc);
+
+  PROF_KBEGIN(PROF_K_CONV_WEIGHT);
+  double* col = conv_col(cv);
+  memset(dw->data, 0, dw->rows * dw->cols * sizeof(*dw->data));
+  for (n = 0; n < dz->rows; n++) {
+    double* x = act->data + n * act->cols;
+    double* y = dz->data + n * dz->cols;
+    if (cv->transposed)
+      conv_weight(cv, y, x, dw->data, col);
+    else
+      conv_weight(cv, x, y, dw->data, col);
+  }
+  MEM_FREE(col);
+
+  double flops = conv_flops(cv, dz->rows);
+  PROF_KEND(PROF_K_CONV_WEIGHT, flops);
+  return flops;
+}
+
+/**
+ * Gradient des biais de la couche : somme de dz par canal de sortie,
+ * sur le lot et les positions.
+ *
+ * \param cv structure conv
+ * \param db gradient des biais (écrasé)
+ * \param dz gradient de la pré-activation
+ * \return nombre d'opérations flottantes
+ */
+double conv_backward_bias(conv_t* cv, matrix_t* db, matrix_t* dz)
+{
+  int n, ch, q, chans = conv_out_channels(cv), area = conv_out_size(cv) / chans;
+  conv_check(db->cols == chans && dz->cols == conv_out_size(cv));
+
+  PROF_KBEGIN(PROF_K_SUM_AXIS0);
+  for (ch = 0; ch < chans; ch++) {
+    double sum = 0.0;
+    for (n = 0; n < dz->rows; n++)
+      for (q = 0; q < area; q++)
+        sum += dz->data[n * dz->cols + ch * area + q];
+    db->data[ch] = sum;
+  }
+  PROF_KEND(PROF_K_SUM_AXIS0, (double)dz->rows * dz->cols);
+  return (double)dz->rows * dz->cols;
+}
@@ -0,0 +1,61 @@
+/*!
+ * \file conv.h
+ * \brief Fichier header de conv.c
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#ifndef _CONV_H_
+#define _CONV_H_
+
+#include "matrix.h"
+
+// Taille du noyau des couches convolutives du GAN (DCGAN)
+#define CONV_KERNEL 4
+// Pas des couches convolutives du GAN
+#define CONV_STRIDE 2
+// Marge des couches convolutives du GAN
+#define CONV_PAD 1
+// Nombre max. de canaux de sortie (de la convolution) pour le noyau direct
+#define CONV_DIRECT_MAX_OC 4
+// Nombre de canaux de sortie traités ensemble par le noyau direct
+#define CONV_DIRECT_OC 4
+// Taille des blocs du produit matriciel (im2col)
+#define CONV_BLOCK 64
+
+/* Enumération pour le choix du noyau de convolution */
+enum CONV_ALGO_E {
+  CONV_AUTO = 0,
+  CONV_IM2COL,
+  CONV_DIRECT
+};
+
+typedef struct conv conv_t;
+/* Structure représentant une couche convolutive (ou transposée).
+ * Une image est stockée sur une ligne de matrice, au format CHW.
+ * Les poids sont une matrice (c * k * k) x oc de la convolution
+ * (c, h, w) -> (oc, oh, ow) ; une convolution transposée utilise la
+ * convolution inverse (sortie -> entrée) et son adjoint. */
+struct conv {
+  int transposed; // convolution transposée
+  int algo; // noyau utilisé (CONV_IM2COL ou CONV_DIRECT)
+  int c, h, w; // dimensions de l'entrée de la convolution
+  int oc, oh, ow; // dimensions de la sortie de la convolution
+  int k; // taille du noyau
+  int stride; // pas
+  int pad; // marge
+};
+
+conv_t* conv_init(int, int, int, int, int, int, int, int, int);
+int conv_in_size(conv_t*);
+int conv_out_size(conv_t*);
+int conv_out_channels(conv_t*);
+int conv_in_channels(conv_t*);
+int conv_fan_in(conv_t*);
+matrix_t* conv_init_weights(conv_t*);
+matrix_t* conv_init_bias(conv_t*);
+double conv_forward(conv_t*, matrix_t*, matrix_t*, matrix_t*, matrix_t*);
+double conv_backward_input(conv_t*, matrix_t*, matrix_t*, matrix_t*);
+double conv_backward_weight(conv_t*, matrix_t*, matrix_t*, matrix_t*);
+double conv_backward_bias(conv_t*, matrix_t*, matrix_t*);
+const char* conv_algo_name(int);
+
+#endif
@@ -0,0 +1,298 @@
+/*!
+ * \file fastmath.c
+ * \brief Fichier comprenant les fonctions transcendantes des activations et
+ * des pertes (tanh, sigmoïde, log) à plusieurs niveaux de précision : libm,
+ * ou approximations polynomiales sans appel de fonction ni branchement,
+ * vectorisées par le compilateur. Le niveau est choisi par FAST_MATH
+ * dans gan.cfg.
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include "fastmath.h"
+
+// log2(e)
+#define FM_LOG2E 1.4426950408889634
+// ln(2) en deux parties (réduction de l'argument sans perte)
+#define FM_LN2_HI 6.93147180369123816490e-01
+#define FM_LN2_LO 1.90821492927058770002e-10
+// 1.5 * 2^52 : ajouté à un double, arrondit à l'entier le plus proche
+#define FM_ROUND 6755399441055744.0
+// Argument min. de l'exponentielle (résultat normalisé)
+#define FM_EXP_MIN -708.0
+
+// Niveau de précision courant
+static int fm_tier = FM_EXACT;
+
+/**
+ * Choisir le niveau de précision des fonctions transcendantes
+ * (avant le démarrage des threads d'apprentissage).
+ *
+ * \param tier niveau de précision (FM_TIER_E)
+ */
+void fm_set_tier(int tier)
+{
+  if (tier < 0 || tier >= FM_NB_TIERS) {
+    fprintf(stderr, "Error: invalid fast math tier %d (0 to %d). \n", tier, FM_NB_TIERS - 1);
+    exit(1);
+  }
+  fm_tier = tier;
+}
+
+/**
+ * Niveau de précision courant.
+ *
+ * \return niveau de précision
+ */
+int fm_get_tier(void)
+{
+  return fm_tier;
+}
+
+/**
+ * Nom d'un niveau de précision.
+ *
+ * \param tier niveau de précision
+ * \return nom du niveau
+ */
+const char* fm_tier_name(int tier)
+{
+  switch (tier) {
+  case FM_1E7:
+    return "1e-7";
+  case FM_1E4:
+    return "1e-4";
+  default:
+    return "exact";
+  }
+}
+
+/**
+ * Erreur absolue max. garantie d'un niveau de précision, sur tanh,
+ * sa dérivée, la sigmoïde et log (vérifiée par gan_bench).
+ *
+ * \param tier niveau de précision
+ * \return erreur absolue max.
+ */
+double fm_tier_bound(int tier)
+{
+  switch (tier) {
+  case FM_1E7:
+    return 1e-7;
+  case FM_1E4:
+    return 1e-4;
+  default:
+    return 0.0;
+  }
+}
+
+/**
+ * Exponentielle approchée : x = k * ln(2) + r avec |r| <= ln(2) / 2,
+ * e^r par son développement de Taylor (degré 7 ou 4 selon le niveau,
+ * erreur relative ~1e-8 ou ~6e-5), et 2^k construit dans l'exposant.
+ *
+ * \param x argument (inférieur à 709)
+ * \param tier niveau de précision (constante après inlining)
+ * \return e^x
+ */
+static inline double fm_exp(double x, int tier)
+{
+  uint64_t u;
+  double p, scale;
+
+  x = x < FM_EXP_MIN ? FM_EXP_MIN : x;
+  double kd = x * FM_LOG2E + FM_ROUND;
+  double k = kd - FM_ROUND;
+  double r = x - k * FM_LN2_HI - k * FM_LN2_LO;
+
+  if (tier == FM_1E7)
+    p = 1.0 + r * (1.0 + r * (1.0 / 2 + r * (1.0 / 6 + r * (1.0 / 24 + r * (1.0 / 120 +
+      r * (1.0 / 720 + r * (1.0 / 5040)))))));
+  else
+    p = 1.0 + r * (1.0 + r * (1.0 / 2 + r * (1.0 / 6 + r * (1.0 / 24))));
+
+  // Les bits de poids faible de kd contiennent k
+  memcpy(&u, &kd, sizeof(u));
+  u = (u + 1023) << 52;
+  memcpy(&scale, &u, sizeof(scale));
+  return p * scale;
+}
+
+/**
+ * tanh approchée : (1 - e) / (1 + e) avec e = exp(-2|x|), puis signe de x.
+ *
+ * \param x argument
+ * \param tier niveau de précision
+ * \return tanh(x)
+ */
+static inline double fm_tanh_approx(double x, int tier)
+{
+  double e = fm_exp(-2.0 * fabs(x), tier);
+  double t = (1.0 - e) / (1.0 + e);
+  return x < 0 ? -t : t;
+}
+
+/**
+ * Sigmoïde approchée à partir de e = exp(-|x|) (pas de dépassement).
+ *
+ * \param x argument
+ * \param tier niveau de précision
+ * \return 1 / (1 + exp(-x))
+ */
+static inline double fm_sigmoid_approx(double x, int tier)
+{
+  double e = fm_exp(-fabs(x), tier);
+  double inv = 1.0 / (1.0 + e);
+  return x < 0 ? e * inv : inv;
+}
+
+/**
+ * Appliquer tanh sur 'n' valeurs.
+ *
+ * \param y résultats
+ * \param x arguments
+ * \param n nombre de valeurs
+ */
+void fm_tanh(double* y, const double* x, int n)
+{
+  int i;
+  switch (fm_tier) {
+  case FM_1E7:
+    for (i = 0; i < n; i++)
+      y[i] = fm_tanh_approx(x[i], FM_1E7);
+    break;
+  case FM_1E4:
+    for (i = 0; i < n; i++)
+      y[i] = fm_tanh_approx(x[i], FM_1E4);
+    break;
+  default:
+    for (i = 0; i < n; i++)
+      y[i] = tanh(x[i]);
+  }
+}
+
+/**
+ * Appliquer la dérivée de tanh (1 - tanh(x)^2) sur 'n' valeurs.
+ *
+ * \param y résultats
+ * \param x arguments
+ * \param n nombre de valeurs
+ */
+void fm_dtanh(double* y, const double* x, int n)
+{
+  int i;
+  double t;
+  switch (fm_tier) {
+  case FM_1E7:
+    for (i = 0; i < n; i++) {
+      t = fm_tanh_approx(x[i], FM_1E7);
+      y[i] = 1.0 - t * t;
+    }
+    break;
+  case FM_1E4:
+    for (i = 0; i < n; i++) {
+      t = fm_tanh_approx(x[i], FM_1E4);
+      y[i] = 1.0 - t * t;
+    }
+    break;
+  default:
+    for (i = 0; i < n; i++)
+      y[i] = 1.0 - pow(tanh(x[i]), 2);
+  }
+}
+
+/**
+ * Appliquer la sigmoïde sur 'n' valeurs.
+ *
+ * \param y résultats
+ * \param x arguments
+ * \param n nombre de valeurs
+ */
+void fm_sigmoid(double* y, const double* x, int n)
+{
+  int i;
+  switch (fm_tier) {
+  case FM_1E7:
+    for (i = 0; i < n; i++)
+      y[i] = fm_sigmoid_approx(x[i], FM_1E7);
+    break;
+  case FM_1E4:
+    for (i = 0; i < n; i++)
+      y[i] = fm_sigmoid_approx(x[i], FM_1E4);
+    break;
+  default:
+    for (i = 0; i < n; i++)
+      y[i] = 1 / (1 + exp(-x[i]));
+  }
+}
+
+/**
+ * Logarithme népérien approché : x = m * 2^e avec m dans [sqrt(2) / 2,
+ * sqrt(2)[, log(m) = 2 atanh(s) avec s = (m - 1) / (m + 1), |s| < 0.172,
+ * par sa série (jusqu'à s^7 ou s^3 selon le niveau). L'exposant est
+ * converti en double par les bits (pas de conversion entière vectorielle).
+ * Valable pour les doubles normalisés positifs.
+ *
+ * \param x argument
+ * \param tier niveau de précision (constante après inlining)
+ * \return log(x)
+ */
+static inline double fm_log_approx(double x, int tier)
+{
+  uint64_t u, eu;
+  double m, e, s, s2, p;
+
+  memcpy(&u, &x, sizeof(u));
+  // 2^52 + exposant biaisé, puis soustraction de 2^52 + 1023
+  eu = (u >> 52) | 0x4330000000000000ULL;
+  memcpy(&e, &eu, sizeof(e));
+  e -= 4503599627371519.0;
+  u = (u & 0x000fffffffffffffULL) | 0x3ff0000000000000ULL;
+  memcpy(&m, &u, sizeof(m));
+
+  e = m > M_SQRT2 ? e + 1.0 : e;
+  m = m > M_SQRT2 ? m * 0.5 : m;
+  s = (m - 1.0) / (m + 1.0);
+  s2 = s * s;
+  if (tier == FM_1E7)
+    p = 1.0 + s2 * (1.0 / 3 + s2 * (1.0 / 5 + s2 * (1.0 / 7)));
+  else
+    p = 1.0 + s2 * (1.0 / 3);
+  return e * M_LN2 + 2.0 * s * p;
+}
+
+/**
+ * Appliquer le logarithme népérien sur 'n' valeurs. Les valeurs hors des
+ * doubles normalisés positifs (0, infini, NaN, dénormalisés) sont
+ * recalculées par libm ('y' et 'x' distincts).
+ *
+ * \param y résultats
+ * \param x arguments
+ * \param n nombre de valeurs
+ */
+void fm_log(double* y, const double* x, int n)
+{
+  int i;
+  switch (fm_tier) {
+  case FM_1E7:
+    for (i = 0; i < n; i++)
+      y[i] = fm_log_approx(x[i], FM_1E7);
+    break;
+  case FM_1E4:
+    for (i = 0; i < n; i++)
+      y[i] = fm_log_approx(x[i], FM_1E4);
+    break;
+  default:
+    for (i = 0; i < n; i++)
+      y[i] = log(x[i]);
+    return;
+  }
+
+  for (i = 0; i < n; i++)
+    if (!(x[i] >= DBL_MIN && x[i] <= DBL_MAX))
+      y[i] = log(x[i]);
+}
@@ -0,0 +1,26 @@
+/*!
+ * \file fastmath.h
+ * \brief Fichier header de fastmath.c
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#ifndef _FASTMATH_H_
+#define _FASTMATH_H_
+
+/* Enumération pour les niveaux de précision des fonctions transcendantes */
+enum FM_TIER_E {
+  FM_EXACT = 0, // libm (double précision)
+  FM_1E7, // approximations, erreur max. ~1e-7
+  FM_1E4, // approximations, erreur max. ~1e-4
+  FM_NB_TIERS
+};
+
+void fm_set_tier(int);
+int fm_get_tier(void);
+const char* fm_tier_name(int);
+double fm_tier_bound(int);
+void fm_tanh(double*, const double*, int);
+void fm_dtanh(double*, const double*, int);
+void fm_sigmoid(double*, const double*, int);
+void fm_log(double*, const double*, int);
+
+#endif
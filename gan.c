@@ -12,19 +12,16 @@
 #include <time.h>
 #include <math.h>
 #include "gan.h"
-
-// Minimum entre deux nombres
-#define MIN(a, b) \
-  ({ __typeof__ (a) _a = (a); \
-     __typeof__ (b) _b = (b); \
-   _a < _b ? _a : _b; })
+#include "mem.h"
+#include "prof.h"
+#include "trace.h"
+#include "fastmath.h"
+#include "gemm.h"
+#include "tune.h"
 
 // Constante 2 * PI
 #define _2PI 6.28
 
-// Constante pour fixer l'affichage a chaque 'n' iteration
-#define PRINT_EP 5
-
 /**
  * Générer un nombre aléatoire avec une distribution normale.
  * \return nombre aléatoire
@@ -36,36 +33,248 @@ static double normal_rand(void)
   return cos(_2PI * v2) * sqrt(-2. * log(v1));
 }
 
+/**
+ * Générer un nombre aléatoire avec une distribution normale,
+ * à partir d'une graine propre à l'appelant (utilisable par plusieurs threads).
+ * \param seed graine du générateur
+ * \return nombre aléatoire
+ */
+static double normal_rand_r(unsigned int* seed)
+{
+  double v1 = ((double)(rand_r(seed)) + 1.) / ((double)(RAND_MAX) + 1.);
+  double v2 = ((double)(rand_r(seed)) + 1.) / ((double)(RAND_MAX) + 1.);
+  return cos(_2PI * v2) * sqrt(-2. * log(v1));
+}
+
+/**
+ * Générer un nombre aléatoire avec une distribution normale, à partir de la
+ * graine de l'appelant si elle est donnée, de rand() sinon.
+ * \param seed graine du générateur (NULL : rand())
+ * \return nombre aléatoire
+ */
+static double normal_rand_s(unsigned int* seed)
+{
+  return seed ? normal_rand_r(seed) : normal_rand();
+}
+
+/**
+ * Nombre d'opérations flottantes d'un produit matriciel (m x k) . (k x n).
+ * 
+ * \param m nombre de lignes
+ * \param k dimension commune
+ * \param n nombre de colonnes
+ * \return nombre d'opérations flottantes
+ */
+static inline double dot_flops(int m, int k, int n)
+{
+  return 2.0 * m * k * n;
+}
+
+/**
+ * Propagation avant d'une couche, dense (z = act . w + b) ou convolutive.
+ *
+ * \param conv couche convolutive (NULL : couche dense)
+ * \param z pré-activation
+ * \param act activation de la couche précédente
+ * \param w poids
+ * \param b biais
+ * \return nombre d'opérations flottantes
+ */
+static double layer_forward(conv_t* conv, matrix_t* z, matrix_t* act, matrix_t* w, matrix_t* b)
+{
+  if (conv)
+    return conv_forward(conv, z, act, w, b) + (double)z->rows * z->cols;
+
+  gemm_sum_z_act(z, act, w, b);
+  return dot_flops(act->rows, w->rows, w->cols) + 2.0 * z->rows * z->cols;
+}
+
+/**
+ * Gradient par rapport à l'entrée d'une couche (da = dz . w^T pour une
+ * couche dense).
+ *
+ * \param conv couche convolutive (NULL : couche dense)
+ * \param da gradient de l'entrée
+ * \param dz gradient de la pré-activation
+ * \param w poids
+ * \return nombre d'opérations flottantes
+ */
+static double layer_backward_input(conv_t* conv, matrix_t* da, matrix_t* dz, matrix_t* w)
+{
+  if (conv)
+    return conv_backward_input(conv, da, dz, w);
+
+  gemm_dot_right(da, dz, w);
+  return dot_flops(da->rows, dz->cols, da->cols);
+}
+
+/**
+ * Gradient des poids d'une couche (dw = act^T . dz pour une couche dense).
+ *
+ * \param conv couche convolutive (NULL : couche dense)
+ * \param dw gradient des poids
+ * \param act activation de la couche précédente
+ * \param dz gradient de la pré-activation
+ * \return nombre d'opérations flottantes
+ */
+static double layer_backward_weight(conv_t* conv, matrix_t* dw, matrix_t* act, matrix_t* dz)
+{
+  if (conv)
+    return conv_backward_weight(conv, dw, act, dz);
+
+  gemm_dot_left(dw, act, dz);
+  return dot_flops(act->cols, act->rows, dz->cols);
+}
+
+/**
+ * Gradient des biais d'une couche (somme des lignes de dz pour une couche
+ * dense, somme par canal pour une couche convolutive).
+ *
+ * \param conv couche convolutive (NULL : couche dense)
+ * \param db gradient des biais
+ * \param dz gradient de la pré-activation
+ * \return nombre d'opérations flottantes
+ */
+static double layer_backward_bias(conv_t* conv, matrix_t* db, matrix_t* dz)
+{
+  if (conv)
+    return conv_backward_bias(conv, db, dz);
+
+  mat_sum_axis0_(db, dz);
+  return (double)dz->rows * dz->cols;
+}
+
+/**
+ * Initialiser le plongement des labels d'une première couche : une ligne
+ * par label, ajoutée à la pré-activation. Pour une couche dense, c'est
+ * exactement la concaténation d'un vecteur one-hot à l'entrée (les lignes
+ * de poids correspondantes), sans copier les entrées.
+ *
+ * \param nb_classes nombre de labels
+ * \param cols taille de la pré-activation
+ * \param fan_in nombre d'entrées de la couche (initialisation)
+ * \param seed graine de l'initialisation (NULL : rand())
+ * \return matrice du plongement
+ */
+static matrix_t* init_embedding(int nb_classes, int cols, int fan_in, unsigned int* seed)
+{
+  int n;
+  matrix_t* e = mat_zinit(nb_classes, cols);
+  for (n = 0; n < e->rows * e->cols; n++)
+    e->data[n] = normal_rand_s(seed) * sqrt(2.0 / (fan_in + nb_classes));
+  return e;
+}
+
+/**
+ * Ajouter le plongement du label de chaque ligne à la pré-activation.
+ *
+ * \param z pré-activation
+ * \param e plongement des labels
+ * \param labels label de chaque ligne
+ * \return nombre d'opérations flottantes
+ */
+static double layer_embedding(matrix_t* z, matrix_t* e, const unsigned int* labels)
+{
+  int r, c;
+  for (r = 0; r < z->rows; r++) {
+    double* row = e->data + labels[r] * e->cols;
+    for (c = 0; c < z->cols; c++)
+      z->data[r * z->cols + c] += row[c];
+  }
+  return (double)z->rows * z->cols;
+}
+
+/**
+ * Gradient du plongement des labels : somme des lignes de dz par label.
+ *
+ * \param de gradient du plongement
+ * \param dz gradient de la pré-activation
+ * \param labels label de chaque ligne
+ * \return nombre d'opérations flottantes
+ */
+static double layer_backward_embedding(matrix_t* de, matrix_t* dz, const unsigned int* labels)
+{
+  int r, c;
+  memset(de->data, 0, de->rows * de->cols * sizeof(*de->data));
+  for (r = 0; r < dz->rows; r++) {
+    double* row = de->data + labels[r] * de->cols;
+    for (c = 0; c < dz->cols; c++)
+      row[c] += dz->data[r * dz->cols + c];
+  }
+  return (double)dz->rows * dz->cols;
+}
+
+/**
+ * Savoir si la couche 'i' du generator est normalisée (couches cachées,
+ * hors couche convolutive transposée).
+ *
+ * \param cfg structure config
+ * \param conv couches convolutives transposées (NULL : couche dense)
+ * \param i indice de la couche
+ * \return 1 si la couche est normalisée
+ */
+static int generator_bn(config_t* cfg, conv_t** conv, int i)
+{
+  return cfg->bn_g && i < cfg->nb_layers - 2 && !(conv[i] && conv[i]->transposed);
+}
+
 /**
  * Initialiser le generator pour le GAN.
  * 
  * \param cfg structure config
  * \param layers_sz_g taille de la couche d'entrée (generator)
+ * \param conv couches convolutives transposées (NULL : couche dense)
+ * \param shared generator dont les poids, biais et normalisations sont partagés (NULL pour de nouveaux poids)
+ * \param ck recalcul des activations (NULL : toutes gardées)
+ * \param seed graine de l'initialisation des poids (NULL : rand())
  * \return la structure generator
  */
-static generator_t* init_generator(config_t* cfg, unsigned int* layers_sz_g)
+static generator_t* init_generator(config_t* cfg, unsigned int* layers_sz_g, conv_t** conv, generator_t* shared,
+  ckpt_t* ck, unsigned int* seed)
 {
-  matrix_t** w_g = (matrix_t**)malloc((cfg->nb_layers - 1) * sizeof(*w_g));
+  matrix_t** w_g = shared ? shared->w : (matrix_t**)malloc((cfg->nb_layers - 1) * sizeof(*w_g));
   assert(w_g);
-  matrix_t** b_g = (matrix_t**)malloc((cfg->nb_layers - 1) * sizeof(*b_g));
+  matrix_t** b_g = shared ? shared->b : (matrix_t**)malloc((cfg->nb_layers - 1) * sizeof(*b_g));
   assert(b_g);
   matrix_t** z_g = (matrix_t**)malloc((cfg->nb_layers - 1) * sizeof(*z_g));
   assert(z_g);
   matrix_t** a_g = (matrix_t**)malloc((cfg->nb_layers - 1) * sizeof(*a_g));
   assert(a_g);
+  bn_t** bn_g = (bn_t**)calloc(cfg->nb_layers - 1, sizeof(*bn_g));
+  assert(bn_g);
 
-  int r, c, i, g_rows;
+  int r, c, i, g_rows, fan_in, chans;
   for (i = 0; i < cfg->nb_layers - 1; i++) {
     g_rows = (i == 0) ? cfg->batch_sz : a_g[i - 1]->rows;
 
-    w_g[i] = mat_zinit(layers_sz_g[i], layers_sz_g[i + 1]);
-    b_g[i] = mat_zinit(1, layers_sz_g[i + 1]);
-    a_g[i] = mat_zinit(g_rows, w_g[i]->cols);
-    z_g[i] = mat_zinit(g_rows, w_g[i]->cols);
+    // Normalisation des couches cachées (par canal si la couche est une carte)
+    if (generator_bn(cfg, conv, i)) {
+      chans = conv[i] ? conv_out_channels(conv[i]) :
+        conv[i + 1] ? conv_in_channels(conv[i + 1]) : layers_sz_g[i + 1];
+      bn_g[i] = bn_init(g_rows, chans, layers_sz_g[i + 1] / chans, shared ? shared->bn[i] : NULL);
+    }
+
+    if (!shared) {
+      w_g[i] = conv[i] ? conv_init_weights(conv[i]) : mat_zinit(layers_sz_g[i], layers_sz_g[i + 1]);
+      b_g[i] = conv[i] ? conv_init_bias(conv[i]) : mat_zinit(1, layers_sz_g[i + 1]);
+      if (!conv[i])
+        mat_pack_init(w_g[i]);
+    }
+    // Couches recalculées : zones partagées
+    a_g[i] = ckpt_view(ck, CKPT_G, i, 1);
+    z_g[i] = ckpt_view(ck, CKPT_G, i, 0);
+    if (!a_g[i]) {
+      a_g[i] = mat_zinit(g_rows, layers_sz_g[i + 1]);
+      z_g[i] = mat_zinit(g_rows, layers_sz_g[i + 1]);
+    }
+
+    if (shared)
+      continue;
 
-    for (r = 0; r < layers_sz_g[i]; r++)
-      for (c = 0; c < layers_sz_g[i + 1]; c++)
-        w_g[i]->data[r * w_g[i]->cols + c] = normal_rand() * sqrt(2.0 / layers_sz_g[i]);
+    fan_in = conv[i] ? conv_fan_in(conv[i]) : layers_sz_g[i];
+    for (r = 0; r < w_g[i]->rows; r++)
+      for (c = 0; c < w_g[i]->cols; c++)
+        w_g[i]->data[r * w_g[i]->cols + c] = normal_rand_s(seed) * sqrt(2.0 / fan_in);
   }
 
   generator_t* gen = (generator_t*)malloc(sizeof(*gen));
@@ -75,6 +284,12 @@ static generator_t* init_generator(config_t* cfg, unsigned int* layers_sz_g)
   gen->b = b_g;
   gen->z = z_g;
   gen->a = a_g;
+  gen->conv = conv;
+  gen->bn = bn_g;
+  gen->e = NULL;
+  if (cfg->cond)
+    gen->e = shared ? shared->e : init_embedding(MNIST_NUM_CLASSES, layers_sz_g[1],
+      conv[0] ? conv_fan_in(conv[0]) : layers_sz_g[0], seed);
 
   return gen;
 }
@@ -103,10 +318,10 @@ static generator_t* init_der_generator(config_t* cfg, unsigned int* layers_sz_g,
   for (i = 0; i < cfg->nb_layers - 1; i++) {
     g_rows = (i == 0) ? cfg->batch_sz : gen->a[i - 1]->rows;
 
-    da_g[i] = mat_zinit(g_rows, gen->w[i]->cols);
-    dz_g[i] = mat_zinit(g_rows, gen->w[i]->cols);
-    dw_g[i] = mat_zinit(layers_sz_g[i], layers_sz_g[i + 1]);
-    db_g[i] = mat_zinit(1, layers_sz_g[i + 1]);
+    da_g[i] = mat_zinit(g_rows, layers_sz_g[i + 1]);
+    dz_g[i] = mat_zinit(g_rows, layers_sz_g[i + 1]);
+    dw_g[i] = mat_zinit(gen->w[i]->rows, gen->w[i]->cols);
+    db_g[i] = mat_zinit(1, gen->b[i]->cols);
   }
 
   generator_t* der_g = (generator_t*)malloc(sizeof(*gen));
@@ -116,6 +331,9 @@ static generator_t* init_der_generator(config_t* cfg, unsigned int* layers_sz_g,
   der_g->b = db_g;
   der_g->z = dz_g;
   der_g->a = da_g;
+  der_g->conv = gen->conv;
+  der_g->bn = gen->bn;
+  der_g->e = gen->e ? mat_zinit(gen->e->rows, gen->e->cols) : NULL;
 
   return der_g;
 }
@@ -125,13 +343,18 @@ static generator_t* init_der_generator(config_t* cfg, unsigned int* layers_sz_g,
  * 
  * \param cfg structure config
  * \param layers_sz_d taille de la couche d'entrée (discriminator)
+ * \param conv couches convolutives (NULL : couche dense)
+ * \param shared discriminator dont les poids et biais sont partagés (NULL pour de nouveaux poids)
+ * \param ck recalcul des activations (NULL : toutes gardées)
+ * \param seed graine de l'initialisation des poids (NULL : rand())
  * \return la structure discriminator
  */
-static discriminator_t* init_discriminator(config_t* cfg, unsigned int* layers_sz_d)
+static discriminator_t* init_discriminator(config_t* cfg, unsigned int* layers_sz_d, conv_t** conv,
+  discriminator_t* shared, ckpt_t* ck, unsigned int* seed)
 {
-  matrix_t** w_d = (matrix_t**)malloc((cfg->nb_layers - 1) * sizeof(*w_d));
+  matrix_t** w_d = shared ? shared->w : (matrix_t**)malloc((cfg->nb_layers - 1) * sizeof(*w_d));
   assert(w_d);
-  matrix_t** b_d = (matrix_t**)malloc((cfg->nb_layers - 1) * sizeof(*b_d));
+  matrix_t** b_d = shared ? shared->b : (matrix_t**)malloc((cfg->nb_layers - 1) * sizeof(*b_d));
   assert(b_d);
   matrix_t** z_d_fake = (matrix_t**)malloc((cfg->nb_layers - 1) * sizeof(*z_d_fake));
   assert(z_d_fake);
@@ -142,22 +365,35 @@ static discriminator_t* init_discriminator(config_t* cfg, unsigned int* layers_s
   matrix_t** a_d_real = (matrix_t**)malloc((cfg->nb_layers - 1) * sizeof(*a_d_real));
   assert(a_d_real);
 
-  int r, c, i, d_rows;
+  int r, c, i, d_rows, fan_in;
   for (i = 0; i < cfg->nb_layers - 1; i++) {
     d_rows = (i == 0) ? cfg->batch_sz : a_d_real[i - 1]->rows;
 
-    w_d[i] = mat_zinit(layers_sz_d[i], layers_sz_d[i + 1]);
-    b_d[i] = mat_zinit(1, layers_sz_d[i + 1]);
+    if (!shared) {
+      w_d[i] = conv[i] ? conv_init_weights(conv[i]) : mat_zinit(layers_sz_d[i], layers_sz_d[i + 1]);
+      b_d[i] = conv[i] ? conv_init_bias(conv[i]) : mat_zinit(1, layers_sz_d[i + 1]);
+      if (!conv[i])
+        mat_pack_init(w_d[i]);
+    }
 
-    a_d_fake[i] = mat_zinit(d_rows, w_d[i]->cols);
-    a_d_real[i] = mat_zinit(d_rows, w_d[i]->cols);
+    a_d_fake[i] = mat_zinit(d_rows, layers_sz_d[i + 1]);
+    z_d_fake[i] = mat_zinit(d_rows, layers_sz_d[i + 1]);
 
-    z_d_fake[i] = mat_zinit(d_rows, w_d[i]->cols);
-    z_d_real[i] = mat_zinit(d_rows, w_d[i]->cols);
+    // Couches recalculées (données réelles) : zones partagées
+    a_d_real[i] = ckpt_view(ck, CKPT_D_REAL, i, 1);
+    z_d_real[i] = ckpt_view(ck, CKPT_D_REAL, i, 0);
+    if (!a_d_real[i]) {
+      a_d_real[i] = mat_zinit(d_rows, layers_sz_d[i + 1]);
+      z_d_real[i] = mat_zinit(d_rows, layers_sz_d[i + 1]);
+    }
+
+    if (shared)
+      continue;
 
-    for (r = 0; r < layers_sz_d[i]; r++)
-      for (c = 0; c < layers_sz_d[i + 1]; c++)
-        w_d[i]->data[r * w_d[i]->cols + c] = normal_rand() * sqrt(2.0 / layers_sz_d[i]);
+    fan_in = conv[i] ? conv_fan_in(conv[i]) : layers_sz_d[i];
+    for (r = 0; r < w_d[i]->rows; r++)
+      for (c = 0; c < w_d[i]->cols; c++)
+        w_d[i]->data[r * w_d[i]->cols + c] = normal_rand_s(seed) * sqrt(2.0 / fan_in);
   }
 
   discriminator_t* dis = (discriminator_t*)malloc(sizeof(*dis));
@@ -169,6 +405,11 @@ static discriminator_t* init_discriminator(config_t* cfg, unsigned int* layers_s
   dis->a_fake = a_d_fake;
   dis->z_real = z_d_real;
   dis->a_real = a_d_real;
+  dis->conv = conv;
+  dis->e = NULL;
+  if (cfg->cond)
+    dis->e = shared ? shared->e : init_embedding(MNIST_NUM_CLASSES, layers_sz_d[1],
+      conv[0] ? conv_fan_in(conv[0]) : layers_sz_d[0], seed);
 
   return dis;
 }
@@ -188,6 +429,10 @@ static der_discriminator_t* init_der_discriminator(config_t* cfg, unsigned int*
   assert(da_d);
   matrix_t** dz_d = (matrix_t**)malloc((cfg->nb_layers - 1) * sizeof(*dz_d));
   assert(dz_d);
+  matrix_t** da_d_real = (matrix_t**)malloc((cfg->nb_layers - 1) * sizeof(*da_d_real));
+  assert(da_d_real);
+  matrix_t** dz_d_real = (matrix_t**)malloc((cfg->nb_layers - 1) * sizeof(*dz_d_real));
+  assert(dz_d_real);
   matrix_t** dw_d_real = (matrix_t**)malloc((cfg->nb_layers - 1) * sizeof(*dw_d_real));
   assert(dw_d_real);
   matrix_t** dw_d_fake = (matrix_t**)malloc((cfg->nb_layers - 1) * sizeof(*dw_d_fake));
@@ -201,12 +446,14 @@ static der_discriminator_t* init_der_discriminator(config_t* cfg, unsigned int*
   for (i = 0; i < cfg->nb_layers - 1; i++) {
     d_rows = (i == 0) ? cfg->batch_sz : dis->a_real[i - 1]->rows;
 
-    da_d[i] = mat_zinit(d_rows, dis->w[i]->cols);
-    dz_d[i] = mat_zinit(d_rows, dis->w[i]->cols);
-    dw_d_real[i] = mat_zinit(layers_sz_d[i], layers_sz_d[i + 1]);
-    dw_d_fake[i] = mat_zinit(layers_sz_d[i], layers_sz_d[i + 1]);
-    db_d_real[i] = mat_zinit(1, layers_sz_d[i + 1]);
-    db_d_fake[i] = mat_zinit(1, layers_sz_d[i + 1]);
+    da_d[i] = mat_zinit(d_rows, layers_sz_d[i + 1]);
+    dz_d[i] = mat_zinit(d_rows, layers_sz_d[i + 1]);
+    da_d_real[i] = mat_zinit(d_rows, layers_sz_d[i + 1]);
+    dz_d_real[i] = mat_zinit(d_rows, layers_sz_d[i + 1]);
+    dw_d_real[i] = mat_zinit(dis->w[i]->rows, dis->w[i]->cols);
+    dw_d_fake[i] = mat_zinit(dis->w[i]->rows, dis->w[i]->cols);
+    db_d_real[i] = mat_zinit(1, dis->b[i]->cols);
+    db_d_fake[i] = mat_zinit(1, dis->b[i]->cols);
   }
 
   der_discriminator_t* der_d = (der_discriminator_t*)malloc(sizeof(*der_d));
@@ -214,21 +461,56 @@ static der_discriminator_t* init_der_discriminator(config_t* cfg, unsigned int*
 
   der_d->a = da_d;
   der_d->z = dz_d;
+  der_d->a_real = da_d_real;
+  der_d->z_real = dz_d_real;
   der_d->w_real = dw_d_real;
   der_d->w_fake = dw_d_fake;
   der_d->b_real = db_d_real;
   der_d->b_fake = db_d_fake;
-  der_d->x = mat_zinit(dz_d[0]->rows, dis->w[0]->rows);
+  der_d->x = mat_zinit(dz_d[0]->rows, layers_sz_d[0]);
+  der_d->e_real = dis->e ? mat_zinit(dis->e->rows, dis->e->cols) : NULL;
+  der_d->e_fake = dis->e ? mat_zinit(dis->e->rows, dis->e->cols) : NULL;
 
   return der_d;
 }
 
 /**
- * Initialiser le modèle GAN avec les paramètres de config.
+ * Initialiser le modèle GAN avec les paramètres de config, les poids étant
+ * tirés à partir de la graine 'seed' (rand() si NULL). Les paramètres des
+ * noyaux communs au processus (précision des fonctions, implémentation des
+ * produits matriciels) ne sont fixés que si 'kernels' est non nul : ils
+ * restent sinon ceux du modèle qui les a fixés, les dimensions des couches
+ * étant seulement ajoutées aux noyaux spécialisés.
+ *
+ * \param cfg structure config
+ * \param seed graine de l'initialisation des poids (NULL : rand())
+ * \param kernels 1 : fixer les paramètres des noyaux, 0 : les conserver
  * \return structure GAN
  */
-gan_t* init_gan(config_t* cfg)
+gan_t* init_gan_r(config_t* cfg, unsigned int* seed, int kernels)
 {
+  int i, out = cfg->nb_layers - 2;
+  tune_t tune;
+  if (cfg->nb_layers < 3) {
+    fprintf(stderr, "Error: LAYERS must be at least 3 (%u). \n", cfg->nb_layers);
+    exit(1);
+  }
+  // Le LR de gan.cfg (0.001) est réglé pour 3 couches : un modèle plus
+  // profond peut diverger (pertes NaN) dès les premières itérations
+  if (cfg->nb_layers > 3 && cfg->learning_rate > DEEP_LR_MAX)
+    fprintf(stderr, "Warning: LR %g may diverge with LAYERS=%u, use LR <= %g. \n", cfg->learning_rate,
+      cfg->nb_layers, DEEP_LR_MAX);
+  if (cfg->checkpoint > 1 && (cfg->hogwild || cfg->pipeline || cfg->sched)) {
+    fprintf(stderr, "Error: CHECKPOINT is not supported with HOGWILD, PIPELINE or SCHED. \n");
+    exit(1);
+  }
+  // Dimensions des images (données déjà chargées, DATA_IMG ou MNIST sinon)
+  load_image_config(cfg);
+  if ((cfg->conv_d || cfg->conv_g) && (cfg->img_w % CONV_STRIDE || cfg->img_h % CONV_STRIDE)) {
+    fprintf(stderr, "Error: CONV_D and CONV_G need an even image size (%u x %u). \n", cfg->img_w, cfg->img_h);
+    exit(1);
+  }
+
   unsigned int* layers_sz_d = (unsigned int*)malloc(cfg->nb_layers * sizeof(*layers_sz_d));
   assert(layers_sz_d);
   unsigned int* layers_sz_g = (unsigned int*)malloc(cfg->nb_layers * sizeof(*layers_sz_g));
@@ -239,24 +521,80 @@ gan_t* init_gan(config_t* cfg)
   int* act_fn_d = (int*)malloc((cfg->nb_layers - 1) * sizeof(*act_fn_d));
   assert(act_fn_d);
 
-  // TODO: Automatiser avec une boucle
-  act_fn_g[0] = LRELU;
-  act_fn_g[1] = TANH;
-  act_fn_d[0] = LRELU;
-  act_fn_d[1] = SIGMOID;
+  // Couches cachées de même taille (HD_D / HD_G), LRELU puis la sortie
+  for (i = 0; i < cfg->nb_layers - 1; i++) {
+    act_fn_g[i] = i < out ? LRELU : TANH;
+    act_fn_d[i] = i < out ? LRELU : SIGMOID;
+    layers_sz_d[i + 1] = cfg->hd_layer_sz_d;
+    layers_sz_g[i + 1] = cfg->hd_layer_sz_g;
+  }
 
-  layers_sz_d[0] = MNIST_SIZE;
-  layers_sz_d[1] = cfg->hd_layer_sz_d;
-  layers_sz_d[2] = 1;
+  layers_sz_d[0] = cfg->img_sz;
+  layers_sz_d[out + 1] = 1;
 
   layers_sz_g[0] = cfg->in_layer_sz_g;
-  layers_sz_g[1] = cfg->hd_layer_sz_g;
-  layers_sz_g[2] = MNIST_SIZE;
+  layers_sz_g[out + 1] = cfg->img_sz;
+
+  conv_t** conv_g = (conv_t**)calloc(cfg->nb_layers - 1, sizeof(*conv_g));
+  assert(conv_g);
+  conv_t** conv_d = (conv_t**)calloc(cfg->nb_layers - 1, sizeof(*conv_d));
+  assert(conv_d);
+
+  // Paramètres des noyaux réglés par ./gan tune pour cette machine et ces
+  // dimensions, valeurs de gan.cfg sinon
+  tune_defaults(cfg, &tune);
+  int tuned = tune_load(cfg->tune_file, cfg, &tune);
+  if (tuned < 0) {
+    fprintf(stderr, "Error: bad tuning entry in %s. \n", cfg->tune_file);
+    exit(1);
+  }
+
+  // Couches convolutives (DCGAN) : la première couche cachée du
+  // discriminator / la dernière du generator devient une carte de
+  // 'conv_d' / 'conv_g' canaux de taille moitié (14 x 14 en 28 x 28)
+  if (cfg->conv_d) {
+    conv_d[0] = conv_init(cfg->img_ch, cfg->img_h, cfg->img_w, cfg->conv_d,
+      CONV_KERNEL, CONV_STRIDE, CONV_PAD, 0, tune.conv_algo_d);
+    layers_sz_d[1] = conv_out_size(conv_d[0]);
+  }
+  if (cfg->conv_g) {
+    conv_g[out] = conv_init(cfg->conv_g, cfg->img_h / CONV_STRIDE, cfg->img_w / CONV_STRIDE, cfg->img_ch,
+      CONV_KERNEL, CONV_STRIDE, CONV_PAD, 1, tune.conv_algo_g);
+    layers_sz_g[out] = conv_in_size(conv_g[out]);
+  }
+
+  if (kernels) {
+    // Précision des fonctions transcendantes (activations et pertes)
+    fm_set_tier(cfg->fast_math);
+    // Implémentation des produits matriciels des couches denses
+    gemm_set_backend(tune.gemm);
+    // Noyaux générés par kgen pour les dimensions des couches denses
+    // (noyaux génériques pour les autres dimensions)
+    gemm_set_spec(tune.kgen);
+  }
+  for (i = 0; i < cfg->nb_layers - 1; i++) {
+    if (!conv_g[i])
+      gemm_specialize(cfg->batch_sz, layers_sz_g[i], layers_sz_g[i + 1]);
+    if (!conv_d[i])
+      gemm_specialize(cfg->batch_sz, layers_sz_d[i], layers_sz_d[i + 1]);
+  }
+
+  // Recalcul des activations : une couche gardée toutes les 'checkpoint'
+  // couches (les couches normalisées restent gardées)
+  ckpt_t* ck = NULL;
+  if (cfg->checkpoint > 1) {
+    char* keep_g = (char*)malloc((cfg->nb_layers - 1) * sizeof(*keep_g));
+    assert(keep_g);
+    for (i = 0; i < cfg->nb_layers - 1; i++)
+      keep_g[i] = generator_bn(cfg, conv_g, i);
+    ck = ckpt_init(cfg->checkpoint, cfg->nb_layers - 1, cfg->batch_sz, layers_sz_g, layers_sz_d, keep_g);
+    free(keep_g);
+  }
 
   // generator
-  generator_t* gen = init_generator(cfg, layers_sz_g);
+  generator_t* gen = init_generator(cfg, layers_sz_g, conv_g, NULL, ck, seed);
   // discriminator
-  discriminator_t* dis = init_discriminator(cfg, layers_sz_d);
+  discriminator_t* dis = init_discriminator(cfg, layers_sz_d, conv_d, NULL, ck, seed);
   // derivées pour le generator
   generator_t* der_g = init_der_generator(cfg, layers_sz_g, gen);
   // derivées pour le discriminator
@@ -270,12 +608,19 @@ gan_t* init_gan(config_t* cfg)
   gan->act_fn_g = act_fn_g;
   gan->act_fn_d = act_fn_d;
   gan->nb_layers = cfg->nb_layers;
-  gan->hidden_layer_sz_d = cfg->hd_layer_sz_d;
-  gan->hidden_layer_sz_g = cfg->hd_layer_sz_g;
+  gan->hidden_layer_sz_d = layers_sz_d[1];
+  gan->hidden_layer_sz_g = layers_sz_g[1];
   gan->input_layer_sz_g = cfg->in_layer_sz_g;
   gan->lr = cfg->learning_rate;
   gan->dr = cfg->decay_rate;
   gan->epochs = cfg->epochs;
+  gan->infer = 0;
+  gan->nb_classes = cfg->cond ? MNIST_NUM_CLASSES : 0;
+  gan->labels = NULL;
+  gan->x_sparse = NULL;
+  gan->sparse_row = 0;
+  gan->tuned = tuned;
+  gan->ckpt = ck;
 
   gan->g = gen;
   gan->d = dis;
@@ -285,6 +630,248 @@ gan_t* init_gan(config_t* cfg)
   return gan;
 }
 
+/**
+ * Initialiser le modèle GAN avec les paramètres de config.
+ * \return structure GAN
+ */
+gan_t* init_gan(config_t* cfg)
+{
+  return init_gan_r(cfg, NULL, 1);
+}
+
+/**
+ * Initialiser une réplique du modèle GAN : les poids et les biais
+ * sont partagés avec le modèle passé en paramètre, seules les matrices
+ * intermédiaires (activations, dérivées) sont propres à la réplique.
+ * 
+ * \param cfg structure config
+ * \param gan modèle GAN dont les paramètres sont partagés
+ * \return structure GAN répliquée
+ */
+gan_t* init_gan_replica(config_t* cfg, gan_t* gan)
+{
+  gan_t* rep = (gan_t*)malloc(sizeof(*rep));
+  assert(rep);
+
+  *rep = *gan;
+  rep->g = init_generator(cfg, gan->layers_sz_g, gan->g->conv, gan->g, NULL, NULL);
+  rep->d = init_discriminator(cfg, gan->layers_sz_d, gan->d->conv, gan->d, NULL, NULL);
+  rep->ckpt = NULL;
+  rep->der_g = init_der_generator(cfg, gan->layers_sz_g, rep->g);
+  rep->der_d = init_der_discriminator(cfg, gan->layers_sz_d, rep->d);
+
+  return rep;
+}
+
+/**
+ * Libérer une réplique du modèle GAN (sans toucher aux paramètres partagés).
+ * 
+ * \param rep réplique créée par init_gan_replica
+ */
+void free_gan_replica(gan_t* rep)
+{
+  int i;
+  for (i = 0; i < rep->nb_layers - 1; i++) {
+    // Couches recalculées : libérées avec le recalcul (ckpt_free)
+    if (ckpt_kept(rep->ckpt, CKPT_G, i)) {
+      mat_free(rep->g->z[i]);
+      mat_free(rep->g->a[i]);
+    }
+    if (ckpt_kept(rep->ckpt, CKPT_D_REAL, i)) {
+      mat_free(rep->d->z_real[i]);
+      mat_free(rep->d->a_real[i]);
+    }
+    mat_free(rep->d->z_fake[i]);
+    mat_free(rep->d->a_fake[i]);
+    mat_free(rep->der_g->w[i]);
+    mat_free(rep->der_g->b[i]);
+    mat_free(rep->der_g->z[i]);
+    mat_free(rep->der_g->a[i]);
+    mat_free(rep->der_d->a[i]);
+    mat_free(rep->der_d->z[i]);
+    mat_free(rep->der_d->a_real[i]);
+    mat_free(rep->der_d->z_real[i]);
+    mat_free(rep->der_d->w_real[i]);
+    mat_free(rep->der_d->w_fake[i]);
+    mat_free(rep->der_d->b_real[i]);
+    mat_free(rep->der_d->b_fake[i]);
+    if (rep->g->bn[i])
+      bn_free(rep->g->bn[i], 0);
+  }
+  mat_free(rep->der_d->x);
+  if (rep->der_g->e) {
+    mat_free(rep->der_g->e);
+    mat_free(rep->der_d->e_real);
+    mat_free(rep->der_d->e_fake);
+  }
+
+  free(rep->g->z);
+  free(rep->g->a);
+  free(rep->g->bn);
+  free(rep->d->z_fake);
+  free(rep->d->z_real);
+  free(rep->d->a_fake);
+  free(rep->d->a_real);
+  free(rep->der_g->w);
+  free(rep->der_g->b);
+  free(rep->der_g->z);
+  free(rep->der_g->a);
+  free(rep->der_d->a);
+  free(rep->der_d->z);
+  free(rep->der_d->a_real);
+  free(rep->der_d->z_real);
+  free(rep->der_d->w_real);
+  free(rep->der_d->w_fake);
+  free(rep->der_d->b_real);
+  free(rep->der_d->b_fake);
+  free(rep->g);
+  free(rep->d);
+  free(rep->der_g);
+  free(rep->der_d);
+  free(rep);
+}
+
+/**
+ * Libérer le modèle GAN créé par init_gan, avec ses paramètres.
+ * 
+ * \param gan structure GAN
+ */
+void free_gan(gan_t* gan)
+{
+  int i;
+  for (i = 0; i < gan->nb_layers - 1; i++) {
+    mat_free(gan->g->w[i]);
+    mat_free(gan->g->b[i]);
+    mat_free(gan->d->w[i]);
+    mat_free(gan->d->b[i]);
+    if (gan->g->bn[i]) {
+      bn_free(gan->g->bn[i], 1);
+      gan->g->bn[i] = NULL;
+    }
+    free(gan->g->conv[i]);
+    free(gan->d->conv[i]);
+  }
+  if (gan->g->e) {
+    mat_free(gan->g->e);
+    mat_free(gan->d->e);
+  }
+
+  free(gan->g->w);
+  free(gan->g->b);
+  free(gan->d->w);
+  free(gan->d->b);
+  free(gan->g->conv);
+  free(gan->d->conv);
+  free(gan->layers_sz_d);
+  free(gan->layers_sz_g);
+  free(gan->act_fn_g);
+  free(gan->act_fn_d);
+  ckpt_t* ck = gan->ckpt;
+  free_gan_replica(gan);
+  ckpt_free(ck);
+}
+
+/**
+ * Propagation avant de la couche 'i' du generator.
+ *
+ * \param gan structure GAN
+ * \param i indice de la couche
+ * \param act activation de la couche précédente (donnée bruitée pour la première)
+ * \return nombre d'opérations flottantes
+ */
+static double generator_layer(gan_t* gan, int i, matrix_t* act)
+{
+  generator_t* gen = gan->g;
+  double flops = layer_forward(gen->conv[i], gen->z[i], act, gen->w[i], gen->b[i]);
+  if (i == 0 && gen->e)
+    flops += layer_embedding(gen->z[0], gen->e, gan->labels);
+
+  // Normalisation et activation fusionnées
+  if (gen->bn[i])
+    return flops + bn_forward(gen->bn[i], gen->z[i], gen->a[i], 0, !gan->infer);
+
+  switch (gan->act_fn_g[i]) {
+  case LRELU:
+    mat_lrelu_(gen->a[i], gen->z[i], 0);
+    break;
+  case TANH:
+    mat_tanh_(gen->a[i], gen->z[i]);
+    break;
+  default:
+    fprintf(stderr, "Error: invalid activation function. \n");
+    exit(1);
+  }
+  return flops;
+}
+
+/**
+ * Propagation avant de la couche 'i' du discriminator.
+ *
+ * \param gan structure GAN
+ * \param i indice de la couche
+ * \param act activation de la couche précédente (image pour la première)
+ * \param real booléen pour l'image générée ou source
+ * \return nombre d'opérations flottantes
+ */
+static double discriminator_layer(gan_t* gan, int i, matrix_t* act, int real)
+{
+  discriminator_t* dis = gan->d;
+  matrix_t* z = real ? dis->z_real[i] : dis->z_fake[i];
+  matrix_t* a = real ? dis->a_real[i] : dis->a_fake[i];
+  double flops;
+
+  if (i == 0 && real && gan->x_sparse)
+    flops = sparse_sum_z_act(z, gan->x_sparse, gan->sparse_row, dis->w[0], dis->b[0]);
+  else
+    flops = layer_forward(dis->conv[i], z, act, dis->w[i], dis->b[i]);
+  if (i == 0 && dis->e)
+    flops += layer_embedding(z, dis->e, gan->labels);
+
+  switch (gan->act_fn_d[i]) {
+  case LRELU:
+    mat_lrelu_(a, z, 1e-2);
+    break;
+  case SIGMOID:
+    mat_sigmoid_(a, z);
+    break;
+  default:
+    fprintf(stderr, "Error: invalid activation function. \n");
+    exit(1);
+  }
+  return flops;
+}
+
+/**
+ * Recalculer les activations de la couche 'i' d'un chemin si sa zone
+ * partagée est occupée par une autre couche : tout son segment est
+ * recalculé à partir de la couche gardée précédente (ou de l'entrée de la
+ * dernière propagation avant du chemin).
+ *
+ * \param gan structure GAN
+ * \param path chemin de la propagation avant (CKPT_G, CKPT_D_REAL, CKPT_D_FAKE)
+ * \param i indice de la couche (rien à faire si négatif)
+ */
+static void checkpoint_fetch(gan_t* gan, int path, int i)
+{
+  ckpt_t* ck = gan->ckpt;
+  if (i < 0 || ckpt_resident(ck, path, i))
+    return;
+
+  int j, real = path == CKPT_D_REAL;
+  double flops = 0.0;
+  matrix_t** a = path == CKPT_G ? gan->g->a : real ? gan->d->a_real : gan->d->a_fake;
+
+  PROF_BEGIN(PROF_RECOMPUTE);
+  for (j = ckpt_first(ck, path, i); !ckpt_kept(ck, path, j); j++) {
+    matrix_t* act = j == 0 ? ck->in[path] : a[j - 1];
+    flops += path == CKPT_G ? generator_layer(gan, j, act) : discriminator_layer(gan, j, act, real);
+    ckpt_mark(ck, path, j);
+    ck->layers++;
+  }
+  ck->flops += flops;
+  PROF_END(PROF_RECOMPUTE, flops);
+}
+
 /**
  * Génère une image par rapport au label demandé
  * avec le generator, à partir de données bruitées.
@@ -294,24 +881,20 @@ gan_t* init_gan(config_t* cfg)
 void forward_generator(gan_t* gan, matrix_t* z)
 {
   int i;
+  double flops = 0.0;
   matrix_t* act = z;
-  generator_t* gen = gan->g;
-  for (i = 0; i < gan->nb_layers - 1; i++) {
-    mat_sum_z_act(gen->z[i], act, gen->w[i], gen->b[i]);
 
-    switch (gan->act_fn_g[i]) {
-    case LRELU:
-      mat_lrelu_(gen->a[i], gen->z[i], 0);
-      break;
-    case TANH:
-      mat_tanh_(gen->a[i], gen->z[i]);
-      break;
-    default:
-      fprintf(stderr, "Error: invalid activation function. \n");
-      exit(1);
-    }
-    act = gen->a[i];
+  PROF_BEGIN(PROF_FORWARD_G);
+  for (i = 0; i < gan->nb_layers - 1; i++) {
+    flops += generator_layer(gan, i, act);
+    ckpt_mark(gan->ckpt, CKPT_G, i);
+    act = gan->g->a[i];
+  }
+  if (gan->ckpt) {
+    gan->ckpt->in[CKPT_G] = z;
+    gan->ckpt->fwd_flops += flops;
   }
+  PROF_END(PROF_FORWARD_G, flops);
 }
 
 /**
@@ -324,151 +907,198 @@ void forward_generator(gan_t* gan, matrix_t* z)
  */
 void forward_discriminator(gan_t* gan, matrix_t* x, int real)
 {
-  discriminator_t* dis = gan->d;
-  matrix_t** z = real ? dis->z_real : dis->z_fake;
-  matrix_t** a = real ? dis->a_real : dis->a_fake;
+  matrix_t** a = real ? gan->d->a_real : gan->d->a_fake;
   matrix_t* act = x;
+  double flops = 0.0;
 
   int i;
+  PROF_BEGIN(real ? PROF_FORWARD_D_REAL : PROF_FORWARD_D_FAKE);
   for (i = 0; i < gan->nb_layers - 1; i++) {
-    mat_sum_z_act(z[i], act, dis->w[i], dis->b[i]);
-
-    switch (gan->act_fn_d[i]) {
-    case LRELU:
-      mat_lrelu_(a[i], z[i], 1e-2);
-      break;
-    case SIGMOID:
-      mat_sigmoid_(a[i], z[i]);
-      break;
-    default:
-      fprintf(stderr, "Error: invalid activation function. \n");
-      exit(1);
-    }
+    flops += discriminator_layer(gan, i, act, real);
+    ckpt_mark(gan->ckpt, real ? CKPT_D_REAL : CKPT_D_FAKE, i);
     act = a[i];
   }
+  if (gan->ckpt) {
+    gan->ckpt->in[real ? CKPT_D_REAL : CKPT_D_FAKE] = x;
+    gan->ckpt->fwd_flops += flops;
+  }
+  PROF_END(real ? PROF_FORWARD_D_REAL : PROF_FORWARD_D_FAKE, flops);
 }
 
 /**
- * Propagation en arrière du discriminator pour qu'il apprenne
- * les caractéristiques des données et améliorer ses performances.
+ * Propagation en arrière d'une couche du discriminator : gradient par rapport
+ * à l'activation puis à la pré-activation de la couche 'i', pour les données
+ * réelles (der_d->a_real / der_d->z_real) ou fausses (der_d->a / der_d->z).
  * 
  * \param gan la structure gan
- * \param x_real données d'apprentissage 
+ * \param i indice de la couche
+ * \param real booléen pour les données réelles ou générées
  */
-void backward_discriminator(gan_t* gan, matrix_t* x_real)
+void backward_discriminator_delta(gan_t* gan, int i, int real)
 {
-  int i, r, c, out = gan->nb_layers - 2;
+  int r, c, out = gan->nb_layers - 2;
 
-  generator_t* gen = gan->g;
   discriminator_t* dis = gan->d;
   der_discriminator_t* der_d = gan->der_d;
+  matrix_t** da = real ? der_d->a_real : der_d->a;
+  matrix_t** dz = real ? der_d->z_real : der_d->z;
+  matrix_t *der, *sig;
+  double flops = 2.0 * dz[i]->rows * dz[i]->cols;
+
+  PROF_BEGIN(PROF_BACKWARD_D);
+  if (i == out) {
+    // Gradient de la perte pour la donnée d'entrée réelle (MNIST) ou fausse (GAN)
+    matrix_t* a_out = real ? dis->a_real[out] : dis->a_fake[out];
+    for (r = 0; r < da[out]->rows; r++)
+      for (c = 0; c < da[out]->cols; c++) {
+        if (real)
+          da[out]->data[r * da[out]->cols + c] = -1.0 / (a_out->data[r * a_out->cols + c] + 1e-8);
+        else
+          da[out]->data[r * da[out]->cols + c] = 1.0 / (1.0 - a_out->data[r * a_out->cols + c] + 1e-8);
+      }
+  }
+  else
+    flops += layer_backward_input(dis->conv[i + 1], da[i], dz[i + 1], dis->w[i + 1]);
+
+  switch (gan->act_fn_d[i]) {
+  case LRELU:
+    der = mat_dlrelu(dis->z_fake[i], 1e-2);
+    break;
+  case SIGMOID:
+    sig = mat_sigmoid(real && i == out ? dis->z_real[out] : dis->z_fake[i]);
+    der = mat_dsigmoid(sig);
+    mat_free(sig);
+    break;
+  default:
+    fprintf(stderr, "Error: invalid activation function. \n");
+    exit(1);
+  }
+  mat_mul_(dz[i], da[i], der);
+  mat_free(der);
+  PROF_END(PROF_BACKWARD_D, flops);
+}
 
-  // Gradient pour la donnée d'entrée réelle (MNIST)
-  for (r = 0; r < der_d->a[out]->rows; r++)
-    for (c = 0; c < der_d->a[out]->cols; c++)
-      der_d->a[out]->data[r * der_d->a[out]->cols + c] = -1.0 / (dis->a_real[out]->data[r * dis->a_real[out]->cols + c] + 1e-8);
-
-  matrix_t* z = dis->z_real[out];
-  matrix_t* act = NULL;
+/**
+ * Gradient des poids de la couche 'i' du discriminator.
+ * 
+ * \param gan la structure gan
+ * \param x_real données d'apprentissage
+ * \param i indice de la couche
+ * \param real booléen pour les données réelles ou générées
+ */
+void backward_discriminator_dw(gan_t* gan, matrix_t* x_real, int i, int real)
+{
+  der_discriminator_t* der_d = gan->der_d;
+  matrix_t* x = real ? x_real : gan->g->a[gan->nb_layers - 2];
+  matrix_t* act = i - 1 < 0 ? x : gan->d->a_fake[i - 1];
+  matrix_t* dz = real ? der_d->z_real[i] : der_d->z[i];
+
+  PROF_BEGIN(PROF_BACKWARD_D);
+  double flops = i == 0 && real && gan->x_sparse ?
+    sparse_dot_left(der_d->w_real[0], gan->x_sparse, gan->sparse_row, dz) :
+    layer_backward_weight(gan->d->conv[i], real ? der_d->w_real[i] : der_d->w_fake[i], act, dz);
+  PROF_END(PROF_BACKWARD_D, flops);
+}
 
-  for (i = gan->nb_layers - 2; i >= 0; i--) {
-    if (i != gan->nb_layers - 2) {
-      mat_dot_(der_d->a[i], der_d->z[i + 1], dis->w[i + 1], RIGHT_TRANSPOSE);
-      z = dis->z_fake[i];
-    }
+/**
+ * Gradient des biais de la couche 'i' du discriminator (et du plongement
+ * des labels pour la première couche).
+ * 
+ * \param gan la structure gan
+ * \param i indice de la couche
+ * \param real booléen pour les données réelles ou générées
+ */
+void backward_discriminator_db(gan_t* gan, int i, int real)
+{
+  der_discriminator_t* der_d = gan->der_d;
+  matrix_t* dz = real ? der_d->z_real[i] : der_d->z[i];
 
-    switch (gan->act_fn_d[i]) {
-    case LRELU:
-      mat_mul_(der_d->z[i], der_d->a[i], mat_dlrelu(dis->z_fake[i], 1e-2));
-      break;
-    case SIGMOID:
-      mat_mul_(der_d->z[i], der_d->a[i], mat_dsigmoid(mat_sigmoid(z)));
-      break;
-    default:
-      fprintf(stderr, "Error: invalid activation function. \n");
-      exit(1);
-    }
+  PROF_BEGIN(PROF_BACKWARD_D);
+  double flops = layer_backward_bias(gan->d->conv[i], real ? der_d->b_real[i] : der_d->b_fake[i], dz);
+  if (i == 0 && gan->d->e)
+    flops += layer_backward_embedding(real ? der_d->e_real : der_d->e_fake, dz, gan->labels);
+  PROF_END(PROF_BACKWARD_D, flops);
+}
 
-    act = i - 1 < 0 ? x_real : dis->a_fake[i - 1];
-    mat_dot_(der_d->w_real[i], act, der_d->z[i], LEFT_TRANSPOSE);
-    mat_sum_axis0_(der_d->b_real[i], der_d->z[i]);
-  }
+/**
+ * SGD pour mettre à jour les poids et les biais de la couche 'i'
+ * du discriminator, en combinant les gradients des deux images
+ * (réelle et fausse).
+ * 
+ * \param gan la structure gan
+ * \param i indice de la couche
+ */
+void update_discriminator(gan_t* gan, int i)
+{
+  discriminator_t* dis = gan->d;
+  der_discriminator_t* der_d = gan->der_d;
 
-  // Gradient pour la donnée d'entrée fausse (généré par le GAN)
-  for (r = 0; r < der_d->a[out]->rows; r++)
-    for (c = 0; c < der_d->a[out]->cols; c++)
-      der_d->a[out]->data[r * der_d->a[out]->cols + c] = 1.0 / (1.0 - dis->a_fake[out]->data[r * dis->a_fake[out]->cols + c] + 1e-8);
+  PROF_BEGIN(PROF_UPDATE_D);
+  matrix_t* dw = mat_zinit(der_d->w_fake[i]->rows, der_d->w_fake[i]->cols);
+  matrix_t* db = mat_zinit(der_d->b_fake[i]->rows, der_d->b_fake[i]->cols);
 
-  act = NULL;
+  // Combinaison des deux images (réelle et fausse)
+  mat_sum_(dw, der_d->w_real[i], der_d->w_fake[i]);
+  mat_sum_(db, der_d->b_real[i], der_d->b_fake[i]);
 
-  for (i = gan->nb_layers - 2; i >= 0; i--) {
-    if (i != gan->nb_layers - 2)
-      mat_dot_(der_d->a[i], der_d->z[i + 1], dis->w[i + 1], RIGHT_TRANSPOSE);
+  // SGD pour mettre à jour les poids et les biais
+  mat_mul_scalar(dw, gan->lr);
+  mat_sub_(dis->w[i], dis->w[i], dw);
+  mat_touch(dis->w[i]);
 
-    switch (gan->act_fn_d[i]) {
-    case LRELU:
-      mat_mul_(der_d->z[i], der_d->a[i], mat_dlrelu(dis->z_fake[i], 1e-2));
-      break;
-    case SIGMOID:
-      mat_mul_(der_d->z[i], der_d->a[i], mat_dsigmoid(mat_sigmoid(dis->z_fake[i])));
-      break;
-    default:
-      fprintf(stderr, "Error: invalid activation function. \n");
-      exit(1);
-    }
+  mat_mul_scalar(db, gan->lr);
+  mat_sub_(dis->b[i], dis->b[i], db);
 
-    act = i - 1 < 0 ? gen->a[out] : dis->a_fake[i - 1];
-    mat_dot_(der_d->w_fake[i], act, der_d->z[i], LEFT_TRANSPOSE);
-    mat_sum_axis0_(der_d->b_fake[i], der_d->z[i]);
+  if (i == 0 && dis->e) {
+    mat_sum_(der_d->e_real, der_d->e_real, der_d->e_fake);
+    mat_mul_scalar(der_d->e_real, gan->lr);
+    mat_sub_(dis->e, dis->e, der_d->e_real);
   }
 
-  matrix_t** dw = (matrix_t**)malloc((gan->nb_layers - 1) * sizeof(*dw));
-  assert(dw);
-  matrix_t** db = (matrix_t**)malloc((gan->nb_layers - 1) * sizeof(*db));
-  assert(db);
-
-  for (i = 0; i < gan->nb_layers - 1; i++) {
-    dw[i] = mat_zinit(der_d->w_fake[i]->rows, der_d->w_fake[i]->cols);
-    db[i] = mat_zinit(der_d->b_fake[i]->rows, der_d->b_fake[i]->cols);
-
-    // Combinaison des deux images (réelle et fausse)
-    mat_sum_(dw[i], der_d->w_real[i], der_d->w_fake[i]);
-    mat_sum_(db[i], der_d->b_real[i], der_d->b_fake[i]);
+  PROF_END(PROF_UPDATE_D, 3.0 * (dw->rows * dw->cols + db->rows * db->cols));
+  mat_free(dw);
+  mat_free(db);
+}
 
-    // SGD pour mettre à jour les poids et les biais
-    mat_mul_scalar(dw[i], gan->lr);
-    mat_sub_(dis->w[i], dis->w[i], dw[i]);
+/**
+ * Propagation en arrière du discriminator pour qu'il apprenne
+ * les caractéristiques des données et améliorer ses performances.
+ * 
+ * \param gan la structure gan
+ * \param x_real données d'apprentissage 
+ */
+void backward_discriminator(gan_t* gan, matrix_t* x_real)
+{
+  int i, real;
 
-    mat_mul_scalar(db[i], gan->lr);
-    mat_sub_(dis->b[i], dis->b[i], db[i]);
+  for (real = 1; real >= 0; real--) {
+    for (i = gan->nb_layers - 2; i >= 0; i--) {
+      backward_discriminator_delta(gan, i, real);
+      backward_discriminator_dw(gan, x_real, i, real);
+      backward_discriminator_db(gan, i, real);
+    }
   }
 
-  for (i = 0; i < gan->nb_layers - 2; i++) {
-    mat_free(dw[i]);
-    mat_free(db[i]);
-    dw[i] = NULL;
-    db[i] = NULL;
-  }
+  for (i = 0; i < gan->nb_layers - 1; i++)
+    update_discriminator(gan, i);
 }
 
 /**
- * Propagation en arrière du generator pour qu'il apprenne
- * les caractéristiques des données et améliorer ses performances
- * Son but étant de se calquer aux données MNIST pour tromper le 
- * discriminator.
+ * Propagation en arrière à travers le discriminator de la perte du generator,
+ * jusqu'au gradient par rapport à l'image générée (stocké dans der_d->x).
  * 
  * \param gan la structure gan
- * \param z donnée bruitée
  */
-void backward_generator(gan_t* gan, matrix_t* z)
+void backward_generator_input(gan_t* gan)
 {
   int i, r, c, out = gan->nb_layers - 2;
 
-  generator_t* gen = gan->g;
   discriminator_t* dis = gan->d;
   der_discriminator_t* der_d = gan->der_d;
-  generator_t* der_g = gan->der_g;
+  matrix_t *der, *sig;
+  double flops = 0.0;
 
+  PROF_BEGIN(PROF_BACKWARD_G);
   // Propagation en arrière du discriminator
   // Gradient pour la donnée d'entrée fausse (généré par le GAN)
   for (r = 0; r < der_d->a[out]->rows; r++)
@@ -477,57 +1107,203 @@ void backward_generator(gan_t* gan, matrix_t* z)
 
   for (i = out; i >= 0; i--) {
     if (i != out)
-      mat_dot_(der_d->a[i], der_d->z[i + 1], dis->w[i + 1], RIGHT_TRANSPOSE);
+      flops += layer_backward_input(dis->conv[i + 1], der_d->a[i], der_d->z[i + 1], dis->w[i + 1]);
+    flops += 2.0 * der_d->z[i]->rows * der_d->z[i]->cols;
 
     switch (gan->act_fn_d[i]) {
     case LRELU:
-      mat_mul_(der_d->z[i], der_d->a[i], mat_dlrelu(dis->z_fake[i], 1e-2));
+      der = mat_dlrelu(dis->z_fake[i], 1e-2);
       break;
     case SIGMOID:
-      mat_mul_(der_d->z[i], der_d->a[i], mat_dsigmoid(mat_sigmoid(dis->z_fake[i])));
+      sig = mat_sigmoid(dis->z_fake[i]);
+      der = mat_dsigmoid(sig);
+      mat_free(sig);
       break;
     default:
       fprintf(stderr, "Error: invalid activation function. \n");
       exit(1);
     }
+    mat_mul_(der_d->z[i], der_d->a[i], der);
+    mat_free(der);
   }
 
-  // Propagation en arrière du generator
   // Gradient pour la donnée d'entrée fausse (généré par le GAN)
-  mat_dot_(der_d->x, der_d->z[0], dis->w[0], RIGHT_TRANSPOSE);
-  matrix_t* act_der_g = der_d->x;
-  matrix_t* act_gen = NULL;
+  flops += layer_backward_input(dis->conv[0], der_d->x, der_d->z[0], dis->w[0]);
+  PROF_END(PROF_BACKWARD_G, flops);
+}
 
-  for (i = out; i >= 0; i--) {
-    if (i != out)
-      mat_dot_(der_g->a[i], der_g->z[i + 1], gen->w[i + 1], RIGHT_TRANSPOSE);
+/**
+ * Propagation en arrière d'une couche du generator : gradient par rapport
+ * à l'activation puis à la pré-activation de la couche 'i'.
+ * 
+ * \param gan la structure gan
+ * \param dx gradient de la perte par rapport à l'image générée
+ * \param i indice de la couche
+ */
+void backward_generator_delta(gan_t* gan, matrix_t* dx, int i)
+{
+  int out = gan->nb_layers - 2;
 
-    switch (gan->act_fn_g[i]) {
-    case TANH:
-      mat_mul_(der_g->z[i], act_der_g, mat_dtanh(gen->z[i]));
-      break;
-    case LRELU:
-      mat_mul_(der_g->z[i], act_der_g, mat_dlrelu(gen->z[i], 0));
-      break;
-    default:
-      fprintf(stderr, "Error: invalid activation function. \n");
-      exit(1);
-    }
+  generator_t* gen = gan->g;
+  generator_t* der_g = gan->der_g;
+  matrix_t* der;
+  double flops = 2.0 * der_g->z[i]->rows * der_g->z[i]->cols;
+
+  checkpoint_fetch(gan, CKPT_G, i);
+  PROF_BEGIN(PROF_BACKWARD_G);
+  if (i != out)
+    flops += layer_backward_input(gen->conv[i + 1], der_g->a[i], der_g->z[i + 1], gen->w[i + 1]);
+  matrix_t* act_der_g = i == out ? dx : der_g->a[i];
+
+  // Dérivées de l'activation et de la normalisation fusionnées
+  if (gen->bn[i]) {
+    flops += bn_backward(gen->bn[i], der_g->z[i], act_der_g, gen->z[i], 0);
+    PROF_END(PROF_BACKWARD_G, flops);
+    return;
+  }
 
-    act_gen = (i - 1 < 0) ? z : gen->a[i - 1];
-    mat_dot_(der_g->w[i], act_gen, der_g->z[i], LEFT_TRANSPOSE);
-    mat_sum_axis0_(der_g->b[i], der_g->z[i]);
-    act_der_g = der_g->a[MIN(0, i - 1)];
+  switch (gan->act_fn_g[i]) {
+  case TANH:
+    der = mat_dtanh(gen->z[i]);
+    break;
+  case LRELU:
+    der = mat_dlrelu(gen->z[i], 0);
+    break;
+  default:
+    fprintf(stderr, "Error: invalid activation function. \n");
+    exit(1);
   }
+  mat_mul_(der_g->z[i], act_der_g, der);
+  mat_free(der);
+  PROF_END(PROF_BACKWARD_G, flops);
+}
 
-  // SGD pour mettre à jour les poids et les biais
-  for (i = 0; i < gan->nb_layers - 1; i++) {
-    mat_mul_scalar(der_g->w[i], gan->lr);
-    mat_sub_(gen->w[i], gen->w[i], der_g->w[i]);
+/**
+ * Gradient des poids de la couche 'i' du generator.
+ * 
+ * \param gan la structure gan
+ * \param z donnée bruitée
+ * \param i indice de la couche
+ */
+void backward_generator_dw(gan_t* gan, matrix_t* z, int i)
+{
+  matrix_t* act_gen = (i - 1 < 0) ? z : gan->g->a[i - 1];
+
+  checkpoint_fetch(gan, CKPT_G, i - 1);
+  PROF_BEGIN(PROF_BACKWARD_G);
+  double flops = layer_backward_weight(gan->g->conv[i], gan->der_g->w[i], act_gen, gan->der_g->z[i]);
+  PROF_END(PROF_BACKWARD_G, flops);
+}
 
-    mat_mul_scalar(der_g->b[i], gan->lr);
-    mat_sub_(gen->b[i], gen->b[i], der_g->b[i]);
+/**
+ * Gradient des biais de la couche 'i' du generator (et du plongement
+ * des labels pour la première couche).
+ * 
+ * \param gan la structure gan
+ * \param i indice de la couche
+ */
+void backward_generator_db(gan_t* gan, int i)
+{
+  PROF_BEGIN(PROF_BACKWARD_G);
+  double flops = layer_backward_bias(gan->g->conv[i], gan->der_g->b[i], gan->der_g->z[i]);
+  if (i == 0 && gan->g->e)
+    flops += layer_backward_embedding(gan->der_g->e, gan->der_g->z[0], gan->labels);
+  PROF_END(PROF_BACKWARD_G, flops);
+}
+
+/**
+ * SGD pour mettre à jour les poids et les biais de la couche 'i'
+ * du generator (et l'échelle / le décalage de sa normalisation).
+ * 
+ * \param gan la structure gan
+ * \param i indice de la couche
+ */
+void update_generator(gan_t* gan, int i)
+{
+  generator_t* gen = gan->g;
+  generator_t* der_g = gan->der_g;
+  double flops = 2.0 * (der_g->w[i]->rows * der_g->w[i]->cols + der_g->b[i]->rows * der_g->b[i]->cols);
+
+  PROF_BEGIN(PROF_UPDATE_G);
+  mat_mul_scalar(der_g->w[i], gan->lr);
+  mat_sub_(gen->w[i], gen->w[i], der_g->w[i]);
+  mat_touch(gen->w[i]);
+
+  mat_mul_scalar(der_g->b[i], gan->lr);
+  mat_sub_(gen->b[i], gen->b[i], der_g->b[i]);
+
+  if (gen->bn[i])
+    flops += bn_update(gen->bn[i], gan->lr);
+  if (i == 0 && gen->e) {
+    mat_mul_scalar(der_g->e, gan->lr);
+    mat_sub_(gen->e, gen->e, der_g->e);
+  }
+  PROF_END(PROF_UPDATE_G, flops);
+}
+
+/**
+ * Propagation en arrière du generator à partir du gradient de l'image
+ * générée, suivie de la mise à jour de ses poids et biais.
+ * 
+ * \param gan la structure gan
+ * \param z donnée bruitée
+ * \param dx gradient de la perte par rapport à l'image générée
+ */
+void backward_generator_params(gan_t* gan, matrix_t* z, matrix_t* dx)
+{
+  int i;
+
+  for (i = gan->nb_layers - 2; i >= 0; i--) {
+    backward_generator_delta(gan, dx, i);
+    backward_generator_dw(gan, z, i);
+    backward_generator_db(gan, i);
+  }
+
+  for (i = 0; i < gan->nb_layers - 1; i++)
+    update_generator(gan, i);
+}
+
+/**
+ * Propagation en arrière du generator pour qu'il apprenne
+ * les caractéristiques des données et améliorer ses performances
+ * Son but étant de se calquer aux données MNIST pour tromper le 
+ * discriminator.
+ * 
+ * \param gan la structure gan
+ * \param z donnée bruitée
+ */
+void backward_generator(gan_t* gan, matrix_t* z)
+{
+  backward_generator_input(gan);
+  backward_generator_params(gan, z, gan->der_d->x);
+}
+
+/**
+ * Replier les normalisations du generator dans les poids et biais des
+ * couches qui les précèdent (statistiques cumulées) : le generator
+ * d'inférence exécute alors les mêmes noyaux qu'un generator sans
+ * normalisation. A appeler une fois l'apprentissage terminé, sans réplique.
+ *
+ * \param gan structure gan
+ * \return nombre de couches repliées
+ */
+int fold_generator(gan_t* gan)
+{
+  int i, nb = 0;
+  generator_t* gen = gan->g;
+
+  for (i = 0; i < gan->nb_layers - 1; i++) {
+    if (!gen->bn[i])
+      continue;
+    bn_fold(gen->bn[i], gen->w[i], gen->b[i]);
+    mat_touch(gen->w[i]);
+    if (i == 0 && gen->e)
+      bn_scale(gen->bn[i], gen->e);
+    bn_free(gen->bn[i], 1);
+    gen->bn[i] = NULL;
+    nb++;
   }
+  return nb;
 }
 
 /**
@@ -536,7 +1312,7 @@ void backward_generator(gan_t* gan, matrix_t* z)
  * \param cfg structure config
  * \param epoch itération actuelle
  */
-static inline void print_progressbar(int current_epoch, int print_epoch, int epochs)
+void print_progressbar(int current_epoch, int print_epoch, int epochs)
 {
   int b;
 
@@ -561,8 +1337,9 @@ static inline void print_progressbar(int current_epoch, int print_epoch, int epo
  * \param epoch itération actuel de la phase d'apprentissage
  * \param loss_d perte pour le discriminant
  * \param loss_g perte pour le generator
+ * \param img_s débit d'apprentissage (images par seconde)
  */
-static inline void print_loss(mnist_t* mnist, gan_t* gan, int epoch, matrix_t* loss_d, matrix_t* loss_g)
+void print_loss(mnist_t* mnist, gan_t* gan, int epoch, matrix_t* loss_d, matrix_t* loss_g, double img_s)
 {
   int out = gan->nb_layers - 2;
   generator_t* gen = gan->g;
@@ -575,7 +1352,11 @@ static inline void print_loss(mnist_t* mnist, gan_t* gan, int epoch, matrix_t* l
   printf(" * lr:     %f\n", gan->lr);
   printf(" * loss_g: %.3f\n", mat_mean(loss_g));
   printf(" * loss_d: %.3f\n", mat_mean(loss_d));
-  save_mnist_pgm_mat(gen->a[out], mnist);
+  printf(" * img/s:  %.1f\n", img_s);
+  if (mnist->snapshot)
+    snapshot_push(mnist->snapshot, gen->a[out], epoch);
+  else
+    save_mnist_pgm_mat(gen->a[out], mnist);
   printf("\n");
 }
 
@@ -583,12 +1364,111 @@ static inline void print_loss(mnist_t* mnist, gan_t* gan, int epoch, matrix_t* l
  * Générer du bruit pour l'apprentissage du generator.
  * 
  * \param z matrice pour le stockage du bruit
+ * \param seed graine propre à l'appelant (NULL pour utiliser rand())
  */
-static inline void generate_noise(matrix_t* z)
+void generate_noise(matrix_t* z, unsigned int* seed)
 {
   int n;
-  for (n = 0; n < z->rows * z->cols; n++)
-    z->data[n] = normal_rand();
+  PROF_BEGIN(PROF_NOISE);
+  if (seed) {
+    for (n = 0; n < z->rows * z->cols; n++)
+      z->data[n] = normal_rand_r(seed);
+  }
+  else {
+    for (n = 0; n < z->rows * z->cols; n++)
+      z->data[n] = normal_rand();
+  }
+  PROF_END(PROF_NOISE, 0.0);
+}
+
+/**
+ * Copier le lot 'batch' des données d'apprentissage.
+ * 
+ * \param cfg structure config
+ * \param x_real matrice pour le stockage du lot
+ * \param batch indice du lot
+ */
+void load_batch(config_t* cfg, matrix_t* x_real, int batch)
+{
+  PROF_BEGIN(PROF_COPY);
+  mat_copy_(x_real, cfg->x_train, cfg->x_stream ? 0 : batch * cfg->batch_sz);
+  PROF_END(PROF_COPY, 0.0);
+}
+
+/**
+ * Sélectionner les données du lot 'batch' propres au modèle : labels
+ * (condition du GAN conditionnel) et images réelles creuses, utilisées par
+ * la première couche du discriminator si le lot est assez creux. En
+ * lecture en flux, le lot est d'abord lu dans x_train et y_train : appeler
+ * select_batch avant load_batch.
+ *
+ * \param cfg structure config
+ * \param gan structure gan
+ * \param batch indice du lot
+ */
+void select_batch(config_t* cfg, gan_t* gan, int batch)
+{
+  if (cfg->x_stream) {
+    stream_batch(cfg->x_stream, batch, cfg->x_train, cfg->y_train);
+    batch = 0;
+  }
+
+  if (gan->nb_classes)
+    gan->labels = cfg->y_train + batch * cfg->batch_sz;
+
+  gan->sparse_row = batch * cfg->batch_sz;
+  gan->x_sparse = cfg->x_sparse && !gan->d->conv[0] &&
+    sparse_density(cfg->x_sparse, gan->sparse_row, cfg->batch_sz) <= SPARSE_MAX_DENSITY ? cfg->x_sparse : NULL;
+}
+
+/**
+ * Générer un lot d'images avec le generator (propagation avant seule,
+ * nouveau bruit). En mode conditionnel, toutes les images sont du chiffre
+ * 'digit', ou de chaque chiffre à tour de rôle si 'digit' n'est pas un label.
+ * Les images sont dans la dernière activation du generator.
+ *
+ * \param cfg structure config
+ * \param gan structure gan
+ * \param digit chiffre demandé (GAN conditionnel)
+ * \param seed graine du bruit (NULL : rand())
+ */
+void sample_generator(config_t* cfg, gan_t* gan, unsigned int digit, unsigned int* seed)
+{
+  int r;
+  matrix_t* z = mat_zinit(cfg->batch_sz, gan->input_layer_sz_g);
+  unsigned int* labels = (unsigned int*)malloc(cfg->batch_sz * sizeof(*labels));
+  assert(labels);
+
+  for (r = 0; r < cfg->batch_sz; r++)
+    labels[r] = gan->nb_classes ? (digit < gan->nb_classes ? digit : r % gan->nb_classes) : 0;
+
+  gan->labels = labels;
+  generate_noise(z, seed);
+  forward_generator(gan, z);
+  gan->labels = NULL;
+
+  free(labels);
+  mat_free(z);
+}
+
+/**
+ * Une itération d'apprentissage sur un lot : propagations avant
+ * du generator et du discriminator, puis propagations arrières.
+ * 
+ * \param gan structure gan
+ * \param z données bruitées
+ * \param x_real lot de données d'apprentissage
+ */
+void train_gan_step(gan_t* gan, matrix_t* z, matrix_t* x_real)
+{
+  if (gan->ckpt)
+    gan->ckpt->steps++;
+  forward_generator(gan, z);
+  forward_discriminator(gan, x_real, 1);
+  forward_discriminator(gan, gan->g->a[gan->nb_layers - 2], 0);
+
+  backward_discriminator(gan, x_real);
+  backward_generator(gan, z);
 }
 
 /**
@@ -605,8 +1485,9 @@ void train_gan(config_t* cfg, gan_t* gan, mnist_t* mnist)
 {
   int i, j;
   int out = gan->nb_layers - 2;
+  struct timespec start, end;
+  double elapsed = 0.0;
 
-  generator_t* gen = gan->g;
   discriminator_t* dis = gan->d;
 
   matrix_t* z = mat_zinit(cfg->batch_sz, gan->input_layer_sz_g);
@@ -615,27 +1496,36 @@ void train_gan(config_t* cfg, gan_t* gan, mnist_t* mnist)
   matrix_t* loss_g = mat_zinit(dis->a_fake[out]->rows, dis->a_fake[out]->cols);
 
   for (i = 0; i < gan->epochs; i++) {
+    clock_gettime(CLOCK_MONOTONIC, &start);
     for (j = 0; j < cfg->num_batches; j++) {
-      generate_noise(z);
-      mat_copy_(x_real, cfg->x_train, i * cfg->batch_sz);
-
-      forward_generator(gan, z);
-      forward_discriminator(gan, x_real, 1);
-      forward_discriminator(gan, gen->a[out], 0);
-
-      backward_discriminator(gan, x_real);
-      backward_generator(gan, z);
+      TRACE_STEP();
+      generate_noise(z, NULL);
+      select_batch(cfg, gan, j);
+      load_batch(cfg, x_real, j);
+
+      train_gan_step(gan, z, x_real);
+      monitor_publish(mnist->monitor, gan->g->a[out], dis->a_real[out], dis->a_fake[out],
+        gan->lr, (long)i * cfg->num_batches + j, i);
     }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
 
+    PROF_EPOCH(i);
+    MEM_EPOCH(i);
     if (cfg->progressbar)
       print_progressbar(i, PRINT_EP, gan->epochs);
 
     if (cfg->verbose && i % PRINT_EP == 0)
-      print_loss(mnist, gan, i, loss_d, loss_g);
+      print_loss(mnist, gan, i, loss_d, loss_g, (double)(i + 1) * cfg->train_sz / elapsed);
 
     gan->lr = gan->lr * (1.0 / (1.0 + gan->dr * i));
   }
 
+  mat_ce_(loss_d, dis->a_fake[out], dis->a_real[out]);
+  mat_log_(loss_g, dis->a_fake[out]);
+  printf("[sync] threads: 1, img/s: %.1f, loss_d: %.3f, loss_g: %.3f\n",
+    (double)gan->epochs * cfg->train_sz / elapsed, mat_mean(loss_d), mat_mean(loss_g));
+
   mat_free(z);
   mat_free(x_real);
   mat_free(loss_d);
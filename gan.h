@@ -7,6 +7,14 @@
 #define _GAN_H_
 
 #include "config.h"
+#include "conv.h"
+#include "bn.h"
+#include "ckpt.h"
+
+// Constante pour fixer l'affichage a chaque 'n' iteration
+#define PRINT_EP 5
+// Coefficient d'apprentissage max. conseillé au-delà de 3 couches (LAYERS)
+#define DEEP_LR_MAX 3e-4
 
 /* Enumération pour la fonction d'activation */
 enum ACT_E {
@@ -22,6 +30,9 @@ struct generator {
   matrix_t** b; // biais
   matrix_t** z; // pre-activation
   matrix_t** a; // activation
+  conv_t** conv; // couches convolutives transposées (NULL : couche dense)
+  bn_t** bn; // normalisations par lot (NULL : pas de normalisation)
+  matrix_t* e; // plongement des labels dans la première couche (NULL : GAN non conditionnel)
 };
 
 typedef struct discriminator discriminator_t;
@@ -33,18 +44,24 @@ struct discriminator {
   matrix_t** z_real; // pre-activation pour les données MNIST
   matrix_t** a_fake; // activation pour le generator
   matrix_t** a_real; // pre-activation pour les données MNIST
+  conv_t** conv; // couches convolutives (NULL : couche dense)
+  matrix_t* e; // plongement des labels dans la première couche (NULL : GAN non conditionnel)
 };
 
 typedef struct der_discriminator der_discriminator_t;
 /* Structure pour les dérivées du discriminator du GAN */
 struct der_discriminator {
-  matrix_t** a; // activation
-  matrix_t** z; // pre-activation
-  matrix_t* x; //
+  matrix_t** a; // activation (données générées)
+  matrix_t** z; // pre-activation (données générées)
+  matrix_t** a_real; // activation (données MNIST)
+  matrix_t** z_real; // pre-activation (données MNIST)
+  matrix_t* x; // gradient par rapport à l'image générée
   matrix_t** w_real; // poids pour le calcul du discriminator avec les données MNIST
   matrix_t** w_fake; // poids pour le calcul du discriminator avec le generator
   matrix_t** b_real; // biais pour le calcul du discriminator avec les données MNIST
   matrix_t** b_fake; // biais pour le calcul du discriminator avec le generator
+  matrix_t* e_real; // plongement des labels (données MNIST)
+  matrix_t* e_fake; // plongement des labels (données générées)
 };
 
 typedef struct gan_t gan_t;
@@ -61,6 +78,13 @@ struct gan_t {
   int* act_fn_g; // id pour les fonctions d'activation pour chaque couche (generator)
   double lr; // coefficient d'apprentissage
   double dr; // ratio de décroissance
+  int infer; // propagation avant en inférence (statistiques cumulées des normalisations)
+  unsigned int nb_classes; // nombre de labels du GAN conditionnel (0 : non conditionnel)
+  const unsigned int* labels; // labels du lot courant (GAN conditionnel)
+  const sparse_t* x_sparse; // images réelles creuses du lot courant (NULL : noyau dense)
+  int sparse_row; // première ligne du lot courant dans x_sparse
+  int tuned; // paramètres des noyaux lus dans le cache de réglage (TUNE_FILE)
+  ckpt_t* ckpt; // recalcul des activations (NULL : toutes gardées)
 
   generator_t* g; // generator
   discriminator_t* d; // discriminator
@@ -68,11 +92,33 @@ struct gan_t {
   der_discriminator_t* der_d; // dérivées pour le discriminator
 };
 
+gan_t* init_gan_r(config_t*, unsigned int*, int);
 gan_t* init_gan(config_t*);
+gan_t* init_gan_replica(config_t*, gan_t*);
+void free_gan_replica(gan_t*);
+void free_gan(gan_t*);
 void forward_generator(gan_t*, matrix_t*);
 void forward_discriminator(gan_t*, matrix_t*, int);
+void backward_discriminator_delta(gan_t*, int, int);
+void backward_discriminator_dw(gan_t*, matrix_t*, int, int);
+void backward_discriminator_db(gan_t*, int, int);
+void update_discriminator(gan_t*, int);
 void backward_discriminator(gan_t*, matrix_t*);
+void backward_generator_delta(gan_t*, matrix_t*, int);
+void backward_generator_dw(gan_t*, matrix_t*, int);
+void backward_generator_db(gan_t*, int);
+void update_generator(gan_t*, int);
+void backward_generator_input(gan_t*);
+void backward_generator_params(gan_t*, matrix_t*, matrix_t*);
 void backward_generator(gan_t*, matrix_t*);
+int fold_generator(gan_t*);
+void generate_noise(matrix_t*, unsigned int*);
+void load_batch(config_t*, matrix_t*, int);
+void select_batch(config_t*, gan_t*, int);
+void sample_generator(config_t*, gan_t*, unsigned int, unsigned int*);
+void train_gan_step(gan_t*, matrix_t*, matrix_t*);
+void print_progressbar(int, int, int);
+void print_loss(mnist_t*, gan_t*, int, matrix_t*, matrix_t*, double);
 void train_gan(config_t*, gan_t*, mnist_t*);
 
 #endif
\ No newline at end of file
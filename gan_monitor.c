@@ -0,0 +1,212 @@
+/*!
+ * \file gan_monitor.c
+ * \brief Programme de suivi d'un apprentissage en cours : lecture du
+ * segment de mémoire partagée publié par gan (clé MONITOR de gan.cfg),
+ * affichage des pertes, du coefficient d'apprentissage, des durées
+ * d'itération et d'un aperçu de l'image générée, et écriture optionnelle
+ * de la grille des images générées en PNG.
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#include <assert.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "monitor.h"
+#include "snapshot.h"
+
+// Segment par défaut
+#define GAN_MONITOR_NAME "/gan"
+// Intervalle de rafraîchissement par défaut (en millisecondes)
+#define GAN_MONITOR_INTERVAL 1000
+// Niveaux de gris de l'aperçu (du plus sombre au plus clair)
+#define GAN_MONITOR_RAMP " .:-=+*#%@"
+
+static volatile sig_atomic_t stop = 0;
+
+/**
+ * Arrêter le suivi (Ctrl-C).
+ *
+ * \param sig signal reçu
+ */
+static void on_signal(int sig)
+{
+  (void)sig;
+  stop = 1;
+}
+
+/**
+ * Afficher la première image générée en caractères ASCII
+ * (une ligne sur deux, les caractères étant deux fois plus hauts que larges).
+ *
+ * \param shm segment
+ * \param st état lu
+ */
+static void print_preview(monitor_shm_t* shm, monitor_state_t* st)
+{
+  int x, y, levels = strlen(GAN_MONITOR_RAMP) - 1;
+
+  if (st->nb_images == 0)
+    return;
+
+  for (y = 0; y < shm->height; y += 2) {
+    for (x = 0; x < shm->width; x++) {
+      double v = (st->images[y * shm->width + x] + 1.0) / 2.0;
+      int l = (int)(v * levels + 0.5);
+      putchar(GAN_MONITOR_RAMP[l < 0 ? 0 : l > levels ? levels : l]);
+    }
+    putchar('\n');
+  }
+}
+
+/**
+ * Écrire la grille des images générées dans un fichier PNG
+ * (même disposition que snapshot.c).
+ *
+ * \param shm segment
+ * \param st état lu
+ * \param output fichier de sortie
+ */
+static void write_grid(monitor_shm_t* shm, monitor_state_t* st, const char* output)
+{
+  int i, x, y, cols = 1, rows;
+  int w = shm->width, h = shm->height;
+  size_t size;
+
+  if (st->nb_images == 0)
+    return;
+
+  while (cols * cols < st->nb_images)
+    cols++;
+  rows = (st->nb_images + cols - 1) / cols;
+
+  int width = cols * (w + SNAPSHOT_PAD) + SNAPSHOT_PAD;
+  int height = rows * (h + SNAPSHOT_PAD) + SNAPSHOT_PAD;
+  unsigned char* pixels = (unsigned char*)calloc(width * height, sizeof(*pixels));
+  assert(pixels);
+
+  for (i = 0; i < st->nb_images; i++) {
+    int ox = SNAPSHOT_PAD + (i % cols) * (w + SNAPSHOT_PAD);
+    int oy = SNAPSHOT_PAD + (i / cols) * (h + SNAPSHOT_PAD);
+    for (y = 0; y < h; y++) {
+      for (x = 0; x < w; x++) {
+        double v = (st->images[(i * h + y) * w + x] + 1.0) * 127.5;
+        pixels[(oy + y) * width + ox + x] = v < 0 ? 0 : v > 255 ? 255 : (unsigned char)v;
+      }
+    }
+  }
+
+  unsigned char* buf = encode_png(pixels, width, height, 1, &size);
+  FILE* fp = fopen(output, "wb");
+  if (!fp || fwrite(buf, 1, size, fp) != size)
+    fprintf(stderr, "Error: could not write file %s. \n", output);
+  if (fp)
+    fclose(fp);
+  free(buf);
+  free(pixels);
+}
+
+/**
+ * Cas d'usage du programme.
+ *
+ * \param exec nom de l'exécutable
+ */
+static void usage(char* exec)
+{
+  fprintf(stderr, "Usage: %s [-n name] [-i interval_ms] [-c count] [-o grid.png] [-q]\n", exec);
+  exit(1);
+}
+
+int main(int argc, char* argv[])
+{
+  int i, nb, count = 0, quiet = 0, interval = GAN_MONITOR_INTERVAL;
+  const char* name = GAN_MONITOR_NAME;
+  const char* output = NULL;
+  unsigned long read = 0;
+  monitor_shm_t* shm;
+  monitor_state_t* st;
+  monitor_metric_t* metrics;
+  struct timespec delay;
+
+  for (i = 1; i < argc; i++) {
+    if (argv[i][0] != '-')
+      usage(argv[0]);
+    if (argv[i][1] == 'q') {
+      quiet = 1;
+      continue;
+    }
+    if (i + 1 >= argc)
+      usage(argv[0]);
+
+    switch (argv[i][1]) {
+    case 'n':
+      name = argv[++i];
+      break;
+    case 'i':
+      interval = atoi(argv[++i]);
+      break;
+    case 'c':
+      count = atoi(argv[++i]);
+      break;
+    case 'o':
+      output = argv[++i];
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+
+  if ((shm = monitor_attach(name)) == NULL) {
+    fprintf(stderr, "Error: no training is publishing to %s. \n", name);
+    exit(1);
+  }
+
+  st = (monitor_state_t*)malloc(sizeof(*st));
+  assert(st);
+  metrics = (monitor_metric_t*)malloc(MONITOR_RING * sizeof(*metrics));
+  assert(metrics);
+
+  signal(SIGINT, on_signal);
+  delay.tv_sec = interval / 1000;
+  delay.tv_nsec = (interval % 1000) * 1000000L;
+
+  for (i = 0; !stop && (count == 0 || i < count); i++) {
+    double loss_d = 0.0, loss_g = 0.0;
+    unsigned long head = monitor_read_metrics(shm, read, metrics, &nb);
+    monitor_read_state(shm, st);
+
+    // Moyenne des pertes depuis le dernier affichage
+    for (int k = 0; k < nb; k++) {
+      loss_d += metrics[k].loss_d;
+      loss_g += metrics[k].loss_g;
+    }
+    if (nb > 0) {
+      loss_d /= nb;
+      loss_g /= nb;
+    }
+
+    if (!quiet)
+      print_preview(shm, st);
+    printf("[monitor] pid: %d, epoch: %d, step: %ld, loss_d: %.3f, loss_g: %.3f, lr: %g, "
+      "ms/step: %.3f (mean %.3f, max %.3f), img/s: %.1f, new steps: %d, lost: %lu\n",
+      shm->pid, st->last.epoch, st->last.step, nb ? loss_d : st->last.loss_d, nb ? loss_g : st->last.loss_g,
+      st->last.lr, st->last.step_ms, st->step_ms_mean, st->step_ms_max, st->img_s,
+      nb, head - read - nb);
+    fflush(stdout);
+    read = head;
+
+    if (output)
+      write_grid(shm, st, output);
+
+    if (count == 0 || i + 1 < count)
+      nanosleep(&delay, NULL);
+  }
+
+  munmap(shm, sizeof(*shm));
+  free(metrics);
+  free(st);
+  return 0;
+}
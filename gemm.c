@@ -0,0 +1,350 @@
+/*!
+ * \file gemm.c
+ * \brief Fichier comprenant les implémentations interchangeables des
+ * produits matriciels des couches denses : noyaux de matrix.c (par défaut)
+ * ou CBLAS installée sur la machine (OpenBLAS, BLIS) avec make CBLAS=1.
+ * L'implémentation est choisie par GEMM dans gan.cfg. Les noyaux internes
+ * utilisent les noyaux spécialisés de kernels_gen.c (kgen.c) pour les
+ * dimensions retenues par init_gan.
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gemm.h"
+#include "kgen.h"
+#include "prof.h"
+#ifdef GAN_CBLAS
+#include <cblas.h>
+#endif
+
+// Nombre max. de dimensions de couches spécialisées
+#define GEMM_MAX_SPEC 16
+
+// Noyaux spécialisés retenus par init_gan
+static const kgen_kernel_t* gemm_spec[GEMM_MAX_SPEC];
+// Nombre de noyaux spécialisés retenus (lu par les modèles en cours
+// d'apprentissage pendant qu'un nouveau modèle en ajoute)
+static atomic_int gemm_nb_spec = 0;
+// Utilisation des noyaux spécialisés
+static int gemm_spec_on = 1;
+
+/**
+ * Noyaux spécialisés retenus pour des dimensions de couche.
+ *
+ * \param batch taille du lot
+ * \param in taille de l'entrée
+ * \param out taille de la sortie
+ * \return noyaux, NULL si aucun (noyaux génériques)
+ */
+static const kgen_kernel_t* gemm_spec_find(int batch, int in, int out)
+{
+  int i, nb = atomic_load(&gemm_nb_spec);
+  if (!gemm_spec_on)
+    return NULL;
+  for (i = 0; i < nb; i++)
+    if (gemm_spec[i]->batch == batch && gemm_spec[i]->in == in && gemm_spec[i]->out == out)
+      return gemm_spec[i];
+  return NULL;
+}
+
+/**
+ * Propagation avant par les noyaux de matrix.c, ou spécialisés.
+ */
+static void internal_sum_z_act(matrix_t* z, matrix_t* act, matrix_t* w, matrix_t* b)
+{
+  const kgen_kernel_t* kg = gemm_spec_find(act->rows, w->rows, w->cols);
+  if (kg && act->cols == w->rows && z->rows == act->rows && z->cols == w->cols && b->rows == 1 &&
+    b->cols == w->cols) {
+    PROF_KBEGIN(PROF_K_DOT);
+    kg->sum_z_act(z->data, act->data, w->data, b->data);
+    PROF_KEND(PROF_K_DOT, 2.0 * act->rows * w->rows * w->cols + (double)z->rows * z->cols);
+    return;
+  }
+  mat_sum_z_act(z, act, w, b);
+}
+
+/**
+ * Gradient des poids par les noyaux de matrix.c, ou spécialisés.
+ */
+static void internal_dot_left(matrix_t* dw, matrix_t* act, matrix_t* dz)
+{
+  const kgen_kernel_t* kg = gemm_spec_find(act->rows, act->cols, dz->cols);
+  if (kg && dz->rows == act->rows && dw->rows == act->cols && dw->cols == dz->cols) {
+    PROF_KBEGIN(PROF_K_DOT_LEFT);
+    kg->dot_left(dw->data, act->data, dz->data);
+    PROF_KEND(PROF_K_DOT_LEFT, 2.0 * dw->rows * dw->cols * act->rows);
+    return;
+  }
+  mat_dot_(dw, act, dz, LEFT_TRANSPOSE);
+}
+
+/**
+ * Gradient de l'entrée par les noyaux de matrix.c, ou spécialisés
+ * (poids pré-emballés).
+ */
+static void internal_dot_right(matrix_t* da, matrix_t* dz, matrix_t* w)
+{
+  const kgen_kernel_t* kg = w->pack ? gemm_spec_find(dz->rows, w->rows, w->cols) : NULL;
+  if (kg && dz->cols == w->cols && da->rows == dz->rows && da->cols == w->rows) {
+    const double* panel = mat_pack_panel(w, 1);
+    PROF_KBEGIN(PROF_K_DOT_RIGHT);
+    kg->dot_right(da->data, dz->data, panel);
+    PROF_KEND(PROF_K_DOT_RIGHT, 2.0 * da->rows * da->cols * dz->cols);
+    return;
+  }
+  mat_dot_(da, dz, w, RIGHT_TRANSPOSE);
+}
+
+#ifdef GAN_CBLAS
+/**
+ * Vérifier les dimensions des matrices passées à CBLAS.
+ *
+ * \param cond condition à vérifier
+ */
+static void blas_check(int cond)
+{
+  if (!cond) {
+    fprintf(stderr, "Error: bad matrix structures while dot. \n");
+    exit(1);
+  }
+}
+
+/**
+ * Propagation avant par CBLAS : z = b sur chaque ligne, puis
+ * z += act . w (dgemv si la couche n'a qu'une sortie, dgemm sinon).
+ *
+ * \param z pré-activation
+ * \param act activation de la couche précédente
+ * \param w poids
+ * \param b biais
+ */
+static void blas_sum_z_act(matrix_t* z, matrix_t* act, matrix_t* w, matrix_t* b)
+{
+  int r;
+  blas_check(act->cols == w->rows && z->rows == act->rows && z->cols == w->cols &&
+    b->cols == w->cols && (b->rows == 1 || b->rows == z->rows));
+
+  PROF_KBEGIN(PROF_K_DOT);
+  if (b->rows == 1)
+    for (r = 0; r < z->rows; r++)
+      memcpy(z->data + r * z->cols, b->data, z->cols * sizeof(*z->data));
+  else
+    memcpy(z->data, b->data, (size_t)z->rows * z->cols * sizeof(*z->data));
+
+  if (w->cols == 1)
+    cblas_dgemv(CblasRowMajor, CblasNoTrans, act->rows, act->cols, 1.0, act->data, act->cols,
+      w->data, 1, 1.0, z->data, 1);
+  else
+    cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, act->rows, w->cols, act->cols, 1.0,
+      act->data, act->cols, w->data, w->cols, 1.0, z->data, z->cols);
+  PROF_KEND(PROF_K_DOT, 2.0 * act->rows * w->rows * w->cols + (double)z->rows * z->cols);
+}
+
+/**
+ * Gradient des poids par CBLAS : dw = act^T . dz (dgemv transposé si la
+ * couche n'a qu'une sortie, dgemm sinon).
+ *
+ * \param dw gradient des poids
+ * \param act activation de la couche précédente
+ * \param dz gradient de la pré-activation
+ */
+static void blas_dot_left(matrix_t* dw, matrix_t* act, matrix_t* dz)
+{
+  blas_check(act->rows == dz->rows && dw->rows == act->cols && dw->cols == dz->cols);
+
+  PROF_KBEGIN(PROF_K_DOT_LEFT);
+  if (dz->cols == 1)
+    cblas_dgemv(CblasRowMajor, CblasTrans, act->rows, act->cols, 1.0, act->data, act->cols,
+      dz->data, 1, 0.0, dw->data, 1);
+  else
+    cblas_dgemm(CblasRowMajor, CblasTrans, CblasNoTrans, act->cols, dz->cols, act->rows, 1.0,
+      act->data, act->cols, dz->data, dz->cols, 0.0, dw->data, dw->cols);
+  PROF_KEND(PROF_K_DOT_LEFT, 2.0 * dw->rows * dw->cols * act->rows);
+}
+
+/**
+ * Gradient de l'entrée par CBLAS : da = dz . w^T (produit extérieur dger
+ * si la couche n'a qu'une sortie, dgemm sinon).
+ *
+ * \param da gradient de l'entrée
+ * \param dz gradient de la pré-activation
+ * \param w poids
+ */
+static void blas_dot_right(matrix_t* da, matrix_t* dz, matrix_t* w)
+{
+  blas_check(dz->cols == w->cols && da->rows == dz->rows && da->cols == w->rows);
+
+  PROF_KBEGIN(PROF_K_DOT_RIGHT);
+  if (dz->cols == 1) {
+    memset(da->data, 0, (size_t)da->rows * da->cols * sizeof(*da->data));
+    cblas_dger(CblasRowMajor, da->rows, da->cols, 1.0, dz->data, 1, w->data, 1, da->data, da->cols);
+  }
+  else
+    cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasTrans, dz->rows, w->rows, dz->cols, 1.0,
+      dz->data, dz->cols, w->data, w->cols, 0.0, da->data, da->cols);
+  PROF_KEND(PROF_K_DOT_RIGHT, 2.0 * da->rows * da->cols * dz->cols);
+}
+#endif
+
+// Implémentations, dans l'ordre de GEMM_BACKEND_E (NULL : non compilée)
+static const gemm_backend_t gemm_backends[GEMM_NB_BACKENDS] = {
+  {"internal", internal_sum_z_act, internal_dot_left, internal_dot_right},
+#ifdef GAN_CBLAS
+  {"cblas", blas_sum_z_act, blas_dot_left, blas_dot_right},
+#else
+  {"cblas", NULL, NULL, NULL},
+#endif
+};
+
+// Implémentation courante
+static int gemm_backend = GEMM_INTERNAL;
+
+/**
+ * Savoir si une implémentation est compilée dans le programme.
+ *
+ * \param backend implémentation (GEMM_BACKEND_E)
+ * \return 1 si elle est disponible, 0 sinon
+ */
+int gemm_available(int backend)
+{
+  return backend >= 0 && backend < GEMM_NB_BACKENDS && gemm_backends[backend].sum_z_act != NULL;
+}
+
+/**
+ * Choisir l'implémentation des produits matriciels (avant le démarrage
+ * des threads d'apprentissage).
+ *
+ * \param backend implémentation (GEMM_BACKEND_E)
+ */
+void gemm_set_backend(int backend)
+{
+  if (!gemm_available(backend)) {
+    fprintf(stderr, "Error: GEMM backend %d is not available (cblas needs make CBLAS=1). \n", backend);
+    exit(1);
+  }
+  gemm_backend = backend;
+}
+
+/**
+ * Implémentation courante.
+ *
+ * \return implémentation
+ */
+int gemm_get_backend(void)
+{
+  return gemm_backend;
+}
+
+/**
+ * Nom d'une implémentation.
+ *
+ * \param backend implémentation
+ * \return nom
+ */
+const char* gemm_backend_name(int backend)
+{
+  return backend >= 0 && backend < GEMM_NB_BACKENDS ? gemm_backends[backend].name : "unknown";
+}
+
+/**
+ * Retenir les noyaux spécialisés générés pour des dimensions de couche
+ * (avant le démarrage des threads d'apprentissage). Les noyaux retenus ne
+ * sont jamais retirés : un appel concurrent aux produits matriciels voit
+ * la table avant ou après l'ajout, les appels à gemm_specialize doivent
+ * être exclusifs entre eux.
+ *
+ * \param batch taille du lot
+ * \param in taille de l'entrée
+ * \param out taille de la sortie
+ * \return 1 si des noyaux ont été générés pour ces dimensions, 0 sinon
+ */
+int gemm_specialize(int batch, int in, int out)
+{
+  int i, nb = atomic_load(&gemm_nb_spec);
+  for (i = 0; i < nb; i++)
+    if (gemm_spec[i]->batch == batch && gemm_spec[i]->in == in && gemm_spec[i]->out == out)
+      return 1;
+
+  for (i = 0; i < kgen_nb_kernels; i++)
+    if (kgen_kernels[i].batch == batch && kgen_kernels[i].in == in && kgen_kernels[i].out == out) {
+      if (nb == GEMM_MAX_SPEC)
+        return 0;
+      // Entrée écrite avant d'être publiée par le compteur
+      gemm_spec[nb] = &kgen_kernels[i];
+      atomic_store(&gemm_nb_spec, nb + 1);
+      return 1;
+    }
+  return 0;
+}
+
+/**
+ * Activer ou non les noyaux spécialisés retenus.
+ *
+ * \param on 1 : noyaux spécialisés, 0 : noyaux génériques seulement
+ */
+void gemm_set_spec(int on)
+{
+  gemm_spec_on = on;
+}
+
+/**
+ * Utilisation des noyaux spécialisés.
+ *
+ * \return 1 si activés, 0 sinon
+ */
+int gemm_get_spec(void)
+{
+  return gemm_spec_on;
+}
+
+/**
+ * Savoir si les noyaux spécialisés sont utilisés pour des dimensions.
+ *
+ * \param batch taille du lot
+ * \param in taille de l'entrée
+ * \param out taille de la sortie
+ * \return 1 si oui, 0 sinon
+ */
+int gemm_is_specialized(int batch, int in, int out)
+{
+  return gemm_backend == GEMM_INTERNAL && gemm_spec_find(batch, in, out) != NULL;
+}
+
+/**
+ * Propagation avant d'une couche dense : z = act . w + b.
+ *
+ * \param z pré-activation
+ * \param act activation de la couche précédente
+ * \param w poids
+ * \param b biais
+ */
+void gemm_sum_z_act(matrix_t* z, matrix_t* act, matrix_t* w, matrix_t* b)
+{
+  gemm_backends[gemm_backend].sum_z_act(z, act, w, b);
+}
+
+/**
+ * Gradient des poids d'une couche dense : dw = act^T . dz.
+ *
+ * \param dw gradient des poids
+ * \param act activation de la couche précédente
+ * \param dz gradient de la pré-activation
+ */
+void gemm_dot_left(matrix_t* dw, matrix_t* act, matrix_t* dz)
+{
+  gemm_backends[gemm_backend].dot_left(dw, act, dz);
+}
+
+/**
+ * Gradient de l'entrée d'une couche dense : da = dz . w^T.
+ *
+ * \param da gradient de l'entrée
+ * \param dz gradient de la pré-activation
+ * \param w poids
+ */
+void gemm_dot_right(matrix_t* da, matrix_t* dz, matrix_t* w)
+{
+  gemm_backends[gemm_backend].dot_right(da, dz, w);
+}
@@ -0,0 +1,40 @@
+/*!
+ * \file gemm.h
+ * \brief Fichier header de gemm.c
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#ifndef _GEMM_H_
+#define _GEMM_H_
+
+#include "matrix.h"
+
+/* Enumération pour les implémentations des produits matriciels */
+enum GEMM_BACKEND_E {
+  GEMM_INTERNAL = 0, // noyaux de matrix.c
+  GEMM_CBLAS, // CBLAS installée (OpenBLAS, BLIS), avec make CBLAS=1
+  GEMM_NB_BACKENDS
+};
+
+typedef struct gemm_backend gemm_backend_t;
+/* Structure représentant une implémentation des produits matriciels des
+ * couches denses (propagation avant et arrière). */
+struct gemm_backend {
+  const char* name; // nom de l'implémentation
+  void (*sum_z_act)(matrix_t*, matrix_t*, matrix_t*, matrix_t*); // z = act . w + b
+  void (*dot_left)(matrix_t*, matrix_t*, matrix_t*); // dw = act^T . dz
+  void (*dot_right)(matrix_t*, matrix_t*, matrix_t*); // da = dz . w^T
+};
+
+int gemm_available(int);
+void gemm_set_backend(int);
+int gemm_get_backend(void);
+const char* gemm_backend_name(int);
+int gemm_specialize(int, int, int);
+void gemm_set_spec(int);
+int gemm_get_spec(void);
+int gemm_is_specialized(int, int, int);
+void gemm_sum_z_act(matrix_t*, matrix_t*, matrix_t*, matrix_t*);
+void gemm_dot_left(matrix_t*, matrix_t*, matrix_t*);
+void gemm_dot_right(matrix_t*, matrix_t*, matrix_t*);
+
+#endif
@@ -0,0 +1,149 @@
+/*!
+ * \file hogwild.c
+ * \brief Fichier comprenant l'apprentissage asynchrone sans verrou
+ * (Hogwild) du modèle GAN : plusieurs threads exécutent la boucle
+ * d'apprentissage en même temps et écrivent directement dans les poids
+ * partagés.
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include "hogwild.h"
+#include "mem.h"
+#include "prof.h"
+#include "trace.h"
+
+typedef struct hogwild_worker hogwild_worker_t;
+/* Structure représentant un thread d'apprentissage Hogwild */
+struct hogwild_worker {
+  int id; // identifiant du thread
+  unsigned int seed; // graine pour le bruit du generator
+  config_t* cfg; // structure config
+  gan_t* gan; // réplique du GAN (poids partagés)
+  mnist_t* mnist; // structure mnist
+  pthread_barrier_t* barrier; // barrière de fin d'itération
+  double elapsed; // temps d'apprentissage (thread 0)
+};
+
+/**
+ * Boucle d'apprentissage d'un thread : chaque thread traite un lot sur
+ * 'nb_threads' et met à jour les poids partagés sans synchronisation.
+ * Les écritures concurrentes sur les poids sont des courses bénignes :
+ * une mise à jour peut en écraser une autre, ce que Hogwild tolère.
+ *
+ * \param arg structure hogwild_worker
+ * \return NULL
+ */
+static void* hogwild_worker(void* arg)
+{
+  hogwild_worker_t* wk = (hogwild_worker_t*)arg;
+  config_t* cfg = wk->cfg;
+  gan_t* gan = wk->gan;
+  int i, j, out = gan->nb_layers - 2;
+  struct timespec start, end;
+
+  matrix_t* z = mat_zinit(cfg->batch_sz, gan->input_layer_sz_g);
+  matrix_t* x_real = mat_zinit(cfg->batch_sz, cfg->x_train->cols);
+  matrix_t* loss_d = mat_zinit(gan->d->a_fake[out]->rows, gan->d->a_real[out]->cols);
+  matrix_t* loss_g = mat_zinit(gan->d->a_fake[out]->rows, gan->d->a_fake[out]->cols);
+
+  for (i = 0; i < gan->epochs; i++) {
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (j = wk->id; j < cfg->num_batches; j += cfg->nb_threads) {
+      TRACE_STEP();
+      generate_noise(z, &wk->seed);
+      load_batch(cfg, x_real, j);
+      select_batch(cfg, gan, j);
+
+      train_gan_step(gan, z, x_real);
+      if (wk->id == 0)
+        monitor_publish(wk->mnist->monitor, gan->g->a[out], gan->d->a_real[out], gan->d->a_fake[out],
+          gan->lr, (long)i * cfg->num_batches + j, i);
+    }
+    pthread_barrier_wait(wk->barrier);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (wk->id == 0) {
+      wk->elapsed += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+      PROF_EPOCH(i);
+      MEM_EPOCH(i);
+
+      if (cfg->progressbar)
+        print_progressbar(i, PRINT_EP, gan->epochs);
+
+      if (cfg->verbose && i % PRINT_EP == 0)
+        print_loss(wk->mnist, gan, i, loss_d, loss_g, (double)(i + 1) * cfg->train_sz / wk->elapsed);
+    }
+
+    gan->lr = gan->lr * (1.0 / (1.0 + gan->dr * i));
+  }
+
+  if (wk->id == 0) {
+    mat_ce_(loss_d, gan->d->a_fake[out], gan->d->a_real[out]);
+    mat_log_(loss_g, gan->d->a_fake[out]);
+    printf("[hogwild] threads: %u, img/s: %.1f, loss_d: %.3f, loss_g: %.3f\n",
+      cfg->nb_threads, (double)gan->epochs * cfg->train_sz / wk->elapsed, mat_mean(loss_d), mat_mean(loss_g));
+  }
+
+  mat_free(z);
+  mat_free(x_real);
+  mat_free(loss_d);
+  mat_free(loss_g);
+  return NULL;
+}
+
+/**
+ * Entraîner le modèle GAN en mode Hogwild : 'nb_threads' threads exécutent
+ * chacun la boucle complète (bruit, propagations avant et arrière, SGD) sur
+ * leur part des lots, avec les poids du GAN partagés et sans verrou. Le thread 0
+ * utilise directement le modèle passé en paramètre, les autres des répliques.
+ * Le débit (images/s) et les pertes sont affichés comme pour train_gan afin
+ * de pouvoir comparer les deux modes.
+ *
+ * \param cfg structure config
+ * \param gan structure gan
+ * \param mnist structure mnist
+ */
+void train_gan_hogwild(config_t* cfg, gan_t* gan, mnist_t* mnist)
+{
+  int t, nb_threads = cfg->nb_threads > 0 ? cfg->nb_threads : 1;
+  cfg->nb_threads = nb_threads;
+
+  pthread_t* threads = (pthread_t*)malloc(nb_threads * sizeof(*threads));
+  assert(threads);
+  hogwild_worker_t* workers = (hogwild_worker_t*)malloc(nb_threads * sizeof(*workers));
+  assert(workers);
+
+  pthread_barrier_t barrier;
+  pthread_barrier_init(&barrier, NULL, nb_threads);
+
+  for (t = 0; t < nb_threads; t++) {
+    workers[t].id = t;
+    workers[t].seed = (unsigned int)rand() + t;
+    workers[t].cfg = cfg;
+    workers[t].gan = t == 0 ? gan : init_gan_replica(cfg, gan);
+    workers[t].mnist = mnist;
+    workers[t].barrier = &barrier;
+    workers[t].elapsed = 0.0;
+  }
+
+  for (t = 0; t < nb_threads; t++) {
+    if (pthread_create(&threads[t], NULL, hogwild_worker, &workers[t])) {
+      fprintf(stderr, "Error: could not create hogwild thread. \n");
+      exit(1);
+    }
+  }
+
+  for (t = 0; t < nb_threads; t++)
+    pthread_join(threads[t], NULL);
+
+  for (t = 1; t < nb_threads; t++)
+    free_gan_replica(workers[t].gan);
+
+  pthread_barrier_destroy(&barrier);
+  free(workers);
+  free(threads);
+}
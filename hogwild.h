@@ -0,0 +1,13 @@
+/*!
+ * \file hogwild.h
+ * \brief Fichier header de hogwild.c
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#ifndef _HOGWILD_H_
+#define _HOGWILD_H_
+
+#include "gan.h"
+
+void train_gan_hogwild(config_t*, gan_t*, mnist_t*);
+
+#endif
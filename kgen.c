@@ -0,0 +1,243 @@
+/*!
+ * \file kgen.c
+ * \brief Générateur des noyaux spécialisés : lit un fichier de configuration
+ * (gan.cfg) et écrit kernels_gen.c, qui contient pour chaque couche dense du
+ * generator et du discriminator les produits matriciels de la propagation
+ * avant et arrière avec toutes les dimensions en constantes (boucles sans
+ * borne à l'exécution, déroulées et vectorisées par le compilateur).
+ * Les sommes sont faites dans le même ordre que les noyaux de matrix.c :
+ * les résultats sont identiques bit à bit.
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "config.h"
+#include "mnist.h"
+#include "matrix.h"
+#include "conv.h"
+
+// Nombre max. de dimensions de couches distinctes
+#define KGEN_MAX_SHAPES 16
+
+typedef struct kgen_shape kgen_shape_t;
+/* Structure représentant les dimensions d'une couche dense */
+struct kgen_shape {
+  int batch; // taille du lot
+  int in; // taille de l'entrée
+  int out; // taille de la sortie
+};
+
+// Corps d'un panneau de 'width' colonnes (à partir de la colonne p)
+typedef void (*kgen_panel_fn)(FILE*, const kgen_shape_t*, int);
+
+/**
+ * Ajouter les dimensions d'une couche dense si elles ne sont pas déjà présentes.
+ *
+ * \param shapes dimensions déjà trouvées
+ * \param nb nombre de dimensions
+ * \param batch taille du lot
+ * \param in taille de l'entrée
+ * \param out taille de la sortie
+ * \return nouveau nombre de dimensions
+ */
+static int add_shape(kgen_shape_t* shapes, int nb, int batch, int in, int out)
+{
+  int i;
+  for (i = 0; i < nb; i++)
+    if (shapes[i].batch == batch && shapes[i].in == in && shapes[i].out == out)
+      return nb;
+
+  assert(nb < KGEN_MAX_SHAPES);
+  shapes[nb].batch = batch;
+  shapes[nb].in = in;
+  shapes[nb].out = out;
+  return nb + 1;
+}
+
+/**
+ * Ecrire les panneaux d'un noyau : une boucle sur les panneaux complets de
+ * MAT_PACK_NR colonnes, puis le panneau restant.
+ *
+ * \param fp fichier généré
+ * \param s dimensions de la couche
+ * \param n nombre de colonnes du résultat
+ * \param panel corps d'un panneau
+ */
+static void emit_panels(FILE* fp, const kgen_shape_t* s, int n, kgen_panel_fn panel)
+{
+  int full = n / MAT_PACK_NR * MAT_PACK_NR;
+
+  if (full) {
+    fprintf(fp, "  for (p = 0; p < %d; p += %d) {\n", full, MAT_PACK_NR);
+    panel(fp, s, MAT_PACK_NR);
+    fprintf(fp, "  }\n");
+  }
+  if (n > full) {
+    fprintf(fp, "  p = %d;\n  {\n", full);
+    panel(fp, s, n - full);
+    fprintf(fp, "  }\n");
+  }
+}
+
+/**
+ * Ecrire la mise à zéro, puis la boucle d'accumulation d'un panneau.
+ *
+ * \param fp fichier généré
+ * \param width largeur du panneau
+ * \param k_dim dimension commune
+ * \param x terme de la matrice de gauche (dépend de r et k)
+ * \param y terme de la matrice de droite (dépend de k et p + j)
+ */
+static void emit_acc(FILE* fp, int width, int k_dim, const char* x, const char* y)
+{
+  fprintf(fp, "      for (j = 0; j < %d; j++)\n        acc[j] = 0.0;\n", width);
+  fprintf(fp, "      for (k = 0; k < %d; k++) {\n", k_dim);
+  fprintf(fp, "        double x = %s;\n", x);
+  fprintf(fp, "        for (j = 0; j < %d; j++)\n          acc[j] += x * %s;\n      }\n", width, y);
+}
+
+/**
+ * Panneau de la propagation avant : z = act . w + b, w lue directement
+ * (ses lignes sont contiguës sur les colonnes du panneau).
+ */
+static void panel_sum_z_act(FILE* fp, const kgen_shape_t* s, int width)
+{
+  char x[64], y[64];
+  snprintf(x, sizeof(x), "act[r * %d + k]", s->in);
+  snprintf(y, sizeof(y), "w[k * %d + p + j]", s->out);
+
+  fprintf(fp, "    for (r = 0; r < %d; r++) {\n", s->batch);
+  emit_acc(fp, width, s->in, x, y);
+  fprintf(fp, "      for (j = 0; j < %d; j++)\n        z[r * %d + p + j] = acc[j] + b[p + j];\n    }\n",
+    width, s->out);
+}
+
+/**
+ * Panneau du gradient des poids : dw = act^T . dz.
+ */
+static void panel_dot_left(FILE* fp, const kgen_shape_t* s, int width)
+{
+  char x[64], y[64];
+  snprintf(x, sizeof(x), "act[k * %d + r]", s->in);
+  snprintf(y, sizeof(y), "dz[k * %d + p + j]", s->out);
+
+  fprintf(fp, "    for (r = 0; r < %d; r++) {\n", s->in);
+  emit_acc(fp, width, s->batch, x, y);
+  fprintf(fp, "      for (j = 0; j < %d; j++)\n        dw[r * %d + p + j] = acc[j];\n    }\n",
+    width, s->out);
+}
+
+/**
+ * Panneau du gradient de l'entrée : da = dz . w^T, w^T pré-emballée
+ * (panneaux de MAT_PACK_NR colonnes).
+ */
+static void panel_dot_right(FILE* fp, const kgen_shape_t* s, int width)
+{
+  char x[64], y[64];
+  snprintf(x, sizeof(x), "dz[r * %d + k]", s->out);
+  snprintf(y, sizeof(y), "panel[p * %d + k * %d + j]", s->out, MAT_PACK_NR);
+
+  fprintf(fp, "    for (r = 0; r < %d; r++) {\n", s->batch);
+  emit_acc(fp, width, s->out, x, y);
+  fprintf(fp, "      for (j = 0; j < %d; j++)\n        da[r * %d + p + j] = acc[j];\n    }\n",
+    width, s->in);
+}
+
+/**
+ * Ecrire un noyau d'une couche dense.
+ *
+ * \param fp fichier généré
+ * \param name nom du noyau
+ * \param s dimensions de la couche
+ * \param params paramètres du noyau
+ * \param n nombre de colonnes du résultat
+ * \param panel corps d'un panneau
+ */
+static void emit_kernel(FILE* fp, const char* name, const kgen_shape_t* s, const char* params, int n,
+  kgen_panel_fn panel)
+{
+  fprintf(fp, "\nstatic void %s_%dx%dx%d(%s)\n{\n", name, s->batch, s->in, s->out, params);
+  fprintf(fp, "  int r, k, j, p;\n  double acc[%d];\n\n", MAT_PACK_NR);
+  emit_panels(fp, s, n, panel);
+  fprintf(fp, "}\n");
+}
+
+/**
+ * Ecrire les trois noyaux d'une couche dense.
+ *
+ * \param fp fichier généré
+ * \param s dimensions de la couche
+ */
+static void emit_layer(FILE* fp, const kgen_shape_t* s)
+{
+  fprintf(fp, "\n/* Couche %d x %d x %d */\n", s->batch, s->in, s->out);
+  emit_kernel(fp, "kg_sum_z_act", s,
+    "double* restrict z, const double* restrict act, const double* restrict w, const double* restrict b",
+    s->out, panel_sum_z_act);
+  emit_kernel(fp, "kg_dot_left", s, "double* restrict dw, const double* restrict act, const double* restrict dz",
+    s->out, panel_dot_left);
+  emit_kernel(fp, "kg_dot_right", s, "double* restrict da, const double* restrict dz, const double* restrict panel",
+    s->in, panel_dot_right);
+}
+
+/**
+ * Cas d'usage du programme.
+ */
+static void usage(char* exec)
+{
+  fprintf(stderr, "Usage: %s <config> <sortie.c>\n", exec);
+  exit(1);
+}
+
+int main(int argc, char* argv[])
+{
+  int i, nb = 0;
+  kgen_shape_t shapes[KGEN_MAX_SHAPES];
+  FILE* fp;
+
+  if (argc != 3)
+    usage(argv[0]);
+
+  config_t* cfg = init_config(argv[1]);
+  if (cfg->nb_layers < 3) {
+    fprintf(stderr, "Error: LAYERS must be at least 3 (%d). \n", cfg->nb_layers);
+    exit(1);
+  }
+
+  // Couches denses, comme dans init_gan (les couches convolutives gardent
+  // leurs noyaux, les couches cachées de même taille partagent le leur)
+  load_image_config(cfg);
+  int out = cfg->nb_layers - 2;
+  int hd_d = cfg->conv_d ? cfg->conv_d * (cfg->img_h / CONV_STRIDE) * (cfg->img_w / CONV_STRIDE) : cfg->hd_layer_sz_d;
+  int hd_g = cfg->conv_g ? cfg->conv_g * (cfg->img_h / CONV_STRIDE) * (cfg->img_w / CONV_STRIDE) : cfg->hd_layer_sz_g;
+  for (i = 0; i < out || (i == out && !cfg->conv_g); i++)
+    nb = add_shape(shapes, nb, cfg->batch_sz, i ? cfg->hd_layer_sz_g : cfg->in_layer_sz_g,
+      i < out - 1 ? cfg->hd_layer_sz_g : i < out ? hd_g : cfg->img_sz);
+  for (i = cfg->conv_d ? 1 : 0; i <= out; i++)
+    nb = add_shape(shapes, nb, cfg->batch_sz, i == 0 ? cfg->img_sz : i == 1 ? hd_d : cfg->hd_layer_sz_d,
+      i == out ? 1 : i == 0 ? hd_d : cfg->hd_layer_sz_d);
+
+  if ((fp = fopen(argv[2], "w")) == NULL) {
+    fprintf(stderr, "Error: could not open file %s. \n", argv[2]);
+    exit(1);
+  }
+
+  fprintf(fp, "/* Fichier généré par kgen à partir de %s : ne pas modifier. */\n", argv[1]);
+  fprintf(fp, "#include \"kgen.h\"\n");
+  for (i = 0; i < nb; i++)
+    emit_layer(fp, &shapes[i]);
+
+  fprintf(fp, "\nconst char kgen_config[] = \"%s\";\n\n", argv[1]);
+  fprintf(fp, "const kgen_kernel_t kgen_kernels[] = {\n");
+  for (i = 0; i < nb; i++)
+    fprintf(fp, "  {%d, %d, %d, kg_sum_z_act_%dx%dx%d, kg_dot_left_%dx%dx%d, kg_dot_right_%dx%dx%d},\n",
+      shapes[i].batch, shapes[i].in, shapes[i].out, shapes[i].batch, shapes[i].in, shapes[i].out,
+      shapes[i].batch, shapes[i].in, shapes[i].out, shapes[i].batch, shapes[i].in, shapes[i].out);
+  fprintf(fp, "};\n\nconst int kgen_nb_kernels = %d;\n", nb);
+
+  fclose(fp);
+  printf("%s: %d layer shapes from %s\n", argv[2], nb, argv[1]);
+  free_config(cfg);
+  return 0;
+}
@@ -0,0 +1,32 @@
+/*!
+ * \file kgen.h
+ * \brief Fichier header des noyaux spécialisés générés par kgen.c
+ * (kernels_gen.c) pour les dimensions des couches denses de gan.cfg.
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#ifndef _KGEN_H_
+#define _KGEN_H_
+
+typedef struct kgen_kernel kgen_kernel_t;
+/* Structure représentant les noyaux d'une couche dense de dimensions fixées
+ * à la compilation (lot x entrée x sortie). */
+struct kgen_kernel {
+  int batch; // taille du lot
+  int in; // taille de l'entrée de la couche
+  int out; // taille de la sortie de la couche
+  // z = act . w + b
+  void (*sum_z_act)(double*, const double*, const double*, const double*);
+  // dw = act^T . dz
+  void (*dot_left)(double*, const double*, const double*);
+  // da = dz . w^T, w^T donnée par ses panneaux pré-emballés (mat_pack_panel)
+  void (*dot_right)(double*, const double*, const double*);
+};
+
+// Fichier de configuration d'où viennent les dimensions
+extern const char kgen_config[];
+// Noyaux générés, un par dimensions de couche
+extern const kgen_kernel_t kgen_kernels[];
+// Nombre de noyaux générés
+extern const int kgen_nb_kernels;
+
+#endif
@@ -0,0 +1,530 @@
+/*!
+ * \file libgan.c
+ * \brief Fichier comprenant l'interface publique réentrante de libgan.a :
+ * la configuration est lue par read_config, les paramètres et les données
+ * sont vérifiés avant d'appeler init_gan et load_mnist_config (qui quittent
+ * le programme en cas d'erreur), chaque
+ * modèle a sa graine et son verrou, et les itérations d'un contexte sont
+ * exécutées par son ordonnanceur (step.c).
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#include <assert.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libgan.h"
+#include "config.h"
+#include "mnist.h"
+#include "gan.h"
+#include "step.h"
+#include "gemm.h"
+#include "fastmath.h"
+#include "tune.h"
+
+// Nombre de couches des modèles construits par init_gan
+#define LIBGAN_LAYERS 3
+// Taille max. d'un message du journal
+#define LIBGAN_MAX_LOG 256
+
+/* Structure représentant un contexte de l'interface */
+struct gan_ctx {
+  gan_callbacks_t cb; // fonctions de l'application
+  unsigned int seed; // graine d'où sont tirées celles des modèles
+  sched_t* sc; // threads partagés par les modèles du contexte
+  pthread_mutex_t lock; // verrou de 'seed', 'sc' et 'nb_models'
+  int nb_models; // nombre de modèles non libérés
+};
+
+/* Structure représentant un modèle créé par gan_model_create */
+struct gan_model {
+  gan_ctx_t* ctx; // contexte du modèle
+  config_t* cfg; // configuration et données d'apprentissage
+  gan_t* gan; // structure gan
+  step_t* st; // itération d'apprentissage
+  unsigned int seed; // graine des poids et du bruit du modèle
+  int batch; // prochain lot
+  int epoch; // itération en cours
+  matrix_t* loss_d; // perte du discriminator
+  matrix_t* loss_g; // perte du generator
+  pthread_mutex_t lock; // verrou du modèle (apprentissage et génération)
+};
+
+// Paramètres communs au processus, fixés par le premier modèle créé
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+static int shared_models = 0;
+static int shared_fast_math, shared_gemm, shared_kgen;
+
+/**
+ * Allouer un bloc avec la fonction du contexte.
+ *
+ * \param ctx contexte
+ * \param size taille en octets
+ * \return bloc alloué (NULL en cas d'échec)
+ */
+static void* ctx_alloc(gan_ctx_t* ctx, size_t size)
+{
+  return ctx->cb.alloc ? ctx->cb.alloc(size, ctx->cb.user) : malloc(size);
+}
+
+/**
+ * Libérer un bloc alloué par ctx_alloc.
+ *
+ * \param ctx contexte
+ * \param ptr bloc
+ */
+static void ctx_free(gan_ctx_t* ctx, void* ptr)
+{
+  if (ctx->cb.free)
+    ctx->cb.free(ptr, ctx->cb.user);
+  else
+    free(ptr);
+}
+
+/**
+ * Ecrire un message dans le journal du contexte.
+ *
+ * \param ctx contexte
+ * \param level niveau (GAN_LOG_E)
+ * \param fmt format du message
+ */
+static void ctx_log(gan_ctx_t* ctx, int level, const char* fmt, ...)
+{
+  char msg[LIBGAN_MAX_LOG];
+  va_list ap;
+  if (!ctx->cb.log)
+    return;
+
+  va_start(ap, fmt);
+  vsnprintf(msg, sizeof(msg), fmt, ap);
+  va_end(ap);
+  ctx->cb.log(level, msg, ctx->cb.user);
+}
+
+/**
+ * Vérifier les paramètres de la configuration utilisés par init_gan.
+ *
+ * \param ctx contexte
+ * \param cfg structure config
+ * \param config fichier de configuration
+ * \return GAN_OK ou GAN_ERR_CONFIG
+ */
+static int check_config(gan_ctx_t* ctx, config_t* cfg, const char* config)
+{
+  const char* err = NULL;
+  if (cfg->nb_layers != LIBGAN_LAYERS)
+    err = "LAYERS must be 3";
+  else if (cfg->batch_sz == 0 || cfg->in_layer_sz_g == 0)
+    err = "BATCH and IN_G must be positive";
+  else if ((!cfg->conv_g && cfg->hd_layer_sz_g == 0) || (!cfg->conv_d && cfg->hd_layer_sz_d == 0))
+    err = "HD_G and HD_D must be positive";
+  else if ((cfg->img_sz && cfg->img_sz != MNIST_SIZE) || (cfg->img_w && cfg->img_w != MNIST_WIDTH) ||
+    (cfg->img_h && cfg->img_h != MNIST_HEIGHT) || (cfg->img_ch && cfg->img_ch != 1))
+    err = "images must be 28 x 28 x 1 (IMG_W, IMG_H, IMG_CH, IMG_SZ)";
+  else if (cfg->fast_math < 0 || cfg->fast_math >= FM_NB_TIERS)
+    err = "invalid FAST_MATH";
+  else if (!gemm_available(cfg->gemm))
+    err = "GEMM backend not available";
+  else if (cfg->conv_algo < CONV_AUTO || cfg->conv_algo > CONV_DIRECT)
+    err = "invalid CONV_ALGO";
+  else if (cfg->stream)
+    err = "STREAM is not supported (the data are given by the application)";
+  else if (cfg->checkpoint > 1)
+    err = "CHECKPOINT is not supported (iterations run by the scheduler)";
+
+  if (err) {
+    ctx_log(ctx, GAN_LOG_ERROR, "%s: %s", config, err);
+    return GAN_ERR_CONFIG;
+  }
+  return GAN_OK;
+}
+
+/**
+ * Vérifier l'entrée du cache de réglage (TUNE_FILE) de ces dimensions,
+ * qui arrêterait le programme dans init_gan.
+ *
+ * \param ctx contexte
+ * \param cfg structure config (dimensions des images connues)
+ * \param config fichier de configuration
+ * \return GAN_OK ou GAN_ERR_CONFIG
+ */
+static int check_tune(gan_ctx_t* ctx, config_t* cfg, const char* config)
+{
+  tune_t tune;
+  tune_defaults(cfg, &tune);
+  if (tune_load(cfg->tune_file, cfg, &tune) < 0) {
+    ctx_log(ctx, GAN_LOG_ERROR, "%s: bad tuning entry in %s", config, cfg->tune_file);
+    return GAN_ERR_CONFIG;
+  }
+  return GAN_OK;
+}
+
+/**
+ * Vérifier que les données permettent au moins un lot, comme
+ * load_mnist_config.
+ *
+ * \param ctx contexte
+ * \param cfg structure config
+ * \param labels labels des images
+ * \param num nombre d'images
+ * \return GAN_OK ou GAN_ERR_DATA
+ */
+static int check_data(gan_ctx_t* ctx, config_t* cfg, const unsigned int* labels, int num)
+{
+  int i, size = 0, n = (int)cfg->num_train < num ? (int)cfg->num_train : num;
+  for (i = 0; i < n; i++) {
+    if (cfg->cond && labels[i] >= MNIST_NUM_CLASSES) {
+      ctx_log(ctx, GAN_LOG_ERROR, "invalid label %u for the conditional GAN", labels[i]);
+      return GAN_ERR_DATA;
+    }
+    if (cfg->cond || labels[i] == cfg->chosen_label)
+      size++;
+  }
+
+  if (size < (int)cfg->batch_sz) {
+    ctx_log(ctx, GAN_LOG_ERROR, "not enough images with label %u for one batch", cfg->chosen_label);
+    return GAN_ERR_DATA;
+  }
+  return GAN_OK;
+}
+
+/**
+ * Récupérer les données d'apprentissage du modèle (load_mnist_config) à
+ * partir des images brutes de l'application.
+ *
+ * \param ctx contexte
+ * \param cfg structure config
+ * \param images images brutes (MNIST_SIZE octets par image)
+ * \param labels labels des images
+ * \param num nombre d'images
+ * \return GAN_OK ou GAN_ERR_ALLOC
+ */
+static int load_data(gan_ctx_t* ctx, config_t* cfg, const unsigned char* images, const unsigned int* labels, int num)
+{
+  int i, j;
+  mnist_t data;
+  memset(&data, 0, sizeof(data));
+  data.num_train = (int)cfg->num_train < num ? (int)cfg->num_train : num;
+  data.img_sz = MNIST_SIZE;
+  data.width = MNIST_WIDTH;
+  data.height = MNIST_HEIGHT;
+  data.channels = 1;
+
+  double** rows = (double**)ctx_alloc(ctx, data.num_train * sizeof(*rows));
+  double* pixels = (double*)ctx_alloc(ctx, (size_t)data.num_train * MNIST_SIZE * sizeof(*pixels));
+  if (!rows || !pixels) {
+    if (rows)
+      ctx_free(ctx, rows);
+    if (pixels)
+      ctx_free(ctx, pixels);
+    ctx_log(ctx, GAN_LOG_ERROR, "could not allocate the training images");
+    return GAN_ERR_ALLOC;
+  }
+
+  for (i = 0; i < data.num_train; i++) {
+    rows[i] = pixels + (size_t)i * MNIST_SIZE;
+    for (j = 0; j < MNIST_SIZE; j++)
+      rows[i][j] = ((double)images[(size_t)i * MNIST_SIZE + j] - 127.5) / 127.5;
+  }
+  data.train_image = rows;
+  data.train_label = (unsigned int*)labels;
+
+  load_mnist_config(cfg, &data);
+  ctx_free(ctx, pixels);
+  ctx_free(ctx, rows);
+  return GAN_OK;
+}
+
+/**
+ * Créer un contexte : les modèles du contexte tirent leur graine de 'seed'
+ * et exécutent leurs itérations sur 'nb_threads' threads (un modèle à la
+ * fois ; un contexte par groupe de modèles à entraîner en parallèle).
+ *
+ * \param cb fonctions de l'application (NULL : malloc, free, sans journal)
+ * \param seed graine du contexte
+ * \param nb_threads nombre de threads
+ * \param out contexte créé
+ * \return code de retour (GAN_STATUS_E)
+ */
+int gan_ctx_create(const gan_callbacks_t* cb, unsigned int seed, int nb_threads, gan_ctx_t** out)
+{
+  if (!out || nb_threads < 0)
+    return GAN_ERR_ARG;
+
+  gan_ctx_t* ctx = (gan_ctx_t*)(cb && cb->alloc ? cb->alloc(sizeof(*ctx), cb->user) : malloc(sizeof(*ctx)));
+  if (!ctx)
+    return GAN_ERR_ALLOC;
+
+  memset(ctx, 0, sizeof(*ctx));
+  if (cb)
+    ctx->cb = *cb;
+  ctx->seed = seed;
+  ctx->nb_models = 0;
+  ctx->sc = sched_init(nb_threads, STEP_NB_TASKS(LIBGAN_LAYERS));
+  pthread_mutex_init(&ctx->lock, NULL);
+
+  *out = ctx;
+  return GAN_OK;
+}
+
+/**
+ * Libérer un contexte, une fois tous ses modèles libérés.
+ *
+ * \param ctx contexte
+ * \return code de retour (GAN_STATUS_E)
+ */
+int gan_ctx_free(gan_ctx_t* ctx)
+{
+  if (!ctx)
+    return GAN_ERR_ARG;
+  if (ctx->nb_models) {
+    ctx_log(ctx, GAN_LOG_ERROR, "%d models of the context are not freed", ctx->nb_models);
+    return GAN_ERR_ARG;
+  }
+
+  sched_free(ctx->sc);
+  pthread_mutex_destroy(&ctx->lock);
+  ctx_free(ctx, ctx);
+  return GAN_OK;
+}
+
+/**
+ * Créer un modèle à partir d'un fichier de configuration (format gan.cfg)
+ * et d'images d'apprentissage brutes (MNIST_SIZE octets par image). Les
+ * données sont copiées : l'application peut libérer 'images' et 'labels'.
+ * FAST_MATH, GEMM et KGEN sont communs au processus : ils doivent être
+ * identiques pour tous les modèles.
+ *
+ * \param ctx contexte
+ * \param config fichier de configuration
+ * \param images images brutes
+ * \param labels labels des images
+ * \param num nombre d'images
+ * \param out modèle créé
+ * \return code de retour (GAN_STATUS_E)
+ */
+int gan_model_create(gan_ctx_t* ctx, const char* config, const unsigned char* images, const unsigned int* labels,
+  int num, gan_model_t** out)
+{
+  int status;
+  char err[CONFIG_MAX_ERR];
+  if (!ctx || !config || !images || !labels || num <= 0 || !out)
+    return GAN_ERR_ARG;
+
+  gan_model_t* model = (gan_model_t*)ctx_alloc(ctx, sizeof(*model));
+  if (!model) {
+    ctx_log(ctx, GAN_LOG_ERROR, "could not allocate the model");
+    return GAN_ERR_ALLOC;
+  }
+  memset(model, 0, sizeof(*model));
+  model->ctx = ctx;
+  if ((model->cfg = read_config(config, err, sizeof(err))) == NULL) {
+    ctx_log(ctx, GAN_LOG_ERROR, "%s", err);
+    ctx_free(ctx, model);
+    return GAN_ERR_CONFIG;
+  }
+
+  if ((status = check_config(ctx, model->cfg, config)) != GAN_OK ||
+    (status = check_data(ctx, model->cfg, labels, num)) != GAN_OK ||
+    (status = load_data(ctx, model->cfg, images, labels, num)) != GAN_OK ||
+    (status = check_tune(ctx, model->cfg, config)) != GAN_OK) {
+    free_config(model->cfg);
+    ctx_free(ctx, model);
+    return status;
+  }
+
+  pthread_mutex_lock(&ctx->lock);
+  model->seed = rand_r(&ctx->seed);
+  pthread_mutex_unlock(&ctx->lock);
+
+  // init_gan fixe les paramètres communs au processus : ceux du premier
+  // modèle sont conservés (cache de réglage compris)
+  pthread_mutex_lock(&shared_lock);
+  if (shared_models && (model->cfg->fast_math != shared_fast_math || model->cfg->gemm != shared_gemm ||
+    model->cfg->kgen != shared_kgen)) {
+    pthread_mutex_unlock(&shared_lock);
+    ctx_log(ctx, GAN_LOG_ERROR, "%s: FAST_MATH, GEMM and KGEN must be the same for all the models", config);
+    free_config(model->cfg);
+    ctx_free(ctx, model);
+    return GAN_ERR_SHARED;
+  }
+  // Les modèles suivants ne changent pas les noyaux utilisés par les
+  // modèles en cours d'apprentissage
+  model->gan = init_gan_r(model->cfg, &model->seed, !shared_models);
+  if (!shared_models) {
+    shared_fast_math = model->cfg->fast_math;
+    shared_gemm = model->cfg->gemm;
+    shared_kgen = model->cfg->kgen;
+  }
+  shared_models++;
+  pthread_mutex_unlock(&shared_lock);
+
+  int last = model->gan->nb_layers - 2;
+  model->st = init_step_shared(model->cfg, model->gan, ctx->sc, &model->seed);
+  model->loss_d = mat_zinit(model->gan->d->a_fake[last]->rows, model->gan->d->a_real[last]->cols);
+  model->loss_g = mat_zinit(model->gan->d->a_fake[last]->rows, model->gan->d->a_fake[last]->cols);
+  pthread_mutex_init(&model->lock, NULL);
+
+  pthread_mutex_lock(&ctx->lock);
+  ctx->nb_models++;
+  pthread_mutex_unlock(&ctx->lock);
+
+  ctx_log(ctx, GAN_LOG_INFO, "%s: %u batches of %u images", config, model->cfg->num_batches, model->cfg->batch_sz);
+  *out = model;
+  return GAN_OK;
+}
+
+/**
+ * Entraîner le modèle sur le lot suivant (une itération du graphe de tâches
+ * sur les threads du contexte). Après le dernier lot, le coefficient
+ * d'apprentissage décroît comme dans train_gan.
+ *
+ * \param model modèle
+ * \param loss_d perte du discriminator sur le lot (NULL : non calculée)
+ * \param loss_g perte du generator sur le lot (NULL : non calculée)
+ * \return code de retour (GAN_STATUS_E)
+ */
+int gan_model_train_step(gan_model_t* model, double* loss_d, double* loss_g)
+{
+  if (!model)
+    return GAN_ERR_ARG;
+
+  gan_ctx_t* ctx = model->ctx;
+  gan_t* gan = model->gan;
+  int last = gan->nb_layers - 2;
+
+  pthread_mutex_lock(&model->lock);
+  pthread_mutex_lock(&ctx->lock);
+  sched_clear(ctx->sc);
+  build_step(model->st);
+  run_step(model->st, model->batch);
+  pthread_mutex_unlock(&ctx->lock);
+
+  if (loss_d) {
+    mat_ce_(model->loss_d, gan->d->a_fake[last], gan->d->a_real[last]);
+    *loss_d = mat_mean(model->loss_d);
+  }
+  if (loss_g) {
+    mat_log_(model->loss_g, gan->d->a_fake[last]);
+    *loss_g = mat_mean(model->loss_g);
+  }
+
+  if (++model->batch == model->cfg->num_batches) {
+    model->batch = 0;
+    gan->lr = gan->lr * (1.0 / (1.0 + gan->dr * model->epoch));
+    model->epoch++;
+    ctx_log(ctx, GAN_LOG_INFO, "epoch %d done, lr: %f", model->epoch, gan->lr);
+  }
+  pthread_mutex_unlock(&model->lock);
+  return GAN_OK;
+}
+
+/**
+ * Générer 'nb_images' images (MNIST_SIZE valeurs entre -1 et 1 par image)
+ * avec le generator, sans modifier le modèle : les normalisations utilisent
+ * leurs statistiques cumulées. En mode conditionnel, toutes les images sont
+ * du chiffre 'digit', ou de chaque chiffre à tour de rôle.
+ *
+ * \param model modèle
+ * \param digit chiffre demandé (GAN conditionnel)
+ * \param images images générées
+ * \param nb_images nombre d'images
+ * \return code de retour (GAN_STATUS_E)
+ */
+int gan_model_generate(gan_model_t* model, unsigned int digit, double* images, int nb_images)
+{
+  int n, rows;
+  if (!model || !images || nb_images < 0)
+    return GAN_ERR_ARG;
+
+  gan_t* gan = model->gan;
+  int infer = gan->infer;
+  matrix_t* out = gan->g->a[gan->nb_layers - 2];
+
+  pthread_mutex_lock(&model->lock);
+  gan->infer = 1;
+  for (n = 0; n < nb_images; n += rows) {
+    sample_generator(model->cfg, gan, digit, &model->seed);
+    rows = nb_images - n < out->rows ? nb_images - n : out->rows;
+    memcpy(images + (size_t)n * MNIST_SIZE, out->data, (size_t)rows * MNIST_SIZE * sizeof(*images));
+  }
+  gan->infer = infer;
+  pthread_mutex_unlock(&model->lock);
+  return GAN_OK;
+}
+
+/**
+ * Itération en cours du modèle (nombre de passages complets sur ses données).
+ *
+ * \param model modèle
+ * \return itération (-1 si le modèle est invalide)
+ */
+int gan_model_epoch(gan_model_t* model)
+{
+  int epoch;
+  if (!model)
+    return -1;
+
+  pthread_mutex_lock(&model->lock);
+  epoch = model->epoch;
+  pthread_mutex_unlock(&model->lock);
+  return epoch;
+}
+
+/**
+ * Libérer un modèle.
+ *
+ * \param model modèle
+ */
+void gan_model_free(gan_model_t* model)
+{
+  if (!model)
+    return;
+
+  gan_ctx_t* ctx = model->ctx;
+  free_step(model->st);
+  mat_free(model->loss_d);
+  mat_free(model->loss_g);
+  free_gan(model->gan);
+  free_config(model->cfg);
+  pthread_mutex_destroy(&model->lock);
+
+  pthread_mutex_lock(&shared_lock);
+  shared_models--;
+  pthread_mutex_unlock(&shared_lock);
+
+  pthread_mutex_lock(&ctx->lock);
+  ctx->nb_models--;
+  pthread_mutex_unlock(&ctx->lock);
+  ctx_free(ctx, model);
+}
+
+/**
+ * Taille d'une image générée ou d'apprentissage.
+ *
+ * \return nombre de pixels (MNIST_SIZE)
+ */
+int gan_image_size(void)
+{
+  return MNIST_SIZE;
+}
+
+/**
+ * Message d'un code de retour.
+ *
+ * \param status code de retour (GAN_STATUS_E)
+ * \return message
+ */
+const char* gan_strerror(int status)
+{
+  static const char* messages[GAN_NB_STATUS] = {
+    "success",
+    "invalid argument",
+    "allocation failed",
+    "invalid configuration",
+    "invalid training data",
+    "process-wide setting differs from the other models"
+  };
+  return status >= 0 && status < GAN_NB_STATUS ? messages[status] : "unknown error";
+}
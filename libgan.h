@@ -0,0 +1,54 @@
+/*!
+ * \file libgan.h
+ * \brief Interface publique réentrante de libgan.a : un contexte regroupe
+ * l'allocation, le générateur aléatoire, les threads et le journal ; les
+ * modèles créés dans un ou plusieurs contextes s'entraînent et génèrent des
+ * images en même temps dans un même processus. Aucune fonction n'appelle
+ * exit(), n'écrit sur la sortie standard ni n'utilise rand().
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#ifndef _LIBGAN_H_
+#define _LIBGAN_H_
+
+#include <stddef.h>
+
+/* Enumération pour les codes de retour de l'interface */
+enum GAN_STATUS_E {
+  GAN_OK = 0, // succès
+  GAN_ERR_ARG, // paramètre invalide
+  GAN_ERR_ALLOC, // allocation impossible
+  GAN_ERR_CONFIG, // fichier de configuration illisible ou invalide
+  GAN_ERR_DATA, // données d'apprentissage invalides ou insuffisantes
+  GAN_ERR_SHARED, // FAST_MATH, GEMM ou KGEN différent des modèles déjà créés
+  GAN_NB_STATUS
+};
+
+/* Enumération pour les niveaux du journal */
+enum GAN_LOG_E {
+  GAN_LOG_ERROR = 0, // erreur (avant le retour d'un code d'erreur)
+  GAN_LOG_INFO // information (création d'un modèle, fin d'une itération)
+};
+
+typedef struct gan_callbacks gan_callbacks_t;
+/* Structure représentant les fonctions fournies par l'application */
+struct gan_callbacks {
+  void* (*alloc)(size_t, void*); // allocation (NULL : malloc)
+  void (*free)(void*, void*); // libération (NULL : free)
+  void (*log)(int, const char*, void*); // journal, niveau et message (NULL : aucun)
+  void* user; // dernier argument des fonctions
+};
+
+typedef struct gan_ctx gan_ctx_t;
+typedef struct gan_model gan_model_t;
+
+int gan_ctx_create(const gan_callbacks_t*, unsigned int, int, gan_ctx_t**);
+int gan_ctx_free(gan_ctx_t*);
+int gan_model_create(gan_ctx_t*, const char*, const unsigned char*, const unsigned int*, int, gan_model_t**);
+int gan_model_train_step(gan_model_t*, double*, double*);
+int gan_model_generate(gan_model_t*, unsigned int, double*, int);
+int gan_model_epoch(gan_model_t*);
+void gan_model_free(gan_model_t*);
+int gan_image_size(void);
+const char* gan_strerror(int);
+
+#endif
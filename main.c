@@ -7,6 +7,15 @@
 #include "mnist.h"
 #include "matrix.h"
 #include "gan.h"
+#include "hogwild.h"
+#include "pipeline.h"
+#include "step.h"
+#include "mem.h"
+#include "prof.h"
+#include "trace.h"
+#include "throughput.h"
+#include "tune.h"
+#include "sweep.h"
 #define CONFIG_FILENAME "gan.cfg"
 
 /**
@@ -15,25 +24,198 @@
 void usage(char* exec)
 {
   fprintf(stderr, "Usage: %s<output_filename> \n", exec);
+  fprintf(stderr, "       %s synth <images_file> <labels_file> <num_data> [seed] [size] \n", exec);
+  fprintf(stderr, "       %s bench <steps> [output.json] [seed] [images_file labels_file] \n", exec);
+  fprintf(stderr, "       %s scale <steps> [output.json] [seed] \n", exec);
+  fprintf(stderr, "       %s tune [tuning_file] \n", exec);
+  fprintf(stderr, "       %s sweep <config> <output_filename> [<config> <output_filename> ...] \n", exec);
   exit(1);
 }
 
+/**
+ * Ecrire un jeu de données synthétique au format MNIST.
+ */
+int main_synth(int argc, char* argv[])
+{
+  if (argc < 5 || argc > 7)
+    usage(argv[0]);
+
+  int num_data = atoi(argv[4]);
+  unsigned int seed = argc >= 6 ? (unsigned int)atoi(argv[5]) : THROUGHPUT_SEED;
+  int size = argc == 7 ? atoi(argv[6]) : MNIST_WIDTH;
+  if (size < 1)
+    usage(argv[0]);
+  write_mnist_synth(argv[2], argv[3], num_data, seed, size, size);
+  printf("%d images were written in %s and %s. \n", num_data, argv[2], argv[3]);
+  return 0;
+}
+
+/**
+ * Benchmark de bout en bout de l'apprentissage, sur les données de gan.cfg
+ * ou sur les fichiers passés en paramètre.
+ */
+int main_bench(int argc, char* argv[])
+{
+  if (argc < 3 || argc == 6 || argc > 7)
+    usage(argv[0]);
+
+  int steps = atoi(argv[2]);
+  unsigned int seed = argc > 4 ? (unsigned int)atoi(argv[4]) : THROUGHPUT_SEED;
+  if (steps < 1)
+    usage(argv[0]);
+
+  const char config_file[] = CONFIG_FILENAME;
+  config_t* cfg = init_config(config_file);
+  char* image_file = argc == 7 ? argv[5] : cfg->data_img;
+  char* label_file = argc == 7 ? argv[6] : cfg->data_lbl;
+  if (cfg->stream)
+    load_stream_config(cfg, image_file, label_file);
+  else
+    load_mnist_config(cfg, load_mnist(NULL, image_file, label_file));
+
+  srand(seed);
+  gan_t* gan = init_gan(cfg);
+  TRACE_OPEN(cfg->trace_file, cfg->trace_from, cfg->trace_len);
+  bench_train(cfg, gan, steps, seed, argc > 3 ? argv[3] : NULL);
+  TRACE_CLOSE();
+  return 0;
+}
+
+/**
+ * Benchmark du passage à l'échelle : temps d'une itération et mémoire du
+ * modèle de gan.cfg pour des images 28 x 28, 64 x 64 et 128 x 128.
+ */
+int main_scale(int argc, char* argv[])
+{
+  if (argc < 3 || argc > 5)
+    usage(argv[0]);
+
+  int steps = atoi(argv[2]);
+  unsigned int seed = argc > 4 ? (unsigned int)atoi(argv[4]) : THROUGHPUT_SEED;
+  if (steps < 1)
+    usage(argv[0]);
+
+  const char config_file[] = CONFIG_FILENAME;
+  config_t* cfg = init_config(config_file);
+  bench_scale(cfg, steps, seed, argc > 3 ? argv[3] : NULL);
+  free_config(cfg);
+  return 0;
+}
+
+/**
+ * Régler les noyaux sur les couches du modèle de gan.cfg et écrire le
+ * résultat dans le cache de réglage (TUNE_FILE, ou le fichier passé en
+ * paramètre).
+ */
+int main_tune(int argc, char* argv[])
+{
+  if (argc > 3)
+    usage(argv[0]);
+
+  const char config_file[] = CONFIG_FILENAME;
+  config_t* cfg = init_config(config_file);
+  const char* file = argc == 3 ? argv[2] : cfg->tune_file && cfg->tune_file[0] ? cfg->tune_file : TUNE_FILE;
+
+  srand(THROUGHPUT_SEED);
+  gan_t* gan = init_gan(cfg);
+  tune_run(cfg, gan, file);
+  return 0;
+}
+
+/**
+ * Entraîner plusieurs modèles en même temps (balayage d'hyperparamètres),
+ * chacun avec son fichier de configuration et son image en sortie.
+ */
+int main_sweep(int argc, char* argv[])
+{
+  int m, nb_models = (argc - 2) / 2;
+  if (argc < 4 || argc % 2)
+    usage(argv[0]);
+
+  char** configs = (char**)malloc(nb_models * sizeof(*configs));
+  char** outputs = (char**)malloc(nb_models * sizeof(*outputs));
+  assert(configs && outputs);
+  for (m = 0; m < nb_models; m++) {
+    configs[m] = argv[2 + 2 * m];
+    outputs[m] = argv[3 + 2 * m];
+  }
+
+  srand(time(NULL));
+  sweep_t* sw = init_sweep(nb_models, configs, outputs);
+  train_sweep(sw);
+  save_sweep(sw);
+  free_sweep(sw);
+
+  free(configs);
+  free(outputs);
+  MEM_REPORT();
+  return 0;
+}
+
 int main(int argc, char* argv[])
 {
+  if (argc >= 2 && !strcmp(argv[1], "synth"))
+    return main_synth(argc, argv);
+  if (argc >= 2 && !strcmp(argv[1], "bench"))
+    return main_bench(argc, argv);
+  if (argc >= 2 && !strcmp(argv[1], "scale"))
+    return main_scale(argc, argv);
+  if (argc >= 2 && !strcmp(argv[1], "tune"))
+    return main_tune(argc, argv);
+  if (argc >= 2 && !strcmp(argv[1], "sweep"))
+    return main_sweep(argc, argv);
   if (argc != 2)
     usage(argv[0]);
 
   srand(time(NULL));
 
-  mnist_t* mnist = load_mnist(argv[1]);
-
   const char config_file[] = CONFIG_FILENAME;
   config_t* cfg = init_config(config_file);
-  load_mnist_config(cfg, mnist);
+
+  // En lecture en flux, la structure mnist ne garde que la sortie
+  mnist_t* mnist = cfg->stream ? init_mnist(argv[1], 0, 0) : load_mnist(argv[1], cfg->data_img, cfg->data_lbl);
+  if (cfg->stream) {
+    load_stream_config(cfg, cfg->data_img, cfg->data_lbl);
+    mnist->width = cfg->img_w;
+    mnist->height = cfg->img_h;
+    mnist->channels = cfg->img_ch;
+  }
+  else
+    load_mnist_config(cfg, mnist);
+  mnist->snapshot = snapshot_init(argv[1], cfg->snap_nb, cfg->img_w, cfg->img_h, cfg->img_ch);
+  // gan-monitor affiche les canaux l'un sous l'autre
+  mnist->monitor = monitor_open(cfg->monitor, cfg->img_w, cfg->img_h * cfg->img_ch);
+  PROF_OPEN(cfg->prof_file);
+  TRACE_OPEN(cfg->trace_file, cfg->trace_from, cfg->trace_len);
 
   gan_t* gan = init_gan(cfg);
-  train_gan(cfg, gan, mnist);
-  save_mnist_pgm_mat(gan->g->a[gan->nb_layers - 2], mnist);
+  if (cfg->hogwild)
+    train_gan_hogwild(cfg, gan, mnist);
+  else if (cfg->pipeline)
+    train_gan_pipeline(cfg, gan, mnist);
+  else if (cfg->sched)
+    train_gan_sched(cfg, gan, mnist);
+  else
+    train_gan(cfg, gan, mnist);
+  if (gan->ckpt)
+    ckpt_print(gan->ckpt);
+
+  // Generator d'inférence : normalisations repliées dans les poids
+  int folded = fold_generator(gan);
+  if (folded)
+    printf("[bn] folded layers: %d\n", folded);
+  // Dernier lot généré par le generator d'inférence (chiffre 'LABEL' en
+  // mode conditionnel, ou tous les chiffres si LABEL n'est pas un chiffre)
+  if (folded || gan->nb_classes)
+    sample_generator(cfg, gan, cfg->chosen_label, NULL);
+  snapshot_push_wait(mnist->snapshot, gan->g->a[gan->nb_layers - 2], -1);
+  snapshot_free(mnist->snapshot);
+  monitor_close(mnist->monitor);
+  printf("Image was saved successfully in %s. \n", mnist->output);
+  PROF_CLOSE();
+  TRACE_CLOSE();
 
+  free_mnist(mnist);
+  MEM_REPORT();
   return 0;
 }
\ No newline at end of file
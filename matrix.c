@@ -11,7 +11,12 @@
 #include <string.h>
 #include <time.h>
 #include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include "matrix.h"
+#include "mem.h"
+#include "prof.h"
+#include "fastmath.h"
 
 // Maximum entre deux nombres
 #define MAX(a, b) \
@@ -19,39 +24,210 @@
      __typeof__ (b) _b = (b); \
    _a > _b ? _a : _b; })
 
-// Fonction sigmoïde
-#define SIGMOID(x) (1 / (1 + (exp(-(x)))))
 // Fonction LRELU
 #define LRELU(x, alpha) (MAX((x), (x * alpha)))
 // Fonction dérivée de sigmoïde
 #define DSIGMOID(y) ((y) * (1 - (y)))
 // Fonction dérivée de DLRELU
 #define DLRELU(x, alpha) ((x) < 0 ? alpha : 1)
-// Fonction dérivée de tanh
-#define DTANH(x) ((1.0) - (pow((tanh((x))), 2)))
-// Fonction d'entropie croisée
-#define CE(x, y) ((-log((y))) - (log(1 - (x))))
 
 /** \brief Initialiser une matrice en mettant
- * les valeurs à 0.
+ * les valeurs à 0, en comptabilisant l'allocation pour
+ * le site d'appel 'file:line' (make MEMDEBUG=1).
  *
  * \param rows nombre de lignes
  * \param cols nombre de colonnes
+ * \param file fichier du site d'appel
+ * \param line ligne du site d'appel
  * \return structure matrix
  */
-matrix_t* mat_zinit(int rows, int cols)
+matrix_t* mat_zinit_at(int rows, int cols, const char* file, int line)
 {
+#ifdef GAN_MEMDEBUG
+  matrix_t* mat = (matrix_t*)mem_malloc(sizeof(*mat), file, line);
+  assert(mat);
+
+  mat->data = (double*)mem_calloc(rows * cols, sizeof(*mat->data), file, line);
+  assert(mat->data);
+#else
   matrix_t* mat = (matrix_t*)malloc(sizeof(*mat));
   assert(mat);
 
   mat->data = (double*)calloc(rows * cols, sizeof(*mat->data));
   assert(mat->data);
+#endif
 
   mat->rows = rows;
   mat->cols = cols;
+  mat->version = 0;
+  mat->pack = NULL;
   return mat;
 }
 
+/* Enumération pour l'orientation des panneaux pré-emballés */
+enum MAT_PACK_E {
+  MAT_PACK_N = 0, // B = w (propagation avant)
+  MAT_PACK_T, // B = w^T (gradient de l'entrée)
+  MAT_PACK_NB
+};
+
+/* Structure représentant le cache des panneaux d'une matrice de poids, dans
+ * les deux orientations du produit. Un panneau contient MAT_PACK_NR colonnes
+ * de B, ligne par ligne (complétées par des zéros) : le micro-noyau lit B
+ * de façon contiguë. Les panneaux sont reconstruits à la première utilisation
+ * qui suit une écriture des poids (mat_touch). */
+struct mat_pack {
+  double* panel[MAT_PACK_NB]; // panneaux de chaque orientation (NULL : jamais construits)
+  unsigned long version[MAT_PACK_NB]; // version de la matrice emballée
+  pthread_mutex_t lock; // construction des panneaux (threads partageant les poids)
+};
+
+// Nombre total d'emballages de panneaux
+static atomic_ulong mat_packs;
+
+/** \brief Activer le cache de panneaux pré-emballés d'une matrice de poids.
+ * Toute écriture dans ses valeurs doit ensuite être signalée par mat_touch.
+ *
+ * \param mat matrice de poids
+ */
+void mat_pack_init(matrix_t* mat)
+{
+  int o;
+  mat_pack_t* pack = (mat_pack_t*)MEM_MALLOC(sizeof(*pack));
+  assert(pack);
+
+  for (o = 0; o < MAT_PACK_NB; o++)
+    pack->panel[o] = NULL;
+  pthread_mutex_init(&pack->lock, NULL);
+  mat->pack = pack;
+}
+
+/** \brief Signaler une écriture dans les valeurs de la matrice : les
+ * panneaux pré-emballés seront reconstruits à leur prochaine utilisation.
+ *
+ * \param mat matrice
+ */
+void mat_touch(matrix_t* mat)
+{
+  mat->version++;
+}
+
+/** \brief Nombre total d'emballages de panneaux depuis le début du programme.
+ *
+ * \return nombre d'emballages
+ */
+unsigned long mat_pack_count(void)
+{
+  return atomic_load(&mat_packs);
+}
+
+/** \brief Panneaux pré-emballés de la matrice dans l'orientation 'o',
+ * reconstruits si la matrice a été modifiée depuis le dernier emballage.
+ *
+ * \param mat matrice de poids (cache activé)
+ * \param o orientation (MAT_PACK_N ou MAT_PACK_T)
+ * \return panneaux
+ */
+static const double* mat_pack_get(matrix_t* mat, int o)
+{
+  mat_pack_t* pack = mat->pack;
+  int k, j, p, n;
+  int k_dim = o == MAT_PACK_N ? mat->rows : mat->cols;
+  int n_dim = o == MAT_PACK_N ? mat->cols : mat->rows;
+  int nb_panels = (n_dim + MAT_PACK_NR - 1) / MAT_PACK_NR;
+
+  pthread_mutex_lock(&pack->lock);
+  if (!pack->panel[o] || pack->version[o] != mat->version) {
+    PROF_KBEGIN(PROF_K_PACK);
+    if (!pack->panel[o]) {
+      pack->panel[o] = (double*)MEM_MALLOC((size_t)nb_panels * k_dim * MAT_PACK_NR * sizeof(double));
+      assert(pack->panel[o]);
+    }
+
+    pack->version[o] = mat->version;
+    for (p = 0; p < nb_panels; p++) {
+      double* dst = pack->panel[o] + (size_t)p * k_dim * MAT_PACK_NR;
+      for (k = 0; k < k_dim; k++)
+        for (j = 0; j < MAT_PACK_NR; j++) {
+          n = p * MAT_PACK_NR + j;
+          if (n >= n_dim)
+            dst[k * MAT_PACK_NR + j] = 0.0;
+          else
+            dst[k * MAT_PACK_NR + j] = o == MAT_PACK_N ? mat->data[k * mat->cols + n] : mat->data[n * mat->cols + k];
+        }
+    }
+    atomic_fetch_add(&mat_packs, 1);
+    PROF_KEND(PROF_K_PACK, 0.0);
+  }
+  pthread_mutex_unlock(&pack->lock);
+  return pack->panel[o];
+}
+
+/** \brief Panneaux pré-emballés d'une matrice de poids (cache activé), pour
+ * les noyaux spécialisés de kernels_gen.c.
+ *
+ * \param mat matrice de poids
+ * \param transpose 0 : panneaux de mat, 1 : panneaux de mat^T
+ * \return panneaux (MAT_PACK_NR colonnes, complétés par des zéros)
+ */
+const double* mat_pack_panel(matrix_t* mat, int transpose)
+{
+  return mat_pack_get(mat, transpose ? MAT_PACK_T : MAT_PACK_N);
+}
+
+/** \brief Produit c = a . B (+ bias sur chaque ligne), avec B (k x n) donnée
+ * par ses panneaux pré-emballés. Pour chaque panneau et chaque ligne de a,
+ * les MAT_PACK_NR sommes restent dans des registres pendant tout le parcours
+ * de k ; l'ordre des sommes sur k est celui de mat_dot.
+ *
+ * \param c résultat (m x n)
+ * \param a matrice a (m x k)
+ * \param m nombre de lignes de a
+ * \param k dimension commune
+ * \param n nombre de colonnes de B
+ * \param panel panneaux de B
+ * \param bias biais ajouté à chaque ligne (NULL : aucun)
+ */
+static void mat_gemm_packed(double* c, const double* a, int m, int k, int n, const double* panel, const double* bias)
+{
+  int r, j, p, kk;
+  int nb_panels = (n + MAT_PACK_NR - 1) / MAT_PACK_NR;
+
+  for (p = 0; p < nb_panels; p++) {
+    const double* b = panel + (size_t)p * k * MAT_PACK_NR;
+    int nc = n - p * MAT_PACK_NR < MAT_PACK_NR ? n - p * MAT_PACK_NR : MAT_PACK_NR;
+
+    for (r = 0; r < m; r++) {
+      const double* ar = a + r * k;
+      double* cr = c + r * n + p * MAT_PACK_NR;
+      double acc[MAT_PACK_NR];
+
+      for (j = 0; j < MAT_PACK_NR; j++)
+        acc[j] = 0.0;
+      for (kk = 0; kk < k; kk++) {
+        double x = ar[kk];
+        const double* bk = b + kk * MAT_PACK_NR;
+        for (j = 0; j < MAT_PACK_NR; j++)
+          acc[j] += x * bk[j];
+      }
+      for (j = 0; j < nc; j++)
+        cr[j] = bias ? acc[j] + bias[p * MAT_PACK_NR + j] : acc[j];
+    }
+  }
+}
+
+/** \brief Initialiser une matrice en mettant
+ * les valeurs à 0.
+ *
+ * \param rows nombre de lignes
+ * \param cols nombre de colonnes
+ * \return structure matrix
+ */
+matrix_t* (mat_zinit)(int rows, int cols)
+{
+  return mat_zinit_at(rows, cols, __FILE__, __LINE__);
+}
+
 /** \brief Somme de deux matrices (a + b).
  *
  * \param src matrice source
@@ -61,6 +237,7 @@ matrix_t* mat_zinit(int rows, int cols)
 void mat_sum_(matrix_t* src, matrix_t* a, matrix_t* b)
 {
   int r, c, i;
+  PROF_KBEGIN(PROF_K_SUM);
   if (a->rows == b->rows && a->cols == b->cols) {
     for (r = 0; r < a->rows; r++)
       for (c = 0; c < a->cols; c++) {
@@ -79,6 +256,7 @@ void mat_sum_(matrix_t* src, matrix_t* a, matrix_t* b)
     fprintf(stderr, "Error: bad matrix structures while sum. \n");
     exit(1);
   }
+  PROF_KEND(PROF_K_SUM, (double)a->rows * a->cols);
 }
 
 /** \brief Appliquer la fonction RELU sur la matrice a.
@@ -90,9 +268,11 @@ void mat_sum_(matrix_t* src, matrix_t* a, matrix_t* b)
 void mat_lrelu_(matrix_t* src, matrix_t* a, double alpha)
 {
   int r, c;
+  PROF_KBEGIN(PROF_K_LRELU);
   for (r = 0; r < a->rows; r++)
     for (c = 0; c < a->cols; c++)
       src->data[r * a->cols + c] = LRELU(a->data[r * a->cols + c], alpha);
+  PROF_KEND(PROF_K_LRELU, (double)a->rows * a->cols);
 }
 
 /** \brief Appliquer la fonction tanh sur la matrice a.
@@ -102,11 +282,9 @@ void mat_lrelu_(matrix_t* src, matrix_t* a, double alpha)
  */
 void mat_tanh_(matrix_t* src, matrix_t* a)
 {
-  int r, c;
-
-  for (r = 0; r < a->rows; r++)
-    for (c = 0; c < a->cols; c++)
-      src->data[r * a->cols + c] = tanh(a->data[r * a->cols + c]);
+  PROF_KBEGIN(PROF_K_TANH);
+  fm_tanh(src->data, a->data, a->rows * a->cols);
+  PROF_KEND(PROF_K_TANH, (double)a->rows * a->cols);
 }
 
 /** \brief Soustraction de deux matrices (a - b).
@@ -123,9 +301,11 @@ void mat_sub_(matrix_t* src, matrix_t* a, matrix_t* b)
   }
 
   int r, c;
+  PROF_KBEGIN(PROF_K_SUB);
   for (r = 0; r < a->rows; r++)
     for (c = 0; c < a->cols; c++)
       src->data[r * a->cols + c] = a->data[r * a->cols + c] - b->data[r * a->cols + c];
+  PROF_KEND(PROF_K_SUB, (double)a->rows * a->cols);
 }
 
 /** \brief Multiplication de deux matrices (a * b).
@@ -142,9 +322,11 @@ void mat_mul_(matrix_t* src, matrix_t* a, matrix_t* b)
   }
 
   int r, c;
+  PROF_KBEGIN(PROF_K_MUL);
   for (r = 0; r < a->rows; r++)
     for (c = 0; c < b->cols; c++)
       src->data[r * a->cols + c] = a->data[r * a->cols + c] * b->data[r * a->cols + c];
+  PROF_KEND(PROF_K_MUL, (double)a->rows * a->cols);
 }
 
 /** \brief Appliquer la fonction sigmoïde sur la matrice a.
@@ -156,10 +338,9 @@ matrix_t* mat_sigmoid(matrix_t* a)
 {
   matrix_t* res = mat_zinit(a->rows, a->cols);
 
-  int r, c;
-  for (r = 0; r < a->rows; r++)
-    for (c = 0; c < a->cols; c++)
-      res->data[r * a->cols + c] = SIGMOID(a->data[r * a->cols + c]);
+  PROF_KBEGIN(PROF_K_SIGMOID);
+  fm_sigmoid(res->data, a->data, a->rows * a->cols);
+  PROF_KEND(PROF_K_SIGMOID, 3.0 * a->rows * a->cols);
 
   return res;
 }
@@ -174,13 +355,20 @@ matrix_t* mat_dsigmoid(matrix_t* a)
   matrix_t* res = mat_zinit(a->rows, a->cols);
 
   int r, c;
+  PROF_KBEGIN(PROF_K_DSIGMOID);
   for (r = 0; r < a->rows; r++)
     for (c = 0; c < a->cols; c++)
       res->data[r * a->cols + c] = DSIGMOID(a->data[r * a->cols + c]);
+  PROF_KEND(PROF_K_DSIGMOID, 2.0 * a->rows * a->cols);
 
   return res;
 }
 
+/** \brief Somme de toutes les valeurs d'une matrice.
+ *
+ * \param a matrice a
+ * \return somme des valeurs de la matrice a
+ */
 double mat_sum_val(matrix_t* a)
 {
   int i;
@@ -189,6 +377,7 @@ double mat_sum_val(matrix_t* a)
     sum += a->data[i];
   return sum;
 }
+
 /** \brief Appliquer la dérivée de RELU sur la matrice a.
  *
  * \param a matrice a
@@ -200,9 +389,11 @@ matrix_t* mat_dlrelu(matrix_t* a, double alpha)
   matrix_t* res = mat_zinit(a->rows, a->cols);
 
   int r, c;
+  PROF_KBEGIN(PROF_K_DLRELU);
   for (r = 0; r < a->rows; r++)
     for (c = 0; c < a->cols; c++)
       res->data[r * a->cols + c] = DLRELU(a->data[r * a->cols + c], alpha);
+  PROF_KEND(PROF_K_DLRELU, (double)a->rows * a->cols);
 
   return res;
 }
@@ -216,10 +407,9 @@ matrix_t* mat_dtanh(matrix_t* a)
 {
   matrix_t* res = mat_zinit(a->rows, a->cols);
 
-  int r, c;
-  for (r = 0; r < a->rows; r++)
-    for (c = 0; c < a->cols; c++)
-      res->data[r * a->cols + c] = DTANH(a->data[r * a->cols + c]);
+  PROF_KBEGIN(PROF_K_DTANH);
+  fm_dtanh(res->data, a->data, a->rows * a->cols);
+  PROF_KEND(PROF_K_DTANH, 3.0 * a->rows * a->cols);
 
   return res;
 }
@@ -231,10 +421,9 @@ matrix_t* mat_dtanh(matrix_t* a)
  */
 void mat_sigmoid_(matrix_t* src, matrix_t* a)
 {
-  int r, c;
-  for (r = 0; r < a->rows; r++)
-    for (c = 0; c < a->cols; c++)
-      src->data[r * a->cols + c] = SIGMOID(a->data[r * a->cols + c]);
+  PROF_KBEGIN(PROF_K_SIGMOID);
+  fm_sigmoid(src->data, a->data, a->rows * a->cols);
+  PROF_KEND(PROF_K_SIGMOID, 3.0 * a->rows * a->cols);
 }
 
 /** \brief Appliquer le produit scalaire sur la matrice a et b.
@@ -255,8 +444,18 @@ void mat_dot_(matrix_t* src, matrix_t* a, matrix_t* b, int transpose)
     exit(1);
   }
 
+  // Poids pré-emballés : gradient de l'entrée dz . w^T
+  if (transpose == RIGHT_TRANSPOSE && b->pack) {
+    const double* panel = mat_pack_get(b, MAT_PACK_T);
+    PROF_KBEGIN(PROF_K_DOT_RIGHT);
+    mat_gemm_packed(src->data, a->data, rows, com, cols, panel, NULL);
+    PROF_KEND(PROF_K_DOT_RIGHT, 2.0 * rows * cols * com);
+    return;
+  }
+
   int r, c, k;
   double tmp = 0.0;
+  PROF_KBEGIN(transpose == LEFT_TRANSPOSE ? PROF_K_DOT_LEFT : PROF_K_DOT_RIGHT);
 
   for (r = 0; r < rows; r++) {
     for (c = 0; c < cols; c++) {
@@ -270,6 +469,7 @@ void mat_dot_(matrix_t* src, matrix_t* a, matrix_t* b, int transpose)
       src->data[r * src->cols + c] = tmp;
     }
   }
+  PROF_KEND(transpose == LEFT_TRANSPOSE ? PROF_K_DOT_LEFT : PROF_K_DOT_RIGHT, 2.0 * rows * cols * com);
 }
 
 /** \brief Libérer la mémoire de la matrice.
@@ -278,9 +478,17 @@ void mat_dot_(matrix_t* src, matrix_t* a, matrix_t* b, int transpose)
  */
 void mat_free(matrix_t* mat)
 {
+  int o;
+  if (mat && mat->pack) {
+    for (o = 0; o < MAT_PACK_NB; o++)
+      if (mat->pack->panel[o])
+        MEM_FREE(mat->pack->panel[o]);
+    pthread_mutex_destroy(&mat->pack->lock);
+    MEM_FREE(mat->pack);
+  }
   if (mat) {
-    free(mat->data);
-    free(mat);
+    MEM_FREE(mat->data);
+    MEM_FREE(mat);
     mat = NULL;
   }
 }
@@ -320,10 +528,22 @@ void mat_print_param(matrix_t* mat)
  */
 void mat_ce_(matrix_t* src, matrix_t* pred, matrix_t* labels)
 {
-  int r, c;
-  for (r = 0; r < pred->rows; r++)
-    for (c = 0; c < pred->cols; c++)
-      src->data[r * src->cols + c] = CE(pred->data[r * pred->cols + c], labels->data[r * labels->cols + c]);
+  int i, n = pred->rows * pred->cols;
+  matrix_t* one_minus = mat_zinit(pred->rows, pred->cols);
+  matrix_t* log_one_minus = mat_zinit(pred->rows, pred->cols);
+
+  PROF_KBEGIN(PROF_K_LOSS);
+  // Entropie croisée : -log(labels) - log(1 - pred)
+  for (i = 0; i < n; i++)
+    one_minus->data[i] = 1 - pred->data[i];
+  fm_log(src->data, labels->data, n);
+  fm_log(log_one_minus->data, one_minus->data, n);
+  for (i = 0; i < n; i++)
+    src->data[i] = -src->data[i] - log_one_minus->data[i];
+  PROF_KEND(PROF_K_LOSS, 4.0 * pred->rows * pred->cols);
+
+  mat_free(one_minus);
+  mat_free(log_one_minus);
 }
 
 /** \brief Appliquer la fonction de log sur la matrice pred.
@@ -333,10 +553,12 @@ void mat_ce_(matrix_t* src, matrix_t* pred, matrix_t* labels)
  */
 void mat_log_(matrix_t* src, matrix_t* pred)
 {
-  int r, c;
-  for (r = 0; r < pred->rows; r++)
-    for (c = 0; c < pred->cols; c++)
-      src->data[r * src->cols + c] = -log(pred->data[r * pred->cols + c]);
+  int i, n = pred->rows * pred->cols;
+  PROF_KBEGIN(PROF_K_LOSS);
+  fm_log(src->data, pred->data, n);
+  for (i = 0; i < n; i++)
+    src->data[i] = -src->data[i];
+  PROF_KEND(PROF_K_LOSS, 2.0 * pred->rows * pred->cols);
 }
 
 /** \brief Copier la matrice a.
@@ -348,9 +570,11 @@ void mat_log_(matrix_t* src, matrix_t* pred)
 void mat_copy_(matrix_t* src, matrix_t* a, int i_min)
 {
   int r, c;
+  PROF_KBEGIN(PROF_K_COPY);
   for (r = 0; r < src->rows; r++)
     for (c = 0; c < src->cols; c++)
       src->data[r * src->cols + c] = a->data[(i_min + r) * a->cols + c];
+  PROF_KEND(PROF_K_COPY, 0.0);
 }
 
 /** \brief Somme de toutes les valeurs d'une matrice pour obtenir qu'un
@@ -363,6 +587,7 @@ void mat_sum_axis0_(matrix_t* src, matrix_t* a)
 {
   int r, c;
   double sum = 0.0;
+  PROF_KBEGIN(PROF_K_SUM_AXIS0);
   for (r = 0; r < a->cols; r++) {
     for (c = 0; c < a->rows; c++)
       sum += a->data[c * a->cols + r];
@@ -370,6 +595,7 @@ void mat_sum_axis0_(matrix_t* src, matrix_t* a)
     src->data[0 * src->cols + r] = sum;
     sum = 0.0;
   }
+  PROF_KEND(PROF_K_SUM_AXIS0, (double)a->rows * a->cols);
 }
 
 /** \brief Moyenne de toutes les valeurs d'une matrice.
@@ -403,10 +629,12 @@ matrix_t* mat_dot(matrix_t* a, matrix_t* b)
   matrix_t* res = mat_zinit(a->rows, b->cols);
 
   int r, c, k;
+  PROF_KBEGIN(PROF_K_DOT);
   for (r = 0; r < a->rows; r++)
     for (k = 0; k < b->rows; k++)
       for (c = 0; c < b->cols; c++)
         res->data[r * res->cols + c] += a->data[r * a->cols + k] * b->data[k * b->cols + c];
+  PROF_KEND(PROF_K_DOT, 2.0 * a->rows * a->cols * b->cols);
 
   return res;
 }
@@ -419,13 +647,28 @@ matrix_t* mat_dot(matrix_t* a, matrix_t* b)
 void mat_mul_scalar(matrix_t* a, double val)
 {
   int r, c;
+  PROF_KBEGIN(PROF_K_MUL_SCALAR);
   for (r = 0; r < a->rows; r++)
     for (c = 0; c < a->cols; c++)
       a->data[r * a->cols + c] *= val;
+  PROF_KEND(PROF_K_MUL_SCALAR, (double)a->rows * a->cols);
 }
 
 void mat_sum_z_act(matrix_t* z, matrix_t* act, matrix_t* w, matrix_t* b)
 {
+  // Poids pré-emballés : produit et biais en un seul parcours
+  if (w->pack && b->rows == 1) {
+    if (act->cols != w->rows || z->rows != act->rows || z->cols != w->cols || b->cols != w->cols) {
+      fprintf(stderr, "Error: bad matrix structures while dot. \n");
+      exit(1);
+    }
+    const double* panel = mat_pack_get(w, MAT_PACK_N);
+    PROF_KBEGIN(PROF_K_DOT);
+    mat_gemm_packed(z->data, act->data, act->rows, w->rows, w->cols, panel, b->data);
+    PROF_KEND(PROF_K_DOT, 2.0 * act->rows * w->rows * w->cols + (double)z->rows * z->cols);
+    return;
+  }
+
   matrix_t* dot = mat_dot(act, w);
   mat_sum_(z, dot, b);
   mat_free(dot);
@@ -10,6 +10,11 @@
 #define LEFT_TRANSPOSE 1
 // transposée pour le second argument du produit scalaire
 #define RIGHT_TRANSPOSE 2
+// Colonnes d'un panneau de poids pré-emballé (sommes du micro-noyau
+// gardées dans les registres SSE2)
+#define MAT_PACK_NR 32
+
+typedef struct mat_pack mat_pack_t;
 
 typedef struct matrix matrix_t;
 /* Structure représentant une matrice */
@@ -17,9 +22,12 @@ struct matrix {
   int rows; // nombre de lignes
   int cols; // nombre de colonnes
   double* data; // valeurs
+  unsigned long version; // version des valeurs (incrémentée par mat_touch)
+  mat_pack_t* pack; // panneaux pré-emballés (NULL : pas de cache)
 };
 
 matrix_t* mat_zinit(int, int);
+matrix_t* mat_zinit_at(int, int, const char*, int);
 matrix_t* mat_dot(matrix_t*, matrix_t*);
 matrix_t* mat_sigmoid(matrix_t*);
 matrix_t* mat_dsigmoid(matrix_t*);
@@ -39,8 +47,18 @@ void mat_ce_(matrix_t*, matrix_t*, matrix_t*);
 void mat_log_(matrix_t*, matrix_t*);
 void mat_sum_z_act(matrix_t*, matrix_t*, matrix_t*, matrix_t*);
 double mat_mean(matrix_t*);
+double mat_sum_val(matrix_t*);
 void mat_print_param(matrix_t*);
 void mat_print(matrix_t*);
 void mat_free(matrix_t*);
+void mat_pack_init(matrix_t*);
+void mat_touch(matrix_t*);
+unsigned long mat_pack_count(void);
+const double* mat_pack_panel(matrix_t*, int);
+
+#ifdef GAN_MEMDEBUG
+// Comptabiliser les matrices au site d'appel de mat_zinit
+#define mat_zinit(rows, cols) mat_zinit_at((rows), (cols), __FILE__, __LINE__)
+#endif
 
 #endif
\ No newline at end of file
@@ -0,0 +1,206 @@
+/*!
+ * \file mem.c
+ * \brief Fichier comprenant la comptabilité des allocations : octets
+ * vivants, pic et nombre d'allocations par site d'appel (fichier:ligne),
+ * avec un rapport par itération signalant les sites dont la mémoire
+ * augmente alors que l'apprentissage est en régime permanent.
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+
+#ifdef GAN_MEMDEBUG
+
+// Nombre max. de sites d'appel (puissance de 2)
+#define MEM_MAX_SITES 1024
+
+typedef struct mem_site mem_site_t;
+/* Structure représentant les allocations d'un site d'appel */
+struct mem_site {
+  const char* file; // fichier du site d'appel (NULL si libre)
+  int line; // ligne du site d'appel
+  size_t live; // octets vivants
+  size_t peak; // pic d'octets vivants
+  size_t last; // octets vivants à la fin de l'itération précédente
+  unsigned long allocs; // nombre d'allocations
+  unsigned long frees; // nombre de libérations
+};
+
+typedef union mem_header mem_header_t;
+/* En-tête placé avant chaque bloc (aligné comme un bloc de malloc) */
+union mem_header {
+  struct {
+    size_t size; // taille demandée
+    mem_site_t* site; // site d'appel
+  } h;
+  long double align; // alignement
+};
+
+// Sites d'appel (table de hachage à adressage ouvert)
+static mem_site_t mem_sites[MEM_MAX_SITES];
+// Octets vivants, tous sites confondus
+static size_t mem_live = 0;
+// Pic d'octets vivants
+static size_t mem_peak = 0;
+// Octets vivants à la fin de l'itération précédente
+static size_t mem_last = 0;
+// Nombre d'allocations et de libérations de l'itération
+static unsigned long mem_allocs = 0, mem_frees = 0;
+// Verrou pour les compteurs
+static pthread_mutex_t mem_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Récupérer le site d'appel 'file:line', en le créant au premier appel.
+ * Le verrou doit être pris.
+ *
+ * \param file fichier du site d'appel
+ * \param line ligne du site d'appel
+ * \return site d'appel
+ */
+static mem_site_t* mem_site(const char* file, int line)
+{
+  unsigned long h = (unsigned long)file * 31 + line;
+  int i, n;
+
+  for (n = 0; n < MEM_MAX_SITES; n++) {
+    i = (h + n) & (MEM_MAX_SITES - 1);
+    if (!mem_sites[i].file) {
+      mem_sites[i].file = file;
+      mem_sites[i].line = line;
+      return &mem_sites[i];
+    }
+    if (mem_sites[i].line == line && !strcmp(mem_sites[i].file, file))
+      return &mem_sites[i];
+  }
+
+  fprintf(stderr, "Error: too many allocation sites. \n");
+  exit(1);
+}
+
+/**
+ * Allouer 'size' octets et les comptabiliser pour le site 'file:line'.
+ *
+ * \param size taille en octets
+ * \param file fichier du site d'appel
+ * \param line ligne du site d'appel
+ * \return bloc alloué
+ */
+void* mem_malloc(size_t size, const char* file, int line)
+{
+  mem_header_t* hd = (mem_header_t*)malloc(sizeof(*hd) + size);
+  if (!hd)
+    return NULL;
+
+  pthread_mutex_lock(&mem_mutex);
+  mem_site_t* site = mem_site(file, line);
+  site->live += size;
+  site->allocs++;
+  if (site->live > site->peak)
+    site->peak = site->live;
+
+  mem_live += size;
+  mem_allocs++;
+  if (mem_live > mem_peak)
+    mem_peak = mem_live;
+  pthread_mutex_unlock(&mem_mutex);
+
+  hd->h.size = size;
+  hd->h.site = site;
+  return hd + 1;
+}
+
+/**
+ * Allouer 'n' éléments de 'size' octets initialisés à 0 et les
+ * comptabiliser pour le site 'file:line'.
+ *
+ * \param n nombre d'éléments
+ * \param size taille d'un élément
+ * \param file fichier du site d'appel
+ * \param line ligne du site d'appel
+ * \return bloc alloué
+ */
+void* mem_calloc(size_t n, size_t size, const char* file, int line)
+{
+  void* ptr = mem_malloc(n * size, file, line);
+  if (ptr)
+    memset(ptr, 0, n * size);
+  return ptr;
+}
+
+/**
+ * Libérer un bloc alloué par mem_malloc ou mem_calloc.
+ *
+ * \param ptr bloc
+ */
+void mem_free(void* ptr)
+{
+  if (!ptr)
+    return;
+
+  mem_header_t* hd = (mem_header_t*)ptr - 1;
+  pthread_mutex_lock(&mem_mutex);
+  hd->h.site->live -= hd->h.size;
+  hd->h.site->frees++;
+  mem_live -= hd->h.size;
+  mem_frees++;
+  pthread_mutex_unlock(&mem_mutex);
+
+  free(hd);
+}
+
+/**
+ * Afficher le rapport de l'itération : octets vivants, pic, allocations
+ * et libérations, puis les sites dont les octets vivants ont augmenté
+ * depuis l'itération précédente. Dès la deuxième itération, les tampons
+ * du modèle sont tous alloués : toute croissance est une fuite probable.
+ *
+ * \param epoch itération actuelle
+ */
+void mem_epoch(int epoch)
+{
+  int i;
+
+  pthread_mutex_lock(&mem_mutex);
+  printf("[mem] epoch: %d, live: %.2f MB, peak: %.2f MB, allocs: %lu, frees: %lu\n",
+    epoch, mem_live / 1048576.0, mem_peak / 1048576.0, mem_allocs, mem_frees);
+
+  for (i = 0; i < MEM_MAX_SITES; i++) {
+    mem_site_t* site = &mem_sites[i];
+    if (site->file && epoch > 0 && site->live > site->last)
+      printf("[mem]   growth: %s:%d +%zu bytes (live: %zu bytes, allocs: %lu, frees: %lu)\n",
+        site->file, site->line, site->live - site->last, site->live, site->allocs, site->frees);
+    site->last = site->live;
+  }
+
+  if (epoch > 0 && mem_live > mem_last)
+    printf("[mem]   warning: %.2f MB leaked in steady state\n", (mem_live - mem_last) / 1048576.0);
+  mem_last = mem_live;
+  mem_allocs = 0;
+  mem_frees = 0;
+  pthread_mutex_unlock(&mem_mutex);
+}
+
+/**
+ * Afficher le rapport final : pic et octets encore vivants pour chaque
+ * site d'appel.
+ */
+void mem_report(void)
+{
+  int i;
+
+  pthread_mutex_lock(&mem_mutex);
+  printf("[mem] live: %.2f MB, peak: %.2f MB\n", mem_live / 1048576.0, mem_peak / 1048576.0);
+  for (i = 0; i < MEM_MAX_SITES; i++) {
+    mem_site_t* site = &mem_sites[i];
+    if (site->file)
+      printf("[mem]   %s:%d peak: %zu bytes, live: %zu bytes, allocs: %lu, frees: %lu\n",
+        site->file, site->line, site->peak, site->live, site->allocs, site->frees);
+  }
+  pthread_mutex_unlock(&mem_mutex);
+}
+
+#endif
@@ -0,0 +1,38 @@
+/*!
+ * \file mem.h
+ * \brief Fichier header de mem.c. La comptabilité des allocations n'est
+ * compilée qu'avec -DGAN_MEMDEBUG (make MEMDEBUG=1) ; sinon les macros
+ * appellent directement malloc, calloc et free.
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#ifndef _MEM_H_
+#define _MEM_H_
+
+#include <stdlib.h>
+
+#ifdef GAN_MEMDEBUG
+// Allocation comptabilisée au site d'appel
+#define MEM_MALLOC(size) mem_malloc((size), __FILE__, __LINE__)
+// Allocation initialisée à 0 comptabilisée au site d'appel
+#define MEM_CALLOC(n, size) mem_calloc((n), (size), __FILE__, __LINE__)
+// Libération d'un bloc alloué par MEM_MALLOC ou MEM_CALLOC
+#define MEM_FREE(ptr) mem_free((ptr))
+// Rapport de l'itération (octets vivants, pic, croissance par site)
+#define MEM_EPOCH(epoch) mem_epoch((epoch))
+// Rapport final par site d'appel
+#define MEM_REPORT() mem_report()
+#else
+#define MEM_MALLOC(size) malloc((size))
+#define MEM_CALLOC(n, size) calloc((n), (size))
+#define MEM_FREE(ptr) free((ptr))
+#define MEM_EPOCH(epoch) ((void)0)
+#define MEM_REPORT() ((void)0)
+#endif
+
+void* mem_malloc(size_t, const char*, int);
+void* mem_calloc(size_t, size_t, const char*, int);
+void mem_free(void*);
+void mem_epoch(int);
+void mem_report(void);
+
+#endif
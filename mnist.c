@@ -11,6 +11,7 @@
 #include <string.h>
 #include <assert.h>
 #include "config.h"
+#include "mem.h"
 
 /**
  * Echange des bytes pour les données MNIST
@@ -70,14 +71,15 @@ void read_mnist_char(char* file, int num_data, int len_info, int n, unsigned cha
 /**
  * Transformer les valeurs des images de type char en double.
  * \param num_data nombre de données
+ * \param n nombre de valeur d'une image
  * \param data_image_char valeurs des images (type char)
  * \param data_image valeurs des images (type double)
  */
-void image_char2double(int num_data, unsigned char** data_image_char, double** data_image)
+void image_char2double(int num_data, int n, unsigned char** data_image_char, double** data_image)
 {
   int i, j;
   for (i = 0; i < num_data; i++)
-    for (j = 0; j < MNIST_SIZE; j++)
+    for (j = 0; j < n; j++)
       data_image[i][j] = ((double)data_image_char[i][j] - 127.5) / 127.5;
 }
 
@@ -97,142 +99,378 @@ void label_char2int(int num_data, unsigned char** data_label_char, unsigned int*
 /**
  * Afficher les valeurs d'une image.
  * \param num_data nombre de données
+ * \param n nombre de valeur d'une image
  * \param data_image valeurs de l'image
  */
-void print_data(int num_data, double** data_image)
+void print_data(int num_data, int n, double** data_image)
 {
   int i, j;
   for (i = 0; i < num_data; i++)
-    for (j = 0; j < MNIST_SIZE; j++)
+    for (j = 0; j < n; j++)
       printf("%f\n", data_image[i][j]);
 }
 
+/**
+ * Lire le nombre de données d'un fichier MNIST (IDX), stocké dans
+ * l'en-tête après le nombre magique.
+ *
+ * \param file fichier MNIST
+ * \return nombre de données
+ */
+int read_mnist_count(char* file)
+{
+  int fd;
+  unsigned int buf[2];
+
+  if ((fd = open(file, O_RDONLY)) == -1) {
+    fprintf(stderr, "Error: could not open file %s. \n", file);
+    exit(1);
+  }
+
+  if (read(fd, buf, sizeof(buf)) != sizeof(buf)) {
+    fprintf(stderr, "Error: bad MNIST header in %s. \n", file);
+    exit(1);
+  }
+  close(fd);
+
+  fliplong((unsigned char*)&buf[1]);
+  return (int)buf[1];
+}
+
+/**
+ * Lire l'en-tête d'un fichier IDX : nombre magique (type des données et
+ * nombre de dimensions), puis les dimensions en big-endian. Seules les
+ * données en octets non signés sont acceptées.
+ *
+ * \param file fichier IDX
+ * \param hdr en-tête lu
+ */
+void read_idx_header(char* file, idx_header_t* hdr)
+{
+  int fd, d;
+  unsigned char magic[4], dims[4 * MNIST_IDX_MAX_DIMS];
+
+  if ((fd = open(file, O_RDONLY)) == -1) {
+    fprintf(stderr, "Error: could not open file %s. \n", file);
+    exit(1);
+  }
+
+  if (read(fd, magic, sizeof(magic)) != sizeof(magic) || magic[0] || magic[1] ||
+    magic[2] != MNIST_IDX_UBYTE || magic[3] < 1 || magic[3] > MNIST_IDX_MAX_DIMS) {
+    fprintf(stderr, "Error: bad IDX header in %s (unsigned bytes, 1 to %d dimensions). \n", file, MNIST_IDX_MAX_DIMS);
+    exit(1);
+  }
+
+  hdr->nb_dims = magic[3];
+  if (read(fd, dims, 4 * hdr->nb_dims) != 4 * hdr->nb_dims) {
+    fprintf(stderr, "Error: bad IDX header in %s. \n", file);
+    exit(1);
+  }
+  close(fd);
+
+  hdr->item = 1;
+  for (d = 0; d < hdr->nb_dims; d++) {
+    hdr->dims[d] = (unsigned int)dims[4 * d] << 24 | dims[4 * d + 1] << 16 | dims[4 * d + 2] << 8 | dims[4 * d + 3];
+    if (d > 0)
+      hdr->item *= hdr->dims[d];
+  }
+  hdr->count = hdr->dims[0];
+  hdr->offset = 4 + 4 * hdr->nb_dims;
+}
+
+/**
+ * Dimensions d'une image d'après l'en-tête IDX : N x H x W (un canal) ou
+ * N x C x H x W (canaux l'un après l'autre). Pour un autre nombre de
+ * dimensions, seule la taille d'une image est connue (0 sinon).
+ *
+ * \param hdr en-tête du fichier des images
+ * \param width largeur
+ * \param height hauteur
+ * \param channels nombre de canaux
+ */
+void read_idx_image(idx_header_t* hdr, int* width, int* height, int* channels)
+{
+  *width = *height = *channels = 0;
+  if (hdr->nb_dims == 3) {
+    *channels = 1;
+    *height = hdr->dims[1];
+    *width = hdr->dims[2];
+  }
+  else if (hdr->nb_dims == 4) {
+    *channels = hdr->dims[1];
+    *height = hdr->dims[2];
+    *width = hdr->dims[3];
+  }
+}
+
 /**
  * Initialise les paramètres pour la structure
  * mnist_t.
  * 
  * \param output_file: le fichier de sortie
+ * \param num_train nombre de données d'apprentissage
+ * \param img_sz taille d'une image
  * \return structure mnist_t 
  */
-mnist_t* init_mnist(char* output_file)
+mnist_t* init_mnist(char* output_file, int num_train, int img_sz)
 {
   int i;
-  mnist_t* mnist = (mnist_t*)malloc(sizeof(*mnist));
+  mnist_t* mnist = (mnist_t*)MEM_MALLOC(sizeof(*mnist));
   assert(mnist);
 
-  unsigned int* info_image = (unsigned int*)malloc(MNIST_LEN_INFO_IMAGE * sizeof(*info_image));
+  unsigned int* info_image = (unsigned int*)MEM_MALLOC(MNIST_LEN_INFO_IMAGE * sizeof(*info_image));
   assert(info_image);
-  unsigned int* info_label = (unsigned int*)malloc(MNIST_LEN_INFO_LABEL * sizeof(*info_label));
+  unsigned int* info_label = (unsigned int*)MEM_MALLOC(MNIST_LEN_INFO_LABEL * sizeof(*info_label));
   assert(info_label);
-  unsigned int* train_label = (unsigned int*)malloc(MNIST_NUM_TRAIN * sizeof(*train_label));
+  unsigned int* train_label = (unsigned int*)MEM_MALLOC(num_train * sizeof(*train_label));
   assert(train_label);
 
   // TODO: long
-  double** train_image = (double**)malloc(MNIST_NUM_TRAIN * sizeof(*train_image));
+  double** train_image = (double**)MEM_MALLOC(num_train * sizeof(*train_image));
   assert(train_image);
 
-  for (i = 0; i < MNIST_NUM_TRAIN; i++) {
-    train_image[i] = (double*)malloc(MNIST_NUM_TRAIN * sizeof(*train_image[i]));
+  for (i = 0; i < num_train; i++) {
+    train_image[i] = (double*)MEM_MALLOC(img_sz * sizeof(*train_image[i]));
     assert(train_image[i]);
   }
 
-  unsigned char** image = (unsigned char**)malloc(MNIST_MAX_IMAGESIZE * sizeof(*image));
-  assert(image);
-
-  for (i = 0; i < MNIST_MAX_IMAGESIZE; i++) {
-    image[i] = (unsigned char*)malloc(MNIST_MAX_IMAGESIZE * sizeof(*image[i]));
-    assert(image[i]);
-  }
-
-  unsigned char** train_image_char = (unsigned char**)malloc(MNIST_NUM_TRAIN * sizeof(*train_image_char));
+  unsigned char** train_image_char = (unsigned char**)MEM_MALLOC(num_train * sizeof(*train_image_char));
   assert(train_image_char);
 
-  for (i = 0; i < MNIST_NUM_TRAIN; i++) {
-    train_image_char[i] = (unsigned char*)malloc(MNIST_SIZE * sizeof(*train_image_char[i]));
+  for (i = 0; i < num_train; i++) {
+    train_image_char[i] = (unsigned char*)MEM_MALLOC(img_sz * sizeof(*train_image_char[i]));
     assert(train_image_char[i]);
   }
 
-  unsigned char** train_label_char = (unsigned char**)malloc(MNIST_NUM_TRAIN * sizeof(*train_label_char));
+  unsigned char** train_label_char = (unsigned char**)MEM_MALLOC(num_train * sizeof(*train_label_char));
   assert(train_label_char);
 
-  for (i = 0; i < MNIST_NUM_TRAIN; i++) {
-    train_label_char[i] = (unsigned char*)malloc(sizeof(*train_label_char[i]));
+  for (i = 0; i < num_train; i++) {
+    train_label_char[i] = (unsigned char*)MEM_MALLOC(sizeof(*train_label_char[i]));
     assert(train_label_char);
   }
 
+  mnist->num_train = num_train;
   mnist->info_image = info_image;
   mnist->info_label = info_label;
   mnist->train_label = train_label;
   mnist->train_image = train_image;
-  mnist->image = image;
+  mnist->img_sz = img_sz;
+  mnist->width = 0;
+  mnist->height = 0;
+  mnist->channels = 0;
   mnist->train_image_char = train_image_char;
   mnist->train_label_char = train_label_char;
   mnist->output = output_file;
+  mnist->snapshot = NULL;
+  mnist->monitor = NULL;
 
   return mnist;
 }
 
 /**
- * Charge les données MNIST (données d'apprentissage).
+ * Charge les données MNIST (données d'apprentissage). Le nombre de
+ * données et les dimensions des images sont lus dans l'en-tête des
+ * fichiers (au plus MNIST_NUM_TRAIN images).
  * 
  * \param output_file fichier de sortie
+ * \param image_file fichier des images
+ * \param label_file fichier des labels
  * \return structure mnist_t
  */
-mnist_t* load_mnist(char* output_file)
+mnist_t* load_mnist(char* output_file, char* image_file, char* label_file)
 {
-  mnist_t* mnist = init_mnist(output_file);
+  idx_header_t img, lbl;
+  read_idx_header(image_file, &img);
+  read_idx_header(label_file, &lbl);
+  if (img.nb_dims < 2 || lbl.nb_dims != 1) {
+    fprintf(stderr, "Error: %s is not a set of images (IDX, 2 dimensions or more). \n", image_file);
+    exit(1);
+  }
+
+  int num_train = img.count < lbl.count ? img.count : lbl.count;
+  if (num_train > MNIST_NUM_TRAIN)
+    num_train = MNIST_NUM_TRAIN;
 
-  char mnist_train_image[] = MNIST_TRAIN_IMAGE;
-  char mnist_train_label[] = MNIST_TRAIN_LABEL;
+  mnist_t* mnist = init_mnist(output_file, num_train, img.item);
+  read_idx_image(&img, &mnist->width, &mnist->height, &mnist->channels);
 
   read_mnist_char(
-    mnist_train_image,
-    MNIST_NUM_TRAIN,
-    MNIST_LEN_INFO_IMAGE,
-    MNIST_SIZE,
+    image_file,
+    num_train,
+    1 + img.nb_dims,
+    img.item,
     mnist->train_image_char,
     mnist->info_image);
 
   image_char2double(
-    MNIST_NUM_TRAIN,
+    num_train,
+    img.item,
     mnist->train_image_char,
     mnist->train_image);
 
   read_mnist_char(
-    mnist_train_label,
-    MNIST_NUM_TRAIN,
+    label_file,
+    num_train,
     MNIST_LEN_INFO_LABEL,
     1,
     mnist->train_label_char,
     mnist->info_label);
 
   label_char2int(
-    MNIST_NUM_TRAIN,
+    num_train,
     mnist->train_label_char,
     mnist->train_label);
 
   // Retirer une fois les données chargées et castées
-  if (mnist->train_image_char) {
-    free(mnist->train_image_char);
-    mnist->train_image_char = NULL;
+  free_mnist_rows((void**)mnist->train_image_char, num_train);
+  mnist->train_image_char = NULL;
+
+  free_mnist_rows((void**)mnist->train_label_char, num_train);
+  mnist->train_label_char = NULL;
+  return mnist;
+}
+
+/**
+ * Ecrire un entier 32 bits en big-endian (format IDX).
+ *
+ * \param fp fichier
+ * \param val valeur
+ */
+static void write_be32(FILE* fp, unsigned int val)
+{
+  fputc((val >> 24) & 0xff, fp);
+  fputc((val >> 16) & 0xff, fp);
+  fputc((val >> 8) & 0xff, fp);
+  fputc(val & 0xff, fp);
+}
+
+/**
+ * Dessiner un chiffre sous forme d'afficheur 7 segments, avec une position,
+ * une taille et un bruit aléatoires.
+ *
+ * \param img image 'width' x 'height'
+ * \param width largeur de l'image
+ * \param height hauteur de l'image
+ * \param label chiffre à dessiner
+ * \param seed graine
+ */
+static void draw_synth_digit(unsigned char* img, int width, int height, int label, unsigned int* seed)
+{
+  // Segments allumés pour chaque chiffre (bits : a b c d e f g)
+  static const unsigned char segments[10] = {
+    0x7e, 0x30, 0x6d, 0x79, 0x33, 0x5b, 0x5f, 0x70, 0x7f, 0x7b
+  };
+  // Extrémités des segments dans une boîte de largeur 1 et de hauteur 2
+  static const int ends[7][4] = {
+    {0, 0, 1, 0}, {1, 0, 1, 1}, {1, 1, 1, 2}, {0, 2, 1, 2}, {0, 1, 0, 2}, {0, 0, 0, 1}, {0, 1, 1, 1}
+  };
+  // Tailles de l'image 28 x 28 mises à l'échelle (identiques en 28 x 28)
+  int s, x, y, t, thick = 2 * width / MNIST_WIDTH > 2 ? 2 * width / MNIST_WIDTH : 2;
+  int w = (10 + rand_r(seed) % 5) * width / MNIST_WIDTH, h = (8 + rand_r(seed) % 3) * height / MNIST_HEIGHT;
+  int x0 = (width - w) / 2 + (rand_r(seed) % 5 - 2) * width / MNIST_WIDTH;
+  int y0 = (height - 2 * h) / 2 + (rand_r(seed) % 5 - 2) * height / MNIST_HEIGHT;
+
+  memset(img, 0, (size_t)width * height);
+  for (s = 0; s < 7; s++) {
+    if (!(segments[label] & (0x40 >> s)))
+      continue;
+
+    int xa = x0 + ends[s][0] * w, ya = y0 + ends[s][1] * h;
+    int xb = x0 + ends[s][2] * w, yb = y0 + ends[s][3] * h;
+    for (y = ya; y <= yb; y++)
+      for (x = xa; x <= xb; x++)
+        for (t = 0; t < thick; t++) {
+          int px = xa == xb ? x + t : x, py = ya == yb ? y + t : y;
+          if (px >= 0 && px < width && py >= 0 && py < height)
+            img[py * width + px] = 192 + rand_r(seed) % 64;
+        }
+  }
+}
+
+/**
+ * Ecrire un jeu de données synthétique au format MNIST (IDX) : 'num_data'
+ * images 'width' x 'height' de chiffres et leurs labels, reproductibles
+ * pour une même graine.
+ *
+ * \param image_file fichier des images
+ * \param label_file fichier des labels
+ * \param num_data nombre de données
+ * \param seed graine
+ * \param width largeur des images
+ * \param height hauteur des images
+ */
+void write_mnist_synth(char* image_file, char* label_file, int num_data, unsigned int seed, int width, int height)
+{
+  int i, label;
+  unsigned char* img = (unsigned char*)malloc((size_t)width * height);
+  assert(img);
+  FILE *fp_img, *fp_lbl;
+
+  if ((fp_img = fopen(image_file, "wb")) == NULL || (fp_lbl = fopen(label_file, "wb")) == NULL) {
+    fprintf(stderr, "Error: could not open file. \n");
+    exit(1);
   }
 
-  if (mnist->train_label_char) {
-    free(mnist->train_label_char);
-    mnist->train_label_char = NULL;
+  write_be32(fp_img, MNIST_MAGIC_IMAGE);
+  write_be32(fp_img, num_data);
+  write_be32(fp_img, height);
+  write_be32(fp_img, width);
+  write_be32(fp_lbl, MNIST_MAGIC_LABEL);
+  write_be32(fp_lbl, num_data);
+
+  for (i = 0; i < num_data; i++) {
+    label = rand_r(&seed) % 10;
+    draw_synth_digit(img, width, height, label, &seed);
+    fwrite(img, 1, (size_t)width * height, fp_img);
+    fputc(label, fp_lbl);
   }
-  return mnist;
+
+  fclose(fp_img);
+  fclose(fp_lbl);
+  free(img);
+}
+
+/**
+ * Remplir un lot de données d'apprentissage synthétiques, comme
+ * write_mnist_synth mais en mémoire : une image normalisée par ligne de
+ * 'x' (le même chiffre dans chaque canal) et son label dans 'y'.
+ *
+ * \param x images (une par ligne, width x height x channels valeurs)
+ * \param y labels
+ * \param width largeur des images
+ * \param height hauteur des images
+ * \param channels nombre de canaux
+ * \param seed graine
+ */
+void fill_mnist_synth(matrix_t* x, unsigned int* y, int width, int height, int channels, unsigned int seed)
+{
+  int i, c, p, size = width * height;
+  unsigned char* img = (unsigned char*)malloc(size);
+  assert(img);
+
+  for (i = 0; i < x->rows; i++) {
+    y[i] = rand_r(&seed) % 10;
+    draw_synth_digit(img, width, height, y[i], &seed);
+    for (c = 0; c < channels; c++)
+      for (p = 0; p < size; p++)
+        x->data[(size_t)i * x->cols + c * size + p] = ((double)img[p] - 127.5) / 127.5;
+  }
+  free(img);
 }
 
 /**
- * Sauvegarder une image en créant un nouveau fichier.
+ * Sauvegarder une image en créant un nouveau fichier (PGM, ou PPM pour
+ * une image de 3 canaux ; les autres canaux sont placés l'un sous l'autre).
  * \param mnist structure mnist
+ * \param pixels pixels de l'image (canaux l'un après l'autre)
  */
-void save_image(mnist_t* mnist)
+void save_image(mnist_t* mnist, const unsigned char* pixels)
 {
   char file_name[MNIST_MAX_FILENAME];
   FILE* fp;
-  int x, y;
+  int i, c, size = mnist->width * mnist->height;
+  int rgb = mnist->channels == 3;
 
   strcpy(file_name, mnist->output);
 
@@ -241,14 +479,18 @@ void save_image(mnist_t* mnist)
     exit(1);
   }
 
-  fputs("P5\n", fp);
+  fputs(rgb ? "P6\n" : "P5\n", fp);
   fputs("# Created by Image Processing\n", fp);
-  fprintf(fp, "%d %d\n", MNIST_WIDTH, MNIST_HEIGHT);
+  fprintf(fp, "%d %d\n", mnist->width, rgb ? mnist->height : mnist->height * mnist->channels);
   fprintf(fp, "%d\n", MNIST_MAX_BRIGHTNESS);
 
-  for (y = 0; y < MNIST_HEIGHT; y++)
-    for (x = 0; x < MNIST_WIDTH; x++)
-      fputc(mnist->image[x][y], fp);
+  if (rgb) {
+    for (i = 0; i < size; i++)
+      for (c = 0; c < 3; c++)
+        fputc(pixels[c * size + i], fp);
+  }
+  else
+    fwrite(pixels, 1, (size_t)size * mnist->channels, fp);
   fclose(fp);
 
   printf("Image was saved successfully in %s. \n", mnist->output);
@@ -263,13 +505,30 @@ void save_image(mnist_t* mnist)
  */
 void save_mnist_pgm_mat(matrix_t* data_image, mnist_t* mnist)
 {
-  int x, y;
+  int i, n = mnist->width * mnist->height * mnist->channels;
+  unsigned char* pixels = (unsigned char*)malloc(n);
+  assert(pixels);
+
+  for (i = 0; i < n; i++)
+    pixels[i] = data_image->data[i] * 255.0;
 
-  for (y = 0; y < MNIST_HEIGHT; y++)
-    for (x = 0; x < MNIST_WIDTH; x++)
-      mnist->image[x][y] = data_image->data[y * MNIST_WIDTH + x] * 255.0;
+  save_image(mnist, pixels);
+  free(pixels);
+}
 
-  save_image(mnist);
+/**
+ * Libère un tableau de 'num' lignes et ses lignes.
+ * \param rows tableau de lignes
+ * \param num nombre de lignes
+ */
+void free_mnist_rows(void** rows, int num)
+{
+  int i;
+  if (rows) {
+    for (i = 0; i < num; i++)
+      MEM_FREE(rows[i]);
+    MEM_FREE(rows);
+  }
 }
 
 /**
@@ -278,38 +537,29 @@ void save_mnist_pgm_mat(matrix_t* data_image, mnist_t* mnist)
  */
 void free_mnist(mnist_t* mnist)
 {
-  if (mnist->image) {
-    free(mnist->image);
-    mnist->image = NULL;
-  }
+  free_mnist_rows((void**)mnist->train_image, mnist->num_train);
+  mnist->train_image = NULL;
+
+  free_mnist_rows((void**)mnist->train_image_char, mnist->num_train);
+  mnist->train_image_char = NULL;
+
+  free_mnist_rows((void**)mnist->train_label_char, mnist->num_train);
+  mnist->train_label_char = NULL;
 
   if (mnist->info_image) {
-    free(mnist->info_image);
+    MEM_FREE(mnist->info_image);
     mnist->info_image = NULL;
   }
 
   if (mnist->info_label) {
-    free(mnist->info_label);
+    MEM_FREE(mnist->info_label);
     mnist->info_label = NULL;
   }
 
-  if (mnist->train_image) {
-    free(mnist->train_image);
-    mnist->train_image = NULL;
-  }
-
-  if (mnist->train_image_char) {
-    free(mnist->train_image_char);
-    mnist->train_image_char = NULL;
-  }
-
   if (mnist->train_label) {
-    free(mnist->train_label);
+    MEM_FREE(mnist->train_label);
     mnist->train_label = NULL;
   }
 
-  if (mnist->train_label_char) {
-    free(mnist->train_label_char);
-    mnist->train_label_char = NULL;
-  }
-}
\ No newline at end of file
+  MEM_FREE(mnist);
+}
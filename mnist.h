@@ -8,13 +8,15 @@
 
 #include "matrix.h"
 #include "mnist.h"
+#include "snapshot.h"
+#include "monitor.h"
 
 // Fichier pour les données d'apprentissage MNIST
 #define MNIST_TRAIN_IMAGE "./data/train-images.idx3-ubyte"
 // Fichier pour les labels MNIST
 #define MNIST_TRAIN_LABEL "./data/train-labels.idx1-ubyte"
 
-// Taille d'une image MNIST (28 * 28)
+// Taille d'une image MNIST (28 * 28), dimensions par défaut sans données
 #define MNIST_SIZE 784
 // Taille de la longueur d'une image MNIST
 #define MNIST_WIDTH 28
@@ -22,38 +24,72 @@
 #define MNIST_HEIGHT 28
 // Nombre de données d'apprentissage
 #define MNIST_NUM_TRAIN 60000
-// Taille pour les informations sur l'image pour le buffer
-#define MNIST_LEN_INFO_IMAGE 4
+// Nombre de classes (chiffres)
+#define MNIST_NUM_CLASSES 10
+// Valeur normalisée du fond des images (pixel noir)
+#define MNIST_BACKGROUND -1.0
+// Nombre magique des fichiers d'images (IDX)
+#define MNIST_MAGIC_IMAGE 0x00000803
+// Nombre magique des fichiers de labels (IDX)
+#define MNIST_MAGIC_LABEL 0x00000801
+// Taille max. pour les informations sur l'image pour le buffer (nombre
+// magique et dimensions)
+#define MNIST_LEN_INFO_IMAGE (1 + MNIST_IDX_MAX_DIMS)
 // Taille pour les informations sur le label pour le buffer
 #define MNIST_LEN_INFO_LABEL 2
-// Taille max. pour les images
-#define MNIST_MAX_IMAGESIZE 1280
 // Luminosité max. pour les images
 #define MNIST_MAX_BRIGHTNESS 255
 // Taille max. pour le nom des images
 #define MNIST_MAX_FILENAME 256
 // Nombre max. d'images à stocker
 #define MNIST_MAX_NUM_OF_IMAGES 1
+// Type des données d'un fichier IDX (octets non signés)
+#define MNIST_IDX_UBYTE 0x08
+// Nombre max. de dimensions d'un fichier IDX
+#define MNIST_IDX_MAX_DIMS 8
+
+typedef struct idx_header idx_header_t;
+/* Structure représentant l'en-tête d'un fichier IDX */
+struct idx_header {
+  int nb_dims; // nombre de dimensions
+  unsigned int dims[MNIST_IDX_MAX_DIMS]; // dimensions (la première : nombre de données)
+  long count; // nombre de données
+  long item; // taille d'une donnée en octets (produit des autres dimensions)
+  long offset; // taille de l'en-tête (début des données)
+};
 
 typedef struct mnist mnist_t;
 /* Structure représentant les données MNIST */
 struct mnist {
+  int num_train; // nombre de données d'apprentissage chargées
   unsigned int* train_label; // labels MNIST
   unsigned int* info_image; // informations sur l'image pour le buffer
   unsigned int* info_label; // informations sur le label pour le buffer
   double** train_image; // données d'apprentissage MNIST
-  unsigned char** image; // l'image en sortie (sauvegardée)
+  int img_sz; // taille d'une image (largeur x hauteur x canaux)
+  int width; // largeur d'une image (0 : inconnue)
+  int height; // hauteur d'une image (0 : inconnue)
+  int channels; // nombre de canaux d'une image (0 : inconnu)
   unsigned char** train_image_char; // données d'apprentissage MNIST brutes
   unsigned char** train_label_char; // labels MNIST brutes
   char* output; // nom du fichier en sortie (de l'image sauvegardé)
+  snapshot_t* snapshot; // écriture asynchrone des images (NULL : écriture directe)
+  monitor_t* monitor; // publication pour gan-monitor (NULL : aucune)
 };
 
-mnist_t* init_mnist(char*);
-mnist_t* load_mnist(char*);
+mnist_t* init_mnist(char*, int, int);
+mnist_t* load_mnist(char*, char*, char*);
+int read_mnist_count(char*);
+void read_idx_header(char*, idx_header_t*);
+void read_idx_image(idx_header_t*, int*, int*, int*);
+void write_mnist_synth(char*, char*, int, unsigned int, int, int);
+void fill_mnist_synth(matrix_t*, unsigned int*, int, int, int, unsigned int);
 void read_mnist_char(char*, int, int, int, unsigned char**, unsigned int*);
-void image_char2double(int, unsigned char**, double**);
+void image_char2double(int, int, unsigned char**, double**);
 void label_char2int(int, unsigned char**, unsigned int*);
-void save_image(mnist_t*);
+void save_image(mnist_t*, const unsigned char*);
 void save_mnist_pgm_mat(matrix_t*, mnist_t*);
+void free_mnist_rows(void**, int);
+void free_mnist(mnist_t*);
 
 #endif
\ No newline at end of file
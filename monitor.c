@@ -0,0 +1,271 @@
+/*!
+ * \file monitor.c
+ * \brief Fichier comprenant la publication de l'état de l'apprentissage
+ * dans un segment de mémoire partagée POSIX : le dernier état (images
+ * générées, pertes, coefficient d'apprentissage, durées) protégé par un
+ * seqlock, et un anneau sans verrou des mesures de chaque itération.
+ * L'apprentissage n'y fait que des copies mémoire, sans appel système ;
+ * l'outil gan-monitor lit le segment depuis un autre processus.
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "monitor.h"
+
+/**
+ * Savoir si le segment 'name' a été laissé par un apprentissage qui
+ * s'est arrêté sans le supprimer (processus terminé).
+ *
+ * \param name nom du segment
+ * \return 1 si le segment est abandonné, 0 sinon
+ */
+static int monitor_stale(const char* name)
+{
+  int stale;
+  monitor_shm_t* shm = monitor_attach(name);
+  if (!shm)
+    return 0;
+  stale = kill(shm->pid, 0) == -1 && errno == ESRCH;
+  munmap(shm, sizeof(*shm));
+  return stale;
+}
+
+/**
+ * Créer le segment de mémoire partagée 'name' (par exemple "/gan").
+ * Un segment déjà publié par un autre apprentissage en cours n'est pas
+ * écrasé ; un segment abandonné (processus terminé) est remplacé.
+ * En cas d'échec, un avertissement est affiché et l'apprentissage
+ * continue sans publication.
+ *
+ * \param name nom du segment
+ * \param width largeur d'une image
+ * \param height hauteur d'une image
+ * \return structure monitor, ou NULL
+ */
+monitor_t* monitor_open(const char* name, int width, int height)
+{
+  int fd;
+  monitor_shm_t* shm;
+
+  if (!name || !name[0])
+    return NULL;
+
+  if (width * height > MONITOR_MAX_PIXELS) {
+    fprintf(stderr, "Warning: images too large for monitor %s. \n", name);
+    return NULL;
+  }
+
+  fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd == -1 && errno == EEXIST && monitor_stale(name)) {
+    shm_unlink(name);
+    fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+  }
+  if (fd == -1 && errno == EEXIST) {
+    fprintf(stderr, "Warning: monitor %s is used by another process. \n", name);
+    return NULL;
+  }
+  if (fd == -1 || ftruncate(fd, sizeof(*shm)) == -1) {
+    fprintf(stderr, "Warning: could not create monitor %s. \n", name);
+    if (fd != -1) {
+      close(fd);
+      shm_unlink(name);
+    }
+    return NULL;
+  }
+
+  shm = (monitor_shm_t*)mmap(NULL, sizeof(*shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (shm == MAP_FAILED) {
+    fprintf(stderr, "Warning: could not map monitor %s. \n", name);
+    shm_unlink(name);
+    return NULL;
+  }
+
+  monitor_t* mon = (monitor_t*)malloc(sizeof(*mon));
+  assert(mon);
+  mon->name = strdup(name);
+  assert(mon->name);
+  mon->shm = shm;
+  mon->total_ms = 0.0;
+  mon->nb_steps = 0;
+  clock_gettime(CLOCK_MONOTONIC, &mon->last);
+
+  shm->width = width;
+  shm->height = height;
+  shm->pid = getpid();
+  shm->version = MONITOR_VERSION;
+  atomic_store_explicit(&shm->seq, 0, memory_order_relaxed);
+  atomic_store_explicit(&shm->head, 0, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  shm->magic = MONITOR_MAGIC;
+  return mon;
+}
+
+/**
+ * Publier les mesures d'une itération : ajout dans l'anneau, puis mise à
+ * jour du dernier état sous seqlock (les premières images générées sont
+ * copiées en float).
+ *
+ * \param mon structure monitor (NULL : aucune publication)
+ * \param images images générées (une image par ligne)
+ * \param a_real sortie du discriminator pour les données réelles
+ * \param a_fake sortie du discriminator pour les données générées
+ * \param lr coefficient d'apprentissage
+ * \param step itération (lot)
+ * \param epoch itération (epoch)
+ */
+void monitor_publish(monitor_t* mon, matrix_t* images, matrix_t* a_real, matrix_t* a_fake,
+  double lr, long step, int epoch)
+{
+  int i, n;
+  double loss_d = 0.0, loss_g = 0.0;
+  monitor_metric_t metric;
+  struct timespec now;
+
+  if (!mon)
+    return;
+
+  // Horloge vDSO : pas d'appel système
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  monitor_shm_t* shm = mon->shm;
+  monitor_state_t* st = &shm->state;
+
+  for (i = 0; i < a_fake->rows; i++) {
+    loss_d += -log(a_real->data[i]) - log(1.0 - a_fake->data[i]);
+    loss_g += -log(a_fake->data[i]);
+  }
+
+  metric.step = step;
+  metric.epoch = epoch;
+  metric.loss_d = loss_d / a_fake->rows;
+  metric.loss_g = loss_g / a_fake->rows;
+  metric.lr = lr;
+  metric.step_ms = (now.tv_sec - mon->last.tv_sec) * 1e3 + (now.tv_nsec - mon->last.tv_nsec) * 1e-6;
+  mon->last = now;
+  mon->total_ms += metric.step_ms;
+  mon->nb_steps++;
+
+  // Anneau : un seul écrivain, l'indice est publié après la mesure
+  unsigned long head = atomic_load_explicit(&shm->head, memory_order_relaxed);
+  shm->ring[head & (MONITOR_RING - 1)] = metric;
+  atomic_store_explicit(&shm->head, head + 1, memory_order_release);
+
+  // Dernier état : compteur impair pendant l'écriture
+  unsigned int seq = atomic_load_explicit(&shm->seq, memory_order_relaxed);
+  atomic_store_explicit(&shm->seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  st->last = metric;
+  st->step_ms_mean = mon->total_ms / mon->nb_steps;
+  if (metric.step_ms > st->step_ms_max)
+    st->step_ms_max = metric.step_ms;
+  st->img_s = images->rows * 1e3 / st->step_ms_mean;
+  st->nb_images = images->rows < MONITOR_IMAGES ? images->rows : MONITOR_IMAGES;
+  n = st->nb_images * images->cols;
+  for (i = 0; i < n; i++)
+    st->images[i] = (float)images->data[i];
+
+  atomic_store_explicit(&shm->seq, seq + 2, memory_order_release);
+}
+
+/**
+ * Supprimer le segment de mémoire partagée.
+ *
+ * \param mon structure monitor
+ */
+void monitor_close(monitor_t* mon)
+{
+  if (!mon)
+    return;
+
+  munmap(mon->shm, sizeof(*mon->shm));
+  shm_unlink(mon->name);
+  free(mon->name);
+  free(mon);
+}
+
+/**
+ * Projeter en lecture le segment 'name' d'un apprentissage en cours.
+ *
+ * \param name nom du segment
+ * \return segment, ou NULL s'il n'existe pas
+ */
+monitor_shm_t* monitor_attach(const char* name)
+{
+  int fd;
+  monitor_shm_t* shm;
+
+  if ((fd = shm_open(name, O_RDONLY, 0)) == -1)
+    return NULL;
+
+  shm = (monitor_shm_t*)mmap(NULL, sizeof(*shm), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (shm == MAP_FAILED)
+    return NULL;
+
+  if (shm->magic != MONITOR_MAGIC || shm->version != MONITOR_VERSION) {
+    munmap(shm, sizeof(*shm));
+    return NULL;
+  }
+  return shm;
+}
+
+/**
+ * Lire le dernier état publié, en recommençant si une écriture a eu lieu
+ * pendant la lecture.
+ *
+ * \param shm segment
+ * \param st copie de l'état
+ */
+void monitor_read_state(monitor_shm_t* shm, monitor_state_t* st)
+{
+  unsigned int s1, s2;
+
+  do {
+    s1 = atomic_load_explicit(&shm->seq, memory_order_acquire);
+    memcpy(st, &shm->state, sizeof(*st));
+    atomic_thread_fence(memory_order_acquire);
+    s2 = atomic_load_explicit(&shm->seq, memory_order_relaxed);
+  } while ((s1 & 1) || s1 != s2);
+}
+
+/**
+ * Lire les mesures écrites dans l'anneau depuis 'from'. Les mesures déjà
+ * écrasées par l'apprentissage sont sautées.
+ *
+ * \param shm segment
+ * \param from nombre de mesures déjà lues
+ * \param metrics mesures lues (MONITOR_RING au plus)
+ * \param nb nombre de mesures lues
+ * \return nombre total de mesures lues (à passer en 'from' à l'appel suivant)
+ */
+unsigned long monitor_read_metrics(monitor_shm_t* shm, unsigned long from, monitor_metric_t* metrics, int* nb)
+{
+  unsigned long i, head = atomic_load_explicit(&shm->head, memory_order_acquire);
+
+  if (head - from > MONITOR_RING)
+    from = head - MONITOR_RING;
+
+  for (i = from; i < head; i++)
+    metrics[i - from] = shm->ring[i & (MONITOR_RING - 1)];
+
+  // Mesures écrasées pendant la copie
+  atomic_thread_fence(memory_order_acquire);
+  unsigned long now = atomic_load_explicit(&shm->head, memory_order_relaxed);
+  unsigned long skip = now - from > MONITOR_RING ? now - from - MONITOR_RING : 0;
+  if (skip > head - from)
+    skip = head - from;
+
+  *nb = (int)(head - from - skip);
+  memmove(metrics, metrics + skip, *nb * sizeof(*metrics));
+  return head;
+}
@@ -0,0 +1,77 @@
+/*!
+ * \file monitor.h
+ * \brief Fichier header de monitor.c
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#ifndef _MONITOR_H_
+#define _MONITOR_H_
+
+#include <stdatomic.h>
+#include <time.h>
+#include "matrix.h"
+
+// Identifiant du segment de mémoire partagée ("GANM")
+#define MONITOR_MAGIC 0x47414e4d
+// Version du format du segment
+#define MONITOR_VERSION 1
+// Nombre max. d'images générées publiées
+#define MONITOR_IMAGES 16
+// Taille max. d'une image publiée (en pixels)
+#define MONITOR_MAX_PIXELS 4096
+// Nombre de mesures conservées (puissance de 2)
+#define MONITOR_RING 1024
+
+typedef struct monitor_metric monitor_metric_t;
+/* Structure représentant les mesures d'une itération */
+struct monitor_metric {
+  long step; // itération (lot)
+  int epoch; // itération (epoch)
+  double loss_d; // perte du discriminator
+  double loss_g; // perte du generator
+  double lr; // coefficient d'apprentissage
+  double step_ms; // durée de l'itération en millisecondes
+};
+
+typedef struct monitor_state monitor_state_t;
+/* Structure représentant le dernier état publié (protégé par un seqlock) */
+struct monitor_state {
+  monitor_metric_t last; // mesures de la dernière itération
+  double step_ms_mean; // durée moyenne d'une itération
+  double step_ms_max; // durée max. d'une itération
+  double img_s; // images par seconde
+  int nb_images; // nombre d'images publiées
+  float images[MONITOR_IMAGES * MONITOR_MAX_PIXELS]; // images générées
+};
+
+typedef struct monitor_shm monitor_shm_t;
+/* Structure représentant le segment de mémoire partagée */
+struct monitor_shm {
+  unsigned int magic; // MONITOR_MAGIC
+  unsigned int version; // MONITOR_VERSION
+  int width; // largeur d'une image
+  int height; // hauteur d'une image
+  int pid; // processus d'apprentissage
+  _Atomic unsigned int seq; // seqlock de l'état (impair : écriture en cours)
+  monitor_state_t state; // dernier état publié
+  _Atomic unsigned long head; // nombre de mesures écrites dans l'anneau
+  monitor_metric_t ring[MONITOR_RING]; // anneau des mesures
+};
+
+typedef struct monitor monitor_t;
+/* Structure représentant la publication des mesures par l'apprentissage */
+struct monitor {
+  char* name; // nom du segment
+  monitor_shm_t* shm; // segment projeté
+  struct timespec last; // fin de l'itération précédente
+  double total_ms; // durée cumulée des itérations
+  long nb_steps; // nombre d'itérations publiées
+};
+
+monitor_t* monitor_open(const char*, int, int);
+void monitor_publish(monitor_t*, matrix_t*, matrix_t*, matrix_t*, double, long, int);
+void monitor_close(monitor_t*);
+monitor_shm_t* monitor_attach(const char*);
+void monitor_read_state(monitor_shm_t*, monitor_state_t*);
+unsigned long monitor_read_metrics(monitor_shm_t*, unsigned long, monitor_metric_t*, int*);
+
+#endif
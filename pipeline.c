@@ -0,0 +1,270 @@
+/*!
+ * \file pipeline.c
+ * \brief Fichier comprenant l'apprentissage en pipeline du modèle GAN :
+ * le generator et le discriminator s'exécutent sur deux groupes de coeurs,
+ * le generator pouvant prendre jusqu'à 'staleness' lots d'avance.
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#define _GNU_SOURCE
+#include <assert.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include "pipeline.h"
+#include "mem.h"
+#include "prof.h"
+#include "trace.h"
+#include "queue.h"
+
+typedef struct pipeline pipeline_t;
+/* Structure représentant l'état partagé du pipeline */
+struct pipeline {
+  int nb_slots; // nombre de lots en vol (staleness + 1)
+  int nb_steps; // nombre total de lots (epochs * num_batches)
+  unsigned int seed; // graine pour le bruit du generator
+  config_t* cfg; // structure config
+  mnist_t* mnist; // structure mnist
+  gan_t** slots; // répliques du GAN, une par lot en vol
+  matrix_t** z; // bruit de chaque lot en vol
+  matrix_t** x_real; // données réelles de chaque lot en vol
+  queue_t* fwd; // lots générés, du generator vers le discriminator
+  queue_t* grad; // gradients calculés, du discriminator vers le generator
+  cpu_set_t cpus_g; // coeurs du generator
+  cpu_set_t cpus_d; // coeurs du discriminator
+};
+
+/**
+ * Répartir les coeurs disponibles en deux moitiés, une pour le generator
+ * et une pour le discriminator. Sans au moins deux coeurs, les threads
+ * ne sont pas fixés.
+ *
+ * \param pl structure pipeline
+ * \return 1 si les threads doivent être fixés, 0 sinon
+ */
+static int split_cpus(pipeline_t* pl)
+{
+  cpu_set_t all;
+  int c, n = 0, half;
+
+  CPU_ZERO(&pl->cpus_g);
+  CPU_ZERO(&pl->cpus_d);
+  if (sched_getaffinity(0, sizeof(all), &all) || CPU_COUNT(&all) < 2)
+    return 0;
+
+  half = CPU_COUNT(&all) / 2;
+  for (c = 0; c < CPU_SETSIZE; c++) {
+    if (!CPU_ISSET(c, &all))
+      continue;
+    if (n++ < half)
+      CPU_SET(c, &pl->cpus_g);
+    else
+      CPU_SET(c, &pl->cpus_d);
+  }
+  return 1;
+}
+
+/**
+ * Appliquer le gradient d'un lot revenu du discriminator au generator.
+ *
+ * \param pl structure pipeline
+ * \param s indice du lot en vol
+ * \param lr coefficient d'apprentissage du generator
+ */
+static void apply_generator_grad(pipeline_t* pl, int s, double lr)
+{
+  gan_t* slot = pl->slots[s];
+  slot->lr = lr;
+  backward_generator_params(slot, pl->z[s], slot->der_d->x);
+}
+
+/**
+ * Thread du generator : propagation avant du lot k + staleness pendant que
+ * le discriminator traite le lot k, puis application des gradients revenus.
+ *
+ * \param arg structure pipeline
+ * \return NULL
+ */
+static void* generator_stage(void* arg)
+{
+  pipeline_t* pl = (pipeline_t*)arg;
+  int k, s, inflight = 0;
+  double lr = pl->slots[0]->lr;
+
+  for (k = 0; k < pl->nb_steps; k++) {
+    // Attendre un emplacement libre, puis récupérer les gradients déjà prêts
+    if (inflight == pl->nb_slots) {
+      apply_generator_grad(pl, queue_pop_wait(pl->grad), lr);
+      inflight--;
+    }
+    while (queue_pop(pl->grad, &s)) {
+      apply_generator_grad(pl, s, lr);
+      inflight--;
+    }
+
+    if (k > 0 && k % pl->cfg->num_batches == 0) {
+      int epoch = k / pl->cfg->num_batches - 1;
+      lr = lr * (1.0 / (1.0 + pl->slots[0]->dr * epoch));
+    }
+
+    s = k % pl->nb_slots;
+    generate_noise(pl->z[s], &pl->seed);
+    select_batch(pl->cfg, pl->slots[s], k % pl->cfg->num_batches);
+    forward_generator(pl->slots[s], pl->z[s]);
+    queue_push_wait(pl->fwd, s);
+    inflight++;
+  }
+
+  while (inflight > 0) {
+    apply_generator_grad(pl, queue_pop_wait(pl->grad), lr);
+    inflight--;
+  }
+  return NULL;
+}
+
+/**
+ * Thread du discriminator : propagations avant et arrière du discriminator
+ * pour chaque lot généré, puis calcul du gradient par rapport à l'image
+ * générée, renvoyé au generator.
+ *
+ * \param arg structure pipeline
+ * \return NULL
+ */
+static void* discriminator_stage(void* arg)
+{
+  pipeline_t* pl = (pipeline_t*)arg;
+  config_t* cfg = pl->cfg;
+  gan_t* gan = pl->slots[0];
+  int k, s, epoch, out = gan->nb_layers - 2;
+  double lr = gan->lr, elapsed = 0.0;
+  struct timespec start, end;
+
+  matrix_t* loss_d = mat_zinit(gan->d->a_fake[out]->rows, gan->d->a_real[out]->cols);
+  matrix_t* loss_g = mat_zinit(gan->d->a_fake[out]->rows, gan->d->a_fake[out]->cols);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (k = 0; k < pl->nb_steps; k++) {
+    gan_t* slot;
+    s = queue_pop_wait(pl->fwd);
+    slot = pl->slots[s];
+    TRACE_STEP();
+    slot->lr = lr;
+
+    load_batch(cfg, pl->x_real[s], k % cfg->num_batches);
+    forward_discriminator(slot, pl->x_real[s], 1);
+    forward_discriminator(slot, slot->g->a[out], 0);
+    backward_discriminator(slot, pl->x_real[s]);
+    backward_generator_input(slot);
+    monitor_publish(pl->mnist->monitor, slot->g->a[out], slot->d->a_real[out], slot->d->a_fake[out],
+      lr, k, k / cfg->num_batches);
+
+    if ((k + 1) % cfg->num_batches == 0) {
+      epoch = k / cfg->num_batches;
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+      PROF_EPOCH(epoch);
+      MEM_EPOCH(epoch);
+
+      if (cfg->progressbar)
+        print_progressbar(epoch, PRINT_EP, gan->epochs);
+
+      if (cfg->verbose && epoch % PRINT_EP == 0)
+        print_loss(pl->mnist, slot, epoch, loss_d, loss_g, (double)(epoch + 1) * cfg->train_sz / elapsed);
+
+      if (k + 1 == pl->nb_steps) {
+        mat_ce_(loss_d, slot->d->a_fake[out], slot->d->a_real[out]);
+        mat_log_(loss_g, slot->d->a_fake[out]);
+        printf("[pipeline] staleness: %d, img/s: %.1f, loss_d: %.3f, loss_g: %.3f\n",
+          pl->nb_slots - 1, (double)gan->epochs * cfg->train_sz / elapsed, mat_mean(loss_d), mat_mean(loss_g));
+      }
+
+      lr = lr * (1.0 / (1.0 + gan->dr * epoch));
+    }
+
+    queue_push_wait(pl->grad, s);
+  }
+
+  mat_free(loss_d);
+  mat_free(loss_g);
+  return NULL;
+}
+
+/**
+ * Entraîner le modèle GAN en pipeline : un thread pour le generator et un
+ * thread pour le discriminator, sur deux moitiés des coeurs disponibles.
+ * Les lots générés et les gradients circulent par deux files sans verrou ;
+ * le generator peut avoir au plus 'staleness' lots d'avance sur les
+ * gradients qu'il a appliqués. Chaque thread est le seul à écrire dans ses
+ * propres poids, il n'y a donc pas de course sur les paramètres.
+ *
+ * \param cfg structure config
+ * \param gan structure gan
+ * \param mnist structure mnist
+ */
+void train_gan_pipeline(config_t* cfg, gan_t* gan, mnist_t* mnist)
+{
+  int s;
+  pthread_t thread_g, thread_d;
+  pthread_attr_t attr_g, attr_d;
+
+  pipeline_t* pl = (pipeline_t*)malloc(sizeof(*pl));
+  assert(pl);
+
+  pl->nb_slots = cfg->staleness + 1;
+  pl->nb_steps = gan->epochs * cfg->num_batches;
+  pl->seed = (unsigned int)rand();
+  pl->cfg = cfg;
+  pl->mnist = mnist;
+
+  pl->slots = (gan_t**)malloc(pl->nb_slots * sizeof(*pl->slots));
+  assert(pl->slots);
+  pl->z = (matrix_t**)malloc(pl->nb_slots * sizeof(*pl->z));
+  assert(pl->z);
+  pl->x_real = (matrix_t**)malloc(pl->nb_slots * sizeof(*pl->x_real));
+  assert(pl->x_real);
+
+  for (s = 0; s < pl->nb_slots; s++) {
+    pl->slots[s] = s == 0 ? gan : init_gan_replica(cfg, gan);
+    pl->z[s] = mat_zinit(cfg->batch_sz, gan->input_layer_sz_g);
+    pl->x_real[s] = mat_zinit(cfg->batch_sz, cfg->x_train->cols);
+  }
+
+  pl->fwd = queue_init(pl->nb_slots);
+  pl->grad = queue_init(pl->nb_slots);
+
+  pthread_attr_init(&attr_g);
+  pthread_attr_init(&attr_d);
+  if (split_cpus(pl)) {
+    pthread_attr_setaffinity_np(&attr_g, sizeof(pl->cpus_g), &pl->cpus_g);
+    pthread_attr_setaffinity_np(&attr_d, sizeof(pl->cpus_d), &pl->cpus_d);
+  }
+
+  if (pthread_create(&thread_g, &attr_g, generator_stage, pl) ||
+    pthread_create(&thread_d, &attr_d, discriminator_stage, pl)) {
+    fprintf(stderr, "Error: could not create pipeline threads. \n");
+    exit(1);
+  }
+
+  pthread_join(thread_g, NULL);
+  pthread_join(thread_d, NULL);
+  pthread_attr_destroy(&attr_g);
+  pthread_attr_destroy(&attr_d);
+
+  // Le modèle principal conserve le dernier coefficient d'apprentissage
+  gan->lr = pl->slots[(pl->nb_steps - 1) % pl->nb_slots]->lr;
+
+  for (s = 0; s < pl->nb_slots; s++) {
+    if (s > 0)
+      free_gan_replica(pl->slots[s]);
+    mat_free(pl->z[s]);
+    mat_free(pl->x_real[s]);
+  }
+
+  queue_free(pl->fwd);
+  queue_free(pl->grad);
+  free(pl->slots);
+  free(pl->z);
+  free(pl->x_real);
+  free(pl);
+}
@@ -0,0 +1,13 @@
+/*!
+ * \file pipeline.h
+ * \brief Fichier header de pipeline.c
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+#include "gan.h"
+
+void train_gan_pipeline(config_t*, gan_t*, mnist_t*);
+
+#endif
@@ -0,0 +1,477 @@
+/*!
+ * \file prof.c
+ * \brief Fichier comprenant l'instrumentation des phases de l'apprentissage :
+ * temps, nombre d'appels et GFLOP/s, cumulés par thread et écrits en CSV
+ * à chaque itération (epoch). Avec GAN_PERF, les noyaux de matrix.c sont
+ * aussi mesurés, avec les compteurs matériels de perf_event_open (cycles,
+ * instructions, défauts de cache L1 / LLC, mauvaises prédictions de
+ * branchement), résumés en fin d'apprentissage dans un tableau par noyau.
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "prof.h"
+#include "trace.h"
+
+#ifdef GAN_PERF
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#ifdef GAN_PROFILE
+
+/* Enumération pour les compteurs matériels */
+enum PERF_E {
+  PERF_CYCLES = 0,
+  PERF_INSTRUCTIONS,
+  PERF_L1D_MISSES,
+  PERF_LLC_MISSES,
+  PERF_BRANCH_MISSES,
+  PERF_NB
+};
+
+typedef struct prof_stat prof_stat_t;
+/* Structure représentant les totaux d'une phase */
+struct prof_stat {
+  unsigned long calls; // nombre d'appels
+  double time; // temps cumulé en secondes
+  double flops; // nombre d'opérations flottantes cumulé
+  unsigned long long counters[PERF_NB]; // compteurs matériels cumulés
+};
+
+typedef struct prof_thread prof_thread_t;
+/* Structure représentant les mesures d'un thread */
+struct prof_thread {
+  prof_stat_t totals[PROF_NB]; // totaux par phase (tout l'apprentissage)
+  atomic_uint seq; // seqlock des totaux (impair pendant une mise à jour)
+  prof_stat_t reported[PROF_NB]; // totaux déjà écrits par prof_epoch (sous prof_mutex)
+  double start[PROF_NB]; // début de la phase en cours
+  unsigned long long cstart[PROF_NB][PERF_NB]; // compteurs au début de la phase
+  int perf_fd; // descripteur du groupe de compteurs (-1 si indisponible)
+  int perf_fds[PERF_NB]; // descripteurs des compteurs du groupe (-1 si indisponible)
+  int perf_avail[PERF_NB]; // compteurs ouverts avec succès par ce thread
+  prof_thread_t* next; // thread suivant
+};
+
+// Noms des phases
+static const char* prof_names[PROF_NB] = {
+  "forward_generator",
+  "forward_discriminator_real",
+  "forward_discriminator_fake",
+  "backward_discriminator",
+  "backward_generator",
+  "update_discriminator",
+  "update_generator",
+  "generate_noise",
+  "batch_copy",
+  "recompute_activations",
+  "mat_dot",
+  "mat_dot_(LEFT_TRANSPOSE)",
+  "mat_dot_(RIGHT_TRANSPOSE)",
+  "mat_sum_",
+  "mat_sub_",
+  "mat_mul_",
+  "mat_mul_scalar",
+  "mat_sum_axis0_",
+  "mat_lrelu_",
+  "mat_tanh_",
+  "mat_sigmoid",
+  "mat_dlrelu",
+  "mat_dtanh",
+  "mat_dsigmoid",
+  "mat_copy_",
+  "mat_ce_/mat_log_",
+  "conv_forward",
+  "conv_backward_input",
+  "conv_backward_weight",
+  "bn_forward",
+  "bn_backward",
+  "sparse_sum_z_act",
+  "sparse_dot_left",
+  "mat_pack"
+};
+
+// Mesures du thread courant
+static __thread prof_thread_t* prof_local = NULL;
+// Liste des mesures de tous les threads
+static prof_thread_t* prof_threads = NULL;
+// Verrou pour la liste des threads
+static pthread_mutex_t prof_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Fichier de sortie
+static FILE* prof_fp = NULL;
+
+#ifdef GAN_PERF
+// Fermeture des compteurs à la fin de chaque thread
+static pthread_key_t perf_key;
+static pthread_once_t perf_once = PTHREAD_ONCE_INIT;
+// Raison de l'indisponibilité des compteurs (affichée une seule fois)
+static atomic_int perf_warned = 0;
+
+/**
+ * Ouvrir un compteur matériel pour le thread courant.
+ *
+ * \param type type du compteur
+ * \param config compteur
+ * \param group descripteur du premier compteur du groupe (-1 pour le créer)
+ * \return descripteur, ou -1 si le compteur est indisponible
+ */
+static int perf_open(unsigned int type, unsigned long long config, int group)
+{
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP;
+  return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+/**
+ * Ouvrir le groupe de compteurs du thread courant. Sans compteurs
+ * (conteneur, machine virtuelle, perf_event_paranoid), seuls le temps
+ * et les opérations flottantes sont mesurés.
+ *
+ * \param pt mesures du thread
+ */
+static void perf_init(prof_thread_t* pt)
+{
+  static const unsigned int types[PERF_NB] = {
+    PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE
+  };
+  static const unsigned long long configs[PERF_NB] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES
+  };
+  int e;
+
+  for (e = 0; e < PERF_NB; e++)
+    pt->perf_fds[e] = -1;
+  pt->perf_fd = pt->perf_fds[0] = perf_open(types[0], configs[0], -1);
+  if (pt->perf_fd < 0) {
+    if (!atomic_exchange(&perf_warned, 1))
+      fprintf(stderr, "Warning: hardware counters unavailable (%s), timing only. \n", strerror(errno));
+    return;
+  }
+
+  // Les compteurs absents (LLC sur certaines machines virtuelles) sont
+  // ignorés ; l'ordre des valeurs lues dépend des compteurs de ce thread
+  pt->perf_avail[0] = 1;
+  for (e = 1; e < PERF_NB; e++) {
+    pt->perf_fds[e] = perf_open(types[e], configs[e], pt->perf_fd);
+    pt->perf_avail[e] = pt->perf_fds[e] >= 0;
+  }
+}
+
+/**
+ * Fermer les compteurs d'un thread (fin du thread ou de l'apprentissage).
+ * Les totaux restent dans la liste des threads pour le tableau final.
+ *
+ * \param arg mesures du thread
+ */
+static void perf_close(void* arg)
+{
+  prof_thread_t* pt = (prof_thread_t*)arg;
+  int e;
+
+  for (e = PERF_NB - 1; e >= 0; e--)
+    if (pt->perf_fds[e] >= 0) {
+      close(pt->perf_fds[e]);
+      pt->perf_fds[e] = -1;
+    }
+  pt->perf_fd = -1;
+}
+
+/**
+ * Créer la clé dont le destructeur ferme les compteurs d'un thread.
+ */
+static void perf_key_init(void)
+{
+  pthread_key_create(&perf_key, perf_close);
+}
+
+/**
+ * Lire les compteurs du thread courant.
+ *
+ * \param pt mesures du thread
+ * \param values valeurs des compteurs (0 si indisponibles)
+ */
+static void perf_read(prof_thread_t* pt, unsigned long long* values)
+{
+  unsigned long long buf[PERF_NB + 1];
+  int e, n = 1;
+
+  memset(values, 0, PERF_NB * sizeof(*values));
+  if (pt->perf_fd < 0 || read(pt->perf_fd, buf, sizeof(buf)) <= 0)
+    return;
+
+  for (e = 0; e < PERF_NB; e++)
+    if (pt->perf_avail[e] && n <= buf[0])
+      values[e] = buf[n++];
+}
+#endif
+
+/**
+ * Temps actuel en secondes.
+ * \return temps en secondes
+ */
+static double prof_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Récupérer les mesures du thread courant, en les créant au premier appel.
+ * \return mesures du thread
+ */
+static prof_thread_t* prof_thread(void)
+{
+  if (!prof_local) {
+    prof_local = (prof_thread_t*)calloc(1, sizeof(*prof_local));
+    assert(prof_local);
+    prof_local->perf_fd = -1;
+#ifdef GAN_PERF
+    perf_init(prof_local);
+    pthread_once(&perf_once, perf_key_init);
+    pthread_setspecific(perf_key, prof_local);
+#endif
+
+    pthread_mutex_lock(&prof_mutex);
+    prof_local->next = prof_threads;
+    prof_threads = prof_local;
+    pthread_mutex_unlock(&prof_mutex);
+  }
+  return prof_local;
+}
+
+/**
+ * Nom d'une phase ou d'un noyau.
+ *
+ * \param id identifiant de la phase ou du noyau
+ * \return nom
+ */
+const char* prof_name(int id)
+{
+  return prof_names[id];
+}
+
+/**
+ * Ouvrir le fichier CSV de sortie.
+ *
+ * \param file nom du fichier (NULL ou vide pour ne rien écrire)
+ */
+void prof_open(const char* file)
+{
+  if (!file || !file[0])
+    return;
+
+  if ((prof_fp = fopen(file, "w")) == NULL) {
+    fprintf(stderr, "Error: could not open profile file %s. \n", file);
+    exit(1);
+  }
+  fprintf(prof_fp, "epoch,phase,calls,time_s,gflop,gflop_s\n");
+}
+
+/**
+ * Début d'une phase pour le thread courant.
+ *
+ * \param id identifiant de la phase
+ */
+void prof_begin(int id)
+{
+  prof_thread_t* pt = prof_thread();
+#ifdef GAN_PERF
+  perf_read(pt, pt->cstart[id]);
+#endif
+  pt->start[id] = prof_now();
+}
+
+/**
+ * Fin d'une phase pour le thread courant.
+ *
+ * \param id identifiant de la phase
+ * \param flops nombre d'opérations flottantes de la phase
+ */
+void prof_end(int id, double flops)
+{
+  prof_thread_t* pt = prof_thread();
+  double time = prof_now() - pt->start[id];
+#ifdef GAN_PERF
+  int e;
+  unsigned long long values[PERF_NB];
+  perf_read(pt, values);
+#endif
+
+  // Totaux lus par prof_epoch depuis un autre thread : compteur impair
+  // pendant la mise à jour
+  unsigned int seq = atomic_load_explicit(&pt->seq, memory_order_relaxed);
+  atomic_store_explicit(&pt->seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  pt->totals[id].time += time;
+  pt->totals[id].flops += flops;
+  pt->totals[id].calls++;
+#ifdef GAN_PERF
+  for (e = 0; e < PERF_NB; e++)
+    pt->totals[id].counters[e] += values[e] - pt->cstart[id][e];
+#endif
+  atomic_store_explicit(&pt->seq, seq + 2, memory_order_release);
+
+#ifdef GAN_TRACE
+  trace_event(id, pt->start[id], pt->start[id] + time);
+#endif
+}
+
+/**
+ * Lire les totaux d'une phase d'un thread, en recommençant si le thread
+ * les a mis à jour pendant la lecture.
+ *
+ * \param pt mesures du thread
+ * \param id identifiant de la phase
+ * \param stat copie des totaux
+ */
+static void prof_snapshot(prof_thread_t* pt, int id, prof_stat_t* stat)
+{
+  unsigned int s1, s2;
+
+  do {
+    s1 = atomic_load_explicit(&pt->seq, memory_order_acquire);
+    memcpy(stat, &pt->totals[id], sizeof(*stat));
+    atomic_thread_fence(memory_order_acquire);
+    s2 = atomic_load_explicit(&pt->seq, memory_order_relaxed);
+  } while ((s1 & 1) || s1 != s2);
+}
+
+/**
+ * Ecrire les totaux de l'itération (tous threads confondus) : différence
+ * entre les totaux de chaque thread (copie cohérente sous seqlock) et ceux
+ * déjà écrits. Les totaux des autres threads, qui peuvent toujours mesurer
+ * des phases, ne sont jamais modifiés ; une phase terminée pendant l'écriture compte pour l'itération
+ * suivante. Avec plusieurs threads, le temps est un temps CPU cumulé.
+ *
+ * \param epoch itération actuelle
+ */
+void prof_epoch(int epoch)
+{
+  int id;
+  prof_thread_t* pt;
+  prof_stat_t total;
+
+  pthread_mutex_lock(&prof_mutex);
+  for (id = 0; id < PROF_NB; id++) {
+    total.calls = 0;
+    total.time = 0.0;
+    total.flops = 0.0;
+
+    for (pt = prof_threads; pt; pt = pt->next) {
+      prof_stat_t now;
+      prof_snapshot(pt, id, &now);
+      total.calls += now.calls - pt->reported[id].calls;
+      total.time += now.time - pt->reported[id].time;
+      total.flops += now.flops - pt->reported[id].flops;
+      pt->reported[id] = now;
+    }
+
+    if (prof_fp && total.calls > 0)
+      fprintf(prof_fp, "%d,%s,%lu,%.6f,%.6f,%.3f\n", epoch, prof_names[id], total.calls, total.time,
+        total.flops * 1e-9, total.time > 0 ? total.flops * 1e-9 / total.time : 0.0);
+  }
+  pthread_mutex_unlock(&prof_mutex);
+
+  if (prof_fp)
+    fflush(prof_fp);
+}
+
+#ifdef GAN_PERF
+/**
+ * Afficher le tableau des compteurs par phase et par noyau, sur tout
+ * l'apprentissage et tous threads confondus : IPC, défauts de cache
+ * par opération flottante et mauvaises prédictions pour 1000 instructions.
+ * Les noyaux appelés par d'autres noyaux (mat_dot dans mat_sum_z_act) sont
+ * comptés aussi dans la phase appelante.
+ */
+static void perf_report(void)
+{
+  int id, e, perf_avail[PERF_NB] = {0};
+  prof_thread_t* pt;
+  prof_stat_t total;
+
+  printf("[perf] %-26s %10s %10s %8s %6s %12s %12s %12s\n", "kernel", "calls", "time_ms", "gflop_s",
+    "ipc", "l1d_miss/fl", "llc_miss/fl", "br_miss/ki");
+
+  pthread_mutex_lock(&prof_mutex);
+  // Compteur affiché s'il a été ouvert par au moins un thread
+  for (pt = prof_threads; pt; pt = pt->next)
+    for (e = 0; e < PERF_NB; e++)
+      perf_avail[e] |= pt->perf_avail[e];
+
+  for (id = 0; id < PROF_NB; id++) {
+    memset(&total, 0, sizeof(total));
+    for (pt = prof_threads; pt; pt = pt->next) {
+      prof_stat_t now;
+      prof_snapshot(pt, id, &now);
+      total.calls += now.calls;
+      total.time += now.time;
+      total.flops += now.flops;
+      for (e = 0; e < PERF_NB; e++)
+        total.counters[e] += now.counters[e];
+    }
+    if (total.calls == 0)
+      continue;
+
+    printf("[perf] %-26s %10lu %10.2f %8.3f", prof_names[id], total.calls, total.time * 1e3,
+      total.time > 0 ? total.flops * 1e-9 / total.time : 0.0);
+
+    if (perf_avail[PERF_CYCLES] && perf_avail[PERF_INSTRUCTIONS] && total.counters[PERF_CYCLES] > 0)
+      printf(" %6.2f", (double)total.counters[PERF_INSTRUCTIONS] / total.counters[PERF_CYCLES]);
+    else
+      printf(" %6s", "n/a");
+
+    for (e = PERF_L1D_MISSES; e <= PERF_LLC_MISSES; e++) {
+      if (perf_avail[e] && total.flops > 0)
+        printf(" %12.5f", total.counters[e] / total.flops);
+      else
+        printf(" %12s", "n/a");
+    }
+
+    if (perf_avail[PERF_BRANCH_MISSES] && perf_avail[PERF_INSTRUCTIONS] && total.counters[PERF_INSTRUCTIONS] > 0)
+      printf(" %12.3f\n", 1e3 * total.counters[PERF_BRANCH_MISSES] / total.counters[PERF_INSTRUCTIONS]);
+    else
+      printf(" %12s\n", "n/a");
+  }
+  pthread_mutex_unlock(&prof_mutex);
+}
+#endif
+
+/**
+ * Fermer le fichier de sortie (et afficher le tableau des compteurs
+ * avec GAN_PERF, puis fermer ceux du thread courant : ceux des autres
+ * threads sont fermés à la fin de chaque thread).
+ */
+void prof_close(void)
+{
+#ifdef GAN_PERF
+  perf_report();
+  if (prof_local)
+    perf_close(prof_local);
+#endif
+  if (prof_fp) {
+    fclose(prof_fp);
+    prof_fp = NULL;
+  }
+}
+
+#endif
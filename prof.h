@@ -0,0 +1,87 @@
+/*!
+ * \file prof.h
+ * \brief Fichier header de prof.c. L'instrumentation n'est compilée
+ * qu'avec -DGAN_PROFILE (make PROFILE=1) ; sinon les macros sont vides.
+ * Les noyaux de matrix.c ne sont mesurés qu'avec -DGAN_PERF (make PERF=1,
+ * compteurs matériels) ou -DGAN_TRACE (make TRACE=1, chronologie).
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#ifndef _PROF_H_
+#define _PROF_H_
+
+/* Enumération pour les phases et les noyaux mesurés */
+enum PROF_E {
+  PROF_FORWARD_G = 0,
+  PROF_FORWARD_D_REAL,
+  PROF_FORWARD_D_FAKE,
+  PROF_BACKWARD_D,
+  PROF_BACKWARD_G,
+  PROF_UPDATE_D,
+  PROF_UPDATE_G,
+  PROF_NOISE,
+  PROF_COPY,
+  PROF_RECOMPUTE,
+  PROF_K_DOT,
+  PROF_K_DOT_LEFT,
+  PROF_K_DOT_RIGHT,
+  PROF_K_SUM,
+  PROF_K_SUB,
+  PROF_K_MUL,
+  PROF_K_MUL_SCALAR,
+  PROF_K_SUM_AXIS0,
+  PROF_K_LRELU,
+  PROF_K_TANH,
+  PROF_K_SIGMOID,
+  PROF_K_DLRELU,
+  PROF_K_DTANH,
+  PROF_K_DSIGMOID,
+  PROF_K_COPY,
+  PROF_K_LOSS,
+  PROF_K_CONV,
+  PROF_K_CONV_INPUT,
+  PROF_K_CONV_WEIGHT,
+  PROF_K_BN,
+  PROF_K_BN_BACKWARD,
+  PROF_K_SPARSE_DOT,
+  PROF_K_SPARSE_DOT_LEFT,
+  PROF_K_PACK,
+  PROF_NB
+};
+
+#ifdef GAN_PROFILE
+// Début d'une phase
+#define PROF_BEGIN(id) prof_begin((id))
+// Fin d'une phase avec le nombre d'opérations flottantes effectuées
+#define PROF_END(id, flops) prof_end((id), (flops))
+// Ouvrir le fichier de sortie
+#define PROF_OPEN(file) prof_open((file))
+// Ecrire les totaux de l'itération et les remettre à zéro
+#define PROF_EPOCH(epoch) prof_epoch((epoch))
+// Fermer le fichier de sortie
+#define PROF_CLOSE() prof_close()
+#else
+#define PROF_BEGIN(id) ((void)0)
+#define PROF_END(id, flops) ((void)(flops))
+#define PROF_OPEN(file) ((void)0)
+#define PROF_EPOCH(epoch) ((void)0)
+#define PROF_CLOSE() ((void)0)
+#endif
+
+#if defined(GAN_PERF) || defined(GAN_TRACE)
+// Début d'un noyau de matrix.c
+#define PROF_KBEGIN(id) prof_begin((id))
+// Fin d'un noyau de matrix.c avec le nombre d'opérations flottantes effectuées
+#define PROF_KEND(id, flops) prof_end((id), (flops))
+#else
+#define PROF_KBEGIN(id) ((void)0)
+#define PROF_KEND(id, flops) ((void)(flops))
+#endif
+
+void prof_open(const char*);
+void prof_begin(int);
+void prof_end(int, double);
+void prof_epoch(int);
+void prof_close(void);
+const char* prof_name(int);
+
+#endif
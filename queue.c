@@ -0,0 +1,113 @@
+/*!
+ * \file queue.c
+ * \brief Fichier comprenant une file circulaire sans verrou pour
+ * un seul producteur et un seul consommateur, utilisée pour échanger
+ * des indices entre deux threads.
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#include <assert.h>
+#include <sched.h>
+#include <stdlib.h>
+#include "queue.h"
+
+/**
+ * Initialiser une file d'au moins 'capacity' éléments.
+ *
+ * \param capacity nombre d'éléments
+ * \return structure queue
+ */
+queue_t* queue_init(int capacity)
+{
+  queue_t* q = (queue_t*)malloc(sizeof(*q));
+  assert(q);
+
+  q->capacity = 1;
+  while (q->capacity < capacity)
+    q->capacity <<= 1;
+
+  q->items = (int*)malloc(q->capacity * sizeof(*q->items));
+  assert(q->items);
+
+  atomic_init(&q->head, 0);
+  atomic_init(&q->tail, 0);
+  return q;
+}
+
+/**
+ * Ajouter un élément à la file (producteur).
+ *
+ * \param q structure queue
+ * \param item élément
+ * \return 1 si l'élément a été ajouté, 0 si la file est pleine
+ */
+int queue_push(queue_t* q, int item)
+{
+  unsigned int tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+  unsigned int head = atomic_load_explicit(&q->head, memory_order_acquire);
+
+  if (tail - head == (unsigned int)q->capacity)
+    return 0;
+
+  q->items[tail & (q->capacity - 1)] = item;
+  atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+  return 1;
+}
+
+/**
+ * Retirer un élément de la file (consommateur).
+ *
+ * \param q structure queue
+ * \param item élément retiré
+ * \return 1 si un élément a été retiré, 0 si la file est vide
+ */
+int queue_pop(queue_t* q, int* item)
+{
+  unsigned int head = atomic_load_explicit(&q->head, memory_order_relaxed);
+  unsigned int tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+
+  if (head == tail)
+    return 0;
+
+  *item = q->items[head & (q->capacity - 1)];
+  atomic_store_explicit(&q->head, head + 1, memory_order_release);
+  return 1;
+}
+
+/**
+ * Ajouter un élément à la file en attendant qu'une place se libère.
+ *
+ * \param q structure queue
+ * \param item élément
+ */
+void queue_push_wait(queue_t* q, int item)
+{
+  while (!queue_push(q, item))
+    sched_yield();
+}
+
+/**
+ * Retirer un élément de la file en attendant qu'il soit disponible.
+ *
+ * \param q structure queue
+ * \return élément retiré
+ */
+int queue_pop_wait(queue_t* q)
+{
+  int item;
+  while (!queue_pop(q, &item))
+    sched_yield();
+  return item;
+}
+
+/**
+ * Libérer la mémoire de la file.
+ *
+ * \param q structure queue
+ */
+void queue_free(queue_t* q)
+{
+  if (q) {
+    free(q->items);
+    free(q);
+  }
+}
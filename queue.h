@@ -0,0 +1,27 @@
+/*!
+ * \file queue.h
+ * \brief Fichier header de queue.c
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#ifndef _QUEUE_H_
+#define _QUEUE_H_
+
+#include <stdatomic.h>
+
+typedef struct queue queue_t;
+/* Structure représentant une file sans verrou (un producteur, un consommateur) */
+struct queue {
+  int capacity; // nombre max. d'éléments (puissance de 2)
+  int* items; // éléments de la file
+  _Atomic unsigned int head; // indice de lecture (consommateur)
+  _Atomic unsigned int tail; // indice d'écriture (producteur)
+};
+
+queue_t* queue_init(int);
+int queue_push(queue_t*, int);
+int queue_pop(queue_t*, int*);
+void queue_push_wait(queue_t*, int);
+int queue_pop_wait(queue_t*);
+void queue_free(queue_t*);
+
+#endif
@@ -0,0 +1,419 @@
+/*!
+ * \file sched.c
+ * \brief Fichier comprenant un ordonnanceur par vol de tâches
+ * (work-stealing) pour un graphe de dépendances exécuté plusieurs fois :
+ * chaque thread possède sa propre file, et vole les tâches des autres
+ * threads quand la sienne est vide.
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#include <assert.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sched.h"
+
+typedef struct sched_worker sched_worker_t;
+/* Structure représentant l'argument d'un thread secondaire */
+struct sched_worker {
+  sched_t* sc; // ordonnanceur
+  int id; // indice du thread
+};
+
+/**
+ * Temps actuel en secondes.
+ * \return temps en secondes
+ */
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Ajouter une tâche en bas de la file (propriétaire).
+ *
+ * \param dq structure deque
+ * \param t indice de la tâche
+ */
+static void deque_push(deque_t* dq, int t)
+{
+  while (atomic_flag_test_and_set_explicit(&dq->lock, memory_order_acquire))
+    ;
+  dq->items[dq->bottom++] = t;
+  atomic_flag_clear_explicit(&dq->lock, memory_order_release);
+}
+
+/**
+ * Retirer une tâche en bas (propriétaire, LIFO) ou en haut (vol, FIFO)
+ * de la file.
+ *
+ * \param dq structure deque
+ * \param t indice de la tâche retirée
+ * \param steal booléen pour un vol
+ * \return 1 si une tâche a été retirée, 0 sinon
+ */
+static int deque_take(deque_t* dq, int* t, int steal)
+{
+  int found = 0;
+  while (atomic_flag_test_and_set_explicit(&dq->lock, memory_order_acquire))
+    ;
+  if (dq->bottom > dq->top) {
+    *t = steal ? dq->items[dq->top++] : dq->items[--dq->bottom];
+    found = 1;
+  }
+  atomic_flag_clear_explicit(&dq->lock, memory_order_release);
+  return found;
+}
+
+/**
+ * Exécuter une tâche et rendre prêts ses successeurs.
+ *
+ * \param sc structure sched
+ * \param id indice du thread
+ * \param t indice de la tâche
+ */
+static void execute(sched_t* sc, int id, int t)
+{
+  int s;
+  task_t* task = &sc->tasks[t];
+
+  task->worker = id;
+  task->start = now() - sc->origin;
+  task->fn(task->arg, task->iarg);
+  task->end = now() - sc->origin;
+
+  for (s = 0; s < task->nb_succ; s++)
+    if (atomic_fetch_sub(&sc->tasks[task->succ[s]].pending, 1) == 1)
+      deque_push(&sc->deques[id], task->succ[s]);
+
+  atomic_fetch_sub(&sc->remaining, 1);
+}
+
+/**
+ * Boucle d'un thread pour une exécution du graphe : prendre les tâches de
+ * sa file, sinon en voler à un autre thread choisi au hasard.
+ *
+ * \param sc structure sched
+ * \param id indice du thread
+ */
+static void run_worker(sched_t* sc, int id)
+{
+  int t, v;
+  unsigned int seed = id + 1;
+
+  while (atomic_load(&sc->remaining) > 0) {
+    if (deque_take(&sc->deques[id], &t, 0)) {
+      execute(sc, id, t);
+      continue;
+    }
+
+    v = rand_r(&seed) % sc->nb_workers;
+    if (v != id && deque_take(&sc->deques[v], &t, 1))
+      execute(sc, id, t);
+    else
+      sched_yield();
+  }
+  atomic_fetch_sub(&sc->running, 1);
+}
+
+/**
+ * Thread secondaire : attendre chaque nouvelle exécution du graphe.
+ *
+ * \param arg structure sched_worker
+ * \return NULL
+ */
+static void* worker_thread(void* arg)
+{
+  sched_worker_t* wk = (sched_worker_t*)arg;
+  sched_t* sc = wk->sc;
+  unsigned int generation = 0;
+  int stop;
+
+  for (;;) {
+    pthread_mutex_lock(&sc->mutex);
+    while (sc->generation == generation && !sc->stop)
+      pthread_cond_wait(&sc->cond, &sc->mutex);
+    generation = sc->generation;
+    stop = sc->stop;
+    pthread_mutex_unlock(&sc->mutex);
+
+    if (stop)
+      break;
+    run_worker(sc, wk->id);
+  }
+
+  free(wk);
+  return NULL;
+}
+
+/**
+ * Initialiser l'ordonnanceur avec 'nb_workers' threads, dont le thread
+ * appelant (qui participe à chaque exécution).
+ *
+ * \param nb_workers nombre de threads
+ * \param max_tasks nombre max. de tâches du graphe
+ * \return structure sched
+ */
+sched_t* sched_init(int nb_workers, int max_tasks)
+{
+  int w;
+  sched_t* sc = (sched_t*)malloc(sizeof(*sc));
+  assert(sc);
+
+  sc->nb_workers = nb_workers > 0 ? nb_workers : 1;
+  sc->nb_tasks = 0;
+  sc->max_tasks = max_tasks;
+  sc->generation = 0;
+  sc->stop = 0;
+  sc->origin = 0.0;
+  atomic_init(&sc->remaining, 0);
+  atomic_init(&sc->running, 0);
+
+  sc->tasks = (task_t*)calloc(max_tasks, sizeof(*sc->tasks));
+  assert(sc->tasks);
+  sc->deques = (deque_t*)malloc(sc->nb_workers * sizeof(*sc->deques));
+  assert(sc->deques);
+  sc->threads = (pthread_t*)malloc(sc->nb_workers * sizeof(*sc->threads));
+  assert(sc->threads);
+
+  pthread_mutex_init(&sc->mutex, NULL);
+  pthread_cond_init(&sc->cond, NULL);
+
+  for (w = 0; w < sc->nb_workers; w++) {
+    atomic_flag_clear(&sc->deques[w].lock);
+    sc->deques[w].items = (int*)malloc(max_tasks * sizeof(*sc->deques[w].items));
+    assert(sc->deques[w].items);
+    sc->deques[w].top = sc->deques[w].bottom = 0;
+  }
+
+  for (w = 1; w < sc->nb_workers; w++) {
+    sched_worker_t* wk = (sched_worker_t*)malloc(sizeof(*wk));
+    assert(wk);
+    wk->sc = sc;
+    wk->id = w;
+    if (pthread_create(&sc->threads[w], NULL, worker_thread, wk)) {
+      fprintf(stderr, "Error: could not create scheduler thread. \n");
+      exit(1);
+    }
+  }
+
+  return sc;
+}
+
+/**
+ * Ajouter une tâche au graphe.
+ *
+ * \param sc structure sched
+ * \param name nom de la tâche
+ * \param fn fonction exécutée
+ * \param arg premier argument de la fonction
+ * \param iarg second argument de la fonction
+ * \return indice de la tâche
+ */
+int sched_task(sched_t* sc, const char* name, task_fn fn, void* arg, int iarg)
+{
+  if (sc->nb_tasks == sc->max_tasks) {
+    fprintf(stderr, "Error: too many tasks in the scheduler graph. \n");
+    exit(1);
+  }
+
+  task_t* task = &sc->tasks[sc->nb_tasks];
+  task->name = name;
+  task->fn = fn;
+  task->arg = arg;
+  task->iarg = iarg;
+  task->nb_deps = 0;
+  task->nb_succ = 0;
+  return sc->nb_tasks++;
+}
+
+/**
+ * Ajouter une dépendance : 'task' ne peut s'exécuter qu'après 'dep'.
+ * Les tâches doivent être ajoutées dans un ordre topologique.
+ *
+ * \param sc structure sched
+ * \param task indice de la tâche
+ * \param dep indice de la tâche dont elle dépend
+ */
+void sched_depend(sched_t* sc, int task, int dep)
+{
+  task_t* d = &sc->tasks[dep];
+  if (dep >= task || d->nb_succ == SCHED_MAX_SUCC) {
+    fprintf(stderr, "Error: invalid dependency in the scheduler graph. \n");
+    exit(1);
+  }
+
+  d->succ[d->nb_succ++] = task;
+  sc->tasks[task].nb_deps++;
+}
+
+/**
+ * Vider le graphe de tâches (hors exécution), pour le reconstruire.
+ *
+ * \param sc structure sched
+ */
+void sched_clear(sched_t* sc)
+{
+  sc->nb_tasks = 0;
+}
+
+/**
+ * Exécuter une fois le graphe de tâches, et attendre la fin de
+ * toutes les tâches.
+ *
+ * \param sc structure sched
+ */
+void sched_run(sched_t* sc)
+{
+  int t, w, r = 0;
+
+  for (w = 0; w < sc->nb_workers; w++)
+    sc->deques[w].top = sc->deques[w].bottom = 0;
+
+  for (t = 0; t < sc->nb_tasks; t++)
+    atomic_store(&sc->tasks[t].pending, sc->tasks[t].nb_deps);
+
+  atomic_store(&sc->remaining, sc->nb_tasks);
+  atomic_store(&sc->running, sc->nb_workers);
+  sc->origin = now();
+
+  // Répartir les tâches sans dépendance entre les threads
+  for (t = 0; t < sc->nb_tasks; t++)
+    if (sc->tasks[t].nb_deps == 0)
+      deque_push(&sc->deques[r++ % sc->nb_workers], t);
+
+  pthread_mutex_lock(&sc->mutex);
+  sc->generation++;
+  pthread_cond_broadcast(&sc->cond);
+  pthread_mutex_unlock(&sc->mutex);
+
+  run_worker(sc, 0);
+  while (atomic_load(&sc->running) > 0)
+    sched_yield();
+}
+
+/**
+ * Travail total de la dernière exécution (somme des durées des tâches).
+ *
+ * \param sc structure sched
+ * \return travail en secondes
+ */
+double sched_work(sched_t* sc)
+{
+  int t;
+  double work = 0.0;
+  for (t = 0; t < sc->nb_tasks; t++)
+    work += sc->tasks[t].end - sc->tasks[t].start;
+  return work;
+}
+
+/**
+ * Longueur du chemin critique de la dernière exécution (plus long chemin
+ * du graphe pondéré par les durées mesurées).
+ *
+ * \param sc structure sched
+ * \param critical marque des tâches du chemin critique (peut être NULL)
+ * \return longueur du chemin critique en secondes
+ */
+double sched_span(sched_t* sc, char* critical)
+{
+  int t, s, last = 0;
+  double span = 0.0;
+  double* finish = (double*)calloc(sc->nb_tasks, sizeof(*finish));
+  assert(finish);
+  int* pred = (int*)malloc(sc->nb_tasks * sizeof(*pred));
+  assert(pred);
+
+  for (t = 0; t < sc->nb_tasks; t++)
+    pred[t] = -1;
+
+  // 'finish' contient d'abord le début au plus tôt de chaque tâche
+  for (t = 0; t < sc->nb_tasks; t++) {
+    task_t* task = &sc->tasks[t];
+    finish[t] += task->end - task->start;
+    if (finish[t] > span) {
+      span = finish[t];
+      last = t;
+    }
+
+    for (s = 0; s < task->nb_succ; s++) {
+      if (finish[t] > finish[task->succ[s]]) {
+        finish[task->succ[s]] = finish[t];
+        pred[task->succ[s]] = t;
+      }
+    }
+  }
+
+  if (critical) {
+    memset(critical, 0, sc->nb_tasks);
+    for (t = sc->nb_tasks ? last : -1; t >= 0; t = pred[t])
+      critical[t] = 1;
+  }
+
+  free(finish);
+  free(pred);
+  return span;
+}
+
+/**
+ * Afficher la trace de la dernière exécution : pour chaque tâche, le thread,
+ * le début et la durée, et si elle appartient au chemin critique ; puis le
+ * travail total comparé au chemin critique.
+ *
+ * \param sc structure sched
+ * \param fp fichier de sortie
+ */
+void sched_trace(sched_t* sc, FILE* fp)
+{
+  int t;
+  double wall = 0.0;
+  char* critical = (char*)malloc(sc->nb_tasks + 1);
+  assert(critical);
+
+  double span = sched_span(sc, critical);
+  double work = sched_work(sc);
+
+  fprintf(fp, "%-24s %6s %8s %10s %10s %s\n", "task", "layer", "worker", "start(us)", "dur(us)", "crit");
+  for (t = 0; t < sc->nb_tasks; t++) {
+    task_t* task = &sc->tasks[t];
+    if (task->end > wall)
+      wall = task->end;
+    fprintf(fp, "%-24s %6d %8d %10.1f %10.1f %s\n", task->name, task->iarg, task->worker,
+      task->start * 1e6, (task->end - task->start) * 1e6, critical[t] ? "*" : "");
+  }
+  fprintf(fp, "work: %.3f ms, span: %.3f ms, parallelism: %.2f, wall: %.3f ms, workers: %d\n",
+    work * 1e3, span * 1e3, span > 0 ? work / span : 0.0, wall * 1e3, sc->nb_workers);
+
+  free(critical);
+}
+
+/**
+ * Arrêter les threads et libérer la mémoire de l'ordonnanceur.
+ *
+ * \param sc structure sched
+ */
+void sched_free(sched_t* sc)
+{
+  int w;
+
+  pthread_mutex_lock(&sc->mutex);
+  sc->stop = 1;
+  pthread_cond_broadcast(&sc->cond);
+  pthread_mutex_unlock(&sc->mutex);
+
+  for (w = 1; w < sc->nb_workers; w++)
+    pthread_join(sc->threads[w], NULL);
+
+  for (w = 0; w < sc->nb_workers; w++)
+    free(sc->deques[w].items);
+
+  pthread_mutex_destroy(&sc->mutex);
+  pthread_cond_destroy(&sc->cond);
+  free(sc->deques);
+  free(sc->threads);
+  free(sc->tasks);
+  free(sc);
+}
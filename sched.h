@@ -0,0 +1,71 @@
+/*!
+ * \file sched.h
+ * \brief Fichier header de sched.c
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#ifndef _SCHED_H_
+#define _SCHED_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+// Nombre max. de successeurs d'une tâche
+#define SCHED_MAX_SUCC 16
+
+typedef void (*task_fn)(void*, int);
+
+typedef struct task task_t;
+/* Structure représentant une tâche du graphe de dépendances */
+struct task {
+  const char* name; // nom de la tâche (trace)
+  task_fn fn; // fonction exécutée
+  void* arg; // premier argument de la fonction
+  int iarg; // second argument de la fonction (indice de couche, ...)
+  int nb_deps; // nombre de dépendances
+  _Atomic int pending; // dépendances restantes pour l'exécution en cours
+  int nb_succ; // nombre de successeurs
+  int succ[SCHED_MAX_SUCC]; // indices des successeurs
+  int worker; // thread ayant exécuté la tâche (trace)
+  double start; // début de l'exécution en secondes (trace)
+  double end; // fin de l'exécution en secondes (trace)
+};
+
+typedef struct deque deque_t;
+/* Structure représentant la file à double entrée d'un thread */
+struct deque {
+  atomic_flag lock; // verrou actif
+  int* items; // indices des tâches
+  int top; // indice de vol (autres threads)
+  int bottom; // indice d'ajout / retrait (propriétaire)
+};
+
+typedef struct sched sched_t;
+/* Structure représentant l'ordonnanceur par vol de tâches */
+struct sched {
+  int nb_workers; // nombre de threads (dont le thread appelant)
+  int nb_tasks; // nombre de tâches du graphe
+  int max_tasks; // nombre max. de tâches
+  task_t* tasks; // tâches, dans un ordre topologique
+  deque_t* deques; // une file par thread
+  pthread_t* threads; // threads secondaires
+  pthread_mutex_t mutex; // verrou pour le réveil des threads
+  pthread_cond_t cond; // condition pour le réveil des threads
+  unsigned int generation; // numéro de l'exécution en cours
+  int stop; // arrêt des threads
+  _Atomic int remaining; // tâches restantes pour l'exécution en cours
+  _Atomic int running; // threads encore actifs pour l'exécution en cours
+  double origin; // début de l'exécution en cours (trace)
+};
+
+sched_t* sched_init(int, int);
+int sched_task(sched_t*, const char*, task_fn, void*, int);
+void sched_depend(sched_t*, int, int);
+void sched_clear(sched_t*);
+void sched_run(sched_t*);
+double sched_work(sched_t*);
+double sched_span(sched_t*, char*);
+void sched_trace(sched_t*, FILE*);
+void sched_free(sched_t*);
+
+#endif
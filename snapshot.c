@@ -0,0 +1,402 @@
+/*!
+ * \file snapshot.c
+ * \brief Fichier comprenant l'écriture asynchrone des images générées :
+ * l'apprentissage copie un lot d'images dans une file et continue ; un
+ * thread d'écriture les assemble en une grille et l'écrit en PGM ou en PNG
+ * (encodeur intégré, blocs deflate non compressés), avec le numéro de
+ * l'itération dans le nom du fichier.
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "snapshot.h"
+
+// Taille max. d'un bloc deflate non compressé
+#define DEFLATE_STORED_MAX 65535
+
+/**
+ * Mettre à jour le CRC-32 (polynôme 0xedb88320) utilisé par les blocs PNG.
+ *
+ * \param crc CRC précédent
+ * \param buf données
+ * \param len taille des données
+ * \return CRC mis à jour
+ */
+static unsigned int crc32_update(unsigned int crc, const unsigned char* buf, size_t len)
+{
+  static unsigned int table[256];
+  static int init = 0;
+  unsigned int c;
+  size_t i;
+  int k;
+
+  if (!init) {
+    for (i = 0; i < 256; i++) {
+      c = (unsigned int)i;
+      for (k = 0; k < 8; k++)
+        c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      table[i] = c;
+    }
+    init = 1;
+  }
+
+  crc = crc ^ 0xffffffffu;
+  for (i = 0; i < len; i++)
+    crc = table[(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
+  return crc ^ 0xffffffffu;
+}
+
+/**
+ * Somme de contrôle Adler-32 du flux zlib.
+ *
+ * \param buf données
+ * \param len taille des données
+ * \return somme de contrôle
+ */
+static unsigned int adler32(const unsigned char* buf, size_t len)
+{
+  unsigned int a = 1, b = 0;
+  size_t i;
+  for (i = 0; i < len; i++) {
+    a = (a + buf[i]) % 65521;
+    b = (b + a) % 65521;
+  }
+  return (b << 16) | a;
+}
+
+/**
+ * Ecrire un entier 32 bits en big-endian.
+ *
+ * \param p destination
+ * \param val valeur
+ * \return position suivante
+ */
+static unsigned char* put_be32(unsigned char* p, unsigned int val)
+{
+  p[0] = (val >> 24) & 0xff;
+  p[1] = (val >> 16) & 0xff;
+  p[2] = (val >> 8) & 0xff;
+  p[3] = val & 0xff;
+  return p + 4;
+}
+
+/**
+ * Ecrire un bloc PNG (taille, type, données, CRC).
+ *
+ * \param p destination
+ * \param type type du bloc
+ * \param data données du bloc
+ * \param len taille des données
+ * \return position suivante
+ */
+static unsigned char* put_chunk(unsigned char* p, const char* type, const unsigned char* data, size_t len)
+{
+  unsigned char* start = p + 4;
+  p = put_be32(p, (unsigned int)len);
+  memcpy(p, type, 4);
+  // Bloc sans données (IEND) : 'data' est NULL
+  if (len)
+    memcpy(p + 4, data, len);
+  p += 4 + len;
+  return put_be32(p, crc32_update(0, start, len + 4));
+}
+
+/**
+ * Encoder une image en niveaux de gris au format PGM (P5), ou en couleur
+ * au format PPM (P6) si elle a 3 canaux.
+ *
+ * \param pixels pixels (ligne par ligne, canaux entrelacés)
+ * \param width largeur
+ * \param height hauteur
+ * \param channels nombre de canaux (1 ou 3)
+ * \param size taille du fichier encodé
+ * \return fichier encodé (à libérer)
+ */
+unsigned char* encode_pgm(const unsigned char* pixels, int width, int height, int channels, size_t* size)
+{
+  char header[64];
+  size_t n = (size_t)width * height * channels;
+  int len = snprintf(header, sizeof(header), "%s\n%d %d\n%d\n", channels == 3 ? "P6" : "P5", width, height, 255);
+
+  unsigned char* buf = (unsigned char*)malloc(len + n);
+  assert(buf);
+  memcpy(buf, header, len);
+  memcpy(buf + len, pixels, n);
+  *size = len + n;
+  return buf;
+}
+
+/**
+ * Encoder une image en niveaux de gris ou en couleur (3 canaux, 8 bits) au
+ * format PNG. Les données sont stockées dans un flux zlib de blocs deflate
+ * non compressés : le fichier est plus gros qu'avec une vraie compression,
+ * mais l'encodeur n'a besoin d'aucune bibliothèque.
+ *
+ * \param pixels pixels (ligne par ligne, canaux entrelacés)
+ * \param width largeur
+ * \param height hauteur
+ * \param channels nombre de canaux (1 ou 3)
+ * \param size taille du fichier encodé
+ * \return fichier encodé (à libérer)
+ */
+unsigned char* encode_png(const unsigned char* pixels, int width, int height, int channels, size_t* size)
+{
+  static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+  size_t row = (size_t)width * channels, raw_len = (row + 1) * height, nb_blocks, off, len;
+  int y;
+
+  // Lignes précédées du filtre 0 (aucun)
+  unsigned char* raw = (unsigned char*)malloc(raw_len);
+  assert(raw);
+  for (y = 0; y < height; y++) {
+    raw[(size_t)y * (row + 1)] = 0;
+    memcpy(raw + (size_t)y * (row + 1) + 1, pixels + (size_t)y * row, row);
+  }
+
+  // Flux zlib : en-tête, blocs non compressés, Adler-32
+  nb_blocks = raw_len / DEFLATE_STORED_MAX + 1;
+  size_t z_len = 2 + nb_blocks * 5 + raw_len + 4;
+  unsigned char* z = (unsigned char*)malloc(z_len);
+  assert(z);
+  unsigned char* p = z;
+  *p++ = 0x78;
+  *p++ = 0x01;
+  off = 0;
+  do {
+    len = raw_len - off < DEFLATE_STORED_MAX ? raw_len - off : DEFLATE_STORED_MAX;
+    *p++ = off + len == raw_len; // dernier bloc
+    *p++ = len & 0xff;
+    *p++ = (len >> 8) & 0xff;
+    *p++ = ~len & 0xff;
+    *p++ = (~len >> 8) & 0xff;
+    memcpy(p, raw + off, len);
+    p += len;
+    off += len;
+  } while (off < raw_len);
+  p = put_be32(p, adler32(raw, raw_len));
+  z_len = p - z;
+
+  // Fichier : signature, IHDR, IDAT, IEND
+  unsigned char ihdr[13];
+  put_be32(ihdr, width);
+  put_be32(ihdr + 4, height);
+  ihdr[8] = 8; // 8 bits par pixel
+  ihdr[9] = channels == 3 ? 2 : 0; // couleur (RVB) ou niveaux de gris
+  ihdr[10] = 0;
+  ihdr[11] = 0;
+  ihdr[12] = 0;
+
+  unsigned char* buf = (unsigned char*)malloc(sizeof(signature) + 3 * 12 + sizeof(ihdr) + z_len);
+  assert(buf);
+  memcpy(buf, signature, sizeof(signature));
+  p = buf + sizeof(signature);
+  p = put_chunk(p, "IHDR", ihdr, sizeof(ihdr));
+  p = put_chunk(p, "IDAT", z, z_len);
+  p = put_chunk(p, "IEND", NULL, 0);
+  *size = p - buf;
+
+  free(raw);
+  free(z);
+  return buf;
+}
+
+/**
+ * Assembler les images d'une copie en une grille et l'écrire en une seule
+ * écriture, en PNG si le nom de sortie se termine par ".png", en PGM sinon.
+ * Le nom du fichier reçoit le numéro de l'itération (out_0010.png).
+ *
+ * \param snap structure snapshot
+ * \param s indice de la copie
+ */
+static void snapshot_write(snapshot_t* snap, int s)
+{
+  int i, x, y, c, n = snap->count[s], ch = snap->channels;
+  int cols = (int)ceil(sqrt((double)n)), rows = (n + cols - 1) / cols;
+  int cell_w = snap->width + SNAPSHOT_PAD, cell_h = snap->height + SNAPSHOT_PAD;
+  int width = cols * cell_w + SNAPSHOT_PAD, height = rows * cell_h + SNAPSHOT_PAD;
+  char file[1024];
+  size_t size;
+  FILE* fp;
+
+  unsigned char* pixels = (unsigned char*)calloc((size_t)width * height * ch, 1);
+  assert(pixels);
+
+  // Sortie tanh dans [-1, 1] vers [0, 255], canaux entrelacés
+  for (i = 0; i < n; i++) {
+    int ox = SNAPSHOT_PAD + (i % cols) * cell_w, oy = SNAPSHOT_PAD + (i / cols) * cell_h;
+    double* img = snap->data[s] + (size_t)i * snap->width * snap->height * ch;
+    for (c = 0; c < ch; c++)
+      for (y = 0; y < snap->height; y++)
+        for (x = 0; x < snap->width; x++) {
+          double v = (img[(c * snap->height + y) * snap->width + x] + 1.0) * 127.5;
+          pixels[((size_t)(oy + y) * width + ox + x) * ch + c] = v < 0 ? 0 : v > 255 ? 255 : (unsigned char)v;
+        }
+  }
+
+  const char* ext = strrchr(snap->output, '.');
+  int png = ext && !strcmp(ext, ".png");
+  if (snap->epoch[s] < 0)
+    snprintf(file, sizeof(file), "%s", snap->output);
+  else
+    snprintf(file, sizeof(file), "%.*s_%04d%s", ext ? (int)(ext - snap->output) : (int)strlen(snap->output),
+      snap->output, snap->epoch[s], ext ? ext : "");
+
+  unsigned char* buf = png ? encode_png(pixels, width, height, ch, &size) : encode_pgm(pixels, width, height, ch, &size);
+  if ((fp = fopen(file, "wb")) == NULL || fwrite(buf, 1, size, fp) != size)
+    fprintf(stderr, "Error: could not write snapshot %s. \n", file);
+  if (fp)
+    fclose(fp);
+
+  free(buf);
+  free(pixels);
+}
+
+/**
+ * Thread d'écriture : attend les copies, les écrit puis les rend libres.
+ * Une copie d'indice -1 termine le thread.
+ *
+ * \param arg structure snapshot
+ * \return NULL
+ */
+static void* snapshot_writer(void* arg)
+{
+  snapshot_t* snap = (snapshot_t*)arg;
+  int s;
+
+  for (;;) {
+    sem_wait(&snap->ready);
+    if (!queue_pop(snap->todo, &s))
+      continue;
+    if (s < 0)
+      break;
+
+    snapshot_write(snap, s);
+    queue_push_wait(snap->done, s);
+  }
+  return NULL;
+}
+
+/**
+ * Initialiser l'écriture asynchrone et démarrer le thread d'écriture.
+ *
+ * \param output nom du fichier de sortie (.png ou .pgm)
+ * \param nb_images nombre max. d'images par grille
+ * \param width largeur d'une image
+ * \param height hauteur d'une image
+ * \param channels nombre de canaux d'une image (3 : couleur, sinon les
+ * canaux sont placés l'un sous l'autre)
+ * \return structure snapshot
+ */
+snapshot_t* snapshot_init(const char* output, int nb_images, int width, int height, int channels)
+{
+  int s;
+  snapshot_t* snap = (snapshot_t*)malloc(sizeof(*snap));
+  assert(snap);
+
+  snap->output = strdup(output);
+  assert(snap->output);
+  snap->nb_images = nb_images > 0 ? nb_images : SNAPSHOT_IMAGES;
+  snap->width = width;
+  snap->height = channels == 3 ? height : height * channels;
+  snap->channels = channels == 3 ? 3 : 1;
+  snap->dropped = 0;
+  snap->todo = queue_init(SNAPSHOT_SLOTS + 1);
+  snap->done = queue_init(SNAPSHOT_SLOTS);
+
+  for (s = 0; s < SNAPSHOT_SLOTS; s++) {
+    snap->data[s] = (double*)malloc((size_t)snap->nb_images * width * height * channels * sizeof(*snap->data[s]));
+    assert(snap->data[s]);
+    queue_push(snap->done, s);
+  }
+
+  sem_init(&snap->ready, 0, 0);
+  if (pthread_create(&snap->thread, NULL, snapshot_writer, snap)) {
+    fprintf(stderr, "Error: could not create snapshot thread. \n");
+    exit(1);
+  }
+  return snap;
+}
+
+/**
+ * Copier les premières images d'un lot généré dans une copie libre et la
+ * confier au thread d'écriture.
+ *
+ * \param snap structure snapshot
+ * \param s copie libre
+ * \param images images générées
+ * \param epoch itération (-1 pour écrire directement dans le fichier de sortie)
+ */
+static void snapshot_give(snapshot_t* snap, int s, matrix_t* images, int epoch)
+{
+  snap->count[s] = images->rows < snap->nb_images ? images->rows : snap->nb_images;
+  snap->epoch[s] = epoch;
+  memcpy(snap->data[s], images->data, (size_t)snap->count[s] * images->cols * sizeof(*images->data));
+
+  queue_push_wait(snap->todo, s);
+  sem_post(&snap->ready);
+}
+
+/**
+ * Copier les premières images d'un lot généré (une image par ligne) et les
+ * confier au thread d'écriture, sans attendre. Si toutes les copies sont
+ * en cours d'écriture, les images sont ignorées plutôt que de bloquer
+ * l'apprentissage.
+ *
+ * \param snap structure snapshot
+ * \param images images générées
+ * \param epoch itération (-1 pour écrire directement dans le fichier de sortie)
+ * \return 1 si les images ont été confiées, 0 si elles ont été ignorées
+ */
+int snapshot_push(snapshot_t* snap, matrix_t* images, int epoch)
+{
+  int s;
+  if (!queue_pop(snap->done, &s)) {
+    snap->dropped++;
+    return 0;
+  }
+
+  snapshot_give(snap, s, images, epoch);
+  return 1;
+}
+
+/**
+ * Confier des images au thread d'écriture en attendant qu'une copie se
+ * libère : utilisé pour le fichier final, qui ne doit pas être ignoré.
+ *
+ * \param snap structure snapshot
+ * \param images images générées
+ * \param epoch itération (-1 pour écrire directement dans le fichier de sortie)
+ */
+void snapshot_push_wait(snapshot_t* snap, matrix_t* images, int epoch)
+{
+  snapshot_give(snap, queue_pop_wait(snap->done), images, epoch);
+}
+
+/**
+ * Attendre l'écriture des copies en attente, arrêter le thread d'écriture
+ * et libérer la mémoire.
+ *
+ * \param snap structure snapshot
+ */
+void snapshot_free(snapshot_t* snap)
+{
+  int s;
+
+  queue_push_wait(snap->todo, -1);
+  sem_post(&snap->ready);
+  pthread_join(snap->thread, NULL);
+
+  if (snap->dropped > 0)
+    fprintf(stderr, "Warning: %lu snapshots were dropped. \n", snap->dropped);
+
+  for (s = 0; s < SNAPSHOT_SLOTS; s++)
+    free(snap->data[s]);
+  queue_free(snap->todo);
+  queue_free(snap->done);
+  sem_destroy(&snap->ready);
+  free(snap->output);
+  free(snap);
+}
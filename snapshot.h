@@ -0,0 +1,46 @@
+/*!
+ * \file snapshot.h
+ * \brief Fichier header de snapshot.c
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include <pthread.h>
+#include <semaphore.h>
+#include "matrix.h"
+#include "queue.h"
+
+// Nombre de lots d'images en attente d'écriture
+#define SNAPSHOT_SLOTS 4
+// Nombre d'images par défaut dans la grille
+#define SNAPSHOT_IMAGES 16
+// Marge entre deux images de la grille (en pixels)
+#define SNAPSHOT_PAD 2
+
+typedef struct snapshot snapshot_t;
+/* Structure représentant l'écriture asynchrone des images générées */
+struct snapshot {
+  char* output; // nom du fichier de sortie (.png ou .pgm)
+  int nb_images; // nombre max. d'images par grille
+  int width; // largeur d'une image
+  int height; // hauteur d'une image
+  int channels; // nombre de canaux (1 : niveaux de gris, 3 : couleur)
+  double* data[SNAPSHOT_SLOTS]; // copies des images en attente
+  int count[SNAPSHOT_SLOTS]; // nombre d'images de chaque copie
+  int epoch[SNAPSHOT_SLOTS]; // itération de chaque copie (-1 : fichier final)
+  queue_t* todo; // copies à écrire (apprentissage -> écriture)
+  queue_t* done; // copies libres (écriture -> apprentissage)
+  sem_t ready; // réveil du thread d'écriture
+  pthread_t thread; // thread d'écriture
+  unsigned long dropped; // copies ignorées (file pleine)
+};
+
+snapshot_t* snapshot_init(const char*, int, int, int, int);
+int snapshot_push(snapshot_t*, matrix_t*, int);
+void snapshot_push_wait(snapshot_t*, matrix_t*, int);
+void snapshot_free(snapshot_t*);
+unsigned char* encode_pgm(const unsigned char*, int, int, int, size_t*);
+unsigned char* encode_png(const unsigned char*, int, int, int, size_t*);
+
+#endif
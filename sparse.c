@@ -0,0 +1,194 @@
+/*!
+ * \file sparse.c
+ * \brief Fichier comprenant les images d'apprentissage stockées en matrice
+ * creuse (pixels différents du fond) et les noyaux de la première couche
+ * du discriminator sur les images réelles : x . w calculé comme
+ * (x - bg) . w + bg * colsum(w), et gradient des poids à partir des seules
+ * valeurs stockées.
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sparse.h"
+#include "mem.h"
+#include "prof.h"
+
+/**
+ * Vérifier les dimensions des matrices passées aux noyaux creux.
+ *
+ * \param cond condition à vérifier
+ */
+static void sparse_check(int cond)
+{
+  if (!cond) {
+    fprintf(stderr, "Error: bad matrix structures while sparse product. \n");
+    exit(1);
+  }
+}
+
+/**
+ * Construire la matrice creuse de 'x' par rapport à la valeur de fond 'bg'.
+ *
+ * \param x matrice dense
+ * \param bg valeur du fond
+ * \return structure sparse
+ */
+sparse_t* sparse_init(matrix_t* x, double bg)
+{
+  long n = 0;
+  int r, c;
+  sparse_t* sp = (sparse_t*)malloc(sizeof(*sp));
+  assert(sp);
+
+  sp->rows = x->rows;
+  sp->cols = x->cols;
+  sp->bg = bg;
+  sp->nnz = 0;
+  for (r = 0; r < x->rows * x->cols; r++)
+    if (x->data[r] != bg)
+      sp->nnz++;
+
+  sp->row_ptr = (long*)MEM_MALLOC((x->rows + 1) * sizeof(*sp->row_ptr));
+  assert(sp->row_ptr);
+  sp->col = (int*)MEM_MALLOC((sp->nnz > 0 ? sp->nnz : 1) * sizeof(*sp->col));
+  assert(sp->col);
+  sp->val = (double*)MEM_MALLOC((sp->nnz > 0 ? sp->nnz : 1) * sizeof(*sp->val));
+  assert(sp->val);
+
+  for (r = 0; r < x->rows; r++) {
+    sp->row_ptr[r] = n;
+    for (c = 0; c < x->cols; c++) {
+      double v = x->data[r * x->cols + c];
+      if (v != bg) {
+        sp->col[n] = c;
+        sp->val[n] = v - bg;
+        n++;
+      }
+    }
+  }
+  sp->row_ptr[x->rows] = n;
+  return sp;
+}
+
+/**
+ * Libérer une matrice creuse.
+ *
+ * \param sp structure sparse
+ */
+void sparse_free(sparse_t* sp)
+{
+  MEM_FREE(sp->row_ptr);
+  MEM_FREE(sp->col);
+  MEM_FREE(sp->val);
+  free(sp);
+}
+
+/**
+ * Densité (part des valeurs stockées) des lignes [row, row + nb_rows).
+ *
+ * \param sp structure sparse
+ * \param row première ligne
+ * \param nb_rows nombre de lignes
+ * \return densité
+ */
+double sparse_density(const sparse_t* sp, int row, int nb_rows)
+{
+  return (double)(sp->row_ptr[row + nb_rows] - sp->row_ptr[row]) / ((double)nb_rows * sp->cols);
+}
+
+/**
+ * Propagation avant d'une couche dense sur les lignes [row, row + z->rows)
+ * de la matrice creuse : z = x . w + b = (x - bg) . w + (b + bg * colsum(w)).
+ * Chaque valeur stockée ajoute une ligne de 'w' à la ligne de 'z'.
+ *
+ * \param z pré-activation
+ * \param sp structure sparse
+ * \param row première ligne du lot
+ * \param w poids
+ * \param b biais
+ * \return nombre d'opérations flottantes
+ */
+double sparse_sum_z_act(matrix_t* z, const sparse_t* sp, int row, matrix_t* w, matrix_t* b)
+{
+  int r, c, k;
+  long e;
+  sparse_check(w->rows == sp->cols && z->cols == w->cols && b->cols == w->cols && row + z->rows <= sp->rows);
+
+  PROF_KBEGIN(PROF_K_SPARSE_DOT);
+  // Décalage commun à toutes les lignes, dans la première ligne de z
+  double* off = z->data;
+  memcpy(off, b->data, w->cols * sizeof(*off));
+  if (sp->bg != 0.0) {
+    for (k = 0; k < w->rows; k++) {
+      double* wk = w->data + k * w->cols;
+      for (c = 0; c < w->cols; c++)
+        off[c] += sp->bg * wk[c];
+    }
+  }
+  for (r = 1; r < z->rows; r++)
+    memcpy(z->data + r * z->cols, off, w->cols * sizeof(*off));
+
+  for (r = 0; r < z->rows; r++) {
+    double* zr = z->data + r * z->cols;
+    for (e = sp->row_ptr[row + r]; e < sp->row_ptr[row + r + 1]; e++) {
+      double v = sp->val[e];
+      double* wk = w->data + sp->col[e] * w->cols;
+      for (c = 0; c < w->cols; c++)
+        zr[c] += v * wk[c];
+    }
+  }
+
+  double nnz = (double)(sp->row_ptr[row + z->rows] - sp->row_ptr[row]);
+  double flops = 2.0 * nnz * w->cols + 2.0 * w->rows * w->cols;
+  PROF_KEND(PROF_K_SPARSE_DOT, flops);
+  return flops;
+}
+
+/**
+ * Gradient des poids d'une couche dense à partir des lignes
+ * [row, row + dz->rows) de la matrice creuse : dw = x^T . dz
+ * = (x - bg)^T . dz + bg * (somme des lignes de dz) sur chaque ligne de dw.
+ *
+ * \param dw gradient des poids
+ * \param sp structure sparse
+ * \param row première ligne du lot
+ * \param dz gradient de la pré-activation
+ * \return nombre d'opérations flottantes
+ */
+double sparse_dot_left(matrix_t* dw, const sparse_t* sp, int row, matrix_t* dz)
+{
+  int r, c, k;
+  long e;
+  sparse_check(dw->rows == sp->cols && dw->cols == dz->cols && row + dz->rows <= sp->rows);
+
+  PROF_KBEGIN(PROF_K_SPARSE_DOT_LEFT);
+  // Contribution du fond, identique pour chaque ligne de dw
+  double* base = dw->data;
+  memset(base, 0, dw->cols * sizeof(*base));
+  if (sp->bg != 0.0) {
+    for (r = 0; r < dz->rows; r++)
+      for (c = 0; c < dz->cols; c++)
+        base[c] += dz->data[r * dz->cols + c];
+    for (c = 0; c < dw->cols; c++)
+      base[c] *= sp->bg;
+  }
+  for (k = 1; k < dw->rows; k++)
+    memcpy(dw->data + k * dw->cols, base, dw->cols * sizeof(*base));
+
+  for (r = 0; r < dz->rows; r++) {
+    double* dzr = dz->data + r * dz->cols;
+    for (e = sp->row_ptr[row + r]; e < sp->row_ptr[row + r + 1]; e++) {
+      double v = sp->val[e];
+      double* dwk = dw->data + sp->col[e] * dw->cols;
+      for (c = 0; c < dw->cols; c++)
+        dwk[c] += v * dzr[c];
+    }
+  }
+
+  double nnz = (double)(sp->row_ptr[row + dz->rows] - sp->row_ptr[row]);
+  double flops = 2.0 * nnz * dw->cols + (double)dz->rows * dz->cols;
+  PROF_KEND(PROF_K_SPARSE_DOT_LEFT, flops);
+  return flops;
+}
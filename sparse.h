@@ -0,0 +1,35 @@
+/*!
+ * \file sparse.h
+ * \brief Fichier header de sparse.c
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#ifndef _SPARSE_H_
+#define _SPARSE_H_
+
+#include "matrix.h"
+
+// Densité max. (part des valeurs différentes du fond) pour le noyau creux,
+// sous le croisement mesuré par gan_bench avec les noyaux denses
+#define SPARSE_MAX_DENSITY 0.5
+
+typedef struct sparse sparse_t;
+/* Structure représentant une matrice creuse (format CSR) par rapport à
+ * une valeur de fond : seules les valeurs différentes du fond sont stockées,
+ * sous la forme x - bg. Les lignes sont les images, les colonnes les pixels. */
+struct sparse {
+  int rows; // nombre de lignes
+  int cols; // nombre de colonnes
+  double bg; // valeur du fond
+  long nnz; // nombre de valeurs stockées
+  long* row_ptr; // indice de la première valeur de chaque ligne (rows + 1)
+  int* col; // colonne de chaque valeur
+  double* val; // valeur (x - bg)
+};
+
+sparse_t* sparse_init(matrix_t*, double);
+void sparse_free(sparse_t*);
+double sparse_density(const sparse_t*, int, int);
+double sparse_sum_z_act(matrix_t*, const sparse_t*, int, matrix_t*, matrix_t*);
+double sparse_dot_left(matrix_t*, const sparse_t*, int, matrix_t*);
+
+#endif
@@ -0,0 +1,413 @@
+/*!
+ * \file step.c
+ * \brief Fichier décrivant une itération d'apprentissage du GAN sous forme
+ * de graphe de tâches (une tâche par noyau), exécuté par l'ordonnanceur
+ * par vol de tâches : les noyaux indépendants (chemins réel et faux du
+ * discriminator, gradients des poids et des biais, ...) se recouvrent.
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "step.h"
+#include "mem.h"
+#include "prof.h"
+#include "trace.h"
+
+/**
+ * Tâche : générer le bruit du generator.
+ */
+static void task_noise(void* arg, int i)
+{
+  step_t* st = (step_t*)arg;
+  generate_noise(st->z, st->seed);
+}
+
+/**
+ * Tâche : copier le lot de données d'apprentissage.
+ */
+static void task_copy(void* arg, int i)
+{
+  step_t* st = (step_t*)arg;
+  load_batch(st->cfg, st->x_real, st->batch);
+}
+
+/**
+ * Tâche : propagation avant du generator.
+ */
+static void task_forward_g(void* arg, int i)
+{
+  step_t* st = (step_t*)arg;
+  forward_generator(st->gan, st->z);
+}
+
+/**
+ * Tâche : propagation avant du discriminator (réel si 'real' vaut 1).
+ */
+static void task_forward_d(void* arg, int real)
+{
+  step_t* st = (step_t*)arg;
+  forward_discriminator(st->gan, real ? st->x_real : st->gan->g->a[st->gan->nb_layers - 2], real);
+}
+
+/**
+ * Tâche : propagation arrière d'une couche du discriminator (chemin réel).
+ */
+static void task_delta_d_real(void* arg, int i)
+{
+  step_t* st = (step_t*)arg;
+  backward_discriminator_delta(st->gan, i, 1);
+}
+
+/**
+ * Tâche : propagation arrière d'une couche du discriminator (chemin faux).
+ */
+static void task_delta_d_fake(void* arg, int i)
+{
+  step_t* st = (step_t*)arg;
+  backward_discriminator_delta(st->gan, i, 0);
+}
+
+/**
+ * Tâche : gradient des poids d'une couche du discriminator (chemin réel).
+ */
+static void task_dw_d_real(void* arg, int i)
+{
+  step_t* st = (step_t*)arg;
+  backward_discriminator_dw(st->gan, st->x_real, i, 1);
+}
+
+/**
+ * Tâche : gradient des poids d'une couche du discriminator (chemin faux).
+ */
+static void task_dw_d_fake(void* arg, int i)
+{
+  step_t* st = (step_t*)arg;
+  backward_discriminator_dw(st->gan, st->x_real, i, 0);
+}
+
+/**
+ * Tâche : gradient des biais d'une couche du discriminator (chemin réel).
+ */
+static void task_db_d_real(void* arg, int i)
+{
+  step_t* st = (step_t*)arg;
+  backward_discriminator_db(st->gan, i, 1);
+}
+
+/**
+ * Tâche : gradient des biais d'une couche du discriminator (chemin faux).
+ */
+static void task_db_d_fake(void* arg, int i)
+{
+  step_t* st = (step_t*)arg;
+  backward_discriminator_db(st->gan, i, 0);
+}
+
+/**
+ * Tâche : mise à jour d'une couche du discriminator.
+ */
+static void task_update_d(void* arg, int i)
+{
+  step_t* st = (step_t*)arg;
+  update_discriminator(st->gan, i);
+}
+
+/**
+ * Tâche : gradient de l'image générée à travers le discriminator.
+ */
+static void task_input_g(void* arg, int i)
+{
+  step_t* st = (step_t*)arg;
+  backward_generator_input(st->gan);
+}
+
+/**
+ * Tâche : propagation arrière d'une couche du generator.
+ */
+static void task_delta_g(void* arg, int i)
+{
+  step_t* st = (step_t*)arg;
+  backward_generator_delta(st->gan, st->gan->der_d->x, i);
+}
+
+/**
+ * Tâche : gradient des poids d'une couche du generator.
+ */
+static void task_dw_g(void* arg, int i)
+{
+  step_t* st = (step_t*)arg;
+  backward_generator_dw(st->gan, st->z, i);
+}
+
+/**
+ * Tâche : gradient des biais d'une couche du generator.
+ */
+static void task_db_g(void* arg, int i)
+{
+  step_t* st = (step_t*)arg;
+  backward_generator_db(st->gan, i);
+}
+
+/**
+ * Tâche : mise à jour d'une couche du generator.
+ */
+static void task_update_g(void* arg, int i)
+{
+  step_t* st = (step_t*)arg;
+  update_generator(st->gan, i);
+}
+
+/**
+ * Ajouter au graphe la propagation arrière d'un chemin du discriminator
+ * (réel ou faux), couche par couche.
+ *
+ * \param st structure step
+ * \param real booléen pour le chemin réel
+ * \param fwd tâches de propagation avant dont dépend la couche de sortie
+ * \param nb_fwd nombre de tâches dans 'fwd'
+ * \param delta indices des tâches 'delta' (sortie)
+ * \param grads indices des tâches 'dw' et 'db' (sortie, deux par couche)
+ */
+static void build_discriminator_path(step_t* st, int real, int* fwd, int nb_fwd, int* delta, int* grads)
+{
+  int i, f, out = st->gan->nb_layers - 2;
+  sched_t* sc = st->sc;
+
+  for (i = out; i >= 0; i--) {
+    delta[i] = sched_task(sc, real ? "delta_d_real" : "delta_d_fake", real ? task_delta_d_real : task_delta_d_fake, st, i);
+    if (i == out)
+      for (f = 0; f < nb_fwd; f++)
+        sched_depend(sc, delta[i], fwd[f]);
+    else
+      sched_depend(sc, delta[i], delta[i + 1]);
+
+    grads[2 * i] = sched_task(sc, real ? "dw_d_real" : "dw_d_fake", real ? task_dw_d_real : task_dw_d_fake, st, i);
+    sched_depend(sc, grads[2 * i], delta[i]);
+    grads[2 * i + 1] = sched_task(sc, real ? "db_d_real" : "db_d_fake", real ? task_db_d_real : task_db_d_fake, st, i);
+    sched_depend(sc, grads[2 * i + 1], delta[i]);
+  }
+}
+
+/**
+ * Initialiser une itération d'apprentissage dont les tâches sont ajoutées
+ * à l'ordonnanceur 'sc' (partagé entre plusieurs modèles en mode sweep),
+ * sans construire son graphe.
+ *
+ * \param cfg structure config
+ * \param gan structure gan
+ * \param sc ordonnanceur
+ * \param seed graine du bruit propre au modèle (NULL : rand())
+ * \return structure step
+ */
+step_t* init_step_shared(config_t* cfg, gan_t* gan, sched_t* sc, unsigned int* seed)
+{
+  step_t* st = (step_t*)malloc(sizeof(*st));
+  assert(st);
+  st->cfg = cfg;
+  st->gan = gan;
+  st->z = mat_zinit(cfg->batch_sz, gan->input_layer_sz_g);
+  st->x_real = mat_zinit(cfg->batch_sz, cfg->x_train->cols);
+  st->batch = 0;
+  st->seed = seed;
+  st->sc = sc;
+  st->own_sc = 0;
+  return st;
+}
+
+/**
+ * Initialiser le graphe de tâches d'une itération d'apprentissage, sur son
+ * propre ordonnanceur.
+ *
+ * \param cfg structure config
+ * \param gan structure gan
+ * \param nb_workers nombre de threads
+ * \return structure step
+ */
+step_t* init_step(config_t* cfg, gan_t* gan, int nb_workers)
+{
+  step_t* st = init_step_shared(cfg, gan, sched_init(nb_workers, STEP_NB_TASKS(gan->nb_layers)), NULL);
+  st->own_sc = 1;
+  build_step(st);
+  return st;
+}
+
+/**
+ * Ajouter à l'ordonnanceur le graphe de tâches d'une itération
+ * (STEP_NB_TASKS tâches). Les dépendances reprennent l'ordre du mode
+ * synchrone : les poids d'une couche ne sont mis à jour qu'une fois tous
+ * les noyaux qui les lisent terminés, le résultat est donc identique à
+ * train_gan_step.
+ *
+ * \param st structure step
+ */
+void build_step(step_t* st)
+{
+  gan_t* gan = st->gan;
+  sched_t* sc = st->sc;
+  int i, out = gan->nb_layers - 2, nb = gan->nb_layers - 1;
+
+  int* delta_r = (int*)malloc(nb * sizeof(*delta_r));
+  int* delta_f = (int*)malloc(nb * sizeof(*delta_f));
+  int* delta_g = (int*)malloc(nb * sizeof(*delta_g));
+  int* grads_r = (int*)malloc(2 * nb * sizeof(*grads_r));
+  int* grads_f = (int*)malloc(2 * nb * sizeof(*grads_f));
+  int* grads_g = (int*)malloc(2 * nb * sizeof(*grads_g));
+  int* update_d = (int*)malloc(nb * sizeof(*update_d));
+  assert(delta_r && delta_f && delta_g && grads_r && grads_f && grads_g && update_d);
+
+  // Propagations avant
+  int noise = sched_task(sc, "noise", task_noise, st, 0);
+  int copy = sched_task(sc, "copy", task_copy, st, 0);
+  int fwd_g = sched_task(sc, "forward_g", task_forward_g, st, 0);
+  sched_depend(sc, fwd_g, noise);
+  int fwd[2];
+  fwd[0] = sched_task(sc, "forward_d_real", task_forward_d, st, 1);
+  sched_depend(sc, fwd[0], copy);
+  fwd[1] = sched_task(sc, "forward_d_fake", task_forward_d, st, 0);
+  sched_depend(sc, fwd[1], fwd_g);
+
+  // Propagation arrière du discriminator (chemins réel et faux indépendants)
+  build_discriminator_path(st, 1, fwd, 2, delta_r, grads_r);
+  build_discriminator_path(st, 0, fwd + 1, 1, delta_f, grads_f);
+
+  for (i = 0; i < nb; i++) {
+    update_d[i] = sched_task(sc, "update_d", task_update_d, st, i);
+    sched_depend(sc, update_d[i], grads_r[2 * i]);
+    sched_depend(sc, update_d[i], grads_r[2 * i + 1]);
+    sched_depend(sc, update_d[i], grads_f[2 * i]);
+    sched_depend(sc, update_d[i], grads_f[2 * i + 1]);
+    if (i > 0) {
+      sched_depend(sc, update_d[i], delta_r[i - 1]);
+      sched_depend(sc, update_d[i], delta_f[i - 1]);
+    }
+  }
+
+  // Propagation arrière du generator
+  int input_g = sched_task(sc, "input_g", task_input_g, st, 0);
+  for (i = 0; i < nb; i++)
+    sched_depend(sc, input_g, update_d[i]);
+
+  for (i = out; i >= 0; i--) {
+    delta_g[i] = sched_task(sc, "delta_g", task_delta_g, st, i);
+    sched_depend(sc, delta_g[i], i == out ? input_g : delta_g[i + 1]);
+    grads_g[2 * i] = sched_task(sc, "dw_g", task_dw_g, st, i);
+    sched_depend(sc, grads_g[2 * i], delta_g[i]);
+    grads_g[2 * i + 1] = sched_task(sc, "db_g", task_db_g, st, i);
+    sched_depend(sc, grads_g[2 * i + 1], delta_g[i]);
+  }
+
+  for (i = 0; i < nb; i++) {
+    int update_g = sched_task(sc, "update_g", task_update_g, st, i);
+    sched_depend(sc, update_g, grads_g[2 * i]);
+    sched_depend(sc, update_g, grads_g[2 * i + 1]);
+    if (i > 0)
+      sched_depend(sc, update_g, delta_g[i - 1]);
+  }
+
+  free(delta_r);
+  free(delta_f);
+  free(delta_g);
+  free(grads_r);
+  free(grads_f);
+  free(grads_g);
+  free(update_d);
+}
+
+/**
+ * Choisir le lot 'batch' de la prochaine exécution du graphe.
+ *
+ * \param st structure step
+ * \param batch indice du lot
+ */
+void select_step(step_t* st, int batch)
+{
+  st->batch = batch;
+  select_batch(st->cfg, st->gan, batch);
+}
+
+/**
+ * Exécuter une itération d'apprentissage sur le lot 'batch'.
+ *
+ * \param st structure step
+ * \param batch indice du lot
+ */
+void run_step(step_t* st, int batch)
+{
+  select_step(st, batch);
+  sched_run(st->sc);
+}
+
+/**
+ * Libérer la mémoire du graphe d'une itération.
+ *
+ * \param st structure step
+ */
+void free_step(step_t* st)
+{
+  if (st->own_sc)
+    sched_free(st->sc);
+  mat_free(st->z);
+  mat_free(st->x_real);
+  free(st);
+}
+
+/**
+ * Entraîner le modèle GAN en exécutant chaque itération comme un graphe de
+ * tâches sur 'nb_threads' threads. En plus des pertes, le travail total et
+ * le chemin critique moyens par itération sont affichés, et la trace de la
+ * dernière itération en fin d'apprentissage (mode verbose).
+ *
+ * \param cfg structure config
+ * \param gan structure gan
+ * \param mnist structure mnist
+ */
+void train_gan_sched(config_t* cfg, gan_t* gan, mnist_t* mnist)
+{
+  int i, j, out = gan->nb_layers - 2;
+  double elapsed = 0.0, work = 0.0, span = 0.0;
+  struct timespec start, end;
+
+  step_t* st = init_step(cfg, gan, cfg->nb_threads);
+  matrix_t* loss_d = mat_zinit(gan->d->a_fake[out]->rows, gan->d->a_real[out]->cols);
+  matrix_t* loss_g = mat_zinit(gan->d->a_fake[out]->rows, gan->d->a_fake[out]->cols);
+
+  for (i = 0; i < gan->epochs; i++) {
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (j = 0; j < cfg->num_batches; j++) {
+      TRACE_STEP();
+      run_step(st, j);
+      work += sched_work(st->sc);
+      span += sched_span(st->sc, NULL);
+      monitor_publish(mnist->monitor, gan->g->a[out], gan->d->a_real[out], gan->d->a_fake[out],
+        gan->lr, (long)i * cfg->num_batches + j, i);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+    PROF_EPOCH(i);
+    MEM_EPOCH(i);
+    if (cfg->progressbar)
+      print_progressbar(i, PRINT_EP, gan->epochs);
+
+    if (cfg->verbose && i % PRINT_EP == 0)
+      print_loss(mnist, gan, i, loss_d, loss_g, (double)(i + 1) * cfg->train_sz / elapsed);
+
+    gan->lr = gan->lr * (1.0 / (1.0 + gan->dr * i));
+  }
+
+  if (cfg->verbose)
+    sched_trace(st->sc, stdout);
+
+  mat_ce_(loss_d, gan->d->a_fake[out], gan->d->a_real[out]);
+  mat_log_(loss_g, gan->d->a_fake[out]);
+  printf("[sched] threads: %d, img/s: %.1f, work/step: %.3f ms, span/step: %.3f ms, loss_d: %.3f, loss_g: %.3f\n",
+    st->sc->nb_workers, (double)gan->epochs * cfg->train_sz / elapsed,
+    work * 1e3 / (gan->epochs * cfg->num_batches), span * 1e3 / (gan->epochs * cfg->num_batches),
+    mat_mean(loss_d), mat_mean(loss_g));
+
+  mat_free(loss_d);
+  mat_free(loss_g);
+  free_step(st);
+}
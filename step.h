@@ -0,0 +1,36 @@
+/*!
+ * \file step.h
+ * \brief Fichier header de step.c
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#ifndef _STEP_H_
+#define _STEP_H_
+
+#include "gan.h"
+#include "sched.h"
+
+// Nombre de tâches du graphe d'une itération pour 'nb_layers' couches
+#define STEP_NB_TASKS(nb_layers) (6 + 11 * ((nb_layers) - 1))
+
+typedef struct step step_t;
+/* Structure représentant une itération d'apprentissage décrite par un graphe de tâches */
+struct step {
+  config_t* cfg; // structure config
+  gan_t* gan; // structure gan
+  matrix_t* z; // données bruitées
+  matrix_t* x_real; // lot de données d'apprentissage
+  int batch; // indice du lot en cours
+  unsigned int* seed; // graine du bruit propre au modèle (NULL : rand())
+  sched_t* sc; // ordonnanceur
+  int own_sc; // ordonnanceur propre à l'itération (libéré avec elle)
+};
+
+step_t* init_step_shared(config_t*, gan_t*, sched_t*, unsigned int*);
+step_t* init_step(config_t*, gan_t*, int);
+void build_step(step_t*);
+void select_step(step_t*, int);
+void run_step(step_t*, int);
+void free_step(step_t*);
+void train_gan_sched(config_t*, gan_t*, mnist_t*);
+
+#endif
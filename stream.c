@@ -0,0 +1,321 @@
+/*!
+ * \file stream.c
+ * \brief Fichier comprenant la lecture en flux des données d'apprentissage
+ * (fichiers IDX de taille quelconque) : les images sont lues par grands
+ * blocs avec des lectures asynchrones POSIX (aio_read) en avance sur
+ * l'apprentissage, dans un tampon circulaire de taille fixe. Seuls les
+ * labels sont parcourus à l'ouverture, pour connaître les lots ; la mémoire
+ * utilisée ne dépend pas du nombre d'images.
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "stream.h"
+
+// Taille des lectures du parcours des labels
+#define STREAM_LABEL_BUF (1 << 18)
+
+/**
+ * Ouvrir un fichier en lecture.
+ *
+ * \param file fichier
+ * \return descripteur
+ */
+static int stream_fd(char* file)
+{
+  int fd = open(file, O_RDONLY);
+  if (fd == -1) {
+    fprintf(stderr, "Error: could not open file %s. \n", file);
+    exit(1);
+  }
+  return fd;
+}
+
+/**
+ * Parcourir les labels pour trouver la première image de chaque lot
+ * (images du label demandé, ou toutes en mode conditionnel) et l'indice
+ * de la dernière image utilisée.
+ *
+ * \param st structure stream
+ * \return indice de la dernière image du dernier lot complet
+ */
+static long stream_scan(stream_t* st)
+{
+  long i, n, matched = 0, last = -1, cap = 1024;
+  unsigned char* buf = (unsigned char*)malloc(STREAM_LABEL_BUF);
+  assert(buf);
+  st->batch_first = (long*)malloc(cap * sizeof(*st->batch_first));
+  assert(st->batch_first);
+  st->nb_batches = 0;
+
+  for (i = 0; i < st->count; i += n) {
+    long k, len = st->count - i < STREAM_LABEL_BUF ? st->count - i : STREAM_LABEL_BUF;
+    n = pread(st->fd_lbl, buf, len, st->lbl_hdr.offset + i);
+    if (n <= 0) {
+      fprintf(stderr, "Error: could not read the labels. \n");
+      exit(1);
+    }
+
+    for (k = 0; k < n; k++) {
+      if (st->cond && buf[k] >= MNIST_NUM_CLASSES) {
+        fprintf(stderr, "Error: invalid label %u for the conditional GAN. \n", buf[k]);
+        exit(1);
+      }
+      if (!st->cond && buf[k] != st->label)
+        continue;
+
+      if (matched % st->batch_sz == 0) {
+        if (st->nb_batches == cap) {
+          cap *= 2;
+          st->batch_first = (long*)realloc(st->batch_first, cap * sizeof(*st->batch_first));
+          assert(st->batch_first);
+        }
+        st->batch_first[st->nb_batches++] = i + k;
+      }
+      if (++matched % st->batch_sz == 0)
+        last = i + k;
+    }
+  }
+
+  // Le dernier lot incomplet est ignoré, comme load_mnist_config
+  st->nb_batches = matched / st->batch_sz;
+  free(buf);
+  return last;
+}
+
+/**
+ * Demander la lecture d'un bloc de la séquence dans son emplacement.
+ *
+ * \param st structure stream
+ * \param seq numéro du bloc dans la séquence de lecture
+ */
+static void slot_submit(stream_t* st, long seq)
+{
+  stream_slot_t* slot = &st->slots[seq % st->nb_slots];
+  long first = (seq % st->nb_chunks) * st->chunk;
+  long n = st->count - first < st->chunk ? st->count - first : st->chunk;
+
+  memset(&slot->img_cb, 0, sizeof(slot->img_cb));
+  slot->img_cb.aio_fildes = st->fd_img;
+  slot->img_cb.aio_offset = st->img_hdr.offset + first * st->img_hdr.item;
+  slot->img_cb.aio_buf = slot->img;
+  slot->img_cb.aio_nbytes = n * st->img_hdr.item;
+
+  memset(&slot->lbl_cb, 0, sizeof(slot->lbl_cb));
+  slot->lbl_cb.aio_fildes = st->fd_lbl;
+  slot->lbl_cb.aio_offset = st->lbl_hdr.offset + first;
+  slot->lbl_cb.aio_buf = slot->lbl;
+  slot->lbl_cb.aio_nbytes = n;
+
+  if (aio_read(&slot->img_cb) || aio_read(&slot->lbl_cb)) {
+    fprintf(stderr, "Error: could not start an asynchronous read (%s). \n", strerror(errno));
+    exit(1);
+  }
+  slot->seq = seq;
+  slot->pending = 1;
+}
+
+/**
+ * Attendre la fin de la lecture d'un emplacement.
+ *
+ * \param st structure stream
+ * \param slot emplacement
+ */
+static void slot_wait(stream_t* st, stream_slot_t* slot)
+{
+  const struct aiocb* list[2] = {&slot->img_cb, &slot->lbl_cb};
+  if (!slot->pending)
+    return;
+
+  while (aio_error(&slot->img_cb) == EINPROGRESS || aio_error(&slot->lbl_cb) == EINPROGRESS)
+    aio_suspend(list, 2, NULL);
+
+  if (aio_return(&slot->img_cb) != (ssize_t)slot->img_cb.aio_nbytes ||
+    aio_return(&slot->lbl_cb) != (ssize_t)slot->lbl_cb.aio_nbytes) {
+    fprintf(stderr, "Error: short read in %s. \n", st->image_file);
+    exit(1);
+  }
+  slot->pending = 0;
+  st->reads++;
+}
+
+/**
+ * Reprendre la lecture au bloc 'chunk' : les lectures en cours sont
+ * terminées, puis tous les emplacements sont relancés à partir du bloc.
+ *
+ * \param st structure stream
+ * \param chunk indice du bloc
+ */
+static void stream_restart(stream_t* st, long chunk)
+{
+  int s;
+  for (s = 0; s < st->nb_slots; s++)
+    slot_wait(st, &st->slots[s]);
+
+  st->seq = chunk;
+  for (s = 0; s < st->nb_slots; s++)
+    slot_submit(st, chunk + s);
+}
+
+/**
+ * Emplacement du bloc 'chunk', en avançant dans la séquence de lecture :
+ * chaque bloc dépassé libère son emplacement pour le bloc suivant du tampon.
+ *
+ * \param st structure stream
+ * \param chunk indice du bloc
+ * \return emplacement lu
+ */
+static stream_slot_t* stream_chunk(stream_t* st, long chunk)
+{
+  while (st->seq % st->nb_chunks != chunk) {
+    slot_wait(st, &st->slots[st->seq % st->nb_slots]);
+    slot_submit(st, st->seq + st->nb_slots);
+    st->seq++;
+  }
+
+  stream_slot_t* slot = &st->slots[st->seq % st->nb_slots];
+  slot_wait(st, slot);
+  return slot;
+}
+
+/**
+ * Ouvrir la lecture en flux d'un couple de fichiers IDX. Les dimensions
+ * des images viennent de l'en-tête.
+ *
+ * \param image_file fichier des images
+ * \param label_file fichier des labels
+ * \param max_count nombre max. d'images lues
+ * \param batch_sz taille du lot
+ * \param cond GAN conditionnel (toutes les images)
+ * \param label label demandé
+ * \param chunk nombre d'images par bloc
+ * \param depth nombre de blocs en lecture anticipée
+ * \return structure stream
+ */
+stream_t* stream_open(char* image_file, char* label_file, long max_count, int batch_sz, int cond, unsigned int label,
+  int chunk, int depth)
+{
+  int s;
+  stream_t* st = (stream_t*)calloc(1, sizeof(*st));
+  assert(st);
+
+  read_idx_header(image_file, &st->img_hdr);
+  read_idx_header(label_file, &st->lbl_hdr);
+  if (st->lbl_hdr.nb_dims != 1) {
+    fprintf(stderr, "Error: %s is not an IDX label file. \n", label_file);
+    exit(1);
+  }
+
+  st->image_file = image_file;
+  st->fd_img = stream_fd(image_file);
+  st->fd_lbl = stream_fd(label_file);
+  st->count = st->img_hdr.count < st->lbl_hdr.count ? st->img_hdr.count : st->lbl_hdr.count;
+  if (max_count < st->count)
+    st->count = max_count;
+  st->batch_sz = batch_sz;
+  st->cond = cond;
+  st->label = label;
+
+  long last = stream_scan(st);
+  if (st->nb_batches == 0) {
+    fprintf(stderr, "Error: not enough images with label %u for one batch. \n", label);
+    exit(1);
+  }
+
+  st->chunk = chunk > 0 ? chunk : STREAM_CHUNK;
+  st->nb_chunks = last / st->chunk + 1;
+  st->nb_slots = depth > 0 ? depth : STREAM_DEPTH;
+  st->slots = (stream_slot_t*)calloc(st->nb_slots, sizeof(*st->slots));
+  assert(st->slots);
+  for (s = 0; s < st->nb_slots; s++) {
+    if (posix_memalign((void**)&st->slots[s].img, STREAM_ALIGN, st->chunk * st->img_hdr.item) ||
+      posix_memalign((void**)&st->slots[s].lbl, STREAM_ALIGN, st->chunk)) {
+      fprintf(stderr, "Error: could not allocate the stream buffers. \n");
+      exit(1);
+    }
+    st->slots[s].seq = -1;
+  }
+
+  stream_restart(st, 0);
+  st->next_batch = 0;
+  return st;
+}
+
+/**
+ * Taille d'une image en pixels.
+ *
+ * \param st structure stream
+ * \return nombre de pixels
+ */
+long stream_item(stream_t* st)
+{
+  return st->img_hdr.item;
+}
+
+/**
+ * Lire le lot 'batch' : images normalisées dans 'x' (comme
+ * image_char2double) et labels dans 'y'. Les lots sont les mêmes que ceux
+ * de load_mnist_config ; une lecture non séquentielle reprend la lecture
+ * anticipée au bloc du lot.
+ *
+ * \param st structure stream
+ * \param batch indice du lot
+ * \param x matrice du lot (batch_sz x taille d'une image)
+ * \param y labels du lot
+ */
+void stream_batch(stream_t* st, int batch, matrix_t* x, unsigned int* y)
+{
+  int n = 0;
+  long k, c = -1, i = st->batch_first[batch], item = st->img_hdr.item;
+  stream_slot_t* slot = NULL;
+
+  if (batch != st->next_batch) {
+    stream_restart(st, i / st->chunk);
+    st->seeks++;
+  }
+
+  while (n < st->batch_sz) {
+    if (i / st->chunk != c) {
+      c = i / st->chunk;
+      slot = stream_chunk(st, c);
+    }
+
+    long off = i - c * st->chunk;
+    unsigned int lbl = slot->lbl[off];
+    if (st->cond || lbl == st->label) {
+      const unsigned char* px = slot->img + off * item;
+      for (k = 0; k < item; k++)
+        x->data[n * x->cols + k] = ((double)px[k] - 127.5) / 127.5;
+      y[n++] = lbl;
+    }
+    i++;
+  }
+
+  st->next_batch = (batch + 1) % st->nb_batches;
+}
+
+/**
+ * Fermer la lecture en flux.
+ *
+ * \param st structure stream
+ */
+void stream_close(stream_t* st)
+{
+  int s;
+  for (s = 0; s < st->nb_slots; s++) {
+    slot_wait(st, &st->slots[s]);
+    free(st->slots[s].img);
+    free(st->slots[s].lbl);
+  }
+
+  close(st->fd_img);
+  close(st->fd_lbl);
+  free(st->slots);
+  free(st->batch_first);
+  free(st);
+}
@@ -0,0 +1,62 @@
+/*!
+ * \file stream.h
+ * \brief Fichier header de stream.c
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#ifndef _STREAM_H_
+#define _STREAM_H_
+
+#include <aio.h>
+#include "matrix.h"
+#include "mnist.h"
+
+// Nombre d'images par lecture par défaut
+#define STREAM_CHUNK 4096
+// Nombre de blocs en lecture anticipée par défaut
+#define STREAM_DEPTH 4
+// Alignement des blocs en mémoire
+#define STREAM_ALIGN 4096
+
+typedef struct stream_slot stream_slot_t;
+/* Structure représentant un emplacement du tampon circulaire : un bloc
+ * d'images et de labels, lu ou en cours de lecture */
+struct stream_slot {
+  struct aiocb img_cb; // lecture asynchrone des images
+  struct aiocb lbl_cb; // lecture asynchrone des labels
+  unsigned char* img; // images du bloc
+  unsigned char* lbl; // labels du bloc
+  long seq; // numéro du bloc dans la séquence de lecture (-1 : vide)
+  int pending; // lecture en cours
+};
+
+typedef struct stream stream_t;
+/* Structure représentant la lecture en flux d'un couple de fichiers IDX
+ * (images et labels), avec lecture anticipée dans un tampon borné */
+struct stream {
+  char* image_file; // fichier des images
+  int fd_img; // descripteur du fichier des images
+  int fd_lbl; // descripteur du fichier des labels
+  idx_header_t img_hdr; // en-tête du fichier des images
+  idx_header_t lbl_hdr; // en-tête du fichier des labels
+  long count; // nombre d'images lues (au plus TRAIN)
+  int chunk; // nombre d'images par bloc
+  int nb_slots; // nombre d'emplacements du tampon (lecture anticipée)
+  long nb_chunks; // nombre de blocs d'une itération
+  stream_slot_t* slots; // tampon circulaire
+  int batch_sz; // taille du lot
+  int nb_batches; // nombre de lots d'une itération
+  long* batch_first; // indice de la première image de chaque lot
+  unsigned int label; // label demandé
+  int cond; // GAN conditionnel (toutes les images)
+  int next_batch; // lot suivant en lecture séquentielle
+  long seq; // numéro du bloc en cours de lecture
+  long reads; // nombre de blocs lus
+  long seeks; // nombre de repositionnements (lecture non séquentielle)
+};
+
+stream_t* stream_open(char*, char*, long, int, int, unsigned int, int, int);
+long stream_item(stream_t*);
+void stream_batch(stream_t*, int, matrix_t*, unsigned int*);
+void stream_close(stream_t*);
+
+#endif
@@ -0,0 +1,242 @@
+/*!
+ * \file sweep.c
+ * \brief Fichier décrivant le balayage d'hyperparamètres : plusieurs modèles
+ * (chacun avec son fichier de configuration, son bruit et ses images en
+ * sortie) apprennent en même temps sur un jeu de données chargé une seule
+ * fois. A chaque pas, les graphes de tâches de tous les modèles sont
+ * exécutés ensemble par un seul ordonnanceur : les produits matriciels des
+ * couches des différents modèles sont répartis sur tous les threads.
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sweep.h"
+#include "mem.h"
+
+/**
+ * Vérifier qu'un paramètre commun à tout le processus est identique dans
+ * toutes les configurations.
+ *
+ * \param name nom de la clé de configuration
+ * \param value valeur du modèle
+ * \param first valeur du premier modèle
+ * \param config fichier de configuration du modèle
+ */
+static void check_shared(const char* name, int value, int first, const char* config)
+{
+  if (value != first) {
+    fprintf(stderr, "Error: %s must be the same for all the models of the sweep (%s). \n", name, config);
+    exit(1);
+  }
+}
+
+/**
+ * Construire le graphe de l'ordonnanceur partagé avec les itérations des
+ * modèles encore actifs.
+ *
+ * \param sw structure sweep
+ */
+static void build_sweep(sweep_t* sw)
+{
+  int m;
+  sched_clear(sw->sc);
+  for (m = 0; m < sw->nb_models; m++)
+    if (sw->models[m].active)
+      build_step(sw->models[m].st);
+}
+
+/**
+ * Initialiser le balayage : les données MNIST sont chargées une fois (fichiers
+ * DATA_IMG / DATA_LBL de la première configuration), puis chaque modèle
+ * récupère ses données d'apprentissage et initialise son GAN. THREADS de la
+ * première configuration donne le nombre de threads partagés.
+ *
+ * \param nb_models nombre de modèles
+ * \param configs fichiers de configuration des modèles
+ * \param outputs fichiers des images en sortie des modèles
+ * \return structure sweep
+ */
+sweep_t* init_sweep(int nb_models, char** configs, char** outputs)
+{
+  int m, nb_tasks = 0;
+  sweep_t* sw = (sweep_t*)malloc(sizeof(*sw));
+  assert(sw);
+  sw->nb_models = nb_models;
+  sw->models = (sweep_model_t*)calloc(nb_models, sizeof(*sw->models));
+  assert(sw->models);
+
+  for (m = 0; m < nb_models; m++) {
+    sweep_model_t* md = &sw->models[m];
+    md->cfg = init_config(configs[m]);
+    if (md->cfg->stream) {
+      fprintf(stderr, "Error: STREAM is not supported by the sweep (%s). \n", configs[m]);
+      exit(1);
+    }
+    if (md->cfg->checkpoint > 1) {
+      fprintf(stderr, "Error: CHECKPOINT is not supported by the sweep (%s). \n", configs[m]);
+      exit(1);
+    }
+    if (m == 0)
+      continue;
+
+    config_t* first = sw->models[0].cfg;
+    if (strcmp(md->cfg->data_img, first->data_img) || strcmp(md->cfg->data_lbl, first->data_lbl)) {
+      fprintf(stderr, "Error: all the models of the sweep must use the same data (%s). \n", configs[m]);
+      exit(1);
+    }
+    check_shared("FAST_MATH", md->cfg->fast_math, first->fast_math, configs[m]);
+    check_shared("GEMM", md->cfg->gemm, first->gemm, configs[m]);
+    check_shared("KGEN", md->cfg->kgen, first->kgen, configs[m]);
+  }
+
+  sw->mnist = load_mnist(NULL, sw->models[0].cfg->data_img, sw->models[0].cfg->data_lbl);
+
+  for (m = 0; m < nb_models; m++) {
+    sweep_model_t* md = &sw->models[m];
+    load_mnist_config(md->cfg, sw->mnist);
+    md->out = *sw->mnist;
+    md->out.output = outputs[m];
+    md->out.snapshot = snapshot_init(outputs[m], md->cfg->snap_nb, md->cfg->img_w, md->cfg->img_h, md->cfg->img_ch);
+    md->out.monitor = NULL;
+
+    md->gan = init_gan(md->cfg);
+    md->seed = (unsigned int)rand();
+    md->active = md->gan->epochs > 0;
+    nb_tasks += STEP_NB_TASKS(md->gan->nb_layers);
+  }
+
+  sw->sc = sched_init(sw->models[0].cfg->nb_threads, nb_tasks);
+  for (m = 0; m < nb_models; m++)
+    sw->models[m].st = init_step_shared(sw->models[m].cfg, sw->models[m].gan, sw->sc, &sw->models[m].seed);
+
+  return sw;
+}
+
+/**
+ * Entraîner les modèles pas à pas : à chaque pas, chaque modèle actif choisit
+ * son lot, puis une seule exécution de l'ordonnanceur fait l'itération de
+ * tous les modèles. Chaque modèle garde son nombre d'itérations, sa
+ * décroissance du coefficient d'apprentissage et ses affichages ; le graphe
+ * est reconstruit quand un modèle termine.
+ *
+ * \param sw structure sweep
+ */
+void train_sweep(sweep_t* sw)
+{
+  int m, active = 0;
+  long images = 0;
+  double elapsed = 0.0;
+  struct timespec start, end;
+
+  for (m = 0; m < sw->nb_models; m++)
+    active += sw->models[m].active;
+  build_sweep(sw);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  while (active > 0) {
+    int done = 0;
+    for (m = 0; m < sw->nb_models; m++)
+      if (sw->models[m].active)
+        select_step(sw->models[m].st, sw->models[m].batch);
+
+    sched_run(sw->sc);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+    for (m = 0; m < sw->nb_models; m++) {
+      sweep_model_t* md = &sw->models[m];
+      if (!md->active)
+        continue;
+
+      md->images += md->cfg->batch_sz;
+      images += md->cfg->batch_sz;
+      if (++md->batch < md->cfg->num_batches)
+        continue;
+
+      // Fin d'une itération du modèle
+      gan_t* gan = md->gan;
+      int out = gan->nb_layers - 2;
+      md->batch = 0;
+      if (md->cfg->verbose && md->epoch % PRINT_EP == 0) {
+        matrix_t* loss_d = mat_zinit(gan->d->a_fake[out]->rows, gan->d->a_real[out]->cols);
+        matrix_t* loss_g = mat_zinit(gan->d->a_fake[out]->rows, gan->d->a_fake[out]->cols);
+        printf("[sweep] %s\n", md->out.output);
+        print_loss(&md->out, gan, md->epoch, loss_d, loss_g, md->images / elapsed);
+        mat_free(loss_d);
+        mat_free(loss_g);
+      }
+
+      gan->lr = gan->lr * (1.0 / (1.0 + gan->dr * md->epoch));
+      if (++md->epoch == gan->epochs) {
+        md->active = 0;
+        md->elapsed = elapsed;
+        active--;
+        done = 1;
+      }
+    }
+
+    if (done && active > 0)
+      build_sweep(sw);
+  }
+
+  for (m = 0; m < sw->nb_models; m++) {
+    sweep_model_t* md = &sw->models[m];
+    gan_t* gan = md->gan;
+    int out = gan->nb_layers - 2;
+    matrix_t* loss_d = mat_zinit(gan->d->a_fake[out]->rows, gan->d->a_real[out]->cols);
+    matrix_t* loss_g = mat_zinit(gan->d->a_fake[out]->rows, gan->d->a_fake[out]->cols);
+    mat_ce_(loss_d, gan->d->a_fake[out], gan->d->a_real[out]);
+    mat_log_(loss_g, gan->d->a_fake[out]);
+    printf("[sweep] %s: epochs: %d, img/s: %.1f, loss_d: %.3f, loss_g: %.3f\n", md->out.output, md->epoch,
+      md->elapsed > 0.0 ? md->images / md->elapsed : 0.0, mat_mean(loss_d), mat_mean(loss_g));
+    mat_free(loss_d);
+    mat_free(loss_g);
+  }
+  printf("[sweep] models: %d, threads: %d, img/s: %.1f\n", sw->nb_models, sw->sc->nb_workers,
+    elapsed > 0.0 ? images / elapsed : 0.0);
+}
+
+/**
+ * Sauvegarder la dernière image de chaque modèle, comme le mode
+ * d'apprentissage d'un seul modèle (generator d'inférence).
+ *
+ * \param sw structure sweep
+ */
+void save_sweep(sweep_t* sw)
+{
+  int m;
+  for (m = 0; m < sw->nb_models; m++) {
+    sweep_model_t* md = &sw->models[m];
+    gan_t* gan = md->gan;
+    int folded = fold_generator(gan);
+    if (folded || gan->nb_classes)
+      sample_generator(md->cfg, gan, md->cfg->chosen_label, &md->seed);
+    snapshot_push_wait(md->out.snapshot, gan->g->a[gan->nb_layers - 2], -1);
+    snapshot_free(md->out.snapshot);
+    md->out.snapshot = NULL;
+    printf("Image was saved successfully in %s. \n", md->out.output);
+  }
+}
+
+/**
+ * Libérer la mémoire du balayage (itérations, modèles et configurations,
+ * ordonnanceur et données partagées).
+ *
+ * \param sw structure sweep
+ */
+void free_sweep(sweep_t* sw)
+{
+  int m;
+  for (m = 0; m < sw->nb_models; m++) {
+    free_step(sw->models[m].st);
+    free_gan(sw->models[m].gan);
+    free_config(sw->models[m].cfg);
+  }
+  sched_free(sw->sc);
+  free_mnist(sw->mnist);
+  free(sw->models);
+  free(sw);
+}
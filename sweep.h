@@ -0,0 +1,43 @@
+/*!
+ * \file sweep.h
+ * \brief Fichier header de sweep.c
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#ifndef _SWEEP_H_
+#define _SWEEP_H_
+
+#include "gan.h"
+#include "step.h"
+
+typedef struct sweep_model sweep_model_t;
+/* Structure représentant un modèle du balayage, avec sa configuration,
+ * son bruit et ses fichiers en sortie */
+struct sweep_model {
+  config_t* cfg; // structure config du modèle
+  gan_t* gan; // structure gan du modèle
+  step_t* st; // itération d'apprentissage (tâches dans l'ordonnanceur partagé)
+  mnist_t out; // données partagées, avec le fichier et les images du modèle
+  unsigned int seed; // graine du bruit du generator
+  int epoch; // itération en cours
+  int batch; // lot en cours
+  int active; // apprentissage en cours
+  long images; // nombre d'images apprises
+  double elapsed; // durée de l'apprentissage en secondes
+};
+
+typedef struct sweep sweep_t;
+/* Structure représentant l'apprentissage simultané de plusieurs modèles
+ * sur le même jeu de données */
+struct sweep {
+  int nb_models; // nombre de modèles
+  sweep_model_t* models; // modèles
+  mnist_t* mnist; // données MNIST chargées une seule fois
+  sched_t* sc; // ordonnanceur partagé
+};
+
+sweep_t* init_sweep(int, char**, char**);
+void train_sweep(sweep_t*);
+void save_sweep(sweep_t*);
+void free_sweep(sweep_t*);
+
+#endif
@@ -0,0 +1,311 @@
+/*!
+ * \file throughput.c
+ * \brief Fichier comprenant le benchmark de bout en bout de l'apprentissage :
+ * un nombre fixe d'itérations avec une graine fixe, et un résultat JSON
+ * (images/s, ms/itération, mémoire max., emballages de poids par itération,
+ * courbe et somme de contrôle des pertes) pour comparer les performances
+ * entre deux versions ou deux niveaux de FAST_MATH. Le benchmark de passage
+ * à l'échelle mesure le même modèle pour plusieurs tailles d'image.
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <malloc.h>
+#include <sys/resource.h>
+#include "throughput.h"
+#include "trace.h"
+#include "fastmath.h"
+#include "gemm.h"
+#include "mem.h"
+
+/**
+ * Temps actuel en secondes.
+ * \return temps en secondes
+ */
+static double throughput_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Mémoire allouée sur le tas (octets), pour mesurer celle d'un modèle.
+ * \return octets alloués
+ */
+static size_t throughput_heap(void)
+{
+  struct mallinfo2 mi = mallinfo2();
+  return mi.uordblks + mi.hblkhd;
+}
+
+/**
+ * Ecrire un nombre en JSON : null s'il n'est pas fini (pertes d'un
+ * apprentissage qui diverge), JSON n'ayant ni inf ni nan.
+ *
+ * \param fp fichier JSON
+ * \param fmt format du nombre
+ * \param v nombre
+ */
+static void throughput_number(FILE* fp, const char* fmt, double v)
+{
+  if (isfinite(v))
+    fprintf(fp, fmt, v);
+  else
+    fputs("null", fp);
+}
+
+/**
+ * Ecrire en JSON le bilan du recalcul des activations (CHECKPOINT) :
+ * mémoire des activations sans et avec recalcul, couches et opérations
+ * recalculées par itération et leur part des propagations avant.
+ *
+ * \param fp fichier JSON
+ * \param ck structure ckpt (NULL : rien à écrire)
+ */
+static void throughput_ckpt(FILE* fp, ckpt_t* ck)
+{
+  if (!ck)
+    return;
+  long steps = ck->steps ? ck->steps : 1;
+  fprintf(fp, "\"checkpoint\":%d,\"act_kb\":%zu,\"act_ckpt_kb\":%zu,\"recompute_layers_step\":%.2f,"
+    "\"recompute_mflop_step\":%.4f,\"recompute_pct\":%.2f,", ck->seg, ck->total / 1024,
+    (ck->total - ck->freed + ck->shared) / 1024, (double)ck->layers / steps, ck->flops / steps * 1e-6,
+    ck->fwd_flops > 0.0 ? 100.0 * ck->flops / ck->fwd_flops : 0.0);
+}
+
+/**
+ * Comparer deux doubles (tri).
+ */
+static int cmp_double(const void* a, const void* b)
+{
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Entraîner le modèle pendant 'steps' itérations (après THROUGHPUT_WARMUP
+ * itérations de préchauffage) comme train_gan, puis écrire les mesures en
+ * JSON. Le bruit est tiré avec la graine 'seed' ; avec la même graine pour
+ * l'initialisation des poids (srand), deux exécutions donnent la même somme
+ * de contrôle, qui change dès que le calcul numérique change.
+ *
+ * \param cfg structure config
+ * \param gan structure gan
+ * \param steps nombre d'itérations mesurées
+ * \param seed graine pour le bruit du generator
+ * \param file fichier JSON de sortie (NULL pour la sortie standard)
+ */
+void bench_train(config_t* cfg, gan_t* gan, int steps, unsigned int seed, const char* file)
+{
+  int i, k, out = gan->nb_layers - 2;
+  unsigned int noise_seed = seed;
+  double t0, elapsed = 0.0, checksum = 0.0;
+  unsigned long packs = 0;
+  double curve[THROUGHPUT_CURVE][2];
+  int nb_curve = 0;
+  struct rusage usage;
+  FILE* fp = stdout;
+
+  double* times = (double*)malloc(steps * sizeof(*times));
+  assert(times);
+
+  matrix_t* z = mat_zinit(cfg->batch_sz, gan->input_layer_sz_g);
+  matrix_t* x_real = mat_zinit(cfg->batch_sz, cfg->x_train->cols);
+  matrix_t* loss_d = mat_zinit(gan->d->a_fake[out]->rows, gan->d->a_real[out]->cols);
+  matrix_t* loss_g = mat_zinit(gan->d->a_fake[out]->rows, gan->d->a_fake[out]->cols);
+
+  for (k = -THROUGHPUT_WARMUP; k < steps; k++) {
+    int j = (k + THROUGHPUT_WARMUP) % cfg->num_batches;
+
+    TRACE_STEP();
+    if (k == 0)
+      packs = mat_pack_count();
+    t0 = throughput_now();
+    generate_noise(z, &noise_seed);
+    select_batch(cfg, gan, j);
+    load_batch(cfg, x_real, j);
+    train_gan_step(gan, z, x_real);
+
+    if (k >= 0) {
+      times[k] = throughput_now() - t0;
+      elapsed += times[k];
+      checksum += mat_sum_val(gan->d->a_real[out]) + mat_sum_val(gan->d->a_fake[out]);
+
+      // Courbe des pertes (hors temps mesuré)
+      if (nb_curve < THROUGHPUT_CURVE && (k + 1) * THROUGHPUT_CURVE >= (nb_curve + 1) * steps) {
+        mat_ce_(loss_d, gan->d->a_fake[out], gan->d->a_real[out]);
+        mat_log_(loss_g, gan->d->a_fake[out]);
+        curve[nb_curve][0] = mat_mean(loss_d);
+        curve[nb_curve][1] = mat_mean(loss_g);
+        nb_curve++;
+      }
+    }
+
+    if (j == cfg->num_batches - 1) {
+      int epoch = (k + THROUGHPUT_WARMUP) / cfg->num_batches;
+      gan->lr = gan->lr * (1.0 / (1.0 + gan->dr * epoch));
+    }
+  }
+
+  mat_ce_(loss_d, gan->d->a_fake[out], gan->d->a_real[out]);
+  mat_log_(loss_g, gan->d->a_fake[out]);
+  packs = mat_pack_count() - packs;
+  qsort(times, steps, sizeof(*times), cmp_double);
+  getrusage(RUSAGE_SELF, &usage);
+
+  if (file && file[0] && (fp = fopen(file, "w")) == NULL) {
+    fprintf(stderr, "Error: could not open file %s. \n", file);
+    exit(1);
+  }
+
+  fprintf(fp, "{\"steps\":%d,\"warmup\":%d,\"batch\":%u,\"seed\":%u,\"label\":%u,\"train\":%u,\"fast_math\":\"%s\",",
+    steps, THROUGHPUT_WARMUP, cfg->batch_sz, seed, cfg->chosen_label, cfg->train_sz, fm_tier_name(fm_get_tier()));
+  fprintf(fp, "\"gemm\":\"%s\",", gemm_backend_name(gemm_get_backend()));
+  for (i = 0, k = 0; i < gan->nb_layers - 1; i++) {
+    k += !gan->g->conv[i] && gemm_is_specialized(cfg->batch_sz, gan->layers_sz_g[i], gan->layers_sz_g[i + 1]);
+    k += !gan->d->conv[i] && gemm_is_specialized(cfg->batch_sz, gan->layers_sz_d[i], gan->layers_sz_d[i + 1]);
+  }
+  fprintf(fp, "\"kgen_layers\":%d,\"tuned\":%d,", k, gan->tuned);
+  if (cfg->x_stream)
+    fprintf(fp, "\"stream_reads\":%ld,\"stream_seeks\":%ld,", cfg->x_stream->reads, cfg->x_stream->seeks);
+  throughput_ckpt(fp, gan->ckpt);
+  fprintf(fp, "\"layers_g\":[");
+  for (i = 0; i < gan->nb_layers; i++)
+    fprintf(fp, "%s%u", i ? "," : "", gan->layers_sz_g[i]);
+  fprintf(fp, "],\"layers_d\":[");
+  for (i = 0; i < gan->nb_layers; i++)
+    fprintf(fp, "%s%u", i ? "," : "", gan->layers_sz_d[i]);
+  fprintf(fp, "],\"loss_curve\":[");
+  for (i = 0; i < nb_curve; i++) {
+    fprintf(fp, "%s[", i ? "," : "");
+    throughput_number(fp, "%.6f", curve[i][0]);
+    fputc(',', fp);
+    throughput_number(fp, "%.6f", curve[i][1]);
+    fputc(']', fp);
+  }
+  fprintf(fp, "],\"img_s\":%.1f,\"ms_step\":%.4f,\"ms_step_median\":%.4f,\"ms_step_min\":%.4f,"
+    "\"peak_rss_kb\":%ld,\"packs_step\":%.2f,\"loss_d\":", (double)steps * cfg->batch_sz / elapsed,
+    elapsed * 1e3 / steps, times[steps / 2] * 1e3, times[0] * 1e3, usage.ru_maxrss, (double)packs / steps);
+  throughput_number(fp, "%.6f", mat_mean(loss_d));
+  fprintf(fp, ",\"loss_g\":");
+  throughput_number(fp, "%.6f", mat_mean(loss_g));
+  fprintf(fp, ",\"checksum\":");
+  throughput_number(fp, "%.17g", checksum);
+  fprintf(fp, "}\n");
+
+  if (fp != stdout)
+    fclose(fp);
+
+  mat_free(z);
+  mat_free(x_real);
+  mat_free(loss_d);
+  mat_free(loss_g);
+  free(times);
+}
+
+/**
+ * Entraîner le modèle de 'cfg' pendant 'steps' itérations (après
+ * THROUGHPUT_WARMUP itérations de préchauffage) pour chaque taille d'image
+ * de THROUGHPUT_SIZES, sur THROUGHPUT_SCALE_BATCHES lots de données
+ * synthétiques, puis écrire en JSON le temps d'une itération et la mémoire
+ * allouée par le modèle (poids, activations, dérivées, espaces de travail)
+ * et par les données. La première et la dernière couche grandissent avec
+ * l'image ; les couches cachées gardent les tailles de gan.cfg.
+ *
+ * \param cfg structure config
+ * \param steps nombre d'itérations mesurées par taille
+ * \param seed graine pour les données, les poids et le bruit
+ * \param file fichier JSON de sortie (NULL pour la sortie standard)
+ */
+void bench_scale(config_t* cfg, int steps, unsigned int seed, const char* file)
+{
+  static const int sizes[] = {THROUGHPUT_SIZES};
+  int s, i, k, nb_sizes = sizeof(sizes) / sizeof(*sizes);
+  struct rusage usage;
+  FILE* fp = stdout;
+
+  double* times = (double*)malloc(steps * sizeof(*times));
+  assert(times);
+
+  if (file && (fp = fopen(file, "w")) == NULL) {
+    fprintf(stderr, "Error: could not open file %s. \n", file);
+    exit(1);
+  }
+
+  fprintf(fp, "{\"steps\":%d,\"warmup\":%d,\"batch\":%u,\"seed\":%u,\"fast_math\":\"%s\",\"sizes\":[", steps,
+    THROUGHPUT_WARMUP, cfg->batch_sz, seed, fm_tier_name(cfg->fast_math));
+
+  for (s = 0; s < nb_sizes; s++) {
+    config_t c = *cfg;
+    unsigned int noise_seed = seed;
+    double t0, elapsed = 0.0;
+    size_t heap = throughput_heap();
+
+    // Données synthétiques à la taille mesurée
+    c.img_w = sizes[s];
+    c.img_h = sizes[s];
+    c.img_ch = cfg->img_ch ? cfg->img_ch : 1;
+    c.img_sz = c.img_w * c.img_h * c.img_ch;
+    c.num_batches = THROUGHPUT_SCALE_BATCHES;
+    c.train_sz = c.num_batches * c.batch_sz;
+    c.x_train = mat_zinit(c.train_sz, c.img_sz);
+    c.y_train = (unsigned int*)MEM_MALLOC(c.train_sz * sizeof(*c.y_train));
+    assert(c.y_train);
+    c.x_sparse = NULL;
+    c.x_stream = NULL;
+    fill_mnist_synth(c.x_train, c.y_train, c.img_w, c.img_h, c.img_ch, seed);
+    size_t data = throughput_heap() - heap;
+
+    srand(seed);
+    gan_t* gan = init_gan(&c);
+    matrix_t* z = mat_zinit(c.batch_sz, gan->input_layer_sz_g);
+    matrix_t* x_real = mat_zinit(c.batch_sz, c.img_sz);
+
+    for (k = -THROUGHPUT_WARMUP; k < steps; k++) {
+      int j = (k + THROUGHPUT_WARMUP) % c.num_batches;
+      t0 = throughput_now();
+      generate_noise(z, &noise_seed);
+      select_batch(&c, gan, j);
+      load_batch(&c, x_real, j);
+      train_gan_step(gan, z, x_real);
+      if (k >= 0) {
+        times[k] = throughput_now() - t0;
+        elapsed += times[k];
+      }
+    }
+
+    size_t model = throughput_heap() - heap - data;
+    qsort(times, steps, sizeof(*times), cmp_double);
+    getrusage(RUSAGE_SELF, &usage);
+
+    fprintf(fp, "%s{\"size\":%d,\"channels\":%u,\"img_sz\":%u,\"layers_g\":[", s ? "," : "", sizes[s], c.img_ch,
+      c.img_sz);
+    for (i = 0; i < gan->nb_layers; i++)
+      fprintf(fp, "%s%u", i ? "," : "", gan->layers_sz_g[i]);
+    fprintf(fp, "],\"layers_d\":[");
+    for (i = 0; i < gan->nb_layers; i++)
+      fprintf(fp, "%s%u", i ? "," : "", gan->layers_sz_d[i]);
+    fprintf(fp, "],");
+    throughput_ckpt(fp, gan->ckpt);
+    fprintf(fp, "\"img_s\":%.1f,\"ms_step\":%.4f,\"ms_step_median\":%.4f,\"ms_step_min\":%.4f,"
+      "\"model_kb\":%zu,\"data_kb\":%zu,\"peak_rss_kb\":%ld}",
+      (double)steps * c.batch_sz / elapsed, elapsed * 1e3 / steps, times[steps / 2] * 1e3, times[0] * 1e3,
+      model / 1024, data / 1024, usage.ru_maxrss);
+    fflush(fp);
+
+    mat_free(z);
+    mat_free(x_real);
+    free_gan(gan);
+    mat_free(c.x_train);
+    MEM_FREE(c.y_train);
+  }
+  fprintf(fp, "]}\n");
+
+  if (fp != stdout)
+    fclose(fp);
+  free(times);
+}
@@ -0,0 +1,25 @@
+/*!
+ * \file throughput.h
+ * \brief Fichier header de throughput.c
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#ifndef _THROUGHPUT_H_
+#define _THROUGHPUT_H_
+
+#include "gan.h"
+
+// Nombre d'itérations de préchauffage (non mesurées) par défaut
+#define THROUGHPUT_WARMUP 10
+// Graine par défaut pour le benchmark
+#define THROUGHPUT_SEED 1
+// Nombre de points de la courbe des pertes
+#define THROUGHPUT_CURVE 10
+// Tailles d'image (côté en pixels) du benchmark de passage à l'échelle
+#define THROUGHPUT_SIZES 28, 64, 128
+// Nombre de lots de données synthétiques par taille d'image
+#define THROUGHPUT_SCALE_BATCHES 4
+
+void bench_train(config_t*, gan_t*, int, unsigned int, const char*);
+void bench_scale(config_t*, int, unsigned int, const char*);
+
+#endif
@@ -0,0 +1,200 @@
+/*!
+ * \file trace.c
+ * \brief Fichier comprenant l'enregistrement des phases et des noyaux
+ * sous forme de chronologie : chaque thread écrit ses évènements dans son
+ * propre tampon circulaire, sans verrou, pendant une fenêtre d'itérations ;
+ * la trace est écrite au format Chrome trace-event (about:tracing, Perfetto).
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "prof.h"
+#include "trace.h"
+
+#ifdef GAN_TRACE
+
+typedef struct trace_event trace_event_t;
+/* Structure représentant un évènement (phase ou noyau terminé) */
+struct trace_event {
+  double start; // début en secondes
+  double end; // fin en secondes
+  int id; // identifiant de la phase ou du noyau
+  int step; // itération
+};
+
+typedef struct trace_buf trace_buf_t;
+/* Structure représentant le tampon circulaire d'un thread */
+struct trace_buf {
+  trace_event_t* events; // évènements
+  atomic_ulong head; // nombre d'évènements écrits
+  int tid; // identifiant du thread dans la trace
+  trace_buf_t* next; // tampon suivant
+};
+
+// Tampon du thread courant
+static __thread trace_buf_t* trace_local = NULL;
+// Trace à laquelle appartient le tampon du thread courant
+static __thread int trace_local_gen = 0;
+// Trace actuelle (incrémentée par trace_close, qui libère les tampons)
+static atomic_int trace_gen = 0;
+// Liste des tampons de tous les threads
+static trace_buf_t* trace_bufs = NULL;
+// Verrou pour la liste des tampons (inscription d'un thread)
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Nombre de threads inscrits
+static int trace_nb_threads = 0;
+// Fichier de sortie
+static FILE* trace_fp = NULL;
+// Fenêtre d'itérations enregistrées
+static int trace_from = 0, trace_len = 0;
+// Itération actuelle (tous threads confondus)
+static atomic_int trace_cur = -1;
+// Enregistrement actif (itération dans la fenêtre)
+static atomic_int trace_active = 0;
+// Origine des temps
+static double trace_t0 = 0.0;
+
+/**
+ * Récupérer le tampon du thread courant, en le créant au premier appel
+ * (ou si celui du thread a été libéré par trace_close).
+ * \return tampon du thread
+ */
+static trace_buf_t* trace_buf(void)
+{
+  int gen = atomic_load_explicit(&trace_gen, memory_order_acquire);
+  if (!trace_local || trace_local_gen != gen) {
+    trace_local_gen = gen;
+    trace_local = (trace_buf_t*)calloc(1, sizeof(*trace_local));
+    assert(trace_local);
+    trace_local->events = (trace_event_t*)malloc(TRACE_CAPACITY * sizeof(*trace_local->events));
+    assert(trace_local->events);
+
+    pthread_mutex_lock(&trace_mutex);
+    trace_local->tid = trace_nb_threads++;
+    trace_local->next = trace_bufs;
+    trace_bufs = trace_local;
+    pthread_mutex_unlock(&trace_mutex);
+  }
+  return trace_local;
+}
+
+/**
+ * Ouvrir la trace : seules les itérations [from, from + len[ sont
+ * enregistrées.
+ *
+ * \param file fichier JSON (NULL ou vide pour ne rien enregistrer)
+ * \param from première itération enregistrée
+ * \param len nombre d'itérations enregistrées
+ */
+void trace_open(const char* file, int from, int len)
+{
+  struct timespec ts;
+
+  if (!file || !file[0] || len <= 0)
+    return;
+
+  if ((trace_fp = fopen(file, "w")) == NULL) {
+    fprintf(stderr, "Error: could not open trace file %s. \n", file);
+    exit(1);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  trace_t0 = ts.tv_sec + ts.tv_nsec * 1e-9;
+  trace_from = from;
+  trace_len = len;
+}
+
+/**
+ * Début d'une itération : active l'enregistrement si l'itération est dans
+ * la fenêtre. Avec plusieurs threads (Hogwild), les itérations de tous les
+ * threads sont comptées ensemble.
+ */
+void trace_step(void)
+{
+  if (!trace_fp)
+    return;
+
+  int step = atomic_fetch_add(&trace_cur, 1) + 1;
+  atomic_store_explicit(&trace_active, step >= trace_from && step < trace_from + trace_len, memory_order_relaxed);
+}
+
+/**
+ * Enregistrer une phase ou un noyau terminé dans le tampon du thread
+ * courant. Le tampon est circulaire : s'il est plein, les évènements les
+ * plus anciens sont écrasés.
+ *
+ * \param id identifiant de la phase ou du noyau
+ * \param start début en secondes
+ * \param end fin en secondes
+ */
+void trace_event(int id, double start, double end)
+{
+  if (!atomic_load_explicit(&trace_active, memory_order_relaxed))
+    return;
+
+  trace_buf_t* tb = trace_buf();
+  unsigned long head = atomic_load_explicit(&tb->head, memory_order_relaxed);
+  trace_event_t* ev = &tb->events[head & (TRACE_CAPACITY - 1)];
+
+  ev->start = start;
+  ev->end = end;
+  ev->id = id;
+  ev->step = atomic_load_explicit(&trace_cur, memory_order_relaxed);
+  atomic_store_explicit(&tb->head, head + 1, memory_order_release);
+}
+
+/**
+ * Ecrire la trace (évènements complets "X", un fil par thread) et libérer
+ * les tampons. Doit être appelé une fois les threads d'apprentissage terminés ;
+ * les évènements suivants sont ignorés.
+ */
+void trace_close(void)
+{
+  int first = 1;
+  unsigned long i, head, n;
+  trace_buf_t *tb, *next;
+
+  if (!trace_fp)
+    return;
+
+  // Plus d'enregistrement, et les tampons libérés ne sont plus ceux des
+  // threads (trace_buf en crée de nouveaux si une trace est rouverte)
+  atomic_store_explicit(&trace_active, 0, memory_order_relaxed);
+  atomic_fetch_add_explicit(&trace_gen, 1, memory_order_release);
+  trace_local = NULL;
+
+  fprintf(trace_fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  pthread_mutex_lock(&trace_mutex);
+  for (tb = trace_bufs; tb; tb = next) {
+    next = tb->next;
+    head = atomic_load_explicit(&tb->head, memory_order_acquire);
+    n = head < TRACE_CAPACITY ? head : TRACE_CAPACITY;
+
+    fprintf(trace_fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+      first ? "" : ",\n", tb->tid, tb->tid);
+    first = 0;
+
+    for (i = head - n; i < head; i++) {
+      trace_event_t* ev = &tb->events[i & (TRACE_CAPACITY - 1)];
+      fprintf(trace_fp, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+        "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"step\":%d}}",
+        prof_name(ev->id), ev->id >= PROF_K_DOT ? "kernel" : "phase", tb->tid,
+        (ev->start - trace_t0) * 1e6, (ev->end - ev->start) * 1e6, ev->step);
+    }
+
+    free(tb->events);
+    free(tb);
+  }
+  trace_bufs = NULL;
+  pthread_mutex_unlock(&trace_mutex);
+
+  fprintf(trace_fp, "\n]}\n");
+  fclose(trace_fp);
+  trace_fp = NULL;
+}
+
+#endif
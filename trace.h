@@ -0,0 +1,31 @@
+/*!
+ * \file trace.h
+ * \brief Fichier header de trace.c. L'enregistrement n'est compilé
+ * qu'avec -DGAN_TRACE (make TRACE=1) ; sinon les macros sont vides.
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+// Nombre d'évènements par thread (puissance de 2)
+#define TRACE_CAPACITY (1 << 16)
+
+#ifdef GAN_TRACE
+// Ouvrir la trace pour les itérations [from, from + len[
+#define TRACE_OPEN(file, from, len) trace_open((file), (from), (len))
+// Début d'une itération d'apprentissage
+#define TRACE_STEP() trace_step()
+// Ecrire la trace au format Chrome trace-event
+#define TRACE_CLOSE() trace_close()
+#else
+#define TRACE_OPEN(file, from, len) ((void)0)
+#define TRACE_STEP() ((void)0)
+#define TRACE_CLOSE() ((void)0)
+#endif
+
+void trace_open(const char*, int, int);
+void trace_step(void);
+void trace_event(int, double, double);
+void trace_close(void);
+
+#endif
@@ -0,0 +1,389 @@
+/*!
+ * \file tune.c
+ * \brief Fichier s'occupant du réglage des noyaux pour la machine : ./gan tune
+ * mesure les implémentations candidates (produits matriciels, noyaux
+ * spécialisés, noyaux de convolution) sur les couches construites par
+ * init_gan, puis écrit les meilleures dans un cache de réglage, une ligne
+ * par modèle de processeur et dimensions des couches. init_gan relit ce
+ * cache au démarrage (TUNE_FILE dans gan.cfg), sans nouvelle mesure.
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "tune.h"
+#include "matrix.h"
+#include "conv.h"
+#include "gemm.h"
+
+// Taille max. d'une ligne du cache de réglage
+#define TUNE_MAX_LINE 512
+// Taille max. d'une clé (modèle de processeur ou dimensions)
+#define TUNE_MAX_KEY 192
+// Nombre de mesures par candidat (la première sert de préchauffage)
+#define TUNE_REPEATS 5
+// Durée min. d'une mesure en secondes
+#define TUNE_MIN_TIME 0.02
+
+/**
+ * Temps actuel en secondes.
+ * \return temps en secondes
+ */
+static double tune_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Modèle de processeur et nombre de coeurs de la machine
+ * (première clé du cache).
+ *
+ * \param model modèle (sortie)
+ * \param size taille de 'model'
+ */
+static void tune_cpu_model(char* model, size_t size)
+{
+  char line[TUNE_MAX_LINE], name[TUNE_MAX_KEY] = "unknown";
+  char* val;
+  FILE* fp = fopen("/proc/cpuinfo", "r");
+
+  while (fp && fgets(line, sizeof(line), fp))
+    if (!strncmp(line, "model name", 10) && (val = strchr(line, ':')) != NULL) {
+      val += strspn(val + 1, " ") + 1;
+      val[strcspn(val, "\n")] = '\0';
+      snprintf(name, sizeof(name), "%s", val);
+      break;
+    }
+  if (fp)
+    fclose(fp);
+  snprintf(model, size, "%s x%ld", name, sysconf(_SC_NPROCESSORS_ONLN));
+}
+
+/**
+ * Dimensions des couches du modèle (seconde clé du cache) : taille du lot,
+ * des couches denses et convolutives, des images et nombre de couches.
+ *
+ * \param cfg structure config
+ * \param shapes dimensions (sortie)
+ * \param size taille de 'shapes'
+ */
+static void tune_shapes(config_t* cfg, char* shapes, size_t size)
+{
+  snprintf(shapes, size, "batch=%u in_g=%u hd_g=%u hd_d=%u conv_g=%d conv_d=%d img=%ux%ux%u layers=%u",
+    cfg->batch_sz, cfg->in_layer_sz_g, cfg->hd_layer_sz_g, cfg->hd_layer_sz_d, cfg->conv_g, cfg->conv_d,
+    cfg->img_w, cfg->img_h, cfg->img_ch, cfg->nb_layers);
+}
+
+/**
+ * Paramètres de gan.cfg, utilisés sans entrée dans le cache.
+ *
+ * \param cfg structure config
+ * \param tune paramètres (sortie)
+ */
+void tune_defaults(config_t* cfg, tune_t* tune)
+{
+  tune->gemm = cfg->gemm;
+  tune->kgen = cfg->kgen;
+  tune->conv_algo_d = cfg->conv_algo;
+  tune->conv_algo_g = cfg->conv_algo;
+}
+
+/**
+ * Découper une ligne du cache : modèle de processeur, dimensions et
+ * paramètres, séparés par des tabulations.
+ *
+ * \param line ligne (modifiée)
+ * \param fields champs (sortie)
+ * \return 1 si la ligne est une entrée, 0 sinon (commentaire)
+ */
+static int tune_split(char* line, char* fields[3])
+{
+  int i;
+  if (line[0] == '#' || line[0] == '\n')
+    return 0;
+
+  line[strcspn(line, "\n")] = '\0';
+  for (i = 0; i < 3; i++) {
+    fields[i] = line;
+    line = strchr(line, '\t');
+    if (!line && i < 2)
+      return 0;
+    if (line)
+      *line++ = '\0';
+  }
+  return 1;
+}
+
+/**
+ * Lire les paramètres réglés pour cette machine et ces dimensions.
+ * Si l'implémentation réglée n'est pas compilée dans ce programme (CBLAS),
+ * les produits matriciels gardent les paramètres de gan.cfg. Une entrée
+ * invalide n'est pas appliquée et n'arrête pas le programme (appelé par
+ * libgan) : l'appelant choisit quoi faire de l'erreur.
+ *
+ * \param file cache de réglage
+ * \param cfg structure config
+ * \param tune paramètres (modifiés si une entrée valide existe)
+ * \return 1 si une entrée a été trouvée, 0 sinon, -1 si elle est invalide
+ */
+int tune_load(const char* file, config_t* cfg, tune_t* tune)
+{
+  char line[TUNE_MAX_LINE], cpu[TUNE_MAX_KEY], shapes[TUNE_MAX_KEY];
+  char* fields[3];
+  tune_t t;
+  int found = 0;
+  FILE* fp;
+
+  if (!file || !file[0] || (fp = fopen(file, "r")) == NULL)
+    return 0;
+
+  tune_cpu_model(cpu, sizeof(cpu));
+  tune_shapes(cfg, shapes, sizeof(shapes));
+  while (!found && fgets(line, sizeof(line), fp)) {
+    if (!tune_split(line, fields) || strcmp(fields[0], cpu) || strcmp(fields[1], shapes))
+      continue;
+    if (sscanf(fields[2], "gemm=%d kgen=%d conv_algo_d=%d conv_algo_g=%d",
+      &t.gemm, &t.kgen, &t.conv_algo_d, &t.conv_algo_g) != 4 ||
+      t.conv_algo_d < CONV_AUTO || t.conv_algo_d > CONV_DIRECT ||
+      t.conv_algo_g < CONV_AUTO || t.conv_algo_g > CONV_DIRECT) {
+      found = -1;
+      break;
+    }
+
+    if (gemm_available(t.gemm)) {
+      tune->gemm = t.gemm;
+      tune->kgen = t.kgen;
+    }
+    tune->conv_algo_d = t.conv_algo_d;
+    tune->conv_algo_g = t.conv_algo_g;
+    found = 1;
+  }
+  fclose(fp);
+  return found;
+}
+
+/**
+ * Ecrire les paramètres réglés dans le cache, en remplaçant l'entrée de
+ * la même machine et des mêmes dimensions (les autres sont conservées).
+ *
+ * \param file cache de réglage
+ * \param cfg structure config
+ * \param tune paramètres
+ */
+void tune_save(const char* file, config_t* cfg, const tune_t* tune)
+{
+  char line[TUNE_MAX_LINE], copy[TUNE_MAX_LINE], cpu[TUNE_MAX_KEY], shapes[TUNE_MAX_KEY], tmp[TUNE_MAX_LINE];
+  char* fields[3];
+  FILE *in, *out;
+
+  tune_cpu_model(cpu, sizeof(cpu));
+  tune_shapes(cfg, shapes, sizeof(shapes));
+  snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+  if ((out = fopen(tmp, "w")) == NULL) {
+    fprintf(stderr, "Error: could not open file %s. \n", tmp);
+    exit(1);
+  }
+
+  fprintf(out, "# modèle de processeur\tdimensions des couches\tparamètres (./gan tune)\n");
+  if ((in = fopen(file, "r")) != NULL) {
+    while (fgets(line, sizeof(line), in)) {
+      memcpy(copy, line, sizeof(line));
+      if (tune_split(copy, fields) && (strcmp(fields[0], cpu) || strcmp(fields[1], shapes)))
+        fputs(line, out);
+    }
+    fclose(in);
+  }
+  fprintf(out, "%s\t%s\tgemm=%d kgen=%d conv_algo_d=%d conv_algo_g=%d\n", cpu, shapes,
+    tune->gemm, tune->kgen, tune->conv_algo_d, tune->conv_algo_g);
+  fclose(out);
+
+  if (rename(tmp, file)) {
+    fprintf(stderr, "Error: could not write file %s. \n", file);
+    exit(1);
+  }
+}
+
+/**
+ * Remplir une matrice de valeurs aléatoires dans ]-1, 1[.
+ *
+ * \param a matrice
+ * \return la matrice a
+ */
+static matrix_t* tune_fill(matrix_t* a)
+{
+  int i;
+  for (i = 0; i < a->rows * a->cols; i++)
+    a->data[i] = 2.0 * rand() / RAND_MAX - 1.0;
+  return a;
+}
+
+/**
+ * Mesurer une itération d'une couche comme pendant l'apprentissage :
+ * propagation avant, gradient de l'entrée et des poids, puis mise à jour
+ * des poids (panneaux pré-emballés à reconstruire). Le temps retenu est le
+ * minimum des mesures.
+ *
+ * \param conv couche convolutive (NULL : couche dense, noyaux de gemm.c)
+ * \param batch taille du lot
+ * \param in taille de l'entrée
+ * \param out taille de la sortie
+ * \return temps d'une itération en secondes
+ */
+static double tune_layer(conv_t* conv, int batch, int in, int out)
+{
+  int i, r, calls = 1;
+  double t0, t, best = 0.0;
+  matrix_t* act = tune_fill(mat_zinit(batch, in));
+  matrix_t* z = mat_zinit(batch, out);
+  matrix_t* dz = tune_fill(mat_zinit(batch, out));
+  matrix_t* da = mat_zinit(batch, in);
+  matrix_t* w = tune_fill(conv ? conv_init_weights(conv) : mat_zinit(in, out));
+  matrix_t* b = tune_fill(conv ? conv_init_bias(conv) : mat_zinit(1, out));
+  matrix_t* dw = mat_zinit(w->rows, w->cols);
+  if (!conv)
+    mat_pack_init(w);
+
+  for (r = 0; r < TUNE_REPEATS; r++) {
+    t0 = tune_now();
+    for (i = 0; i < calls; i++) {
+      if (conv) {
+        conv_forward(conv, z, act, w, b);
+        conv_backward_input(conv, da, dz, w);
+        conv_backward_weight(conv, dw, act, dz);
+      }
+      else {
+        gemm_sum_z_act(z, act, w, b);
+        gemm_dot_right(da, dz, w);
+        gemm_dot_left(dw, act, dz);
+      }
+      mat_touch(w);
+    }
+    t = (tune_now() - t0) / calls;
+
+    // Première mesure : préchauffage et calibration du nombre d'appels
+    if (r == 0)
+      calls = (int)(TUNE_MIN_TIME / t) + 1;
+    else if (r == 1 || t < best)
+      best = t;
+  }
+
+  mat_free(act);
+  mat_free(z);
+  mat_free(dz);
+  mat_free(da);
+  mat_free(w);
+  mat_free(b);
+  mat_free(dw);
+  return best;
+}
+
+/**
+ * Mesurer toutes les couches denses du modèle avec l'implémentation
+ * courante des produits matriciels.
+ *
+ * \param cfg structure config
+ * \param gan structure gan
+ * \return temps d'une itération des couches denses en secondes
+ */
+static double tune_dense(config_t* cfg, gan_t* gan)
+{
+  int i;
+  double t = 0.0;
+  for (i = 0; i < gan->nb_layers - 1; i++) {
+    if (!gan->g->conv[i])
+      t += tune_layer(NULL, cfg->batch_sz, gan->layers_sz_g[i], gan->layers_sz_g[i + 1]);
+    if (!gan->d->conv[i])
+      t += tune_layer(NULL, cfg->batch_sz, gan->layers_sz_d[i], gan->layers_sz_d[i + 1]);
+  }
+  return t;
+}
+
+/**
+ * Choisir le noyau le plus rapide des couches convolutives d'un réseau.
+ *
+ * \param cfg structure config
+ * \param conv couches convolutives du réseau (NULL : couche dense)
+ * \param sz nombre de neurones de chaque couche
+ * \param nb_layers nombre de couches
+ * \param name nom du réseau (affichage)
+ * \param algo noyau courant, remplacé par le plus rapide
+ */
+static void tune_conv(config_t* cfg, conv_t** conv, unsigned int* sz, int nb_layers, const char* name, int* algo)
+{
+  int i, a, saved;
+  double t, best = 0.0;
+
+  for (a = CONV_IM2COL; a <= CONV_DIRECT; a++) {
+    t = 0.0;
+    for (i = 0; i < nb_layers - 1; i++)
+      if (conv[i]) {
+        saved = conv[i]->algo;
+        conv[i]->algo = a;
+        t += tune_layer(conv[i], cfg->batch_sz, sz[i], sz[i + 1]);
+        conv[i]->algo = saved;
+      }
+    if (t == 0.0)
+      return;
+
+    printf("[tune] conv_%s=%s: %.3f ms\n", name, conv_algo_name(a), t * 1e3);
+    if (a == CONV_IM2COL || t < best) {
+      best = t;
+      *algo = a;
+    }
+  }
+}
+
+/**
+ * Régler les noyaux sur les couches du modèle et écrire les meilleurs
+ * paramètres dans le cache de réglage (./gan tune).
+ *
+ * \param cfg structure config
+ * \param gan structure gan (construite par init_gan)
+ * \param file cache de réglage
+ */
+void tune_run(config_t* cfg, gan_t* gan, const char* file)
+{
+  int backend, spec;
+  double t, best = 0.0;
+  char cpu[TUNE_MAX_KEY], shapes[TUNE_MAX_KEY];
+  tune_t tune;
+  int saved_backend = gemm_get_backend();
+  int saved_spec = gemm_get_spec();
+
+  tune_defaults(cfg, &tune);
+  tune_cpu_model(cpu, sizeof(cpu));
+  tune_shapes(cfg, shapes, sizeof(shapes));
+  printf("[tune] %s, %s\n", cpu, shapes);
+
+  // Produits matriciels des couches denses : implémentations compilées,
+  // avec et sans noyaux spécialisés
+  for (backend = 0; backend < GEMM_NB_BACKENDS; backend++) {
+    if (!gemm_available(backend))
+      continue;
+    for (spec = 0; spec <= (backend == GEMM_INTERNAL); spec++) {
+      gemm_set_backend(backend);
+      gemm_set_spec(spec);
+      t = tune_dense(cfg, gan);
+      printf("[tune] gemm=%s kgen=%d: %.3f ms\n", gemm_backend_name(backend), spec, t * 1e3);
+      if (best == 0.0 || t < best) {
+        best = t;
+        tune.gemm = backend;
+        tune.kgen = spec;
+      }
+    }
+  }
+  gemm_set_backend(saved_backend);
+  gemm_set_spec(saved_spec);
+
+  // Noyaux des couches convolutives (CONV_D / CONV_G)
+  tune_conv(cfg, gan->d->conv, gan->layers_sz_d, gan->nb_layers, "d", &tune.conv_algo_d);
+  tune_conv(cfg, gan->g->conv, gan->layers_sz_g, gan->nb_layers, "g", &tune.conv_algo_g);
+
+  tune_save(file, cfg, &tune);
+  printf("[tune] gemm=%s kgen=%d conv_algo_d=%s conv_algo_g=%s written in %s\n", gemm_backend_name(tune.gemm),
+    tune.kgen, conv_algo_name(tune.conv_algo_d), conv_algo_name(tune.conv_algo_g), file);
+}
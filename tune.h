@@ -0,0 +1,30 @@
+/*!
+ * \file tune.h
+ * \brief Fichier header de tune.c
+ * \author PANCHALINGAMOORTHY Gajenthran
+ */
+#ifndef _TUNE_H_
+#define _TUNE_H_
+
+#include "config.h"
+#include "gan.h"
+
+// Fichier du cache de réglage par défaut (./gan tune sans fichier)
+#define TUNE_FILE "gan.tune"
+
+typedef struct tune tune_t;
+/* Structure représentant les paramètres des noyaux choisis pour une machine
+ * et des dimensions de couches. */
+struct tune {
+  int gemm; // implémentation des produits matriciels (GEMM_BACKEND_E)
+  int kgen; // noyaux spécialisés de kernels_gen.c
+  int conv_algo_d; // noyau de la convolution du discriminator (CONV_ALGO_E)
+  int conv_algo_g; // noyau de la convolution transposée du generator
+};
+
+void tune_defaults(config_t*, tune_t*);
+int tune_load(const char*, config_t*, tune_t*);
+void tune_save(const char*, config_t*, const tune_t*);
+void tune_run(config_t*, gan_t*, const char*);
+
+#endif